@@ -44,6 +44,9 @@ const bool debug = false;
  * - rts           -> 'ready-to-sleep' flag
  * - rec_window    -> struct keeping the current rec window settings
  * (duration/period/occurences)
+ * - cap_profile   -> struct keeping the capture profile (channels/rate/bits/
+ * file format)
+ * - evt_trigger   -> struct keeping the event trigger settings
  * - last_record   -> struct keeping the information for the last recording
  * - next_record   -> struct keeping the information for the next (current)
  * recording
@@ -52,6 +55,8 @@ volatile struct wState working_state;
 struct sfState sleep_flags;
 bool rts;
 struct rWindow rec_window;
+struct capProfile cap_profile;
+struct evTrigger evt_trigger;
 struct recInfo last_record;
 struct recInfo next_record;
 time_t rec_rem;
@@ -92,6 +97,7 @@ void setup() {
   // Init all peripherals
   initAudio();
   initSDcard();
+  recoverRecording();
   initGps();
   initWaveHeader();
   initBc127();
@@ -124,6 +130,8 @@ SLEEP : {
   but_rec.update();
   but_mon.update();
   but_blue.update();
+  // Send the last queued lines to the BC127 before sleeping
+  bc127Flush();
   // Switch off i2s clock before sleeping
   SIM_SCGC6 &= ~SIM_SCGC6_I2S;
   Alarm.delay(50);
@@ -258,15 +266,38 @@ WORK : {
                         next_record.gps_source);
     }
 
+    // A window the SD card cannot hold is shortened, or not started
+    enum rwinFit fit = fitRecWindow();
+    if (fit == RWIN_FIT_NONE) {
+      if (debug)
+        snooze_usb.println("Warning: SD card full, recording not started");
+      startLED(&leds[LED_RECORD], LED_MODE_WARNING_SHORT);
+      working_state.rec_state = RECSTATE_OFF;
+      if (working_state.ble_state == BLESTATE_CONNECTED) {
+        sendCmdOut(BCNOT_REC_LEFT);
+        sendCmdOut(BCNOT_REC_STATE);
+      }
+      break;
+    }
+
     // Doing things
     toggleBatMan(BM_DISABLED);
     next_record.cnt = 0;
-    if (next_record.gps_source == GPS_PHONE)
-      prepareRecording(false);
-    else
-      prepareRecording(true);
-    working_state.rec_state = RECSTATE_ON;
-    startRecording(next_record.rpath);
+    if (evt_trigger.enabled) {
+      if (next_record.gps_source == GPS_PHONE)
+        fixRecPosition(false);
+      else
+        fixRecPosition(true);
+      armRecording();
+      working_state.rec_state = RECSTATE_ARMED;
+    } else {
+      if (next_record.gps_source == GPS_PHONE)
+        prepareRecording(false);
+      else
+        prepareRecording(true);
+      working_state.rec_state = RECSTATE_ON;
+      startRecording(next_record.rpath);
+    }
 
     // Checking other states
     if (working_state.mon_state != MONSTATE_ON) {
@@ -276,8 +307,11 @@ WORK : {
       sendCmdOut(BCNOT_REC_TS);
       sendCmdOut(BCNOT_LATLONG);
       sendCmdOut(BCNOT_RWIN_VALS);
+      if (fit == RWIN_FIT_SHORT)
+        sendCmdOut(BCNOT_RWIN_SHORT);
       sendCmdOut(BCNOT_FILEPATH);
       sendCmdOut(BCNOT_REC_NB);
+      sendCmdOut(BCNOT_REC_LEFT);
       sendCmdOut(BCNOT_REC_STATE);
     }
 
@@ -289,7 +323,12 @@ WORK : {
   // 2
   case RECSTATE_ON: {
     continueRecording();
-    detectPeaks();
+    if (evt_trigger.enabled) {
+      if (!eventDetected() && (evt_quiet > (evt_trigger.hang_sec * 1000UL)))
+        working_state.rec_state = RECSTATE_REQ_REARM;
+    } else {
+      detectPeaks();
+    }
     sleep_flags.rec_ready = false;
     break;
   }
@@ -326,6 +365,7 @@ WORK : {
       sendCmdOut(BCNOT_REC_NEXT);
       sendCmdOut(BCNOT_REC_STATE);
       sendCmdOut(BCNOT_FILEPATH);
+      sendCmdOut(BCNOT_REC_LEFT);
     }
     break;
   }
@@ -356,12 +396,21 @@ WORK : {
 
     // Doing things
     toggleBatMan(BM_DISABLED);
-    if (next_record.gps_source == GPS_PHONE)
-      prepareRecording(false);
-    else
-      prepareRecording(true);
-    working_state.rec_state = RECSTATE_ON;
-    startRecording(next_record.rpath);
+    if (evt_trigger.enabled) {
+      if (next_record.gps_source == GPS_PHONE)
+        fixRecPosition(false);
+      else
+        fixRecPosition(true);
+      armRecording();
+      working_state.rec_state = RECSTATE_ARMED;
+    } else {
+      if (next_record.gps_source == GPS_PHONE)
+        prepareRecording(false);
+      else
+        prepareRecording(true);
+      working_state.rec_state = RECSTATE_ON;
+      startRecording(next_record.rpath);
+    }
 
     // Checking other states
     if (working_state.mon_state != MONSTATE_ON) {
@@ -419,9 +468,62 @@ WORK : {
     if (working_state.ble_state == BLESTATE_CONNECTED) {
       sendCmdOut(BCNOT_REC_STATE);
       sendCmdOut(BCNOT_FILEPATH);
+      sendCmdOut(BCNOT_REC_LEFT);
     }
     break;
   }
+  // 9
+  case RECSTATE_ARMED: {
+    keepPreTrigger();
+    if (eventDetected()) {
+      if (debug)
+        snooze_usb.printf("Info:    Audio event, starting recording#%d\n",
+                          (next_record.cnt + 1));
+      prepareRecFile();
+      startLED(&leds[LED_RECORD], LED_MODE_ON);
+      working_state.rec_state = RECSTATE_ON;
+      startRecording(next_record.rpath);
+      if (working_state.ble_state == BLESTATE_CONNECTED) {
+        sendCmdOut(BCNOT_REC_TS);
+        sendCmdOut(BCNOT_FILEPATH);
+        sendCmdOut(BCNOT_REC_NB);
+        sendCmdOut(BCNOT_REC_STATE);
+      }
+    }
+    sleep_flags.rec_ready = false;
+    break;
+  }
+  // 10
+  case RECSTATE_REQ_REARM: {
+    // Debug...
+    if (debug)
+      snooze_usb.printf("Info:    Requesting REC REARM. States: BT %d, BLE %d, "
+                        "REC %d, MON %d\n",
+                        working_state.bt_state, working_state.ble_state,
+                        working_state.rec_state, working_state.mon_state);
+
+    // Doing things
+    Alarm.free(alarm_rec_id);
+    next_record.tsp = getTeensy3Time();
+    breakTime((next_record.tsp - next_record.tss), next_record.dur);
+    stopRecording(next_record.rpath);
+    last_record = next_record;
+    next_record.cnt++;
+    if ((getRecOccurences() != 0) &&
+        (next_record.cnt >= getRecOccurences())) {
+      working_state.rec_state = RECSTATE_REQ_OFF;
+    } else {
+      armRecording();
+      working_state.rec_state = RECSTATE_ARMED;
+    }
+
+    if (working_state.ble_state == BLESTATE_CONNECTED) {
+      sendCmdOut(BCNOT_REC_STATE);
+      sendCmdOut(BCNOT_FILEPATH);
+    }
+    sleep_flags.rec_ready = false;
+    break;
+  }
   default: {
     break;
   }
@@ -449,7 +551,8 @@ WORK : {
     working_state.mon_state = MONSTATE_ON;
     sleep_flags.mon_ready = false;
 
-    if (working_state.rec_state != RECSTATE_ON) {
+    if ((working_state.rec_state != RECSTATE_ON) &&
+        (working_state.rec_state != RECSTATE_ARMED)) {
       startMonitoring();
     }
     if (working_state.bt_state == BTSTATE_CONNECTED) {
@@ -491,7 +594,8 @@ WORK : {
     stopLED(&leds[LED_MONITOR]);
     stopLED(&leds[LED_PEAK]);
 
-    if (working_state.rec_state != RECSTATE_ON) {
+    if ((working_state.rec_state != RECSTATE_ON) &&
+        (working_state.rec_state != RECSTATE_ARMED)) {
       toggleBatMan(BM_ENABLED);
       stopMonitoring();
     }
@@ -549,7 +653,6 @@ WORK : {
       startLED(&leds[LED_BLUETOOTH], LED_MODE_ADV); // LED_MODE_IDLE_FAST);
     } else {
       bc127BlueOn();
-      Alarm.delay(200);
       startLED(&leds[LED_BLUETOOTH], LED_MODE_ADV); // LED_MODE_WAITING);
       alarm_adv_id = Alarm.timerOnce(BLEADV_TIMEOUT_S, alarmAdvTimeout);
     }
@@ -759,14 +862,14 @@ WORK : {
 
   // Serial messaging
   // BLUEPORT
-  if (BLUEPORT.available()) {
-    String inMsg = BLUEPORT.readStringUntil('\r');
-    int outMsg = parseSerialIn(inMsg);
+  if (bc127Poll()) {
+    int outMsg = bc127Receive();
     if (!sendCmdOut(outMsg)) {
       if (debug)
         snooze_usb.println("Error: Sending command error!!");
     }
   }
+  bc127Service();
   // Monitor
   if (snooze_usb.available()) {
     String manInput = snooze_usb.readStringUntil('\n');
@@ -827,6 +930,8 @@ bool setRts(struct sfState sf) {
  * - rts           -> 'ready-to-sleep' flag
  * - rec_window    -> struct keeping the current rec window settings
  * (duration/period/occurences)
+ * - cap_profile   -> struct keeping the capture profile
+ * - evt_trigger   -> struct keeping the event trigger settings
  * - last_record   -> struct keeping the information for the last recording
  * - next_record   -> struct keeping the information for the next (current)
  * recording
@@ -854,6 +959,15 @@ void setDefaultValues(void) {
   rec_window.period.Month = RWIN_PER_DEF_MON;
   rec_window.period.Year = RWIN_PER_DEF_YEAR;
   rec_window.occurences = RWIN_OCC_DEF;
+  cap_profile.channels = REC_CHANNELS_DEF;
+  cap_profile.decim = REC_DECIM_DEF;
+  cap_profile.bits = REC_BITS_DEF;
+  cap_profile.format = REC_FORMAT_DEF;
+  cap_profile.width = REC_BFP_WIDTH_DEF;
+  evt_trigger.enabled = EVT_TRIGGER_DEF;
+  evt_trigger.threshold = EVT_THRESHOLD_DEF;
+  evt_trigger.pre_ms = EVT_PRETRIG_MS_DEF;
+  evt_trigger.hang_sec = EVT_HANG_SEC_DEF;
   last_record.cnt = 0;
   last_record.gps_source = GPS_NONE;
   last_record.gps_lat = 1000.0;
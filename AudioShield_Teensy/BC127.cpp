@@ -8,6 +8,9 @@
 /*****************************************************************************/
 #include "BC127.h"
 
+#include <ctype.h>
+#include <limits.h>
+
 /*** MODULE OBJECTS **********************************************************/
 /*****************************************************************************/
 /*** Constants ***************************************************************/
@@ -20,6 +23,14 @@ struct btDev {
   unsigned int strength;
 };
 struct btDev dev_list[DEVLIST_MAXLEN];
+// Received notifications: name, range of the amount of parameters, handler.
+// Names with several entries are dispatched on their amount of parameters.
+struct bcNotif {
+  const char *name;
+  uint8_t nb_min;
+  uint8_t nb_max;
+  enum serialMsg (*handler)(const struct bcToken *p, unsigned int nb);
+};
 
 /*** Variables ***************************************************************/
 // Amount of found BT devices on inquiry
@@ -35,8 +46,27 @@ int BT_id_avrcp = 0;
 int BLE_conn_id = 0;
 // Flag indicating that the BC127 device is ready
 bool BC127_ready = false;
-String notif, param1, param2, param3, param4, param5, param6, param7, param8,
-    param9, trash;
+// Received lines: rx_count complete lines from rx_head on, then the line
+// being assembled (rx_len characters so far)
+static char rx_pool[BC127_LINE_POOL][BC127_LINE_MAX + 1];
+static unsigned int rx_head = 0;
+static unsigned int rx_count = 0;
+static unsigned int rx_len = 0;
+// Words of the line being parsed
+static struct bcToken rx_tok[BC127_TOKENS_MAX];
+// First recording index entry asked for by the app
+static unsigned long idx_first = 0;
+// Outbound queue: tx_count messages from tx_head on, their text built only
+// when they are sent
+static uint8_t tx_queue[BC127_TX_QUEUE_LEN];
+static unsigned int tx_head = 0;
+static unsigned int tx_count = 0;
+// Text of the message being sent, its next line at tx_pos
+static char tx_text[BC127_TX_MAX + 1];
+static unsigned int tx_pos = 0;
+// The last sent line waits for its OK/ERROR since tx_sent_ms
+static bool tx_wait = false;
+static uint32_t tx_sent_ms = 0;
 
 /*** Function prototypes *****************************************************/
 /*** Macros ******************************************************************/
@@ -44,30 +74,30 @@ String notif, param1, param2, param3, param4, param5, param6, param7, param8,
 /*** Functions implementation ************************************************/
 
 /*****************************************************************************/
-/* populateDevlist(String, String, unsigned int)
- * ---------------------------------------------
+/* populateDevlist(const char*, const char*, const char*, unsigned int)
+ * --------------------------------------------------------------------
  * Search if received device address is already existing.
  * If not, fill the list at the next empty place, otherwise
  * just update the signal strength value.
- * IN:	- device address (String)
- *			- device name (String)
- *			- device capabilities (String)
+ * IN:	- device address (const char*)
+ *			- device name (const char*)
+ *			- device capabilities (const char*)
  *			- absolute signal stregth value (unsigned int)
  * OUT:	- none
  */
-static void populateDevlist(String addr, String name, String caps,
-                            unsigned int stren) {
+static void populateDevlist(const char *addr, const char *name,
+                            const char *caps, unsigned int stren) {
   bool found = false;
   int lastPos = 0;
   for (int i = 0; i < DEVLIST_MAXLEN; i++) {
     // Received address matches to an already existing one.
-    if (addr.equals(dev_list[i].address)) {
+    if (!strcmp(dev_list[i].address.c_str(), addr)) {
       dev_list[i].strength = stren;
       found = true;
       break;
     }
     // No address matched and the current position is empty.
-    else if (dev_list[i].address.equals("")) {
+    else if (dev_list[i].address.length() == 0) {
       lastPos = i;
       break;
     }
@@ -85,113 +115,91 @@ static void populateDevlist(String addr, String name, String caps,
 /*****************************************************************************/
 
 /*****************************************************************************/
-static unsigned int countParams(String input) {
-  // ================================================================
-  // Slicing input string.
-  // Currently 3 usefull schemes:
-  // - 2 words   --> e.g. "OPEN_OK AVRCP"
-  // - RECV BLE  --> commands received from phone over BLE
-  // - other     --> 3+ words inputs like "INQUIRY xxxx 240404 -54dB"
-  // ================================================================
-  int slice1 = input.indexOf(" ");
-  int slice2 = input.indexOf(" ", slice1 + 1);
-  int slice3 = input.indexOf(" ", slice2 + 1);
-  int slice4 = input.indexOf(" ", slice3 + 1);
-  int slice5 = input.indexOf(" ", slice4 + 1);
-  int slice6 = input.indexOf(" ", slice5 + 1);
-  int slice7 = input.indexOf(" ", slice6 + 1);
-  int slice8 = input.indexOf(" ", slice7 + 1);
-  int slice9 = input.indexOf(" ", slice8 + 1);
-  int slice10 = input.indexOf(" ", slice9 + 1);
+/* tokEquals(const struct bcToken*, const char*)
+ * ---------------------------------------------
+ * Compare a word of the received line with a keyword, ignoring case
+ * (as String::equalsIgnoreCase).
+ * IN:	- word (const struct bcToken*)
+ *			- keyword (const char*)
+ * OUT:	- same word (bool)
+ */
+static bool tokEquals(const struct bcToken *tok, const char *key) {
+  unsigned int i;
 
-  unsigned int ret = 0;
-  // no space found -> notification without parameter
-  if (slice1 == -1) {
-    notif = input;
-    ret = 0;
+  for (i = 0; i < tok->len; i++) {
+    if (toupper((unsigned char)tok->str[i]) != toupper((unsigned char)key[i]))
+      return false;
   }
-  // 1+ parameter
-  else {
-    notif = input.substring(0, slice1);
-    if (slice2 == -1) {
-      param1 = input.substring(slice1 + 1);
-      ret = 1;
-    }
-    // 2+ parameters
-    else {
-      param1 = input.substring(slice1 + 1, slice2);
-      if (slice3 == -1) {
-        param2 = input.substring(slice2 + 1);
-        ret = 2;
-      }
-      // 3+ parameters
-      else {
-        param2 = input.substring(slice2 + 1, slice3);
-        if (slice4 == -1) {
-          param3 = input.substring(slice3 + 1);
-          ret = 3;
-        }
-        // 4+ parameters
-        else {
-          param3 = input.substring(slice3 + 1, slice4);
-          if (slice5 == -1) {
-            param4 = input.substring(slice4 + 1);
-            ret = 4;
-          }
-          // 5+ parameters
-          else {
-            param4 = input.substring(slice4 + 1, slice5);
-            if (slice6 == -1) {
-              param5 = input.substring(slice5 + 1);
-              ret = 5;
-            }
-            // 6+ parameters
-            else {
-              param5 = input.substring(slice5 + 1, slice6);
-              if (slice7 == -1) {
-                param6 = input.substring(slice6 + 1);
-                ret = 6;
-              }
-              // 7+ parameters
-              else {
-                param6 = input.substring(slice6 + 1, slice7);
-                if (slice8 == -1) {
-                  trash = input.substring(slice7 + 1);
-                  ret = 7;
-                }
-                // 8+ paramters
-                else {
-                  param7 = input.substring(slice7 + 1, slice8);
-                  if (slice8 == -1) {
-                    trash = input.substring(slice8 + 1);
-                    ret = 8;
-                  }
-                  // 9+ parameters
-                  else {
-                    param8 = input.substring(slice8 + 1, slice9);
-                    if (slice9 == -1) {
-                      trash = input.substring(slice9 + 1);
-                      ret = 9;
-                    }
-                    // 10+ parameters
-                    else {
-                      param9 = input.substring(slice9 + 1, slice10);
-                      if (slice10 == -1) {
-                        trash = input.substring(slice10 + 1);
-                        ret = 10;
-                      }
-                    }
-                  }
-                }
-              }
-            }
-          }
-        }
-      }
+  return (key[i] == '\0');
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* tokToInt(const struct bcToken*)
+ * -------------------------------
+ * Integer value of a word (as String::toInt).
+ * IN:	- word (const struct bcToken*)
+ * OUT:	- value (long)
+ */
+static long tokToInt(const struct bcToken *tok) { return atol(tok->str); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* tokRssi(const struct bcToken*)
+ * ------------------------------
+ * Absolute signal strength of an inquiry result: the two digits
+ * following the sign, e.g. "-54dB" -> 54.
+ * IN:	- word (const struct bcToken*)
+ * OUT:	- absolute signal strength (unsigned int)
+ */
+static unsigned int tokRssi(const struct bcToken *tok) {
+  unsigned int val = 0;
+
+  for (unsigned int i = 1; (i < 3) && (i < tok->len); i++) {
+    if (!isdigit((unsigned char)tok->str[i]))
+      break;
+    val = (val * 10) + (tok->str[i] - '0');
+  }
+  return val;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* joinName(const struct bcToken*, unsigned int, char*, size_t)
+ * ------------------------------------------------------------
+ * Device names may hold spaces and come either quoted or not: join
+ * their words with '_', without the quotes.
+ * IN:	- first word of the name (const struct bcToken*)
+ *			- amount of words (unsigned int)
+ *			- output buffer (char*)
+ *			- size of the output buffer (size_t)
+ * OUT:	- none
+ */
+static void joinName(const struct bcToken *tok, unsigned int nb, char *name,
+                     size_t size) {
+  bool quoted = (tok[0].str[0] == '"');
+  size_t pos = 0;
+
+  for (unsigned int i = 0; i < nb; i++) {
+    const char *str = tok[i].str;
+    size_t len = tok[i].len;
+
+    if (pos >= (size - 1))
+      break;
+    if (quoted && (i == 0)) {
+      str++;
+      len--;
     }
+    if (quoted && (i == (nb - 1)) && (len > 0))
+      len--;
+    if (i > 0)
+      name[pos++] = '_';
+    if (len > (size - pos - 1))
+      len = size - pos - 1;
+    memcpy(&name[pos], str, len);
+    pos += len;
   }
-  // if(debug) snooze_usb.printf("#params: %d\n", nb_params);
-  return ret;
+  name[pos] = '\0';
 }
 /*****************************************************************************/
 
@@ -221,9 +229,11 @@ static bool searchDevlist(String name) {
 // ---------------------
 // RECEIVED BLE MESSAGES
 // ---------------------
+// Every handler gets the parameters of the notification (p[0] is the first
+// one after the notification name) and their amount.
 /*****************************************************************************/
-static enum serialMsg msgAbsVol(String p1, String p2) {
-  vol_value = (float)p2.toInt() / ABS_VOL_MAX_VAL;
+static enum serialMsg msgAbsVol(const struct bcToken *p, unsigned int nb) {
+  vol_value = (float)tokToInt(&p[1]) / ABS_VOL_MAX_VAL;
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return BCNOT_VOL_LEVEL;
   } else {
@@ -232,12 +242,12 @@ static enum serialMsg msgAbsVol(String p1, String p2) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgA2dpInfo(String p1, String p2) {
+static enum serialMsg msgA2dpInfo(const struct bcToken *p, unsigned int nb) {
   static float old_vol = 0;
   enum serialMsg toRet = BCCMD__NOTHING;
 
-  if (p1.equalsIgnoreCase("A2DP")) {
-    float new_vol = (float)strtol(p2.c_str(), NULL, 16) / VOL_MAX_VAL_HEX;
+  if (tokEquals(&p[0], "A2DP")) {
+    float new_vol = (float)strtol(p[1].str, NULL, 16) / VOL_MAX_VAL_HEX;
     if (new_vol != old_vol) {
       vol_value = new_vol;
       old_vol = new_vol;
@@ -249,26 +259,28 @@ static enum serialMsg msgA2dpInfo(String p1, String p2) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgAvrcpPlay(void) {
+static enum serialMsg msgAvrcpPlay(const struct bcToken *p, unsigned int nb) {
   working_state.mon_state = MONSTATE_REQ_ON;
   return BCCMD__NOTHING;
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgAvrcpPause(void) {
+static enum serialMsg msgAvrcpPause(const struct bcToken *p, unsigned int nb) {
   working_state.mon_state = MONSTATE_REQ_OFF;
   return BCCMD__NOTHING;
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgCloseOk(String p1, String p2, String p3) {
-  if (p1.toInt() == BT_id_a2dp) {
+static enum serialMsg msgCloseOk(const struct bcToken *p, unsigned int nb) {
+  long id = tokToInt(&p[0]);
+
+  if (id == BT_id_a2dp) {
     if (working_state.bt_state != BTSTATE_OFF)
       working_state.bt_state = BTSTATE_REQ_DISC;
-  } else if (p1.toInt() == BT_id_avrcp) {
+  } else if (id == BT_id_avrcp) {
     if (working_state.bt_state != BTSTATE_OFF)
       working_state.bt_state = BTSTATE_REQ_DISC;
-  } else if (p1.toInt() == BLE_conn_id) {
+  } else if (id == BLE_conn_id) {
     if (working_state.ble_state != BLESTATE_OFF)
       working_state.ble_state = BLESTATE_REQ_DISC;
   }
@@ -276,93 +288,39 @@ static enum serialMsg msgCloseOk(String p1, String p2, String p3) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgInquiry1(String p1, String p2, String p3, String p4) {
-  String addr = p1;
-  String name;
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    name = p2.substring(1, (p2.length() - 1));
-  } else {
-    name = p2;
-  }
-  String caps = p3;
-  unsigned int stren = p4.substring(1, 3).toInt();
-  populateDevlist(addr, name, caps, stren);
-  return BCNOT_INQ_STATE;
+static enum serialMsg msgError(const struct bcToken *p, unsigned int nb) {
+  if (debug)
+    snooze_usb.printf("Error: BC127 refused the command (%s)\n",
+                      (nb > 0) ? p[0].str : "?");
+  tx_wait = false;
+  return BCCMD__NOTHING;
 }
 /*****************************************************************************/
-static enum serialMsg msgInquiry2(String p1, String p2, String p3, String p4,
-                                  String p5) {
-  String addr = p1;
-  String name;
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    name = p2.substring(1) + "_" + p3.substring(0, (p3.length() - 1));
-  } else {
-    name = p2 + "_" + p3;
-  }
-  String caps = p4;
-  unsigned int stren = p5.substring(1, 3).toInt();
-  populateDevlist(addr, name, caps, stren);
-  return BCNOT_INQ_STATE;
-}
 /*****************************************************************************/
-static enum serialMsg msgInquiry3(String p1, String p2, String p3, String p4,
-                                  String p5, String p6) {
-  String addr = p1;
-  String name;
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    name =
-        p2.substring(1) + "_" + p3 + "_" + p4.substring(0, (p4.length() - 1));
-  } else {
-    name = p2 + "_" + p3 + "_" + p4;
-  }
-  String caps = p5;
-  unsigned int stren = p6.substring(1, 3).toInt();
-  populateDevlist(addr, name, caps, stren);
-  return BCNOT_INQ_STATE;
+static enum serialMsg msgInquOk(const struct bcToken *p, unsigned int nb) {
+  return BCNOT_INQ_DONE;
 }
 /*****************************************************************************/
-static enum serialMsg msgInquiry4(String p1, String p2, String p3, String p4,
-                                  String p5, String p6, String p7) {
-  String addr = p1;
-  String name;
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    name = p2.substring(1) + "_" + p3 + "_" + p4 + "_" +
-           p5.substring(0, (p5.length() - 1));
-  } else {
-    name = p2 + "_" + p3 + "_" + p4 + "_" + p5;
-  }
-  String caps = p6;
-  unsigned int stren = p7.substring(1, 3).toInt();
-  populateDevlist(addr, name, caps, stren);
-  return BCNOT_INQ_STATE;
-}
 /*****************************************************************************/
-static enum serialMsg msgInquiry5(String p1, String p2, String p3, String p4,
-                                  String p5, String p6, String p7, String p8) {
-  String addr = p1;
-  String name;
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    name = p2.substring(1) + "_" + p3 + "_" + p4 + "_" + p5 + "_" +
-           p6.substring(0, (p6.length() - 1));
-  } else {
-    name = p2 + "_" + p3 + "_" + p4 + "_" + p5 + "_" + p6;
-  }
-  String caps = p7;
-  unsigned int stren = p8.substring(1, 3).toInt();
-  populateDevlist(addr, name, caps, stren);
+static enum serialMsg msgInquiry(const struct bcToken *p, unsigned int nb) {
+  // (BTADDR) {"n1 .. nx" || n1 .. nx} (COD) (RSSI)
+  char name[BC127_LINE_MAX];
+
+  joinName(&p[1], nb - 3, name, sizeof(name));
+  populateDevlist(p[0].str, name, p[nb - 2].str, tokRssi(&p[nb - 1]));
   return BCNOT_INQ_STATE;
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgLink1(String p1, String p2, String p3, String p4,
-                               String p5) {
-  if (p3.equalsIgnoreCase("A2DP")) {
-    BT_id_a2dp = p1.toInt();
-    BT_peer_address = p4;
+static enum serialMsg msgLink(const struct bcToken *p, unsigned int nb) {
+  // [link_ID] (state) (profile) (btaddr) (info1) .. (info5)
+  if (tokEquals(&p[2], "A2DP")) {
+    BT_id_a2dp = tokToInt(&p[0]);
+    BT_peer_address = p[3].str;
     if (debug)
       snooze_usb.printf("Info:    A2DP address: %s, ID: %d, state: %s\n",
-                        BT_peer_address.c_str(), BT_id_a2dp, p5.c_str());
-    if (p5.equalsIgnoreCase("STREAMING")) {
+                        BT_peer_address.c_str(), BT_id_a2dp, p[4].str);
+    if (tokEquals(&p[4], "STREAMING")) {
       snooze_usb.printf("Streaming state\n");
       // Alarm.free(alarm_req_vol_id);
       // alarm_req_vol_id =
@@ -372,9 +330,9 @@ static enum serialMsg msgLink1(String p1, String p2, String p3, String p4,
       working_state.bt_state = BTSTATE_CONNECTED;
     }
     return BCCMD_BT_NAME;
-  } else if (p3.equalsIgnoreCase("AVRCP")) {
-    BT_id_avrcp = p1.toInt();
-    BT_peer_address = p4;
+  } else if (tokEquals(&p[2], "AVRCP")) {
+    BT_id_avrcp = tokToInt(&p[0]);
+    BT_peer_address = p[3].str;
     if (debug)
       snooze_usb.printf("Info:    AVRCP address: %s, ID: %d\n",
                         BT_peer_address.c_str(), BT_id_avrcp);
@@ -383,141 +341,16 @@ static enum serialMsg msgLink1(String p1, String p2, String p3, String p4,
   return BCCMD__NOTHING;
 }
 /*****************************************************************************/
-static enum serialMsg msgLink2(String p1, String p2, String p3, String p4,
-                               String p5, String p6) {
-  enum serialMsg ret = BCCMD__NOTHING;
-
-  if (p3.equalsIgnoreCase("A2DP")) {
-    BT_id_a2dp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    A2DP address: %s, ID: %d, state: %s\n",
-                        BT_peer_address.c_str(), BT_id_a2dp, p5.c_str());
-    if (p5.equalsIgnoreCase("STREAMING")) {
-      snooze_usb.printf("Streaming state\n");
-      // Alarm.free(alarm_req_vol_id);
-      // alarm_req_vol_id =
-      //     Alarm.timerRepeat(REQ_VOL_INTERVAL_SEC, timerReqVolDone);
-      working_state.bt_state = BTSTATE_PLAY;
-    } else {
-      working_state.bt_state = BTSTATE_CONNECTED;
-    }
-    return BCCMD_BT_NAME;
-  } else if (p3.equalsIgnoreCase("AVRCP")) {
-    BT_id_avrcp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    AVRCP address: %s, ID: %d\n",
-                        BT_peer_address.c_str(), BT_id_avrcp);
-    working_state.bt_state = BTSTATE_CONNECTED;
-  }
-  return ret;
-}
-/*****************************************************************************/
-static enum serialMsg msgLink3(String p1, String p2, String p3, String p4,
-                               String p5, String p6, String p7) {
-  enum serialMsg ret = BCCMD__NOTHING;
-
-  if (p3.equalsIgnoreCase("A2DP")) {
-    BT_id_a2dp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    A2DP address: %s, ID: %d, state: %s\n",
-                        BT_peer_address.c_str(), BT_id_a2dp, p5.c_str());
-    if (p5.equalsIgnoreCase("STREAMING")) {
-      snooze_usb.printf("Streaming state\n");
-      // Alarm.free(alarm_req_vol_id);
-      // alarm_req_vol_id =
-      //     Alarm.timerRepeat(REQ_VOL_INTERVAL_SEC, timerReqVolDone);
-      working_state.bt_state = BTSTATE_PLAY;
-    } else {
-      working_state.bt_state = BTSTATE_CONNECTED;
-    }
-    return BCCMD_BT_NAME;
-  } else if (p3.equalsIgnoreCase("AVRCP")) {
-    BT_id_avrcp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    AVRCP address: %s, ID: %d\n",
-                        BT_peer_address.c_str(), BT_id_avrcp);
-    working_state.bt_state = BTSTATE_CONNECTED;
-  }
-  return ret;
-}
-/*****************************************************************************/
-static enum serialMsg msgLink4(String p1, String p2, String p3, String p4,
-                               String p5, String p6, String p7, String p8) {
-  enum serialMsg ret = BCCMD__NOTHING;
-
-  if (p3.equalsIgnoreCase("A2DP")) {
-    BT_id_a2dp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    A2DP address: %s, ID: %d, state: %s\n",
-                        BT_peer_address.c_str(), BT_id_a2dp, p5.c_str());
-    if (p5.equalsIgnoreCase("STREAMING")) {
-      snooze_usb.printf("Streaming state\n");
-      // Alarm.free(alarm_req_vol_id);
-      // alarm_req_vol_id =
-      //     Alarm.timerRepeat(REQ_VOL_INTERVAL_SEC, timerReqVolDone);
-      working_state.bt_state = BTSTATE_PLAY;
-    } else {
-      working_state.bt_state = BTSTATE_CONNECTED;
-    }
-    return BCCMD_BT_NAME;
-  } else if (p3.equalsIgnoreCase("AVRCP")) {
-    BT_id_avrcp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    AVRCP address: %s, ID: %d\n",
-                        BT_peer_address.c_str(), BT_id_avrcp);
-    working_state.bt_state = BTSTATE_CONNECTED;
-  }
-  return ret;
-}
-/*****************************************************************************/
-static enum serialMsg msgLink5(String p1, String p2, String p3, String p4,
-                               String p5, String p6, String p7, String p8,
-                               String p9) {
-  enum serialMsg ret = BCCMD__NOTHING;
-
-  if (p3.equalsIgnoreCase("A2DP")) {
-    BT_id_a2dp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    A2DP address: %s, ID: %d, state: %s\n",
-                        BT_peer_address.c_str(), BT_id_a2dp, p5.c_str());
-    if (p5.equalsIgnoreCase("STREAMING")) {
-      snooze_usb.printf("Streaming state\n");
-      // Alarm.free(alarm_req_vol_id);
-      // alarm_req_vol_id =
-      //     Alarm.timerRepeat(REQ_VOL_INTERVAL_SEC, timerReqVolDone);
-      working_state.bt_state = BTSTATE_PLAY;
-    } else {
-      working_state.bt_state = BTSTATE_CONNECTED;
-    }
-    return BCCMD_BT_NAME;
-  } else if (p3.equalsIgnoreCase("AVRCP")) {
-    BT_id_avrcp = p1.toInt();
-    BT_peer_address = p4;
-    if (debug)
-      snooze_usb.printf("Info:    AVRCP address: %s, ID: %d\n",
-                        BT_peer_address.c_str(), BT_id_avrcp);
-    working_state.bt_state = BTSTATE_CONNECTED;
-  }
-  return ret;
-}
-/*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgLinkLoss(String p1, String p2) {
+static enum serialMsg msgLinkLoss(const struct bcToken *p, unsigned int nb) {
   if (debug)
-    snooze_usb.printf("Info:    link_ID: %s, status: %s\n", p1.c_str(),
-                      p2.c_str());
-  if (p1.toInt() == BT_id_a2dp) {
-    if (p2.toInt() == 1) {
+    snooze_usb.printf("Info:    link_ID: %s, status: %s\n", p[0].str,
+                      p[1].str);
+  if (tokToInt(&p[0]) == BT_id_a2dp) {
+    if (tokToInt(&p[1]) == 1) {
       working_state.mon_state = MONSTATE_REQ_OFF;
       working_state.bt_state = BTSTATE_DISCONNECTED;
-    } else if (p2.toInt() == 0) {
+    } else if (tokToInt(&p[1]) == 0) {
       working_state.bt_state = BTSTATE_CONNECTED;
     }
     return BCNOT_BT_STATE;
@@ -527,28 +360,12 @@ static enum serialMsg msgLinkLoss(String p1, String p2) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgName1(String p1, String p2) {
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    int strlen = p2.length();
-    BT_peer_name = p2.substring(1, (strlen - 1));
-  } else {
-    BT_peer_name = p2;
-  }
-  if (working_state.ble_state == BLESTATE_CONNECTED) {
-    return BCNOT_BT_STATE;
-  } else {
-    return BCCMD__NOTHING;
-  }
-}
-/*****************************************************************************/
-static enum serialMsg msgName2(String p1, String p2, String p3) {
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    int strlen = p3.length();
-    BT_peer_name = p2.substring(1) + "_" + p3.substring(0, (strlen - 1));
-  } else {
-    BT_peer_name = p2 + "_" + p3;
-  }
+static enum serialMsg msgName(const struct bcToken *p, unsigned int nb) {
+  // [addr] {"n1 .. nx" || n1 .. nx}
+  char name[BC127_LINE_MAX];
 
+  joinName(&p[1], nb - 1, name, sizeof(name));
+  BT_peer_name = name;
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return BCNOT_BT_STATE;
   } else {
@@ -556,53 +373,26 @@ static enum serialMsg msgName2(String p1, String p2, String p3) {
   }
 }
 /*****************************************************************************/
-static enum serialMsg msgName3(String p1, String p2, String p3, String p4) {
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    int strlen = p4.length();
-    BT_peer_name =
-        p2.substring(1) + "_" + p3 + "_" + p4.substring(0, (strlen - 1));
-  } else {
-    BT_peer_name = p2 + "_" + p3 + "_" + p4;
-  }
-
-  if (working_state.ble_state == BLESTATE_CONNECTED) {
-    return BCNOT_BT_STATE;
-  } else {
-    return BCCMD__NOTHING;
-  }
-}
 /*****************************************************************************/
-static enum serialMsg msgName4(String p1, String p2, String p3, String p4,
-                               String p5) {
-  if (p2.substring(0, 1).equalsIgnoreCase("\"")) {
-    int strlen = p5.length();
-    BT_peer_name = p2.substring(1) + "_" + p3 + "_" + p4 + "_" +
-                   p5.substring(0, (strlen - 1));
-  } else {
-    BT_peer_name = p2 + "_" + p3 + "_" + p4 + "_" + p5;
-  }
-
-  if (working_state.ble_state == BLESTATE_CONNECTED) {
-    return BCNOT_BT_STATE;
-  } else {
-    return BCCMD__NOTHING;
-  }
+static enum serialMsg msgOk(const struct bcToken *p, unsigned int nb) {
+  tx_wait = false;
+  return BCCMD__NOTHING;
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgOpenOk(String p1, String p2, String p3) {
-  if (p2.equalsIgnoreCase("A2DP")) {
-    BT_id_a2dp = p1.toInt();
-    BT_peer_address = p3;
+static enum serialMsg msgOpenOk(const struct bcToken *p, unsigned int nb) {
+  if (tokEquals(&p[1], "A2DP")) {
+    BT_id_a2dp = tokToInt(&p[0]);
+    BT_peer_address = p[2].str;
     if (debug)
       snooze_usb.printf(
           "Info:    A2DP connection opened. Conn ID: %d, peer address = %s\n",
           BT_id_a2dp, BT_peer_address.c_str());
     working_state.bt_state = BTSTATE_REQ_CONN;
     return BCCMD_BT_NAME;
-  } else if (p2.equalsIgnoreCase("AVRCP")) {
-    BT_id_avrcp = p1.toInt();
-    BT_peer_address = p3;
+  } else if (tokEquals(&p[1], "AVRCP")) {
+    BT_id_avrcp = tokToInt(&p[0]);
+    BT_peer_address = p[2].str;
     if (debug)
       snooze_usb.printf("Info:    AVRCP connection opened. Conn ID: %d, peer "
                         "address (check) = %s\n",
@@ -613,8 +403,8 @@ static enum serialMsg msgOpenOk(String p1, String p2, String p3) {
     } else {
       return BCCMD__NOTHING;
     }
-  } else if (p2.equalsIgnoreCase("BLE")) {
-    BLE_conn_id = p1.toInt();
+  } else if (tokEquals(&p[1], "BLE")) {
+    BLE_conn_id = tokToInt(&p[0]);
     working_state.ble_state = BLESTATE_REQ_CONN;
     // Request time update from phone
     alarm_request_id = Alarm.timerOnce(REQ_TIME_INTERVAL_SEC, alarmRequestDone);
@@ -625,18 +415,26 @@ static enum serialMsg msgOpenOk(String p1, String p2, String p3) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgRecv1(String p1, String p2, String p3) {
+static enum serialMsg msgReady(const struct bcToken *p, unsigned int nb) {
+  BC127_ready = true;
+  // A rebooted module will not answer the line sent before
+  tx_wait = false;
+  return BCCMD__NOTHING;
+}
+/*****************************************************************************/
+/*****************************************************************************/
+static enum serialMsg msgRecv1(const struct bcToken *p, unsigned int nb) {
   // - "inq"
   // - "disc"
   // - "latlong"
   enum serialMsg ret = BCCMD__NOTHING;
 
-  if (p1.toInt() == BLE_conn_id) {
-    if (p3.equalsIgnoreCase("inq")) {
+  if (tokToInt(&p[0]) == BLE_conn_id) {
+    if (tokEquals(&p[2], "inq")) {
       ret = BCCMD_INQUIRY;
-    } else if (p3.equalsIgnoreCase("disc")) {
+    } else if (tokEquals(&p[2], "disc")) {
       working_state.bt_state = BTSTATE_REQ_DISC;
-    } else if (p3.equalsIgnoreCase("latlong")) {
+    } else if (tokEquals(&p[2], "latlong")) {
       if (debug)
         snooze_usb.println("Info:    Receiving latlong without values");
     }
@@ -645,26 +443,31 @@ static enum serialMsg msgRecv1(String p1, String p2, String p3) {
   return ret;
 }
 /*****************************************************************************/
-static enum serialMsg msgRecv2(String p1, String p2, String p3, String p4) {
+static enum serialMsg msgRecv2(const struct bcToken *p, unsigned int nb) {
   // - "bt {?}"
   // - "conn {address}"
   // - "filepath {?}"
+  // - "idx {?/first}"
   // - "latlong {?}"
   // - "mon {start/stop/?}"
   // - "rec {start/stop/?}"
+  // - "rec_left {?}"
   // - "rec_nb {?}"
   // - "rec_next {?}"
   // - "rec_ts {?}"
   // - "rwin {?}"
+  // - "stats {?}"
+  // - "status {?/version}"
   // - "time {ts}"
   // - "vol {+/-/?}"
+  const struct bcToken *cmd = &p[2], *arg = &p[3];
   enum serialMsg ret = BCCMD__NOTHING;
-  if (p1.toInt() == BLE_conn_id) {
-    if (p3.equalsIgnoreCase("conn")) {
-      BT_peer_name = p4;
+  if (tokToInt(&p[0]) == BLE_conn_id) {
+    if (tokEquals(cmd, "conn")) {
+      BT_peer_name = arg->str;
       return BCCMD_DEV_CONNECT;
-    } else if (p3.equalsIgnoreCase("time")) {
-      unsigned long rec_time = p4.toInt();
+    } else if (tokEquals(cmd, "time")) {
+      unsigned long rec_time = tokToInt(arg);
       if (rec_time > MIN_TIME_DEC) {
         setCurTime(rec_time, TSOURCE_PHONE);
         if (debug)
@@ -674,115 +477,144 @@ static enum serialMsg msgRecv2(String p1, String p2, String p3, String p4) {
           snooze_usb.println("Error: Received time not correct!");
       }
       return BCREQ_LATLONG;
-    } else if (p3.equalsIgnoreCase("rec")) {
-      if (p4.equalsIgnoreCase("start"))
+    } else if (tokEquals(cmd, "rec")) {
+      if (tokEquals(arg, "start"))
         return BCCMD_REC_START;
-      else if (p4.equalsIgnoreCase("stop"))
+      else if (tokEquals(arg, "stop"))
         return BCCMD_REC_STOP;
-      else if (p4.equalsIgnoreCase("?"))
+      else if (tokEquals(arg, "?"))
         return BCNOT_REC_STATE;
-    } else if (p3.equalsIgnoreCase("rec_next")) {
-      if (p4.equalsIgnoreCase("?"))
+    } else if (tokEquals(cmd, "rec_left")) {
+      if (tokEquals(arg, "?"))
+        return BCNOT_REC_LEFT;
+      else {
+        if (debug)
+          snooze_usb.println("Error: BLE rec_left command not listed");
+      }
+    } else if (tokEquals(cmd, "rec_next")) {
+      if (tokEquals(arg, "?"))
         return BCNOT_REC_NEXT;
       else {
         if (debug)
           snooze_usb.println("Error: BLE rec_next command not listed");
       }
-    } else if (p3.equalsIgnoreCase("rec_nb")) {
-      if (p4.equalsIgnoreCase("?"))
+    } else if (tokEquals(cmd, "rec_nb")) {
+      if (tokEquals(arg, "?"))
         return BCNOT_REC_NB;
       else {
         if (debug)
           snooze_usb.println("Error: BLE rec_nb command not listed");
       }
-    } else if (p3.equalsIgnoreCase("rec_ts")) {
-      if (p4.equalsIgnoreCase("?"))
+    } else if (tokEquals(cmd, "rec_ts")) {
+      if (tokEquals(arg, "?"))
         return BCNOT_REC_TS;
       else {
         if (debug)
           snooze_usb.println("Error: BLE rec_ts command not listed");
       }
-    } else if (p3.equalsIgnoreCase("mon")) {
-      if (p4.equalsIgnoreCase("start"))
+    } else if (tokEquals(cmd, "mon")) {
+      if (tokEquals(arg, "start"))
         working_state.mon_state = MONSTATE_REQ_ON;
-      else if (p4.equalsIgnoreCase("stop"))
+      else if (tokEquals(arg, "stop"))
         working_state.mon_state = MONSTATE_REQ_OFF;
-      else if (p4.equalsIgnoreCase("?"))
+      else if (tokEquals(arg, "?"))
         return BCNOT_MON_STATE;
-    } else if (p3.equalsIgnoreCase("vol")) {
+    } else if (tokEquals(cmd, "vol")) {
       if ((working_state.bt_state == BTSTATE_CONNECTED) ||
           (working_state.bt_state == BTSTATE_PLAY)) {
-        if (p4.equalsIgnoreCase("+")) {
+        if (tokEquals(arg, "+")) {
           return BCCMD_VOL_UP;
-        } else if (p4.equalsIgnoreCase("-")) {
+        } else if (tokEquals(arg, "-")) {
           return BCCMD_VOL_DOWN;
-        } else if (p4.equalsIgnoreCase("?")) {
+        } else if (tokEquals(arg, "?")) {
           return BCNOT_VOL_LEVEL;
         }
       } else {
         return BCERR_VOL_BT_DIS;
       }
-    } else if (p3.equalsIgnoreCase("bt")) {
-      if (p4.equalsIgnoreCase("?")) {
+    } else if (tokEquals(cmd, "bt")) {
+      if (tokEquals(arg, "?")) {
         return BCCMD_STATUS;
       }
-    } else if (p3.equalsIgnoreCase("rwin")) {
-      if (p4.equalsIgnoreCase("?")) {
+    } else if (tokEquals(cmd, "rwin")) {
+      if (tokEquals(arg, "?")) {
         return BCNOT_RWIN_VALS;
       } else {
         return BCERR_RWIN_BAD_REQ;
       }
-    } else if (p3.equalsIgnoreCase("filepath")) {
-      if (p4.equalsIgnoreCase("?")) {
+    } else if (tokEquals(cmd, "filepath")) {
+      if (tokEquals(arg, "?")) {
         return BCNOT_FILEPATH;
       }
-    } else if (p3.equalsIgnoreCase("latlong")) {
-      if (p4.equalsIgnoreCase("?")) {
+    } else if (tokEquals(cmd, "idx")) {
+      // Amount of recordings, or BC127_IDX_PAGE of them from 'first' on
+      if (tokEquals(arg, "?")) {
+        return BCNOT_IDX_NB;
+      } else {
+        // A negative entry is past the end as well: IDX END
+        long first = tokToInt(arg);
+        idx_first = (first < 0) ? ULONG_MAX : (unsigned long)first;
+        return BCNOT_IDX_PAGE;
+      }
+    } else if (tokEquals(cmd, "latlong")) {
+      if (tokEquals(arg, "?")) {
         return BCNOT_LATLONG;
       }
+    } else if (tokEquals(cmd, "stats")) {
+      if (tokEquals(arg, "?")) {
+        return BCNOT_STATS;
+      }
+    } else if (tokEquals(cmd, "status")) {
+      // Latest frame version, or the one the app asks for
+      if (tokEquals(arg, "?") || (tokToInt(arg) == BLE_STATUS_VERSION)) {
+        return BCNOT_STATUS;
+      } else {
+        return BCERR_STATUS_VERSION;
+      }
     }
   }
   return ret;
 }
 /*****************************************************************************/
-static enum serialMsg msgRecv3(String p1, String p2, String p3, String p4,
-                               String p5) {
+static enum serialMsg msgRecv3(const struct bcToken *p, unsigned int nb) {
   // - "latlong {lat long}"
-  if (p1.toInt() == BLE_conn_id) {
-    if (p3.equalsIgnoreCase("latlong")) {
+  if (tokToInt(&p[0]) == BLE_conn_id) {
+    if (tokEquals(&p[2], "latlong")) {
+      next_record.gps_lat = atof(p[3].str);
+      next_record.gps_long = atof(p[4].str);
+      next_record.gps_source = GPS_PHONE;
       if (debug)
-        snooze_usb.printf("Received latlong info: %f, %f\n", atof(p4.c_str()),
-                          atof(p5.c_str()));
-
-      if ((p4.c_str() == NULL) || (p5.c_str() == NULL)) {
-        next_record.gps_source = GPS_NONE;
-        next_record.gps_lat = 1000.0;
-        next_record.gps_long = 1000.0;
-      } else {
-        next_record.gps_lat = atof(p4.c_str());
-        next_record.gps_long = atof(p5.c_str());
-        next_record.gps_source = GPS_PHONE;
-      }
+        snooze_usb.printf("Received latlong info: %f, %f\n",
+                          next_record.gps_lat, next_record.gps_long);
     }
   }
   return BCCMD__NOTHING;
 }
 /*****************************************************************************/
-static enum serialMsg msgRecv4(String p1, String p2, String p3, String p4,
-                               String p5, String p6) {
+static enum serialMsg msgRecv4(const struct bcToken *p, unsigned int nb) {
   enum serialMsg ret = BCCMD__NOTHING;
 
   // - "rwin {duration} {period} {occurences}"
-  if (p1.toInt() == BLE_conn_id) {
-    if (p3.equalsIgnoreCase("rwin")) {
-      unsigned int d, p;
-      d = p4.toInt();
-      p = p5.toInt();
-      if (d < p) {
+  if (tokToInt(&p[0]) == BLE_conn_id) {
+    if (tokEquals(&p[2], "rwin")) {
+      unsigned int d, per;
+      d = tokToInt(&p[3]);
+      per = tokToInt(&p[4]);
+      if (d < per) {
+        struct rWindow prev = rec_window;
         breakTime(d, rec_window.duration);
-        breakTime(p, rec_window.period);
-        rec_window.occurences = p6.toInt();
-        return BCNOT_RWIN_OK;
+        breakTime(per, rec_window.period);
+        rec_window.occurences = tokToInt(&p[5]);
+        // Refuse or shorten a window the SD card cannot hold
+        switch (fitRecWindow()) {
+        case RWIN_FIT_NONE:
+          rec_window = prev;
+          return BCERR_RWIN_NO_SPACE;
+        case RWIN_FIT_SHORT:
+          return BCNOT_RWIN_SHORT;
+        default:
+          return BCNOT_RWIN_OK;
+        }
       } else {
         return BCERR_RWIN_WRONG_PARAMS;
       }
@@ -792,12 +624,16 @@ static enum serialMsg msgRecv4(String p1, String p2, String p3, String p4,
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static enum serialMsg msgRoleOk(String p1, String p2) { return BCCMD__NOTHING; }
+static enum serialMsg msgRoleOk(const struct bcToken *p, unsigned int nb) {
+  return BCCMD__NOTHING;
+}
 /*****************************************************************************/
 
 /*****************************************************************************/
-static enum serialMsg msgState(String p1, String p2, String p3, String p4) {
-  bool connState = p1.substring(p1.length() - 2, p1.length() - 1).toInt();
+static enum serialMsg msgState(const struct bcToken *p, unsigned int nb) {
+  // CONNECTED[x]: flag before the closing bracket
+  char flag = (p[0].len >= 2) ? p[0].str[p[0].len - 2] : '0';
+  bool connState = isdigit((unsigned char)flag) && (flag != '0');
   if (debug)
     snooze_usb.printf("CONNECTED state: %d, A2DP ID: %d\n", connState,
                       BT_id_a2dp);
@@ -808,6 +644,47 @@ static enum serialMsg msgState(String p1, String p2, String p3, String p4) {
 }
 /*****************************************************************************/
 
+/*****************************************************************************/
+// Notifications table
+static const struct bcNotif notif_table[] = {
+    // ABS_VOL [link_ID] (value)
+    {"ABS_VOL", 2, 2, msgAbsVol},
+    // AVRCP_PAUSE [link_ID]
+    {"AVRCP_PAUSE", 1, 1, msgAvrcpPause},
+    // AVRCP_PLAY [link_ID]
+    {"AVRCP_PLAY", 1, 1, msgAvrcpPlay},
+    // CLOSE_OK [link_ID] (profile) (Bluetooth address)
+    {"CLOSE_OK", 3, 3, msgCloseOk},
+    // ERROR (code)
+    {"ERROR", 0, 1, msgError},
+    // INQU_OK
+    {"INQU_OK", 0, 0, msgInquOk},
+    // INQUIRY (BTADDR) {"n1 .. n5" || n1 .. n5} (COD) (RSSI)
+    {"INQUIRY", 4, 8, msgInquiry},
+    // LINK [link_ID] (state) (profile) (btaddr) (info1) .. (info5)
+    {"LINK", 5, 9, msgLink},
+    // LINK_LOSS [link_ID] (status)
+    {"LINK_LOSS", 2, 2, msgLinkLoss},
+    // NAME [addr] {"n1 .. n4" || n1 .. n4}
+    {"NAME", 2, 5, msgName},
+    // OK: answer to the last sent line
+    {"OK", 0, 0, msgOk},
+    // OPEN_OK [link_ID] (profile) (Bluetooth address)
+    {"OPEN_OK", 3, 3, msgOpenOk},
+    // READY
+    {"READY", 0, 0, msgReady},
+    // RECV [link_ID] (size) (report data), report data of 1 to 4 words
+    {"RECV", 3, 3, msgRecv1},
+    {"RECV", 4, 4, msgRecv2},
+    {"RECV", 5, 5, msgRecv3},
+    {"RECV", 6, 6, msgRecv4},
+    // ROLE_OK [link_ID] (role)
+    {"ROLE_OK", 2, 2, msgRoleOk},
+    // STATE (connected) (connectable) (discoverable) (ble)
+    {"STATE", 4, 4, msgState},
+};
+/*****************************************************************************/
+
 // ---------------
 // OUTPUT COMMANDS
 // ---------------
@@ -824,8 +701,7 @@ static String cmdDevConnect(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
-static String cmdInquiry(void) {
-  String cmd, devString;
+static void clearDevlist(void) {
   for (int i = 0; i < DEVLIST_MAXLEN; i++) {
     dev_list[i].address = "";
     dev_list[i].capabilities = "";
@@ -833,17 +709,10 @@ static String cmdInquiry(void) {
   }
   found_dev = 0;
   BT_peer_address = "";
-  devString = "";
-
-  cmd = "SEND " + String(BLE_conn_id) + " INQ START" + "\r";
-  BLUEPORT.print(cmd);
-  Alarm.delay(50);
-  return ("INQUIRY 10\r");
 }
 /*****************************************************************************/
 /*****************************************************************************/
 static String cmdMonPause(void) {
-  working_state.mon_state = MONSTATE_REQ_OFF;
   if (working_state.bt_state == BTSTATE_CONNECTED) {
     return ("MUSIC " + String(BT_id_a2dp) + " PAUSE\r");
   } else
@@ -900,6 +769,37 @@ static String notFilepath(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
+static String notIdxNb(void) {
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    return ("SEND " + String(BLE_conn_id) + " IDX_NB " + recIndexCount() +
+            "\r");
+  } else
+    return "";
+}
+/*****************************************************************************/
+/*****************************************************************************/
+static String notIdxPage(void) {
+  // IDX (entry number) (base64 entry, see struct recIndexEntry), one line
+  // per entry. A request while the previous page waits to be sent
+  // replaces it: the app asks for the next page after the last one.
+  struct recIndexEntry e[BC127_IDX_PAGE];
+  char text[BLE_B64_LEN(sizeof(struct recIndexEntry)) + 1];
+  String ret = "";
+  unsigned int n;
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    n = readRecIndex(idx_first, e, BC127_IDX_PAGE);
+    for (unsigned int i = 0; i < n; i++) {
+      bleBase64((const uint8_t *)&e[i], sizeof(struct recIndexEntry), text);
+      ret += "SEND " + String(BLE_conn_id) + " IDX " +
+             String(idx_first + i) + " " + text + "\r";
+    }
+    if (!n)
+      ret = "SEND " + String(BLE_conn_id) + " IDX END\r";
+  }
+  return ret;
+}
+/*****************************************************************************/
+/*****************************************************************************/
 static String notInqDone(void) {
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return ("SEND " + String(BLE_conn_id) + " INQ DONE\r");
@@ -953,6 +853,16 @@ static String notRecNb(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
+static String notRecLeft(void) {
+  // REC_LEFT seconds of recording left on the SD card
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    return ("SEND " + String(BLE_conn_id) + " REC_LEFT " +
+            String(getRecSecondsLeft()) + "\r");
+  } else
+    return "";
+}
+/*****************************************************************************/
+/*****************************************************************************/
 static String notRecNext(void) {
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return ("SEND " + String(BLE_conn_id) + " REC_NEXT " + next_record.tss +
@@ -975,10 +885,12 @@ static String notRecState(void) {
   String ret;
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     ret = "SEND " + String(BLE_conn_id);
-    if (working_state.rec_state == RECSTATE_ON) {
+    if ((working_state.rec_state == RECSTATE_ON) ||
+        (working_state.rec_state == RECSTATE_REQ_REARM)) {
       ret += " REC ON\r";
     } else if ((working_state.rec_state == RECSTATE_WAIT) ||
-               (working_state.rec_state == RECSTATE_IDLE)) {
+               (working_state.rec_state == RECSTATE_IDLE) ||
+               (working_state.rec_state == RECSTATE_ARMED)) {
       ret += " REC WAIT\r";
     } else {
       ret += " REC OFF\r";
@@ -1006,6 +918,15 @@ static String notRwinOk(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
+static String notRwinShort(void) {
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    return ("SEND " + String(BLE_conn_id) + " RWIN PARAMS SHORT " +
+            String(next_record.rec_fit) + "\r");
+  } else
+    return "";
+}
+/*****************************************************************************/
+/*****************************************************************************/
 static String notRwinVals(void) {
   unsigned int l, p, o;
   if (working_state.ble_state == BLESTATE_CONNECTED) {
@@ -1027,6 +948,38 @@ static String notRwinVals(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
+static String notStats(void) {
+  // STATS expected received dropped missing ring_hwm mem_max cpu_max
+  // STATS_LAT (SD writes per latency bucket, see recStats.h)
+  struct recStats st;
+  String ret;
+  unsigned int b;
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    getRecStats(&st);
+    ret = "SEND " + String(BLE_conn_id) + " STATS " + st.expected + " " +
+          st.received + " " + st.dropped + " " + st.missing + " " +
+          st.ring_hwm + " " + st.mem_max + " " + String(st.cpu_max, 1) + "\r";
+    ret += "SEND " + String(BLE_conn_id) + " STATS_LAT";
+    for (b = 0; b < STATS_LAT_BUCKETS; b++)
+      ret += " " + String(st.lat_hist[b]);
+    ret += "\r";
+  } else
+    ret = "";
+  return ret;
+}
+/*****************************************************************************/
+/*****************************************************************************/
+static String notStatus(void) {
+  // ST (base64 status frame, see bleStatus.h)
+  char text[BLE_STATUS_B64_LEN + 1];
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    bleStatusText(text);
+    return ("SEND " + String(BLE_conn_id) + " ST " + text + "\r");
+  } else
+    return "";
+}
+/*****************************************************************************/
+/*****************************************************************************/
 static String notVolLevel(void) {
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return ("SEND " + String(BLE_conn_id) + " VOL " + String(vol_value) + "\r");
@@ -1067,6 +1020,14 @@ static String errRwinBadReq(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
+static String errRwinNoSpace(void) {
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    return ("SEND " + String(BLE_conn_id) + " RWIN ERR NO SPACE!\r");
+  } else
+    return "";
+}
+/*****************************************************************************/
+/*****************************************************************************/
 static String errRwinWrongParams(void) {
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return ("SEND " + String(BLE_conn_id) + " RWIN ERR WRONG PARAMS!\r");
@@ -1075,6 +1036,15 @@ static String errRwinWrongParams(void) {
 }
 /*****************************************************************************/
 /*****************************************************************************/
+static String errStatusVersion(void) {
+  if (working_state.ble_state == BLESTATE_CONNECTED) {
+    return ("SEND " + String(BLE_conn_id) + " ST ERR VERSION " +
+            String(BLE_STATUS_VERSION) + "\r");
+  } else
+    return "";
+}
+/*****************************************************************************/
+/*****************************************************************************/
 static String errVolBtDis(void) {
   if (working_state.ble_state == BLESTATE_CONNECTED) {
     return ("SEND " + String(BLE_conn_id) + " VOL ERR NO BT DEVICE!\r");
@@ -1083,271 +1053,22 @@ static String errVolBtDis(void) {
 }
 /*****************************************************************************/
 
-/*** EXPORTED OBJECTS ********************************************************/
 /*****************************************************************************/
-/*** Functions ***************************************************************/
-
-/*****************************************************************************/
-/* initBc127(void)
- * ---------------
- * Initialize BC127 by sending a reset command
- * IN:	- none
- * OUT:	- none
- */
-void initBc127(void) {
-  pinMode(BC127_RST_PIN, OUTPUT);
-  digitalWrite(BC127_RST_PIN, HIGH);
-  bc127Reset();
-  BC127_ready = false;
-  while (!BC127_ready) {
-    if (BLUEPORT.available()) {
-      String inMsg = BLUEPORT.readStringUntil('\r');
-      parseSerialIn(inMsg);
-    }
-  };
-  // Alarm.delay(200);
-  // bc127BlueOff();
-  // Alarm.delay(500);
-}
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* bc127BlueOn(void)
- * -----------------
- * Switch on the Bluetooth interface
- * IN:	- none
- * OUT:	- none
- */
-void bc127BlueOn(void) { sendCmdOut(BCCMD_BLUE_ON); }
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* bc127BlueOff(void)
- * -------------------
- * Switch off the Bluetooth interface
- * IN:	- none
- * OUT:	- none
- */
-void bc127BlueOff(void) { sendCmdOut(BCCMD_BLUE_OFF); }
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* bc127Reset(void)
- * ----------------
- * Reset the BC127 device
- * IN:	- none
- * OUT:	- none
- */
-void bc127Reset(void) {
-  Alarm.delay(10);
-  digitalWrite(BC127_RST_PIN, LOW);
-  Alarm.delay(30);
-  digitalWrite(BC127_RST_PIN, HIGH);
-}
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* bc127AdvStart(void)
- * -------------------
- * Start advertising on the BLE channel.
- * IN:	- none
- * OUT:	- none
- */
-void bc127AdvStart(void) { sendCmdOut(BCCMD_ADV_ON); }
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* bc127AdvStop(void)
- * ------------------
- * Stop advertising on the BLE channel.
- * IN:	- none
- * OUT:	- none
- */
-void bc127AdvStop(void) {
-  Alarm.disable(alarm_adv_id);
-  Alarm.free(alarm_adv_id);
-  sendCmdOut(BCCMD_ADV_OFF);
-  Alarm.delay(100);
-}
-/*****************************************************************************/
-
-/*****************************************************************************/
-void bc127BleDisconnect(void) {
-  sendCmdOut(BCCMD_BLE_DISCONNECT);
-  Alarm.delay(200);
-}
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* parseSerialIn(String)
- * ---------------------
- * Parse received string and read information along
- * minimal keywords.
- * IN:	- received input (String)
- * OUT:	- message to send back (int)
- */
-enum serialMsg parseSerialIn(String input) {
-  if (debug)
-    snooze_usb.printf("BC127->: %s\n", input.c_str());
-
-  unsigned int nb_params = countParams(input);
-
-  switch (nb_params) {
-  // INQU_OK
-  // READY
-  case 0: {
-    if (notif.equalsIgnoreCase("INQU_OK"))
-      return BCNOT_INQ_DONE;
-    else if (notif.equalsIgnoreCase("READY"))
-      BC127_ready = true;
-    break;
-  }
-
-  // AVRCP_PLAY [link_ID]
-  // AVRCP_PAUSE [link_ID]
-  case 1: {
-    if (notif.equalsIgnoreCase("AVRCP_PLAY"))
-      return msgAvrcpPlay();
-    else if (notif.equalsIgnoreCase("AVRCP_PAUSE"))
-      return msgAvrcpPause();
-    break;
-  }
-
-  // ABS_VOL [link_ID](value)
-  // LINK_LOSS [link_ID] (status)
-  // NAME [addr] {"name" || name}
-  case 2: {
-    if (notif.equalsIgnoreCase("ABS_VOL"))
-      return msgAbsVol(param1, param2);
-    else if (notif.equalsIgnoreCase("LINK_LOSS"))
-      return msgLinkLoss(param1, param2);
-    else if (notif.equalsIgnoreCase("NAME"))
-      return msgName1(param1, param2);
-    else if (notif.equalsIgnoreCase("ROLE_OK"))
-      return msgRoleOk(param1, param2);
-    else if (notif.equalsIgnoreCase(String(BT_id_a2dp)))
-      return msgA2dpInfo(param1, param2);
-    break;
-  }
-
-  // CLOSE_OK [link_ID] (profile) (Bluetooth address)
-  // NAME [addr] {"n1 n2" || n1 n2}
-  // OPEN_OK [link_ID] (profile) (Bluetooth address)
-  // RECV [link_ID] (size) (report data)
-  case 3: {
-    if (notif.equalsIgnoreCase("CLOSE_OK"))
-      return msgCloseOk(param1, param2, param3);
-    else if (notif.equalsIgnoreCase("NAME"))
-      return msgName2(param1, param2, param3);
-    else if (notif.equalsIgnoreCase("OPEN_OK"))
-      return msgOpenOk(param1, param2, param3);
-    else if (notif.equalsIgnoreCase("RECV"))
-      return msgRecv1(param1, param2, param3);
-    break;
-  }
-
-  // INQUIRY(BTADDR) {"name" || name} (COD) (RSSI)
-  // NAME [addr] {"n1 n2 n3" || n1 n2 n3}
-  // STATE (connected) (connectable) (discoverable) (ble)
-  // RECV [link_ID] (size) (report data) <-- (report data) with 2 parameters
-  case 4: {
-    if (notif.equalsIgnoreCase("INQUIRY"))
-      return msgInquiry1(param1, param2, param3, param4);
-    else if (notif.equalsIgnoreCase("NAME"))
-      return msgName3(param1, param2, param3, param4);
-    else if (notif.equalsIgnoreCase("STATE"))
-      return msgState(param1, param2, param3, param4);
-    else if (notif.equalsIgnoreCase("RECV"))
-      return msgRecv2(param1, param2, param3, param4);
-    break;
-  }
-
-  // INQUIRY (BTADDR) {"n1 n2" || n1 n2} (COD) (RSSI)
-  // LINK [link_ID] (STATE) (PROFILE) (BTADDR) (INFO)
-  // NAME [addr] {"n1 n2 n3 n4" || n1 n2 n3 n4}
-  // RECV [link_ID] (size) (report data) <-- (report data) with 3 parameters
-  case 5: {
-    if (notif.equalsIgnoreCase("INQUIRY"))
-      return msgInquiry2(param1, param2, param3, param4, param5);
-    else if (notif.equalsIgnoreCase("LINK"))
-      return msgLink1(param1, param2, param3, param4, param5);
-    else if (notif.equalsIgnoreCase("NAME"))
-      return msgName4(param1, param2, param3, param4, param5);
-    else if (notif.equalsIgnoreCase("RECV"))
-      return msgRecv3(param1, param2, param3, param4, param5);
-    break;
-  }
-
-  // INQUIRY [addr] {"n1 n2 n3" || n1 n2 n3} (COD) (RSSI)
-  // LINK [link_ID] (state) (profile) (btaddr) (info1) (info2)
-  // RECV [link_ID] (size) (report data) <-- (report data) with 4 parameters
-  case 6: {
-    if (notif.equalsIgnoreCase("INQUIRY"))
-      return msgInquiry3(param1, param2, param3, param4, param5, param6);
-    else if (notif.equalsIgnoreCase("RECV"))
-      return msgRecv4(param1, param2, param3, param4, param5, param6);
-    else if (notif.equalsIgnoreCase("LINK"))
-      return msgLink2(param1, param2, param3, param4, param5, param6);
-    break;
-  }
-
-  // INQUIRY [addr] {"n1 n2 n3 n4" || n1 n2 n3 n4} (COD) (RSSI)
-  // LINK [link_ID] (state) (profile) (btaddr) (info1) (info2) (info3)
-  case 7: {
-    if (notif.equalsIgnoreCase("INQUIRY"))
-      return msgInquiry4(param1, param2, param3, param4, param5, param6,
-                         param7);
-    else if (notif.equalsIgnoreCase("LINK"))
-      return msgLink3(param1, param2, param3, param4, param5, param6, param7);
-    break;
-  }
-
-  // INQUIRY [addr] {"n1 n2 n3 n4 n5" || n1 n2 n3 n4 n5} (COD) (RSSI)
-  // LINK [link_ID] (state) (profile) (btaddr) (info1) (info2) (info3) (info4)
-  case 8: {
-    if (notif.equalsIgnoreCase("INQUIRY"))
-      return msgInquiry5(param1, param2, param3, param4, param5, param6, param7,
-                         param8);
-    else if (notif.equalsIgnoreCase("LINK"))
-      return msgLink4(param1, param2, param3, param4, param5, param6, param7,
-                      param8);
-    break;
-  }
-
-  // LINK [link_ID] (state) (profile) (btaddr) (info1) (info2) (info3) (info4)
-  // (info5)
-  case 9: {
-    if (notif.equalsIgnoreCase("LINK"))
-      return msgLink5(param1, param2, param3, param4, param5, param6, param7,
-                      param8, param9);
-    break;
-  }
-
-  default:
-    break;
-  }
-
-  return BCCMD__NOTHING;
-}
-/*****************************************************************************/
-
-/*****************************************************************************/
-/* sendCmdOut(int)
- * ---------------
- * Send specific commands to the BC127 UART
- * IN:	- message (int)
- * OUT:	- command confirmation (bool)
- */
-bool sendCmdOut(int msg) {
-  String devString = "";
-  String cmdLine = "";
+/* buildMessage(int)
+ * -----------------
+ * Text of a message, from the current state: one or several lines, each
+ * one terminated by '\r'. Empty when there is nothing to send (e.g.
+ * notification without BLE connection).
+ * IN:	- message (int)
+ * OUT:	- lines to send (String)
+ */
+static String buildMessage(int msg) {
+  String cmdLine = "";
 
   switch (msg) {
   /* --------
    * COMMANDS
    * -------- */
-  case BCCMD__NOTHING:
-    break;
   // Start BLE advertising
   case BCCMD_ADV_ON:
     cmdLine = "ADVERTISING ON\r";
@@ -1384,9 +1105,9 @@ bool sendCmdOut(int msg) {
   case BCCMD_DEV_AVRCP_DISCONNECT:
     cmdLine = "CLOSE " + String(BT_id_avrcp) + "\r";
     break;
-  // Start inquiry on BT for 10 s, clearing the device list first
+  // Start inquiry on BT for 10 s
   case BCCMD_INQUIRY:
-    cmdLine = cmdInquiry();
+    cmdLine = "INQUIRY 10\r";
     break;
   // Pause monitoring -> AVRCP pause
   case BCCMD_MON_PAUSE:
@@ -1400,15 +1121,6 @@ bool sendCmdOut(int msg) {
   case BCCMD_MON_STOP:
     cmdLine = cmdMonStop();
     break;
-  // Start recording
-  case BCCMD_REC_START:
-    working_state.rec_state = RECSTATE_REQ_ON;
-    break;
-  // Stop recording
-  case BCCMD_REC_STOP:
-    working_state.rec_state = RECSTATE_REQ_OFF;
-    next_record.man_stop = true;
-    break;
   // Reset module
   case BCCMD_RESET:
     cmdLine = "RESET\r";
@@ -1447,6 +1159,14 @@ bool sendCmdOut(int msg) {
   case BCNOT_FILEPATH:
     cmdLine = notFilepath();
     break;
+  // Amount of recordings in the index
+  case BCNOT_IDX_NB:
+    cmdLine = notIdxNb();
+    break;
+  // Page of the recording index
+  case BCNOT_IDX_PAGE:
+    cmdLine = notIdxPage();
+    break;
   // Inquiry sequence done -> send notification
   case BCNOT_INQ_DONE:
     cmdLine = notInqDone();
@@ -1455,21 +1175,12 @@ bool sendCmdOut(int msg) {
   case BCNOT_INQ_START:
     cmdLine = notInqStart();
     break;
-  // Results of the inquiry -> store devices with address & signal strength
-  case BCNOT_INQ_STATE: {
-    for (unsigned int i = 0; i < found_dev; i++) {
-      devString = dev_list[i].name;
-      devString.concat(" ");
-      devString.concat(String(dev_list[i].strength));
-      cmdLine = "SEND " + String(BLE_conn_id) + " INQ " + devString + "\r";
-      BLUEPORT.print(cmdLine);
-      Alarm.delay(80);
-      if (debug)
-        snooze_usb.printf("Info:   %s\n", cmdLine.c_str());
-    }
-    cmdLine = "";
+  // Results of the inquiry -> one line per device, with its signal strength
+  case BCNOT_INQ_STATE:
+    for (unsigned int i = 0; i < found_dev; i++)
+      cmdLine += "SEND " + String(BLE_conn_id) + " INQ " + dev_list[i].name +
+                 " " + String(dev_list[i].strength) + "\r";
     break;
-  }
   // GPS latlong values
   case BCNOT_LATLONG:
     cmdLine = notLatlong();
@@ -1482,6 +1193,10 @@ bool sendCmdOut(int msg) {
   case BCNOT_REC_STATE:
     cmdLine = notRecState();
     break;
+  // REC_LEFT
+  case BCNOT_REC_LEFT:
+    cmdLine = notRecLeft();
+    break;
   // REC_NEXT
   case BCNOT_REC_NEXT:
     cmdLine = notRecNext();
@@ -1502,10 +1217,22 @@ bool sendCmdOut(int msg) {
   case BCNOT_RWIN_OK:
     cmdLine = notRwinOk();
     break;
+  // RWIN command, recordings limited to those fitting
+  case BCNOT_RWIN_SHORT:
+    cmdLine = notRwinShort();
+    break;
   // RWIN values
   case BCNOT_RWIN_VALS:
     cmdLine = notRwinVals();
     break;
+  // Recording statistics
+  case BCNOT_STATS:
+    cmdLine = notStats();
+    break;
+  // Status frame
+  case BCNOT_STATUS:
+    cmdLine = notStatus();
+    break;
   // VOL level
   case BCNOT_VOL_LEVEL:
     cmdLine = notVolLevel();
@@ -1528,28 +1255,395 @@ bool sendCmdOut(int msg) {
   case BCERR_RWIN_BAD_REQ:
     cmdLine = errRwinBadReq();
     break;
+  // RWIN not fitting on the SD card
+  case BCERR_RWIN_NO_SPACE:
+    cmdLine = errRwinNoSpace();
+    break;
   // RWIN wrong parameters
   case BCERR_RWIN_WRONG_PARAMS:
     cmdLine = errRwinWrongParams();
     break;
+  // Status frame version not supported
+  case BCERR_STATUS_VERSION:
+    cmdLine = errStatusVersion();
+    break;
   // VOL no device connected
   case BCERR_VOL_BT_DIS:
     cmdLine = errVolBtDis();
     break;
-  // No recognised command -> send negative confirmation
   default:
+    break;
+  }
+  return cmdLine;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* nextMessage(void)
+ * -----------------
+ * Take the oldest message of the outbound queue and build its text into
+ * tx_text. A text longer than BC127_TX_MAX is cut after its last
+ * complete line.
+ * IN:	- none
+ * OUT:	- none
+ */
+static void nextMessage(void) {
+  String text = buildMessage(tx_queue[tx_head]);
+  unsigned int len = text.length();
+
+  tx_head = (tx_head + 1) % BC127_TX_QUEUE_LEN;
+  tx_count--;
+  if (len > BC127_TX_MAX) {
+    len = BC127_TX_MAX;
+    while ((len > 0) && (text[len - 1] != '\r'))
+      len--;
+  }
+  memcpy(tx_text, text.c_str(), len);
+  tx_text[len] = '\0';
+  tx_pos = 0;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* initBc127(void)
+ * ---------------
+ * Initialize BC127 by sending a reset command
+ * IN:	- none
+ * OUT:	- none
+ */
+void initBc127(void) {
+  pinMode(BC127_RST_PIN, OUTPUT);
+  digitalWrite(BC127_RST_PIN, HIGH);
+  bc127Reset();
+  BC127_ready = false;
+  elapsedMillis wait = 0;
+  while (!BC127_ready && (wait < BC127_READY_TIMEOUT_MS)) {
+    if (bc127Poll())
+      bc127Receive();
+    else
+      Alarm.delay(1);
+  }
+  if (!BC127_ready && debug)
+    snooze_usb.println("Error: No READY from the BC127!");
+  // Alarm.delay(200);
+  // bc127BlueOff();
+  // Alarm.delay(500);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127BlueOn(void)
+ * -----------------
+ * Switch on the Bluetooth interface
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127BlueOn(void) { sendCmdOut(BCCMD_BLUE_ON); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127BlueOff(void)
+ * -------------------
+ * Switch off the Bluetooth interface
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127BlueOff(void) { sendCmdOut(BCCMD_BLUE_OFF); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Reset(void)
+ * ----------------
+ * Reset the BC127 device
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127Reset(void) {
+  // Lines not sent yet are meaningless to the rebooted module
+  tx_count = 0;
+  tx_pos = 0;
+  tx_text[0] = '\0';
+  tx_wait = false;
+  Alarm.delay(10);
+  digitalWrite(BC127_RST_PIN, LOW);
+  Alarm.delay(30);
+  digitalWrite(BC127_RST_PIN, HIGH);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127AdvStart(void)
+ * -------------------
+ * Start advertising on the BLE channel.
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127AdvStart(void) { sendCmdOut(BCCMD_ADV_ON); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127AdvStop(void)
+ * ------------------
+ * Stop advertising on the BLE channel.
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127AdvStop(void) {
+  Alarm.disable(alarm_adv_id);
+  Alarm.free(alarm_adv_id);
+  sendCmdOut(BCCMD_ADV_OFF);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void bc127BleDisconnect(void) { sendCmdOut(BCCMD_BLE_DISCONNECT); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Tokenize(char*, struct bcToken*, unsigned int)
+ * ---------------------------------------------------
+ * Split a received line into its words, in place: the separators are
+ * overwritten with '\0' and the words point into the line, so that no
+ * copy nor allocation is made.
+ * IN:	- line, NUL terminated (char*)
+ *			- words (struct bcToken*)
+ *			- size of the words table (unsigned int)
+ * OUT:	- amount of words in the line, possibly more than the size of the
+ *			  table (unsigned int)
+ */
+unsigned int bc127Tokenize(char *line, struct bcToken *tok, unsigned int max) {
+  unsigned int nb = 0;
+  char *c = line;
+
+  while (*c != '\0') {
+    // Skip the separators
+    while ((*c == ' ') || (*c == '\n') || (*c == '\t'))
+      *c++ = '\0';
+    if (*c == '\0')
+      break;
+    if (nb < max)
+      tok[nb].str = c;
+    while ((*c != '\0') && (*c != ' ') && (*c != '\n') && (*c != '\t'))
+      c++;
+    if (nb < max)
+      tok[nb].len = c - tok[nb].str;
+    nb++;
+  }
+  return nb;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* parseSerialIn(char*)
+ * --------------------
+ * Parse a received line and dispatch it to the handler of its
+ * notification. The line is split in place.
+ * IN:	- received line, NUL terminated (char*)
+ * OUT:	- message to send back (enum serialMsg)
+ */
+enum serialMsg parseSerialIn(char *line) {
+  unsigned int nb_tok, nb_params;
+  char a2dp_id[12];
+
+  if (debug)
+    snooze_usb.printf("BC127->: %s\n", line);
+
+  nb_tok = bc127Tokenize(line, rx_tok, BC127_TOKENS_MAX);
+  if ((nb_tok == 0) || (nb_tok > BC127_TOKENS_MAX))
+    return BCCMD__NOTHING;
+  nb_params = nb_tok - 1;
+
+  for (unsigned int i = 0; i < (sizeof(notif_table) / sizeof(notif_table[0]));
+       i++) {
+    const struct bcNotif *n = &notif_table[i];
+    if ((nb_params >= n->nb_min) && (nb_params <= n->nb_max) &&
+        tokEquals(&rx_tok[0], n->name))
+      return n->handler(&rx_tok[1], nb_params);
+  }
+
+  // [link_ID] A2DP (volume): the name is the ID of the A2DP connection
+  snprintf(a2dp_id, sizeof(a2dp_id), "%d", BT_id_a2dp);
+  if ((nb_params == 2) && tokEquals(&rx_tok[0], a2dp_id))
+    return msgA2dpInfo(&rx_tok[1], nb_params);
+
+  return BCCMD__NOTHING;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Poll(void)
+ * ---------------
+ * Move the bytes received by the UART into the line pool, without
+ * waiting: a partial line stays in the pool until its '\r' comes. The
+ * characters beyond BC127_LINE_MAX are dropped. When the pool is full,
+ * the bytes are left in the UART buffer.
+ * IN:	- none
+ * OUT:	- a complete line is waiting (bool)
+ */
+bool bc127Poll(void) {
+  while ((rx_count < BC127_LINE_POOL) && (BLUEPORT.available() > 0)) {
+    char *line = rx_pool[(rx_head + rx_count) % BC127_LINE_POOL];
+    int c = BLUEPORT.read();
+
+    if (c == '\r') {
+      // Empty lines are skipped
+      if (rx_len > 0) {
+        line[rx_len] = '\0';
+        rx_count++;
+      }
+      rx_len = 0;
+    } else if (rx_len < BC127_LINE_MAX) {
+      line[rx_len++] = (char)c;
+    }
+  }
+  return (rx_count > 0);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Receive(void)
+ * ------------------
+ * Parse the oldest complete line of the pool, if any.
+ * IN:	- none
+ * OUT:	- message to send back (enum serialMsg)
+ */
+enum serialMsg bc127Receive(void) {
+  enum serialMsg msg;
+
+  if (!bc127Poll())
+    return BCCMD__NOTHING;
+  msg = parseSerialIn(rx_pool[rx_head]);
+  rx_head = (rx_head + 1) % BC127_LINE_POOL;
+  rx_count--;
+  return msg;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* sendCmdOut(int)
+ * ---------------
+ * Queue a message for the BC127 UART, without waiting: bc127Service()
+ * sends it once the lines before it are answered. A notification, request
+ * or error already waiting in the queue is not queued again, its text
+ * being built from the current state when it is sent.
+ * IN:	- message (int)
+ * OUT:	- command confirmation (bool)
+ */
+bool sendCmdOut(int msg) {
+  if ((msg < BCCMD__NOTHING) || (msg >= MAX_OUTPUTS))
     return false;
+
+  switch (msg) {
+  case BCCMD__NOTHING:
+    return true;
+  // Start recording
+  case BCCMD_REC_START:
+    working_state.rec_state = RECSTATE_REQ_ON;
+    return true;
+  // Stop recording
+  case BCCMD_REC_STOP:
+    working_state.rec_state = RECSTATE_REQ_OFF;
+    next_record.man_stop = true;
+    return true;
+  // Clear the device list and notify the start of the inquiry first
+  case BCCMD_INQUIRY:
+    clearDevlist();
+    sendCmdOut(BCNOT_INQ_START);
+    break;
+  // Pause monitoring
+  case BCCMD_MON_PAUSE:
+    working_state.mon_state = MONSTATE_REQ_OFF;
     break;
+  default:
+    break;
+  }
+
+  if (msg >= BCNOT_BT_STATE) {
+    for (unsigned int i = 0; i < tx_count; i++) {
+      if (tx_queue[(tx_head + i) % BC127_TX_QUEUE_LEN] == msg)
+        return true;
+    }
   }
-  if (cmdLine != "") {
+  if (tx_count >= BC127_TX_QUEUE_LEN) {
     if (debug)
-      snooze_usb.printf("->BC127: %s\n", cmdLine.c_str());
+      snooze_usb.printf("Error: BC127 queue full, message %d dropped\n", msg);
+    return false;
   }
-  // Send the prepared command line to UART
-  BLUEPORT.print(cmdLine);
-  // Wait some time to let the sent line finish
-  Alarm.delay(BC127_CMD_WAIT_MS);
-  // Send positive confirmation
+  tx_queue[(tx_head + tx_count) % BC127_TX_QUEUE_LEN] = msg;
+  tx_count++;
   return true;
 }
 /*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Service(void)
+ * ------------------
+ * Send the next queued line to the BC127 once the previous one is
+ * answered (OK/ERROR), or after BC127_ACK_TIMEOUT_MS without an answer.
+ * To be called at each iteration of the main loop: it never waits. A
+ * line missing its '\r' is not sent, with the rest of its message.
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127Service(void) {
+  unsigned int len;
+
+  if (tx_wait) {
+    if ((millis() - tx_sent_ms) < BC127_ACK_TIMEOUT_MS)
+      return;
+    tx_wait = false;
+    if (debug)
+      snooze_usb.println("Error: No answer from the BC127!");
+  }
+  while (tx_text[tx_pos] == '\0') {
+    if (tx_count == 0)
+      return;
+    nextMessage();
+  }
+  for (len = 0; (tx_text[tx_pos + len] != '\r') &&
+                (tx_text[tx_pos + len] != '\0');
+       len++)
+    ;
+  if (tx_text[tx_pos + len] == '\0') {
+    // Unterminated line: drop the rest of the message
+    if (debug)
+      snooze_usb.printf("Error: Unterminated line to the BC127: %s\n",
+                        &tx_text[tx_pos]);
+    tx_pos += len;
+    return;
+  }
+  len++;
+  if (debug)
+    snooze_usb.printf("->BC127: %.*s\n", len - 1, &tx_text[tx_pos]);
+  BLUEPORT.write((const uint8_t *)&tx_text[tx_pos], len);
+  tx_pos += len;
+  tx_wait = true;
+  tx_sent_ms = millis();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Flush(void)
+ * ----------------
+ * Send all the queued lines, e.g. before going to sleep. Blocks until the
+ * last one is answered, at most BC127_FLUSH_TIMEOUT_MS.
+ * IN:	- none
+ * OUT:	- none
+ */
+void bc127Flush(void) {
+  elapsedMillis wait = 0;
+
+  while ((tx_wait || (tx_text[tx_pos] != '\0') || (tx_count > 0)) &&
+         (wait < BC127_FLUSH_TIMEOUT_MS)) {
+    if (bc127Poll())
+      sendCmdOut(bc127Receive());
+    else
+      Alarm.delay(1);
+    bc127Service();
+  }
+}
+/*****************************************************************************/
@@ -20,8 +20,24 @@
 #define BLUEPORT Serial4
 // BC127 reset pin
 #define BC127_RST_PIN 30
-// Default waiting time after sending a command
-#define BC127_CMD_WAIT_MS 80
+// Longest wait for the OK/ERROR answer to a sent line (ms)
+#define BC127_ACK_TIMEOUT_MS 500
+// Longest wait for the outbound queue to empty before sleeping (ms)
+#define BC127_FLUSH_TIMEOUT_MS 2000
+// Recording index entries sent per BLE query
+#define BC127_IDX_PAGE 4
+// Messages waiting to be sent
+#define BC127_TX_QUEUE_LEN 16
+// Longest text of a sent message, all its lines included
+#define BC127_TX_MAX 512
+// Longest received line, terminator excluded (longer lines are cut)
+#define BC127_LINE_MAX 128
+// Received lines waiting to be parsed
+#define BC127_LINE_POOL 4
+// Longest wait for the READY notification after a reset (ms)
+#define BC127_READY_TIMEOUT_MS 2000
+// Most words of a received line: notification and up to 9 parameters
+#define BC127_TOKENS_MAX 10
 
 /*** Types *******************************************************************/
 // Serial command messages
@@ -51,29 +67,44 @@ enum serialMsg {
   // ----------
   BCNOT_BT_STATE,
   BCNOT_FILEPATH,
+  BCNOT_IDX_NB,
+  BCNOT_IDX_PAGE,
   BCNOT_INQ_DONE,
   BCNOT_INQ_START,
   BCNOT_INQ_STATE,
   BCNOT_LATLONG,
   BCNOT_MON_STATE,
   BCNOT_REC_STATE,
+  BCNOT_REC_LEFT,
   BCNOT_REC_NEXT,
   BCNOT_REC_NB,
   BCNOT_REC_REM,
   BCNOT_REC_TS,
   BCNOT_RWIN_OK,
+  BCNOT_RWIN_SHORT,
   BCNOT_RWIN_VALS,
+  BCNOT_STATS,
+  BCNOT_STATUS,
   BCNOT_VOL_LEVEL,
   // ----------
   BCREQ_LATLONG,
   BCREQ_TIME,
   // ----------
   BCERR_RWIN_BAD_REQ,
+  BCERR_RWIN_NO_SPACE,
   BCERR_RWIN_WRONG_PARAMS,
+  BCERR_STATUS_VERSION,
   BCERR_VOL_BT_DIS,
   MAX_OUTPUTS
 };
 
+// Word of a received line, pointing into the line buffer (NUL terminated
+// in place)
+struct bcToken {
+  const char *str;
+  unsigned int len;
+};
+
 extern struct btDev dev_list[DEVLIST_MAXLEN];
 
 /*** Variables ***************************************************************/
@@ -94,7 +125,12 @@ void bc127AdvStart(void);
 void bc127AdvStop(void);
 void bc127BleDisconnect(void);
 void bc127Inquiry(void);
-enum serialMsg parseSerialIn(String input);
+unsigned int bc127Tokenize(char *line, struct bcToken *tok, unsigned int max);
+enum serialMsg parseSerialIn(char *line);
+bool bc127Poll(void);
+enum serialMsg bc127Receive(void);
+void bc127Service(void);
+void bc127Flush(void);
 bool sendCmdOut(int msg);
 
 #endif /* _BC127_H_ */
@@ -6,6 +6,9 @@
  */
 /*** IMPORTED EXTERNAL OBJECTS ***********************************************/
 /*****************************************************************************/
+// main.h first, so that the headers using the SDutils types come after them
+#include "main.h"
+
 #include "SDutils.h"
 
 /*** MODULE OBJECTS **********************************************************/
@@ -13,45 +16,144 @@
 /*** Constants ***************************************************************/
 
 /*** Types *******************************************************************/
-// Wave header for PCM sound file
-struct waveHd {
-  char riff[4]; /* "RIFF" */
-  unsigned long
-      flength;                 /* file length in bytes                 */
-  char wave[4];                /* "WAVE"                */
-  char fmt[4];                 /* "fmt "                 */
-  unsigned long chunk_size;    /* size of FMT chunk in bytes (usually 16)
-                                */
-  short format_tag;            /* 1=PCM, 257=Mu-Law, 258=A-Law, 259=ADPCM
-                                */
-  short num_chans;             /* 1=mono, 2=stereo             */
-  unsigned long srate;         /* Sampling rate in samples per second
-                                */
-  unsigned long bytes_per_sec; /* bytes per second =
-                                  srate*num_chan*bytes_per_samp	*/
-  short bytes_per_samp;        /* 2=16-bit mono, 4=16-bit stereo
-                                */
-  short bits_per_samp;         /* Number of bits per sample
-                                */
-  char data[4];                /* "data"                */
-  unsigned long dlength;       /* data length in bytes (filelength - 44)
-                                */
-};
-struct waveHd wave_header;
 
 /*** Variables ***************************************************************/
+struct waveHd wave_header;
+
+// Storage stage of the recording in progress (NULL -> WAV)
+RecEncoder *rec_enc = NULL;
+
+// SD card file system
+sdFs_t sd;
+
 // SD card file handles
-File frec;
+SdBaseFile frec;
 File fgps;
 
 // Total amount of recorded bytes
 unsigned long tot_rec_bytes = 0;
 
+// Size of the WAV header of the recording in progress (see writeWaveSector)
+unsigned int wave_hd_size = WAVE_HEADER_SIZE;
+
 /*** Function prototypes *****************************************************/
+void metaPrintf(SdBaseFile *fh, const char *format, ...);
+float levelDb(float level);
+unsigned int buildWaveHeader(uint8_t *buf);
+void appendRecIndex(struct recIndexEntry *e);
+void indexRecording(struct recInfo *rec, struct recStats *st);
 /*** Macros ******************************************************************/
 /*** Constant objects ********************************************************/
+// Recording file extension and metadata name of each format
+const char *rec_ext[] = {".wav", ".flac", ".bfp"};
+const char *rec_fmt_name[] = {"PCM", "FLAC", "block floating point"};
 /*** Functions implementation ************************************************/
 
+/*****************************************************************************/
+/* metaPrintf(SdBaseFile*, const char*, ...)
+ * -----------------------------------------
+ * Formatted write to a metadata file (SdFat files have no printf).
+ * IN:	- pointer to the file handle (SdBaseFile*)
+ *			- format string and arguments, as for printf (const char*, ...)
+ * OUT:	- none
+ */
+void metaPrintf(SdBaseFile *fh, const char *format, ...) {
+  char line[META_LINE_SIZE];
+  va_list args;
+  int len;
+
+  va_start(args, format);
+  len = vsnprintf(line, META_LINE_SIZE, format, args);
+  va_end(args);
+  if (len <= 0)
+    return;
+  if (len >= META_LINE_SIZE)
+    len = META_LINE_SIZE - 1;
+  fh->write(line, len);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* levelDb(float)
+ * --------------
+ * Convert a level relative to full scale to dBFS, for the metadata.
+ * IN:	- level, 1.0 -> full scale (float)
+ * OUT:	- level in dBFS, LEVEL_DB_FLOOR for silence (float)
+ */
+float levelDb(float level) {
+  if (level <= 0.0)
+    return LEVEL_DB_FLOOR;
+  level = 20.0 * log10f(level);
+  return ((level < LEVEL_DB_FLOOR) ? LEVEL_DB_FLOOR : level);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* appendRecIndex(struct recIndexEntry*)
+ * -------------------------------------
+ * Append an entry to the recording index. A partial entry left by a
+ * power loss during the previous append is cut first, so that the
+ * entries stay aligned.
+ * IN:	- pointer to the entry (struct recIndexEntry*)
+ * OUT:	- none
+ */
+void appendRecIndex(struct recIndexEntry *e) {
+  SdBaseFile fh;
+  uint32_t size;
+
+  e->version = REC_INDEX_VERSION;
+  if (!fh.open(REC_INDEX_PATH, O_RDWR | O_CREAT)) {
+    if (debug)
+      snooze_usb.println("SD:      Cannot open the recording index");
+    return;
+  }
+  size = fh.fileSize();
+  size -= size % sizeof(struct recIndexEntry);
+  if (size != fh.fileSize())
+    fh.truncate(size);
+  fh.seekSet(size);
+  if ((fh.write(e, sizeof(struct recIndexEntry)) !=
+       sizeof(struct recIndexEntry)) &&
+      debug)
+    snooze_usb.println("SD:      Recording index write error");
+  fh.close();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* indexRecording(struct recInfo*, struct recStats*)
+ * -------------------------------------------------
+ * Add the recording just closed to the recording index.
+ * IN:	- pointer to the recording information (struct recInfo*)
+ *			- pointer to the recording statistics (struct recStats*)
+ * OUT:	- none
+ */
+void indexRecording(struct recInfo *rec, struct recStats *st) {
+  struct recIndexEntry e;
+  bool gps_ok = (rec->gps_lat < 1000.0) && (rec->gps_long < 1000.0);
+
+  memset(&e, 0, sizeof(e));
+  strncpy(e.path, rec->rpath.c_str(), REC_PATH_SIZE - 1);
+  e.tss = rec->tss;
+  e.dur_ms = st->elapsed_ms;
+  e.bytes = tot_rec_bytes;
+  if (gps_ok) {
+    e.gps_lat = lround(rec->gps_lat * 1e6);
+    e.gps_long = lround(rec->gps_long * 1e6);
+    e.flags |= REC_INDEX_F_GPS;
+  }
+  e.dropped = st->dropped;
+  e.missing = st->missing;
+  e.cnt = rec->cnt + 1;
+  e.ring_hwm = st->ring_hwm;
+  e.format = getRecFormat();
+  e.gps_source = rec->gps_source;
+  if (rec->man_stop)
+    e.flags |= REC_INDEX_F_MANSTOP;
+  appendRecIndex(&e);
+}
+/*****************************************************************************/
+
 /*** EXPORTED OBJECTS ********************************************************/
 /*****************************************************************************/
 /*** Functions ***************************************************************/
@@ -64,11 +166,20 @@ unsigned long tot_rec_bytes = 0;
  * OUT:	- none
  */
 void initSDcard(void) {
+  bool mounted;
+  unsigned long free;
+
+#if SDCARD_SDIO
+  mounted = sd.begin();
+#else
   SPI.setMOSI(SDCARD_MOSI_PIN);
   // COMMENT FOR BUILTIN_SDCARD AND SSSHIELD V1.0 !!
   SPI.setMISO(SDCARD_MISO_PIN);
   SPI.setSCK(SDCARD_SCK_PIN);
-  if (!(SD.begin(SDCARD_CS_PIN))) {
+  mounted = sd.begin(SDCARD_CS_PIN);
+#endif
+  raw_rec.begin(sd.card(), &frec);
+  if (!mounted) {
     while (1) {
       if (debug)
         snooze_usb.printf("SD:      Unable to access the SD card on CS: %d, "
@@ -84,6 +195,11 @@ void initSDcard(void) {
       Alarm.delay(250);
     }
   }
+  // Seed the free cluster count, kept by the file system from now on
+  free = sdFreeClusters();
+  if (debug)
+    snooze_usb.printf("SD:      %lu free clusters of %u bytes\n", free,
+                      sdClusterBytes());
 }
 /*****************************************************************************/
 
@@ -106,23 +222,25 @@ String createSDpath(void) {
     breakTime(now(), tm);
     sprintf(buf, "%02d%02d%02d", (tm.Year - 30), tm.Month, tm.Day);
     dir_name.concat(buf);
-    sprintf(buf, "%02d%02d%02d.wav", tm.Hour, tm.Minute, tm.Second);
+    sprintf(buf, "%02d%02d%02d%s", tm.Hour, tm.Minute, tm.Second,
+            rec_ext[getRecFormat()]);
     file_name.concat(buf);
   } else {
     breakTime(next_record.tss, tm);
     sprintf(buf, "u%02d%02d%02d", (tm.Year - 30), tm.Month, tm.Day);
     dir_name.concat(buf);
-    sprintf(buf, "u%02d%02d%02d.wav", tm.Hour, tm.Minute, tm.Second);
+    sprintf(buf, "u%02d%02d%02d%s", tm.Hour, tm.Minute, tm.Second,
+            rec_ext[getRecFormat()]);
     file_name.concat(buf);
   }
   sprintf(buf, "/%s/%s", dir_name.c_str(), file_name.c_str());
   path.concat(buf);
-  if (SD.exists(dir_name.c_str())) {
-    if (SD.exists(path.c_str())) {
-      SD.remove(path.c_str());
+  if (sd.exists(dir_name.c_str())) {
+    if (sd.exists(path.c_str())) {
+      sd.remove(path.c_str());
     }
   } else {
-    SD.mkdir(dir_name.c_str());
+    sd.mkdir(dir_name.c_str());
   }
 
   // String temppath = "il etait une fois un petit canard vert...";
@@ -158,23 +276,336 @@ void initWaveHeader(void) {
 /*****************************************************************************/
 
 /*****************************************************************************/
-/* writeWaveHeader(path, dlen)
- * ----------------------------
- * Write data & file length values to the wave header
- * when recording stop has been called
- * IN:	- file path (String)
- *			- number of recorded bytes (unsigned long)
+/* setWaveFormat(*prof)
+ * --------------------
+ * Set the format values of the wave header from a capture profile.
+ * IN:	- pointer to the capture profile (struct capProfile*)
  * OUT:	- none
  */
-void writeWaveHeader(String path, unsigned long dlen) {
-  File fh;
+void setWaveFormat(struct capProfile *prof) {
+  wave_header.num_chans = prof->channels;
+  wave_header.srate = WAVE_SAMPLING_RATE / prof->decim;
+  wave_header.bits_per_samp = prof->bits;
+  wave_header.bytes_per_samp = (prof->channels * prof->bits) / 8;
+  wave_header.bytes_per_sec = wave_header.srate * wave_header.bytes_per_samp;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* setWaveLengths(dlen)
+ * --------------------
+ * Set data & file length values of the wave header.
+ * IN:	- number of audio data bytes (unsigned long)
+ * OUT:	- none
+ */
+void setWaveLengths(unsigned long dlen) {
   wave_header.dlength = dlen;
-  wave_header.flength = dlen + 36;
+  wave_header.flength = dlen + wave_hd_size - 8;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* buildWaveHeader(uint8_t*)
+ * -------------------------
+ * Lay the wave header out in the given buffer. In the one-sector layout
+ * (wave_hd_size == REC_SECTOR_SIZE), a "JUNK" chunk pads the "fmt "
+ * chunk up to the "data" chunk header, at the end of the sector.
+ * IN:	- pointer to the buffer, REC_SECTOR_SIZE bytes (uint8_t*)
+ * OUT:	- header size in bytes (unsigned int)
+ */
+unsigned int buildWaveHeader(uint8_t *buf) {
+  uint32_t len;
+
+  if (wave_hd_size == WAVE_HEADER_SIZE) {
+    memcpy(buf, &wave_header, WAVE_HEADER_SIZE);
+    return WAVE_HEADER_SIZE;
+  }
+  memset(buf, 0, REC_SECTOR_SIZE);
+  memcpy(buf, &wave_header, WAVE_JUNK_POS);
+  memcpy(&buf[WAVE_JUNK_POS], "JUNK", 4);
+  len = REC_SECTOR_SIZE - WAVE_JUNK_POS - 16;
+  memcpy(&buf[WAVE_JUNK_POS + 4], &len, 4);
+  memcpy(&buf[REC_SECTOR_SIZE - 8], "data", 4);
+  memcpy(&buf[REC_SECTOR_SIZE - 4], &wave_header.dlength, 4);
+  return REC_SECTOR_SIZE;
+}
+/*****************************************************************************/
 
-  fh = SD.open(path.c_str(), O_WRITE);
-  fh.seek(0);
-  fh.write((byte *)&wave_header, 44);
+/*****************************************************************************/
+/* writeWaveSector(void)
+ * ---------------------
+ * Start the recording file with a one-sector wave header, instead of
+ * the 44-byte one written by the record ring. Used when the ring already
+ * holds pre-trigger audio, which has to stay sector-aligned in the file
+ * for the raw recorder.
+ * IN:	- none
+ * OUT:	- none
+ */
+void writeWaveSector(void) {
+  uint8_t hd[REC_SECTOR_SIZE];
+
+  wave_hd_size = REC_SECTOR_SIZE;
+  setWaveLengths(0);
+  writeRecData(hd, buildWaveHeader(hd));
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* updateWaveHeader(dlen)
+ * ----------------------
+ * Patch the data & file length values of the wave header through the
+ * still-open recording file. Called periodically while recording, so
+ * that an interrupted recording stays playable, and before closing.
+ * IN:	- number of audio data bytes (unsigned long)
+ * OUT:	- none
+ */
+void updateWaveHeader(unsigned long dlen) {
+  uint8_t hd[REC_SECTOR_SIZE];
+
+  setWaveLengths(dlen);
+  if (!raw_rec.patch(0, hd, buildWaveHeader(hd)) && debug)
+    snooze_usb.println("SD:      WAV header update error");
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* updateRecHeader(void)
+ * ---------------------
+ * Patch the header of the recording in progress with the current
+ * length: WAV header, or encoder header covering the frames already
+ * written.
+ * IN:	- none
+ * OUT:	- none
+ */
+void updateRecHeader(void) {
+  uint8_t hd[REC_ENC_HEADER_MAX];
+
+  if (!rec_enc) {
+    updateWaveHeader(tot_rec_bytes - wave_hd_size);
+    return;
+  }
+  if (!raw_rec.patch(0, hd, rec_enc->header(hd)) && debug)
+    snooze_usb.println("SD:      File header update error");
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* recoverRecording(void)
+ * ----------------------
+ * Repair the recording interrupted by a power loss, if any. Its path is
+ * read from the marker file left by openRecFile(). The WAV header and
+ * the file size are made consistent with the last checkpoint: the file
+ * is cut after the checkpointed data, or the header lengths are reduced
+ * to the data actually present in the file. A FLAC or block-floating-point
+ * file is cut after the last frame covered by its header.
+ * IN:	- none
+ * OUT:	- none
+ */
+void recoverRecording(void) {
+  SdBaseFile fh;
+  struct waveHd hd;
+  uint8_t fhd[FLAC_HEADER_SIZE];
+  uint32_t flen, fsize;
+  char path[REC_PATH_SIZE];
+  int len;
+  uint32_t avail, hd_size;
+  struct recIndexEntry e;
+
+  if (!fh.open(REC_MARKER_PATH, O_RDONLY))
+    return;
+  memset(&e, 0, sizeof(e));
+  len = fh.read(path, REC_PATH_SIZE - 1);
+  fh.close();
+  path[(len > 0) ? len : 0] = '\0';
+  memset(fhd, 0, FLAC_HEADER_SIZE);
+
+  if (fh.open(path, O_RDWR) &&
+      (fh.read(fhd, FLAC_HEADER_SIZE) == FLAC_HEADER_SIZE) &&
+      !memcmp(fhd, "fLaC", 4) &&
+      !memcmp(&fhd[FLAC_HEADER_SIZE - 8], FLAC_APP_ID, 4)) {
+    flen = ((uint32_t)fhd[FLAC_HEADER_SIZE - 4] << 24) |
+           ((uint32_t)fhd[FLAC_HEADER_SIZE - 3] << 16) |
+           ((uint32_t)fhd[FLAC_HEADER_SIZE - 2] << 8) |
+           fhd[FLAC_HEADER_SIZE - 1];
+    if (fh.fileSize() > flen)
+      fh.truncate(flen);
+    if (debug)
+      snooze_usb.printf("SD:      Recovered %s (%lu bytes)\n", path, flen);
+  } else if (fh.isOpen() && !memcmp(fhd, BFP_MAGIC, 4)) {
+    flen = fhd[16] | (fhd[17] << 8) | ((uint32_t)fhd[18] << 16) |
+           ((uint32_t)fhd[19] << 24);
+    fsize = fhd[20] | (fhd[21] << 8) | ((uint32_t)fhd[22] << 16) |
+            ((uint32_t)fhd[23] << 24);
+    flen = BFP_HEADER_SIZE +
+           (((flen + BFP_BLOCK_SAMPLES - 1) / BFP_BLOCK_SAMPLES) * fsize);
+    if (fh.fileSize() > flen)
+      fh.truncate(flen);
+    if (debug)
+      snooze_usb.printf("SD:      Recovered %s (%lu bytes)\n", path, flen);
+  } else if (fh.isOpen() && fh.seekSet(0) &&
+             (fh.read(&hd, WAVE_HEADER_SIZE) == WAVE_HEADER_SIZE) &&
+             !strncmp(hd.riff, "RIFF", 4)) {
+    // One-sector header: the "data" chunk header ends the first sector
+    hd_size = WAVE_HEADER_SIZE;
+    if (!strncmp(hd.data, "JUNK", 4) &&
+        fh.seekSet(REC_SECTOR_SIZE - 8) && (fh.read(hd.data, 8) == 8))
+      hd_size = REC_SECTOR_SIZE;
+    if (!strncmp(hd.data, "data", 4) && (fh.fileSize() >= hd_size)) {
+      avail = fh.fileSize() - hd_size;
+      if ((hd.dlength > avail) && (hd.bytes_per_samp > 0))
+        hd.dlength = avail - (avail % hd.bytes_per_samp);
+      else if (hd.dlength > avail)
+        hd.dlength = avail;
+      hd.flength = hd.dlength + hd_size - 8;
+      if (fh.fileSize() > (hd.dlength + hd_size))
+        fh.truncate(hd.dlength + hd_size);
+      fh.seekSet(WAVE_FLENGTH_POS);
+      fh.write(&hd.flength, 4);
+      fh.seekSet(hd_size - 4);
+      fh.write(&hd.dlength, 4);
+      if (debug)
+        snooze_usb.printf("SD:      Recovered %s (%lu data bytes)\n", path,
+                          hd.dlength);
+    }
+  }
+  if (fh.isOpen()) {
+    // Start time and statistics are lost with the power
+    strcpy(e.path, path);
+    e.bytes = fh.fileSize();
+    e.format = !memcmp(fhd, "fLaC", 4)
+                   ? RECFMT_FLAC
+                   : (!memcmp(fhd, BFP_MAGIC, 4) ? RECFMT_BFP : RECFMT_WAV);
+    e.flags = REC_INDEX_F_RECOVERED;
+  }
   fh.close();
+  if (e.flags)
+    appendRecIndex(&e);
+  sd.remove(REC_MARKER_PATH);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* openRecFile(String, unsigned long)
+ * ----------------------------------
+ * Open the recording file through the raw recorder. If a size is given,
+ * the file is pre-allocated contiguously and streamed sector by sector
+ * (see rawRecorder.cpp), otherwise it grows cluster by cluster as usual.
+ * IN:	- file path (String)
+ *			- expected file size in bytes, 0 if unknown (unsigned long)
+ * OUT:	- file successfully opened (bool)
+ */
+bool openRecFile(String path, unsigned long size) {
+  SdBaseFile fh;
+
+  // Leave a trace for recoverRecording() before the card gets busy
+  if (fh.open(REC_MARKER_PATH, O_RDWR | O_CREAT | O_TRUNC)) {
+    fh.write(path.c_str(), path.length());
+    fh.close();
+  }
+  tot_rec_bytes = 0;
+  wave_hd_size = WAVE_HEADER_SIZE;
+  // Zero lengths until the first checkpoint: a pre-allocated file may
+  // contain stale data beyond the recorded audio
+  setWaveLengths(0);
+  return raw_rec.open(path.c_str(), size);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* writeRecData(const uint8_t*, unsigned int)
+ * ------------------------------------------
+ * Write recorded data to the file. With a storage stage (FLAC or block
+ * floating point), the data goes through the encoder and only whole
+ * encoded sectors are written, the rest waits for the next call or for
+ * closeRecFile().
+ * IN:	- pointer to the data (const uint8_t*)
+ *			- number of bytes (unsigned int)
+ * OUT:	- none
+ */
+void writeRecData(const uint8_t *buf, unsigned int len) {
+  unsigned int n, olen;
+  uint8_t *obuf;
+
+  if (!rec_enc) {
+    tot_rec_bytes += raw_rec.write(buf, len);
+    return;
+  }
+  while (len) {
+    n = rec_enc->encode(buf, len);
+    buf += n;
+    len -= n;
+    obuf = rec_enc->output(&olen);
+    if (olen) {
+      tot_rec_bytes += raw_rec.write(obuf, olen);
+      rec_enc->consume(olen);
+    } else if (!n) {
+      break; // trailing partial sample
+    }
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* closeRecFile(void)
+ * ------------------
+ * Write the rest of the encoded data (storage stage), terminate the
+ * raw streaming, cut the file down to the recorded length, write the
+ * final header values and close it.
+ * IN:	- none
+ * OUT:	- none
+ */
+void closeRecFile(void) {
+  unsigned int olen;
+  uint8_t *obuf;
+
+  if (rec_enc) {
+    obuf = rec_enc->flush(&olen);
+    tot_rec_bytes += raw_rec.write(obuf, olen);
+    rec_enc->consume(olen);
+  }
+  raw_rec.finish();
+  updateRecHeader();
+  if (!raw_rec.close() && debug)
+    snooze_usb.println("SD:      Recording file closing error");
+  sd.remove(REC_MARKER_PATH);
+  if (debug)
+    snooze_usb.printf("SD:      Write latency (us): mean %lu, max %lu\n",
+                      raw_rec.meanWriteMicros(), raw_rec.maxWriteMicros());
+  if ((rec_enc == &flac_enc) && debug)
+    snooze_usb.printf("SD:      FLAC frame encoding (cycles): mean %lu, "
+                      "max %lu\n",
+                      flac_enc.meanFrameCycles(), flac_enc.maxFrameCycles());
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* writeSpectrum(struct recInfo*)
+ * ------------------------------
+ * Append the spectral summary records of the recording to its sidecar
+ * file, created with its header. While recording, the raw streaming is
+ * suspended for the time of the write.
+ * IN:	- pointer to the recording information (struct recInfo*)
+ * OUT:	- none
+ */
+void writeSpectrum(struct recInfo *rec) {
+  SdBaseFile fh;
+  uint8_t hd[SPEC_HEADER_SIZE];
+  unsigned int n = bandsRec.records();
+
+  if (!n)
+    return;
+  raw_rec.suspend();
+  if (fh.open(rec->spath.c_str(), O_RDWR | O_CREAT | O_AT_END)) {
+    if (!fh.fileSize())
+      fh.write(hd, bandsRec.header(hd, rec->tss));
+    fh.write(bandsRec.getRecords(), n * sizeof(struct specRecord));
+    fh.close();
+  } else if (debug) {
+    snooze_usb.printf("SD:      Cannot open %s\n", rec->spath.c_str());
+  }
+  if (!raw_rec.resume() && debug)
+    snooze_usb.println("SD:      Raw streaming not resumed");
+  bandsRec.clearRecords();
 }
 /*****************************************************************************/
 
@@ -189,41 +620,94 @@ void writeWaveHeader(String path, unsigned long dlen) {
  * - recording number # of total number
  * - GPS latitude (DD)
  * - GPS longitude (DD)
+ * and add the recording to the recording index.
  */
 void createMetadata(struct recInfo *rec) {
   tmElements_t tm;
-  File fh;
-  fh = SD.open(rec->mpath.c_str(), FILE_WRITE);
+  struct levelSummary lvl;
+  struct recStats st;
+  unsigned int b;
+  SdBaseFile fh;
+  fh.open(rec->mpath.c_str(), O_RDWR | O_CREAT | O_AT_END);
   if (debug)
     snooze_usb.printf("SD:      Opening: %s\n", rec->mpath.c_str());
-  if (fh) {
-    fh.printf("Recording meta-data (file: %s)\n", rec->mpath.c_str());
-    fh.printf("----------------------------------------------\n");
-    fh.printf("- recording path: %s\n", rec->rpath.c_str());
+  if (fh.isOpen()) {
+    metaPrintf(&fh, "Recording meta-data (file: %s)\n", rec->mpath.c_str());
+    metaPrintf(&fh, "----------------------------------------------\n");
+    metaPrintf(&fh, "- recording path: %s\n", rec->rpath.c_str());
     // if(debug) snooze_usb.printf("SD:      Recording meta-data (file: %s)\n",
     // rec->mpath.c_str()); if(debug) snooze_usb.printf("SD:
     // ----------------------------------------------\n"); if(debug)
     // snooze_usb.printf("SD:      - recording path: %s\n", rec->rpath.c_str());
     breakTime(rec->tss, tm);
-    fh.printf("- recording date/time: %02d.%02d.%d, %d:%02d'%02d\"\n", tm.Day,
-              tm.Month, (tm.Year + 1970), tm.Hour, tm.Minute, tm.Second);
+    metaPrintf(&fh, "- recording date/time: %02d.%02d.%d, %d:%02d'%02d\"\n",
+               tm.Day, tm.Month, (tm.Year + 1970), tm.Hour, tm.Minute,
+               tm.Second);
     // if(debug) snooze_usb.printf("SD:      - recording date/time:
     // %02d.%02d.%d, %d:%02d'%02d\"\n", tm.Day, tm.Month, (tm.Year+1970),
     // tm.Hour, tm.Minute, tm.Second);
     if (next_record.man_stop) {
-      fh.printf("- recording duration: %d:%02d'%02d\" (manually stopped)\n",
-                rec->dur.Hour, rec->dur.Minute, rec->dur.Second);
-      fh.printf("- recording #%d of %d (manually stopped)\n", (rec->cnt + 1),
-                rec->rec_tot);
+      metaPrintf(&fh,
+                 "- recording duration: %d:%02d'%02d\" (manually stopped)\n",
+                 rec->dur.Hour, rec->dur.Minute, rec->dur.Second);
+      metaPrintf(&fh, "- recording #%d of %d (manually stopped)\n",
+                 (rec->cnt + 1), rec->rec_tot);
     } else {
-      fh.printf(
-          "- recording duration/period: %d:%02d'%02d\" / %d:%02d'%02d\"\n",
+      metaPrintf(
+          &fh, "- recording duration/period: %d:%02d'%02d\" / %d:%02d'%02d\"\n",
           rec->dur.Hour, rec->dur.Minute, rec->dur.Second, rec->per.Hour,
           rec->per.Minute, rec->per.Second);
-      fh.printf("- recording #%d of %d\n", (rec->cnt + 1), rec->rec_tot);
+      metaPrintf(&fh, "- recording #%d of %d\n", (rec->cnt + 1), rec->rec_tot);
     }
-    fh.printf("- device position (lat, long (DD)): %0.5f, %0.5f\n",
-              rec->gps_lat, rec->gps_long);
+    metaPrintf(&fh, "- device position (lat, long (DD)): %0.5f, %0.5f\n",
+               rec->gps_lat, rec->gps_long);
+    metaPrintf(&fh, "- capture profile: %d ch, %lu Hz, %d bit, %s\n",
+               wave_header.num_chans, wave_header.srate,
+               wave_header.bits_per_samp,
+               rec_fmt_name[getRecFormat()]);
+    if (rec_enc == &bfp_pack)
+      metaPrintf(&fh,
+                 "- block floating point: %d-bit mantissas, %d samples per "
+                 "exponent, %d-byte frames\n",
+                 cap_profile.width, BFP_BLOCK_SAMPLES, bfp_pack.frameSize());
+    if (evt_trigger.enabled)
+      metaPrintf(&fh,
+                 "- event trigger: threshold %0.3f, %u ms pre-trigger, "
+                 "%u s hang\n",
+                 evt_trigger.threshold, evt_trigger.pre_ms,
+                 evt_trigger.hang_sec);
+    levelRec.readStats(&lvl);
+    metaPrintf(&fh,
+               "- input level (dBFS): peak %0.1f, RMS %0.1f, loudest block "
+               "RMS %0.1f\n",
+               levelDb(lvl.peak), levelDb(lvl.rms), levelDb(lvl.loudest));
+    metaPrintf(&fh, "- input DC offset: %0.5f, clipped samples: %lu\n",
+               lvl.dc, lvl.clips);
+    metaPrintf(&fh,
+               "- spectral summary: %s (%d-point FFT at %d Hz, %d s "
+               "records)\n",
+               rec->spath.c_str(), SPEC_FFT_SIZE, SPEC_RATE, SPEC_RECORD_SEC);
+    getRecStats(&st);
+    metaPrintf(&fh,
+               "- audio blocks: %lu expected (%lu ms), %lu received, %lu "
+               "dropped, %lu missing\n",
+               st.expected, st.elapsed_ms, st.received, st.dropped,
+               st.missing);
+    metaPrintf(&fh, "- record buffer high-water mark: %d/%d sectors\n",
+               st.ring_hwm, REC_RING_SECTORS);
+    metaPrintf(&fh,
+               "- audio memory max: %d/%d blocks, audio CPU max: %0.1f%%\n",
+               st.mem_max, AUDIO_MEMORY_BLOCKS, st.cpu_max);
+    metaPrintf(&fh, "- record interrupt (CPU cycles): mean %lu, max %lu\n",
+               st.isr_mean_cyc, st.isr_max_cyc);
+    metaPrintf(&fh, "- SD write (us): mean %lu, max %lu\n", st.wr_mean_us,
+               st.wr_max_us);
+    metaPrintf(&fh, "- SD writes per latency (<0.5, <1, <2 ... <131, more "
+                    "ms):");
+    for (b = 0; b < STATS_LAT_BUCKETS; b++)
+      metaPrintf(&fh, " %lu", st.lat_hist[b]);
+    metaPrintf(&fh, "\n");
+    indexRecording(rec, &st);
     // if(debug) snooze_usb.printf("SD:      - recording duration/period:
     // %d:%02d'%02d\" / %d:%02d'%02d\"\n", rec->dur.Hour, rec->dur.Minute,
     // rec->dur.Second, rec->per.Hour, rec->per.Minute, rec->per.Second);
@@ -234,3 +718,90 @@ void createMetadata(struct recInfo *rec) {
   fh.close();
 }
 /*****************************************************************************/
+
+/*****************************************************************************/
+/* recIndexCount(void)
+ * -------------------
+ * Amount of entries in the recording index. While recording, the raw
+ * streaming is suspended for the time of the access.
+ * IN:	- none
+ * OUT:	- amount of entries (unsigned long)
+ */
+unsigned long recIndexCount(void) {
+  SdBaseFile fh;
+  unsigned long n = 0;
+
+  raw_rec.suspend();
+  if (fh.open(REC_INDEX_PATH, O_RDONLY)) {
+    n = fh.fileSize() / sizeof(struct recIndexEntry);
+    fh.close();
+  }
+  if (!raw_rec.resume() && debug)
+    snooze_usb.println("SD:      Raw streaming not resumed");
+  return n;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* readRecIndex(unsigned long, struct recIndexEntry*, unsigned int)
+ * ----------------------------------------------------------------
+ * Read consecutive entries of the recording index, with one file read
+ * and no directory scan. While recording, the raw streaming is suspended
+ * for the time of the access.
+ * IN:	- first entry (unsigned long)
+ *			- entries (struct recIndexEntry*)
+ *			- amount of entries to read (unsigned int)
+ * OUT:	- amount of entries read, 0 from the end of the index on
+ *			  (unsigned int)
+ */
+unsigned int readRecIndex(unsigned long first, struct recIndexEntry *e,
+                          unsigned int n) {
+  SdBaseFile fh;
+  int len = 0;
+
+  raw_rec.suspend();
+  if (fh.open(REC_INDEX_PATH, O_RDONLY)) {
+    // Checked against the entries first, the offset cannot wrap
+    if ((first < (fh.fileSize() / sizeof(struct recIndexEntry))) &&
+        fh.seekSet(first * sizeof(struct recIndexEntry)))
+      len = fh.read(e, n * sizeof(struct recIndexEntry));
+    fh.close();
+  }
+  if (!raw_rec.resume() && debug)
+    snooze_usb.println("SD:      Raw streaming not resumed");
+  return (len > 0) ? (len / sizeof(struct recIndexEntry)) : 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* sdFreeClusters(void)
+ * --------------------
+ * Amount of free clusters of the SD card. The file system keeps the count
+ * up to date on every allocation and release once it is known, the FAT is
+ * only scanned for the first call. While recording, the raw streaming is
+ * suspended for the time of the access.
+ * IN:	- none
+ * OUT:	- free clusters, 0 on error (unsigned long)
+ */
+unsigned long sdFreeClusters(void) {
+  int32_t n;
+
+  raw_rec.suspend();
+  n = sd.freeClusterCount();
+  if (!raw_rec.resume() && debug)
+    snooze_usb.println("SD:      Raw streaming not resumed");
+  return (n > 0) ? n : 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* sdClusterBytes(void)
+ * --------------------
+ * Size of a cluster of the SD card.
+ * IN:	- none
+ * OUT:	- cluster size in bytes (unsigned int)
+ */
+unsigned int sdClusterBytes(void) {
+  return sd.blocksPerCluster() * 512U;
+}
+/*****************************************************************************/
@@ -7,7 +7,7 @@
 /*** IMPORTED EXTERNAL OBJECTS ***********************************************/
 /*****************************************************************************/
 #include "main.h"
-#include <SD.h>
+#include <SdFat.h>
 
 /*** EXPORTED OBJECTS ********************************************************/
 /*****************************************************************************/
@@ -18,11 +18,30 @@
 #define WAVE_FORMAT_PCM 1
 #define WAVE_NUM_CHANNELS 1
 #define WAVE_SAMPLING_RATE 44100
-#define WAVE_BYTES_PER_SEC 705600 // 44100 * 16
+#define WAVE_BYTES_PER_SEC 88200 // 44100 * 2
 #define WAVE_BYTES_PER_SAMP 2
 #define WAVE_BITS_PER_SAMP 16
 #define WAVE_FLENGTH_POS 4
 #define WAVE_DLENGTH_POS 40
+#define WAVE_HEADER_SIZE 44
+// Position of the "JUNK" chunk in a one-sector wave header
+#define WAVE_JUNK_POS 36
+
+// Marker file holding the path of the recording in progress
+#define REC_MARKER_PATH "/RECORD.CUR"
+// Longest recording path ("/uYYMMDD/uHHMMSS.flac")
+#define REC_PATH_SIZE 24
+
+// Index of the recordings: one fixed-size entry per recording, appended
+#define REC_INDEX_PATH "/RECORDS.IDX"
+#define REC_INDEX_VERSION 1
+// Flags of an index entry
+#define REC_INDEX_F_MANSTOP 0x01   // recording sequence manually stopped
+#define REC_INDEX_F_RECOVERED 0x02 // repaired after a power loss
+#define REC_INDEX_F_GPS 0x04       // position known
+
+// Longest line of the metadata file
+#define META_LINE_SIZE 128
 
 // SDcard pins definition
 // -> Audio shield slot !! USED IN SSSHIELD V1.0 !!!
@@ -38,20 +57,83 @@
 #define SDCARD_MOSI_PIN 28
 #define SDCARD_MISO_PIN 39
 #define SDCARD_SCK_PIN 27
+// SD card interface: 0 -> SPI (pins above), 1 -> Teensy built-in SDIO slot
+#define SDCARD_SDIO 0
 
 /*** Types *******************************************************************/
+// File system and card driver of the selected SD card interface
+#if SDCARD_SDIO
+typedef SdFatSdio sdFs_t;
+typedef SdioCard sdCard_t;
+#else
+typedef SdFat sdFs_t;
+typedef SdSpiCard sdCard_t;
+#endif
+
+// Wave header for PCM sound file (WAVE_HEADER_SIZE bytes)
+struct waveHd {
+  char riff[4];           /* "RIFF"                                      */
+  uint32_t flength;       /* file length in bytes                        */
+  char wave[4];           /* "WAVE"                                      */
+  char fmt[4];            /* "fmt "                                      */
+  uint32_t chunk_size;    /* size of FMT chunk in bytes (usually 16)     */
+  int16_t format_tag;     /* 1=PCM, 257=Mu-Law, 258=A-Law, 259=ADPCM     */
+  int16_t num_chans;      /* 1=mono, 2=stereo                            */
+  uint32_t srate;         /* Sampling rate in samples per second         */
+  uint32_t bytes_per_sec; /* bytes per second = srate*num_chan*bytes_per_samp */
+  int16_t bytes_per_samp; /* 2=16-bit mono, 4=16-bit stereo              */
+  int16_t bits_per_samp;  /* Number of bits per sample                   */
+  char data[4];           /* "data"                                      */
+  uint32_t dlength;       /* data length in bytes (filelength - 44)      */
+};
+
+// Entry of the recording index (64 bytes, little endian)
+struct recIndexEntry {
+  char path[REC_PATH_SIZE]; /* recording path, NUL terminated          */
+  uint32_t tss;             /* start timestamp (0 -> unknown)          */
+  uint32_t dur_ms;          /* recorded time (ms)                      */
+  uint32_t bytes;           /* file size                               */
+  int32_t gps_lat;          /* latitude (1e-6 deg)                     */
+  int32_t gps_long;         /* longitude (1e-6 deg)                    */
+  uint32_t dropped;         /* audio blocks dropped                    */
+  uint32_t missing;         /* audio blocks missing                    */
+  uint16_t cnt;             /* recording number                        */
+  uint16_t ring_hwm;        /* record ring high water mark (sectors)   */
+  uint8_t version;          /* REC_INDEX_VERSION                       */
+  uint8_t format;           /* file format (enum recFormat)            */
+  uint8_t gps_source;       /* GPS source (enum gpsSource)             */
+  uint8_t flags;            /* REC_INDEX_F_*                           */
+  uint8_t reserved[4];
+};
 
 /*** Variables ***************************************************************/
+extern RecEncoder *rec_enc;
 extern struct waveHd wave_header;
-extern File frec;
+extern sdFs_t sd;
+extern SdBaseFile frec;
 extern File fmeta;
 extern unsigned long tot_rec_bytes;
+extern unsigned int wave_hd_size;
 
 /*** Functions ***************************************************************/
 void initSDcard(void);
 String createSDpath(void);
 void createMetadata(struct recInfo *rec);
 void initWaveHeader(void);
-void writeWaveHeader(String path, unsigned long dlen);
+void setWaveFormat(struct capProfile *prof);
+void setWaveLengths(unsigned long dlen);
+void updateWaveHeader(unsigned long dlen);
+void updateRecHeader(void);
+void writeWaveSector(void);
+void recoverRecording(void);
+bool openRecFile(String path, unsigned long size);
+void writeRecData(const uint8_t *buf, unsigned int len);
+void closeRecFile(void);
+void writeSpectrum(struct recInfo *rec);
+unsigned long recIndexCount(void);
+unsigned int readRecIndex(unsigned long first, struct recIndexEntry *e,
+                          unsigned int n);
+unsigned long sdFreeClusters(void);
+unsigned int sdClusterBytes(void);
 
 #endif /* _SDUTILS_H_ */
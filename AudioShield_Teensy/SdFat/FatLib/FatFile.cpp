@@ -63,6 +63,7 @@ bool FatFile::addDirCluster() {
   }
   memset(pc, 0, 512);
   // zero rest of clusters
+  m_vol->cacheInvalidate(block + 1, m_vol->blocksPerCluster() - 1);
   for (uint8_t i = 1; i < m_vol->blocksPerCluster(); i++) {
     if (!m_vol->writeBlock(block + i, pc->data)) {
       DBG_FAIL_MACRO;
@@ -787,7 +788,7 @@ int FatFile::read(void* buf, size_t nbyte) {
       }
       block = m_vol->clusterFirstBlock(m_curCluster) + blockOfCluster;
     }
-    if (offset != 0 || toRead < 512 || block == m_vol->cacheBlockNumber()) {
+    if (offset != 0 || toRead < 512 || m_vol->cacheContains(block)) {
       // amount to be read from current block
       n = 512 - offset;
       if (n > toRead) {
@@ -811,13 +812,10 @@ int FatFile::read(void* buf, size_t nbyte) {
         }
       }
       n = 512*nb;
-      if (m_vol->cacheBlockNumber() <= block
-          && block < (m_vol->cacheBlockNumber() + nb)) {
-        // flush cache if a block is in the cache
-        if (!m_vol->cacheSyncData()) {
-          DBG_FAIL_MACRO;
-          goto fail;
-        }
+      // flush cached blocks of the range
+      if (!m_vol->cacheSyncData(block, nb)) {
+        DBG_FAIL_MACRO;
+        goto fail;
       }
       if (!m_vol->readBlocks(block, dst, nb)) {
         DBG_FAIL_MACRO;
@@ -1465,7 +1463,7 @@ int FatFile::write(const void* buf, size_t nbyte) {
       }
       uint8_t* dst = pc->data + blockOffset;
       memcpy(dst, src, n);
-      if (512 == (n + blockOffset)) {
+      if (512 == (n + blockOffset) && !m_vol->cacheWriteBehind()) {
         // Force write if block is full - improves large writes.
         if (!m_vol->cacheSyncData()) {
           DBG_FAIL_MACRO;
@@ -1481,11 +1479,8 @@ int FatFile::write(const void* buf, size_t nbyte) {
         nb = maxBlocks;
       }
       n = 512*nb;
-      if (m_vol->cacheBlockNumber() <= block
-          && block < (m_vol->cacheBlockNumber() + nb)) {
-        // invalidate cache if block is in cache
-        m_vol->cacheInvalidate();
-      }
+      // invalidate cached blocks of the range
+      m_vol->cacheInvalidate(block, nb);
       if (!m_vol->writeBlocks(block, src, nb)) {
         DBG_FAIL_MACRO;
         goto fail;
@@ -1494,9 +1489,7 @@ int FatFile::write(const void* buf, size_t nbyte) {
     } else {
       // use single block write command
       n = 512;
-      if (m_vol->cacheBlockNumber() == block) {
-        m_vol->cacheInvalidate();
-      }
+      m_vol->cacheInvalidate(block, 1);
       if (!m_vol->writeBlock(block, src)) {
         DBG_FAIL_MACRO;
         goto fail;
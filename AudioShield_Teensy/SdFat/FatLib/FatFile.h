@@ -987,6 +987,7 @@ class FatFile {
   bool addDirCluster();
   dir_t* cacheDirEntry(uint8_t action);
   static uint8_t lfnChecksum(uint8_t* name);
+  static bool lfnShortName(ldir_t* ldir, uint8_t* sfn);
   bool lfnUniqueSfn(fname_t* fname);
   bool openCluster(FatFile* file);
   static bool parsePathName(const char* str, fname_t* fname, const char** ptr);
@@ -994,6 +995,7 @@ class FatFile {
   bool open(FatFile* dirFile, fname_t* fname, oflag_t oflag);
   bool openCachedEntry(FatFile* dirFile, uint16_t cacheIndex, oflag_t oflag,
                        uint8_t lfnOrd);
+  bool openSFN(FatFile* dirFile, fname_t* fname, oflag_t oflag);
   bool readLBN(uint32_t* lbn);
   dir_t* readDirCache(bool skipReadOk = false);
   bool setDirSize();
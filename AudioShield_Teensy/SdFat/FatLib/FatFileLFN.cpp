@@ -290,6 +290,23 @@ bool FatFile::parsePathName(const char* path,
   return true;
 }
 //------------------------------------------------------------------------------
+bool FatFile::lfnShortName(ldir_t* ldir, uint8_t* sfn) {
+  // A long name of one entry that fits 8.3 matches that short name.
+  char name[14];
+  const char* ptr;
+  fname_t fname;
+  if (ldir->ord != (LDIR_ORD_LAST_LONG_ENTRY | 1)) {
+    return false;
+  }
+  lfnGetName(ldir, name, sizeof(name));
+  if (!parsePathName(name, &fname, &ptr) || *ptr ||
+      (fname.flags & FNAME_FLAG_LOST_CHARS)) {
+    return false;
+  }
+  memcpy(sfn, fname.sfn, sizeof(fname.sfn));
+  return true;
+}
+//------------------------------------------------------------------------------
 bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
   bool fnameFound = false;
   uint8_t lfnOrd = 0;
@@ -301,15 +318,52 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
   uint16_t curIndex;
   dir_t* dir;
   ldir_t* ldir;
+  const uint8_t* scanMiss;
   size_t len = fname->len;
+#if FAT_DIR_CACHE_ENTRIES
+  uint8_t scanSfn[11];
+  uint8_t scanChksum = 0;
+  bool scanLfn = false;
+#endif  // FAT_DIR_CACHE_ENTRIES
 
   if (!dirFile->isDir() || isOpen()) {
     DBG_FAIL_MACRO;
     goto fail;
   }
+  // A name in 8.3 form only needs the short name scan.
+  if (!(fname->flags & FNAME_FLAG_NEED_LFN)) {
+    return openSFN(dirFile, fname, oflag);
+  }
   // Number of directory entries needed.
-  freeNeed = fname->flags & FNAME_FLAG_NEED_LFN ? 1 + (len + 12)/13 : 1;
+  freeNeed = 1 + (len + 12)/13;
+  scanMiss = fname->flags & FNAME_FLAG_LOST_CHARS ? 0 : fname->sfn;
 
+  // Short name known in the directory cache, or known to be absent.
+  if (!(fname->flags & FNAME_FLAG_LOST_CHARS)) {
+    if (dirFile->m_vol->dirCacheFind(dirFile->m_firstCluster, fname->sfn,
+                                     &curIndex, &lfnOrd)) {
+      if (dirFile->seekSet(32UL*curIndex)) {
+        dir = dirFile->readDirCache();
+        if (dir && DIR_IS_FILE_OR_SUBDIR(dir) &&
+            !memcmp(dir->name, fname->sfn, sizeof(fname->sfn))) {
+          goto found;
+        }
+      }
+      lfnOrd = 0;
+    }
+    if (dirFile->m_vol->dirScanAbsent(dirFile->m_firstCluster, fname->sfn,
+                                      &curIndex)) {
+      if (!(oflag & O_CREAT) || !isWriteMode(oflag)) {
+        DBG_FAIL_MACRO;
+        goto fail;
+      }
+      // Free entries from the end of the directory on.
+      if (curIndex != 0XFFFF && dirFile->seekSet(32UL*curIndex)) {
+        goto create;
+      }
+    }
+  }
+  dirFile->m_vol->dirScanBegin(dirFile->m_firstCluster);
   dirFile->rewind();
   while (1) {
     curIndex = dirFile->m_curPosition/32;
@@ -320,6 +374,7 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
         goto fail;
       }
       // At EOF
+      dirFile->m_vol->dirScanEnd(curIndex, scanMiss);
       goto create;
     }
     if (dir->name[0] == DIR_NAME_DELETED || dir->name[0] == DIR_NAME_FREE) {
@@ -330,8 +385,10 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
         freeFound++;
       }
       if (dir->name[0] == DIR_NAME_FREE) {
+        dirFile->m_vol->dirScanEnd(curIndex, scanMiss);
         goto create;
       }
+      dirFile->m_vol->dirScanHole();
     } else {
       if (freeFound < freeNeed) {
         freeFound = 0;
@@ -342,6 +399,12 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
       lfnOrd = 0;
     } else if (DIR_IS_LONG_NAME(dir)) {
       ldir_t *ldir = reinterpret_cast<ldir_t*>(dir);
+#if FAT_DIR_CACHE_ENTRIES
+      if (ldir->ord & LDIR_ORD_LAST_LONG_ENTRY) {
+        scanLfn = lfnShortName(ldir, scanSfn);
+        scanChksum = ldir->chksum;
+      }
+#endif  // FAT_DIR_CACHE_ENTRIES
       if (!lfnOrd) {
         if ((ldir->ord & LDIR_ORD_LAST_LONG_ENTRY) == 0) {
           continue;
@@ -374,6 +437,13 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
         }
       }
     } else if (DIR_IS_FILE_OR_SUBDIR(dir)) {
+      dirFile->m_vol->dirScanName(dir->name);
+#if FAT_DIR_CACHE_ENTRIES
+      if (scanLfn && scanChksum == lfnChecksum(dir->name)) {
+        dirFile->m_vol->dirScanName(scanSfn);
+      }
+      scanLfn = false;
+#endif  // FAT_DIR_CACHE_ENTRIES
       if (lfnOrd) {
         if (1 == ord && lfnChecksum(dir->name) == chksum) {
           goto found;
@@ -398,6 +468,10 @@ found:
     DBG_FAIL_MACRO;
     goto fail;
   }
+  if (!memcmp(dir->name, fname->sfn, sizeof(fname->sfn))) {
+    dirFile->m_vol->dirCacheAdd(dirFile->m_firstCluster, dir->name,
+                                curIndex, lfnOrd);
+  }
   goto open;
 
 create:
@@ -487,6 +561,8 @@ create:
 
   // Force write of entry to device.
   dirFile->m_vol->cacheDirty();
+  dirFile->m_vol->dirCacheAdd(dirFile->m_firstCluster, dir->name,
+                              curIndex, lfnOrd);
 
 open:
   // open entry in cache.
@@ -579,6 +655,7 @@ bool FatFile::remove() {
 
   // Mark entry deleted.
   dir->name[0] = DIR_NAME_DELETED;
+  m_vol->dirCacheRemove(m_dirCluster, m_dirIndex, m_firstCluster);
 
   // Set this file closed.
   m_attr = FILE_ATTR_CLOSED;
@@ -120,20 +120,57 @@ bool FatFile::parsePathName(const char* path, fname_t* fname,
 fail:
   return false;
 }
+#endif  // !USE_LONG_FILE_NAMES
 //------------------------------------------------------------------------------
-// open with filename in fname
-#define SFN_OPEN_USES_CHKSUM 0
-bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
+// open with an 8.3 name in fname, also for 8.3 names with long file names
+#define SFN_OPEN_USES_CHKSUM USE_LONG_FILE_NAMES
+bool FatFile::openSFN(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
   bool emptyFound = false;
 #if SFN_OPEN_USES_CHKSUM
-  uint8_t chksum;
-#endif
+  uint8_t chksum = 0;
+  uint8_t lfnSfn[11];
+  bool lfn83 = false;
+#endif  // SFN_OPEN_USES_CHKSUM
   uint8_t lfnOrd = 0;
   uint16_t emptyIndex;
   uint16_t index = 0;
   dir_t* dir;
   ldir_t* ldir;
 
+  // Name known in the directory cache, or known to be absent.
+  if (dirFile->m_vol->dirCacheFind(dirFile->m_firstCluster, fname->sfn,
+                                   &index, &lfnOrd)) {
+    if (dirFile->seekSet(32UL*index)) {
+      dir = dirFile->readDirCache();
+      if (dir && DIR_IS_FILE_OR_SUBDIR(dir) &&
+          !memcmp(fname->sfn, dir->name, 11)) {
+        goto found;
+      }
+    }
+    lfnOrd = 0;
+  }
+  if (dirFile->m_vol->dirScanAbsent(dirFile->m_firstCluster, fname->sfn,
+                                    &index)) {
+    if (!(oflag & O_CREAT) || !isWriteMode(oflag)) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+    // Free entries or EOF from the end of the directory on.
+    if (index != 0XFFFF && dirFile->seekSet(32UL*index)) {
+      dir = dirFile->readDirCache();
+      if (!dir && !dirFile->getError()) {
+        // At EOF, add a cluster.
+        goto create;
+      }
+      if (dir && dir->name[0] == DIR_NAME_FREE) {
+        emptyIndex = index;
+        emptyFound = true;
+        goto create;
+      }
+    }
+  }
+  dirFile->m_vol->dirScanBegin(dirFile->m_firstCluster);
+  index = 0;
   dirFile->rewind();
   while (1) {
     if (!emptyFound) {
@@ -155,33 +192,32 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
     if (dir->name[0] == DIR_NAME_DELETED) {
       lfnOrd = 0;
       emptyFound = true;
+      dirFile->m_vol->dirScanHole();
     } else if (DIR_IS_FILE_OR_SUBDIR(dir)) {
-      if (!memcmp(fname->sfn, dir->name, 11)) {
-        // don't open existing file if O_EXCL
-        if (oflag & O_EXCL) {
-          DBG_FAIL_MACRO;
-          goto fail;
-        }
+      dirFile->m_vol->dirScanName(dir->name);
 #if SFN_OPEN_USES_CHKSUM
-        if (lfnOrd && chksum != lfnChecksum(dir->name)) {
-          DBG_FAIL_MACRO;
-          goto fail;
+      if (lfnOrd && chksum != lfnChecksum(dir->name)) {
+        lfnOrd = 0;
+      }
+      if (lfnOrd == 1 && lfn83) {
+        // An 8.3 long name matches its short name, whatever the entry.
+        dirFile->m_vol->dirScanName(lfnSfn);
+        if (!memcmp(fname->sfn, lfnSfn, 11)) {
+          goto found;
         }
+      }
 #endif  // SFN_OPEN_USES_CHKSUM
-        if (!openCachedEntry(dirFile, index, oflag, lfnOrd)) {
-          DBG_FAIL_MACRO;
-          goto fail;
-        }
-        return true;
-      } else {
-        lfnOrd = 0;
+      if (!memcmp(fname->sfn, dir->name, 11)) {
+        goto found;
       }
+      lfnOrd = 0;
     } else if (DIR_IS_LONG_NAME(dir)) {
       ldir = reinterpret_cast<ldir_t*>(dir);
       if (ldir->ord & LDIR_ORD_LAST_LONG_ENTRY) {
         lfnOrd = ldir->ord & 0X1F;
 #if SFN_OPEN_USES_CHKSUM
         chksum = ldir->chksum;
+        lfn83 = lfnShortName(ldir, lfnSfn);
 #endif  // SFN_OPEN_USES_CHKSUM
       }
     } else {
@@ -189,6 +225,9 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
     }
     index++;
   }
+  dirFile->m_vol->dirScanEnd(index, fname->sfn);
+
+create:
   // don't create unless O_CREAT and write mode
   if (!(oflag & O_CREAT) || !isWriteMode(oflag)) {
     DBG_FAIL_MACRO;
@@ -233,13 +272,35 @@ bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
 
   // Force write of entry to device.
   dirFile->m_vol->cacheDirty();
+  dirFile->m_vol->dirCacheAdd(dirFile->m_firstCluster, dir->name, index, 0);
 
   // open entry in cache.
   return openCachedEntry(dirFile, index, oflag, 0);
 
+found:
+  // don't open existing file if O_EXCL
+  if (oflag & O_EXCL) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  if (!memcmp(fname->sfn, dir->name, 11)) {
+    dirFile->m_vol->dirCacheAdd(dirFile->m_firstCluster, fname->sfn,
+                                index, lfnOrd);
+  }
+  if (!openCachedEntry(dirFile, index, oflag, lfnOrd)) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  return true;
+
 fail:
   return false;
 }
+#if !USE_LONG_FILE_NAMES
+//------------------------------------------------------------------------------
+bool FatFile::open(FatFile* dirFile, fname_t* fname, oflag_t oflag) {
+  return openSFN(dirFile, fname, oflag);
+}
 //------------------------------------------------------------------------------
 size_t FatFile::printName(print_t* pr) {
   return printSFN(pr);
@@ -265,6 +326,7 @@ bool FatFile::remove() {
   }
   // Mark entry deleted.
   dir->name[0] = DIR_NAME_DELETED;
+  m_vol->dirCacheRemove(m_dirCluster, m_dirIndex, m_firstCluster);
 
   // Set this file closed.
   m_attr = FILE_ATTR_CLOSED;
@@ -84,6 +84,49 @@
 #endif  // RAMEND
 #endif  // USE_MULTI_BLOCK_IO
 //------------------------------------------------------------------------------
+/**
+ * Number of 512 byte blocks in each block cache.  Blocks are replaced
+ * least recently used first.
+ */
+#ifndef FAT_CACHE_BLOCKS
+#define FAT_CACHE_BLOCKS 1
+#endif  // FAT_CACHE_BLOCKS
+/**
+ * Number of blocks read by one command on a sequential cache miss.
+ * One disables read-ahead.
+ */
+#ifndef FAT_CACHE_READ_AHEAD
+#define FAT_CACHE_READ_AHEAD 1
+#endif  // FAT_CACHE_READ_AHEAD
+/**
+ * Set FAT_CACHE_WRITE_BEHIND nonzero to delay the write of full blocks
+ * until they are replaced or synced.
+ */
+#ifndef FAT_CACHE_WRITE_BEHIND
+#define FAT_CACHE_WRITE_BEHIND 0
+#endif  // FAT_CACHE_WRITE_BEHIND
+/**
+ * Size in bytes of the map of cluster groups with free clusters, zero for
+ * none.  Requires MAINTAIN_FREE_CLUSTER_COUNT.
+ */
+#ifndef FAT_FREE_MAP_BYTES
+#define FAT_FREE_MAP_BYTES 0
+#endif  // FAT_FREE_MAP_BYTES
+/**
+ * Number of entries of the cache of short names to directory entries, zero
+ * for none.
+ */
+#ifndef FAT_DIR_CACHE_ENTRIES
+#define FAT_DIR_CACHE_ENTRIES 0
+#endif  // FAT_DIR_CACHE_ENTRIES
+/**
+ * Hash bits of the short names of the last directory scanned, a multiple
+ * of eight.
+ */
+#ifndef FAT_DIR_SCAN_BITS
+#define FAT_DIR_SCAN_BITS 512
+#endif  // FAT_DIR_SCAN_BITS
+//------------------------------------------------------------------------------
 /**
  * Set MAINTAIN_FREE_CLUSTER_COUNT nonzero to keep the count of free clusters
  * updated.  This will increase the speed of the freeClusterCount() call
@@ -134,7 +177,9 @@
 /**
  *  Enable Extra features for Arduino.
  */
-// #define ENABLE_ARDUINO_FEATURES 0  ////////////////////////FIX THIS /////////////////
+// The Arduino File class clashes with the one of SD.h, which is pulled in
+// by the Audio library (AudioPlaySdWav). Only the FatFile API is used.
+#define ENABLE_ARDUINO_FEATURES 0
 #ifndef ENABLE_ARDUINO_FEATURES
 #include <Arduino.h>
 #if defined(ARDUINO) || defined(PLATFORM_ID) || defined(DOXYGEN)
@@ -25,44 +25,140 @@
 #include <string.h>
 #include "FatVolume.h"
 //------------------------------------------------------------------------------
-cache_t* FatCache::read(uint32_t lbn, uint8_t option) {
-  if (m_lbn != lbn) {
-    if (!sync()) {
+// Load a missing block in the least recently used way.  A miss on the block
+// that follows the last one loaded reads ahead up to m_readAhead blocks with
+// a single command, into the adjacent ways holding the oldest blocks.
+int8_t FatCache::fill(uint32_t lbn, uint8_t option) {
+  uint8_t i = 0;
+  uint8_t n = 1;
+#if USE_MULTI_BLOCK_IO
+  if (lbn == m_seqLbn + 1 && !(option & CACHE_OPTION_NO_READ)
+      && m_readAhead > 1) {
+    uint32_t end = m_vol->m_dataStartBlock
+                   + (m_vol->clusterCount() << m_vol->m_clusterSizeShift);
+    uint32_t age = 0XFFFFFFFF;
+    n = m_readAhead < m_ways ? m_readAhead : m_ways;
+    for (uint8_t w = 0; w + n <= m_ways; w++) {
+      uint32_t newest = 0;
+      for (uint8_t k = w; k < w + n; k++) {
+        if (m_used[k] > newest) {
+          newest = m_used[k];
+        }
+      }
+      if (newest < age) {
+        age = newest;
+        i = w;
+      }
+    }
+    // Stop before the end of the volume or a block already cached.
+    uint8_t k = 1;
+    while (k < n && lbn + k < end && find(lbn + k) < 0) {
+      k++;
+    }
+    n = k;
+  }
+#endif  // USE_MULTI_BLOCK_IO
+  if (n == 1) {
+    i = 0;
+    for (uint8_t k = 1; k < m_ways; k++) {
+      if (m_used[k] < m_used[i]) {
+        i = k;
+      }
+    }
+  }
+  for (uint8_t k = i; k < i + n; k++) {
+    if (!syncWay(k)) {
       DBG_FAIL_MACRO;
       goto fail;
     }
-    if (!(option & CACHE_OPTION_NO_READ)) {
-      if (!m_vol->readBlock(lbn, m_block.data)) {
-        DBG_FAIL_MACRO;
-        goto fail;
-      }
+  }
+  if (!(option & CACHE_OPTION_NO_READ)) {
+#if USE_MULTI_BLOCK_IO
+    bool rtn = n > 1 ? m_vol->readBlocks(lbn, m_block[i].data, n)
+                     : m_vol->readBlock(lbn, m_block[i].data);
+#else  // USE_MULTI_BLOCK_IO
+    bool rtn = m_vol->readBlock(lbn, m_block[i].data);
+#endif  // USE_MULTI_BLOCK_IO
+    if (!rtn) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+  }
+  for (uint8_t k = 0; k < n; k++) {
+    m_status[i + k] = 0;
+    m_lbn[i + k] = lbn + k;
+    m_used[i + k] = ++m_tick;
+  }
+  m_seqLbn = lbn + n - 1;
+  return i;
+
+fail:
+  return -1;
+}
+//------------------------------------------------------------------------------
+void FatCache::invalidate(uint32_t lbn, uint32_t nb) {
+  for (uint8_t i = 0; i < m_ways; i++) {
+    if (m_lbn[i] - lbn < nb) {
+      m_status[i] = 0;
+      m_lbn[i] = 0XFFFFFFFF;
+      m_used[i] = 0;
+    }
+  }
+}
+//------------------------------------------------------------------------------
+cache_t* FatCache::read(uint32_t lbn, uint8_t option) {
+  int8_t i = find(lbn);
+  if (i < 0) {
+    i = fill(lbn, option);
+    if (i < 0) {
+      DBG_FAIL_MACRO;
+      goto fail;
     }
-    m_status = 0;
-    m_lbn = lbn;
   }
-  m_status |= option & CACHE_STATUS_MASK;
-  return &m_block;
+  m_cur = i;
+  m_used[i] = ++m_tick;
+  m_status[i] |= option & CACHE_STATUS_MASK;
+  return &m_block[i];
 
 fail:
 
   return 0;
 }
 //------------------------------------------------------------------------------
+bool FatCache::setup(uint8_t ways, uint8_t readAhead, bool writeBehind) {
+  if (!sync()) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  m_ways = ways < 1 ? 1 : ways > FAT_CACHE_BLOCKS ? FAT_CACHE_BLOCKS : ways;
+  m_readAhead = readAhead < 1 ? 1 : readAhead;
+  m_writeBehind = writeBehind;
+  invalidate();
+  return true;
+
+fail:
+  return false;
+}
+//------------------------------------------------------------------------------
 bool FatCache::sync() {
-  if (m_status & CACHE_STATUS_DIRTY) {
-    if (!m_vol->writeBlock(m_lbn, m_block.data)) {
+  for (uint8_t i = 0; i < m_ways; i++) {
+    if (!syncWay(i)) {
       DBG_FAIL_MACRO;
       goto fail;
     }
-    // mirror second FAT
-    if (m_status & CACHE_STATUS_MIRROR_FAT) {
-      uint32_t lbn = m_lbn + m_vol->blocksPerFat();
-      if (!m_vol->writeBlock(lbn, m_block.data)) {
-        DBG_FAIL_MACRO;
-        goto fail;
-      }
+  }
+  return true;
+
+fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+bool FatCache::sync(uint32_t lbn, uint32_t nb) {
+  for (uint8_t i = 0; i < m_ways; i++) {
+    if (m_lbn[i] - lbn < nb && !syncWay(i)) {
+      DBG_FAIL_MACRO;
+      goto fail;
     }
-    m_status &= ~CACHE_STATUS_DIRTY;
   }
   return true;
 
@@ -70,15 +166,69 @@ fail:
   return false;
 }
 //------------------------------------------------------------------------------
+// Write a dirty way.  With write-behind, the adjacent dirty ways that hold
+// the blocks just before and after it are written by the same command.
+bool FatCache::syncWay(uint8_t i) {
+  uint8_t first = i;
+  uint8_t last = i;
+  uint8_t status = m_status[i];
+  uint32_t lbn;
+  if (!(status & CACHE_STATUS_DIRTY)) {
+    return true;
+  }
+#if USE_MULTI_BLOCK_IO
+  while (m_writeBehind && first > 0 && m_status[first - 1] == status
+         && m_lbn[first - 1] + 1 == m_lbn[first]) {
+    first--;
+  }
+  while (m_writeBehind && last + 1 < m_ways && m_status[last + 1] == status
+         && m_lbn[last] + 1 == m_lbn[last + 1]) {
+    last++;
+  }
+#endif  // USE_MULTI_BLOCK_IO
+  if (!writeWays(m_lbn[first], first, last - first + 1)) {
+    DBG_FAIL_MACRO;
+    goto fail;
+  }
+  // mirror second FAT
+  if (status & CACHE_STATUS_MIRROR_FAT) {
+    lbn = m_lbn[first] + m_vol->blocksPerFat();
+    if (!writeWays(lbn, first, last - first + 1)) {
+      DBG_FAIL_MACRO;
+      goto fail;
+    }
+  }
+  for (uint8_t k = first; k <= last; k++) {
+    m_status[k] &= ~CACHE_STATUS_DIRTY;
+  }
+  return true;
+
+fail:
+  return false;
+}
+//------------------------------------------------------------------------------
+bool FatCache::writeWays(uint32_t lbn, uint8_t i, uint8_t nb) {
+#if USE_MULTI_BLOCK_IO
+  if (nb > 1) {
+    return m_vol->writeBlocks(lbn, m_block[i].data, nb);
+  }
+#endif  // USE_MULTI_BLOCK_IO
+  return m_vol->writeBlock(lbn, m_block[i].data);
+}
+//------------------------------------------------------------------------------
 bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
   uint32_t find;
+  // All clusters from usedFrom to find are in use.
+  uint32_t usedFrom;
   bool setStart;
   if (m_allocSearchStart < current) {
     // Try to keep file contiguous. Start just after current cluster.
     find = current;
+    usedFrom = current + 1;
     setStart = false;
   } else {
     find = m_allocSearchStart;
+    usedFrom = 0;
     setStart = true;
   }
   while (1) {
@@ -90,6 +240,7 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
         goto fail;
       }
       find = m_allocSearchStart;
+      usedFrom = 0;
       setStart = true;
       continue;
     }
@@ -98,6 +249,12 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
       DBG_FAIL_MACRO;
       goto fail;
     }
+    uint32_t end = freeMapGroupEnd(find);
+    if (!freeMapTest(find)) {
+      // No free cluster in this group, skip it but stop at current.
+      find = find < current && current <= end ? current - 1 : end;
+      continue;
+    }
     uint32_t f;
     int8_t fg = fatGet(find, &f);
     if (fg < 0) {
@@ -107,6 +264,10 @@ bool FatVolume::allocateCluster(uint32_t current, uint32_t* next) {
     if (fg && f == 0) {
       break;
     }
+    if (find == end && usedFrom <= freeMapGroupStart(find)) {
+      // Whole group checked, it is full.
+      freeMapClear(find);
+    }
   }
   if (setStart) {
     m_allocSearchStart = find;
@@ -149,6 +310,14 @@ bool FatVolume::allocContiguous(uint32_t count, uint32_t* firstCluster) {
       DBG_FAIL_MACRO;
       goto fail;
     }
+    if (!freeMapTest(endCluster)) {
+      // No free cluster in this group, restart the group after it.
+      if (bgnCluster != endCluster) {
+        setStart = false;
+      }
+      endCluster = bgnCluster = freeMapGroupEnd(endCluster) + 1;
+      continue;
+    }
     uint32_t f;
     int8_t fg = fatGet(endCluster, &f);
     if (fg < 0) {
@@ -280,6 +449,9 @@ bool FatVolume::fatPut(uint32_t cluster, uint32_t value) {
     DBG_FAIL_MACRO;
     goto fail;
   }
+  if (value == 0) {
+    freeMapSet(cluster);
+  }
 
   if (fatType() == 32) {
     lba = m_fatStartBlock + (cluster >> 7);
@@ -383,7 +555,20 @@ int32_t FatVolume::freeClusterCount() {
   uint32_t free = 0;
   uint32_t lba;
   uint32_t todo = m_lastCluster + 1;
+  uint32_t cluster = 0;
   uint16_t n;
+  uint8_t shift = 0XFF;
+#if FAT_FREE_MAP_BYTES
+  // Build the free cluster map along the count.
+  m_freeMapShift = 0XFF;
+  if (m_freeMapOn) {
+    shift = 0;
+    while ((m_lastCluster >> shift) >= 8UL*FAT_FREE_MAP_BYTES) {
+      shift++;
+    }
+    memset(m_freeMap, 0, sizeof(m_freeMap));
+  }
+#endif  // FAT_FREE_MAP_BYTES
 
   if (FAT12_SUPPORT && fatType() == 12) {
     for (unsigned i = 2; i < todo; i++) {
@@ -395,6 +580,7 @@ int32_t FatVolume::freeClusterCount() {
       }
       if (fg && c == 0) {
         free++;
+        freeMapMark(i, shift);
       }
     }
   } else if (fatType() == 16 || fatType() == 32) {
@@ -413,15 +599,18 @@ int32_t FatVolume::freeClusterCount() {
         for (uint16_t i = 0; i < n; i++) {
           if (pc->fat16[i] == 0) {
             free++;
+            freeMapMark(cluster + i, shift);
           }
         }
       } else {
         for (uint16_t i = 0; i < n; i++) {
           if (pc->fat32[i] == 0) {
             free++;
+            freeMapMark(cluster + i, shift);
           }
         }
       }
+      cluster += n;
       todo -= n;
     }
   } else {
@@ -430,11 +619,127 @@ int32_t FatVolume::freeClusterCount() {
     goto fail;
   }
   setFreeClusterCount(free);
+#if FAT_FREE_MAP_BYTES
+  m_freeMapShift = shift;
+#endif  // FAT_FREE_MAP_BYTES
   return free;
 
 fail:
   return -1;
 }
+#if FAT_DIR_CACHE_ENTRIES
+//------------------------------------------------------------------------------
+uint16_t FatVolume::dirCacheHash(uint32_t dirCluster, const uint8_t* sfn) {
+  // FNV-1a of the directory cluster and the short name.
+  uint32_t h = 2166136261UL ^ dirCluster;
+  for (uint8_t i = 0; i < 11; i++) {
+    h = (h ^ sfn[i])*16777619UL;
+  }
+  return h ^ (h >> 16);
+}
+//------------------------------------------------------------------------------
+void FatVolume::dirCacheAdd(uint32_t dirCluster, const uint8_t* sfn,
+                            uint16_t dirIndex, uint8_t lfnOrd) {
+  uint16_t h = dirCacheHash(dirCluster, sfn);
+  DirCacheEntry* e = &m_dirCache[h % FAT_DIR_CACHE_ENTRIES];
+  if (!m_dirCacheOn) {
+    return;
+  }
+  e->dirCluster = dirCluster;
+  e->dirIndex = dirIndex;
+  e->lfnOrd = lfnOrd;
+  memcpy(e->sfn, sfn, 11);
+  // Keep the names of the last directory scanned complete.
+  if (m_dirScanState == DIR_SCAN_DONE && m_dirScanCluster == dirCluster) {
+    if (m_dirMissValid && !memcmp(m_dirMissSfn, sfn, 11)) {
+      m_dirMissValid = false;
+    }
+    h %= FAT_DIR_SCAN_BITS;
+    m_dirScanNames[h >> 3] |= 1 << (h & 7);
+    if (dirIndex >= m_dirScanEnd) {
+      m_dirScanEnd = dirIndex + 1;
+    }
+  }
+}
+//------------------------------------------------------------------------------
+bool FatVolume::dirCacheFind(uint32_t dirCluster, const uint8_t* sfn,
+                             uint16_t* dirIndex, uint8_t* lfnOrd) {
+  DirCacheEntry* e =
+    &m_dirCache[dirCacheHash(dirCluster, sfn) % FAT_DIR_CACHE_ENTRIES];
+  if (!m_dirCacheOn || e->dirIndex == 0XFFFF ||
+      e->dirCluster != dirCluster || memcmp(e->sfn, sfn, 11)) {
+    return false;
+  }
+  *dirIndex = e->dirIndex;
+  *lfnOrd = e->lfnOrd;
+  return true;
+}
+//------------------------------------------------------------------------------
+void FatVolume::dirCacheInit() {
+  for (uint16_t i = 0; i < FAT_DIR_CACHE_ENTRIES; i++) {
+    m_dirCache[i].dirIndex = 0XFFFF;
+  }
+  m_dirScanState = DIR_SCAN_NONE;
+}
+//------------------------------------------------------------------------------
+void FatVolume::dirCacheRemove(uint32_t dirCluster, uint16_t dirIndex,
+                               uint32_t firstCluster) {
+  // Drop the entry and, for a directory, the names it contains.
+  for (uint16_t i = 0; i < FAT_DIR_CACHE_ENTRIES; i++) {
+    DirCacheEntry* e = &m_dirCache[i];
+    if ((e->dirCluster == dirCluster && e->dirIndex == dirIndex) ||
+        (firstCluster && e->dirCluster == firstCluster)) {
+      e->dirIndex = 0XFFFF;
+    }
+  }
+  if (firstCluster && m_dirScanCluster == firstCluster) {
+    m_dirScanState = DIR_SCAN_NONE;
+  } else if (m_dirScanCluster == dirCluster) {
+    // The name may stay in the hash bits, the deleted entry is reused.
+    m_dirScanHoles = true;
+  }
+}
+//------------------------------------------------------------------------------
+bool FatVolume::dirScanAbsent(uint32_t dirCluster, const uint8_t* sfn,
+                              uint16_t* end) {
+  uint16_t b;
+  if (m_dirScanState != DIR_SCAN_DONE || m_dirScanCluster != dirCluster) {
+    return false;
+  }
+  b = dirCacheHash(dirCluster, sfn) % FAT_DIR_SCAN_BITS;
+  if ((m_dirScanNames[b >> 3] & (1 << (b & 7))) &&
+      !(m_dirMissValid && !memcmp(m_dirMissSfn, sfn, 11))) {
+    return false;
+  }
+  *end = m_dirScanHoles ? 0XFFFF : m_dirScanEnd;
+  return true;
+}
+//------------------------------------------------------------------------------
+void FatVolume::dirScanBegin(uint32_t dirCluster) {
+  if (!m_dirCacheOn) {
+    return;
+  }
+  if (m_dirScanState != DIR_SCAN_DONE || m_dirScanCluster != dirCluster) {
+    m_dirScanState = DIR_SCAN_BUILD;
+    m_dirScanCluster = dirCluster;
+    m_dirScanHoles = false;
+    m_dirMissValid = false;
+    memset(m_dirScanNames, 0, sizeof(m_dirScanNames));
+  }
+}
+//------------------------------------------------------------------------------
+void FatVolume::dirScanEnd(uint16_t end, const uint8_t* sfn) {
+  if (m_dirScanState == DIR_SCAN_BUILD) {
+    m_dirScanState = DIR_SCAN_DONE;
+    m_dirScanEnd = end;
+  }
+  // Full scan without a match, sfn is absent.
+  if (m_dirScanState == DIR_SCAN_DONE && sfn) {
+    memcpy(m_dirMissSfn, sfn, 11);
+    m_dirMissValid = true;
+  }
+}
+#endif  // FAT_DIR_CACHE_ENTRIES
 //------------------------------------------------------------------------------
 bool FatVolume::init(uint8_t part) {
   uint32_t clusterCount;
@@ -445,6 +750,10 @@ bool FatVolume::init(uint8_t part) {
   uint8_t tmp;
   m_fatType = 0;
   m_allocSearchStart = 1;
+#if FAT_FREE_MAP_BYTES
+  m_freeMapShift = 0XFF;
+#endif  // FAT_FREE_MAP_BYTES
+  dirCacheInit();
   m_cache.init(this);
 #if USE_SEPARATE_FAT_CACHE
   m_fatCache.init(this);
@@ -530,6 +839,13 @@ bool FatVolume::init(uint8_t part) {
     m_rootDirStart = fbs->fat32RootCluster;
     m_fatType = 32;
   }
+#if FAT_FREE_MAP_BYTES
+  // One FAT scan builds the free cluster map and count.  Without them
+  // clusters are still allocated by reading the FAT.
+  if (m_freeMapOn) {
+    freeClusterCount();
+  }
+#endif  // FAT_FREE_MAP_BYTES
   return true;
 
 fail:
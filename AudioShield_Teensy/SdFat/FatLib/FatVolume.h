@@ -92,6 +92,10 @@ union cache_t {
 /**
  * \class FatCache
  * \brief Block cache.
+ *
+ * The cache holds up to FAT_CACHE_BLOCKS blocks replaced least recently
+ * used first.  The last block read is the current block: block(), dirty(),
+ * isDirty() and lbn() act on it as with a single block cache.
  */
 class FatCache {
  public:
@@ -113,47 +117,102 @@ class FatCache {
     = CACHE_STATUS_DIRTY | CACHE_OPTION_NO_READ;
   /** \return Cache block address. */
   cache_t* block() {
-    return &m_block;
+    return &m_block[m_cur];
+  }
+  /** \return true if the block is in the cache.
+   * \param[in] lbn Block to look for.
+   */
+  bool contains(uint32_t lbn) {
+    return find(lbn) >= 0;
   }
   /** Set current block dirty. */
   void dirty() {
-    m_status |= CACHE_STATUS_DIRTY;
+    m_status[m_cur] |= CACHE_STATUS_DIRTY;
   }
   /** Initialize the cache.
    * \param[in] vol FatVolume that owns this FatCache.
    */
   void init(FatVolume *vol) {
     m_vol = vol;
+    m_ways = FAT_CACHE_BLOCKS;
+    m_readAhead = FAT_CACHE_READ_AHEAD;
+    m_writeBehind = FAT_CACHE_WRITE_BEHIND;
     invalidate();
   }
-  /** Invalidate current cache block. */
+  /** Invalidate all cache blocks. */
   void invalidate() {
-    m_status = 0;
-    m_lbn = 0XFFFFFFFF;
+    for (uint8_t i = 0; i < FAT_CACHE_BLOCKS; i++) {
+      m_status[i] = 0;
+      m_lbn[i] = 0XFFFFFFFF;
+      m_used[i] = 0;
+    }
+    m_cur = 0;
+    m_seqLbn = 0XFFFFFFFF;
+    m_tick = 0;
   }
+  /** Invalidate cached blocks in a range, dirty or not.
+   * \param[in] lbn First block of the range.
+   * \param[in] nb Number of blocks in the range.
+   */
+  void invalidate(uint32_t lbn, uint32_t nb);
   /** \return dirty status */
   bool isDirty() {
-    return m_status & CACHE_STATUS_DIRTY;
+    return m_status[m_cur] & CACHE_STATUS_DIRTY;
   }
   /** \return Logical block number for cached block. */
   uint32_t lbn() {
-    return m_lbn;
+    return m_lbn[m_cur];
   }
   /** Read a block into the cache.
    * \param[in] lbn Block to read.
    * \param[in] option mode for cached block.
    * \return Address of cached block. */
   cache_t* read(uint32_t lbn, uint8_t option);
-  /** Write current block if dirty.
+  /** Change the cache geometry.  Dirty blocks are written first.
+   * \param[in] ways Number of blocks used, at most FAT_CACHE_BLOCKS.
+   * \param[in] readAhead Blocks read on a sequential miss, one for none.
+   * \param[in] writeBehind Delay the write of full blocks.
+   * \return true for success else false.
+   */
+  bool setup(uint8_t ways, uint8_t readAhead, bool writeBehind);
+  /** Write all dirty blocks.
    * \return true for success else false.
    */
   bool sync();
+  /** Write dirty blocks in a range.
+   * \param[in] lbn First block of the range.
+   * \param[in] nb Number of blocks in the range.
+   * \return true for success else false.
+   */
+  bool sync(uint32_t lbn, uint32_t nb);
+  /** \return true if full blocks are left dirty in the cache. */
+  bool writeBehind() {
+    return m_writeBehind;
+  }
 
  private:
-  uint8_t m_status;
+  int8_t find(uint32_t lbn) {
+    for (uint8_t i = 0; i < m_ways; i++) {
+      if (m_lbn[i] == lbn) {
+        return i;
+      }
+    }
+    return -1;
+  }
+  int8_t fill(uint32_t lbn, uint8_t option);
+  bool syncWay(uint8_t i);
+  bool writeWays(uint32_t lbn, uint8_t i, uint8_t nb);
+  uint8_t m_cur;
+  uint8_t m_ways;
+  uint8_t m_readAhead;
+  bool m_writeBehind;
+  uint8_t m_status[FAT_CACHE_BLOCKS];
   FatVolume* m_vol;
-  uint32_t m_lbn;
-  cache_t m_block;
+  uint32_t m_seqLbn;
+  uint32_t m_tick;
+  uint32_t m_lbn[FAT_CACHE_BLOCKS];
+  uint32_t m_used[FAT_CACHE_BLOCKS];
+  cache_t m_block[FAT_CACHE_BLOCKS];
 };
 //==============================================================================
 /**
@@ -164,7 +223,14 @@ class FatVolume {
  public:
   /** Create an instance of FatVolume
    */
-  FatVolume() : m_fatType(0) {}
+  FatVolume() : m_fatType(0) {
+#if FAT_FREE_MAP_BYTES
+    m_freeMapOn = true;
+#endif  // FAT_FREE_MAP_BYTES
+#if FAT_DIR_CACHE_ENTRIES
+    m_dirCacheOn = true;
+#endif  // FAT_DIR_CACHE_ENTRIES
+  }
 
   /** \return The volume's cluster size in blocks. */
   uint8_t blocksPerCluster() const {
@@ -184,6 +250,33 @@ class FatVolume {
     m_cache.invalidate();
     return m_cache.block();
   }
+  /** Invalidate cached copies of blocks about to be written directly to
+   * the block device, bypassing the volume.  Not for normal apps.
+   * \param[in] lbn First block of the range.
+   * \param[in] nb Number of blocks in the range.
+   */
+  void cacheInvalidate(uint32_t lbn, uint32_t nb) {
+    m_cache.invalidate(lbn, nb);
+#if USE_SEPARATE_FAT_CACHE
+    m_fatCache.invalidate(lbn, nb);
+#endif  // USE_SEPARATE_FAT_CACHE
+  }
+  /** Change the geometry of the block caches.  Dirty blocks are written
+   * first.
+   *
+   * \param[in] blocks Number of blocks in each cache, at most
+   * FAT_CACHE_BLOCKS.
+   * \param[in] readAhead Number of blocks read on a sequential cache miss.
+   * \param[in] writeBehind Delay the write of full data blocks.
+   * \return true for success else false.
+   */
+  bool cacheSetup(uint8_t blocks, uint8_t readAhead, bool writeBehind) {
+    return m_cache.setup(blocks, readAhead, writeBehind)
+#if USE_SEPARATE_FAT_CACHE
+           && m_fatCache.setup(blocks, readAhead, writeBehind)
+#endif  // USE_SEPARATE_FAT_CACHE
+           && syncBlocks();
+  }
   /** \return The total number of clusters in the volume. */
   uint32_t clusterCount() const {
     return m_lastCluster - 1;
@@ -213,6 +306,32 @@ class FatVolume {
    * \return Count of free clusters for success or -1 if an error occurs.
    */
   int32_t freeClusterCount();
+#if FAT_FREE_MAP_BYTES
+  /** Use the free cluster map, see FAT_FREE_MAP_BYTES.  The map is on by
+   * default and built at mount.  Without the map clusters are allocated by
+   * reading the FAT from the start of the search.
+   *
+   * \param[in] on Build the map now and at each mount.
+   * \return true for success else false.
+   */
+  bool freeMapSetup(bool on) {
+    m_freeMapOn = on;
+    m_freeMapShift = 0XFF;
+    setFreeClusterCount(-1);
+    return !on || freeClusterCount() >= 0;
+  }
+#endif  // FAT_FREE_MAP_BYTES
+#if FAT_DIR_CACHE_ENTRIES
+  /** Use the directory cache, see FAT_DIR_CACHE_ENTRIES.  The cache is on
+   * by default.  Without it every open scans the directory.
+   *
+   * \param[in] on Use the cache.
+   */
+  void dirCacheSetup(bool on) {
+    m_dirCacheOn = on;
+    dirCacheInit();
+  }
+#endif  // FAT_DIR_CACHE_ENTRIES
   /** Initialize a FAT volume.  Try partition one first then try super
    * floppy format.
    *
@@ -316,6 +435,158 @@ class FatVolume {
     (void)change;
   }
 #endif  // MAINTAIN_FREE_CLUSTER_COUNT
+#if FAT_FREE_MAP_BYTES
+#if !MAINTAIN_FREE_CLUSTER_COUNT
+#error FAT_FREE_MAP_BYTES requires MAINTAIN_FREE_CLUSTER_COUNT
+#endif  // MAINTAIN_FREE_CLUSTER_COUNT
+  // Bit set for each group of 1 << m_freeMapShift clusters that may have
+  // a free cluster, clear if the group is full.
+  uint8_t m_freeMap[FAT_FREE_MAP_BYTES];
+  uint8_t m_freeMapShift;          // Group size shift, 0XFF if no map.
+  bool m_freeMapOn;                // Build the map at mount.
+  void freeMapClear(uint32_t cluster) {
+    if (m_freeMapShift != 0XFF) {
+      uint32_t g = cluster >> m_freeMapShift;
+      m_freeMap[g >> 3] &= ~(1 << (g & 7));
+    }
+  }
+  uint32_t freeMapGroupEnd(uint32_t cluster) {
+    if (m_freeMapShift == 0XFF) {
+      return cluster;
+    }
+    return cluster | ((1UL << m_freeMapShift) - 1);
+  }
+  uint32_t freeMapGroupStart(uint32_t cluster) {
+    if (m_freeMapShift == 0XFF) {
+      return cluster;
+    }
+    return cluster & ~((1UL << m_freeMapShift) - 1);
+  }
+  void freeMapMark(uint32_t cluster, uint8_t shift) {
+    if (shift != 0XFF) {
+      uint32_t g = cluster >> shift;
+      m_freeMap[g >> 3] |= 1 << (g & 7);
+    }
+  }
+  void freeMapSet(uint32_t cluster) {
+    freeMapMark(cluster, m_freeMapShift);
+  }
+  bool freeMapTest(uint32_t cluster) {
+    if (m_freeMapShift == 0XFF) {
+      return true;
+    }
+    uint32_t g = cluster >> m_freeMapShift;
+    return m_freeMap[g >> 3] & (1 << (g & 7));
+  }
+#else  // FAT_FREE_MAP_BYTES
+  void freeMapClear(uint32_t cluster) {
+    (void)cluster;
+  }
+  uint32_t freeMapGroupEnd(uint32_t cluster) {
+    return cluster;
+  }
+  uint32_t freeMapGroupStart(uint32_t cluster) {
+    return cluster;
+  }
+  void freeMapMark(uint32_t cluster, uint8_t shift) {
+    (void)cluster;
+    (void)shift;
+  }
+  void freeMapSet(uint32_t cluster) {
+    (void)cluster;
+  }
+  bool freeMapTest(uint32_t cluster) {
+    (void)cluster;
+    return true;
+  }
+#endif  // FAT_FREE_MAP_BYTES
+#if FAT_DIR_CACHE_ENTRIES
+  // Directory entry of a short name, by directory first cluster and hash.
+  struct DirCacheEntry {
+    uint32_t dirCluster;
+    uint16_t dirIndex;             // 0XFFFF if unused.
+    uint8_t lfnOrd;
+    uint8_t sfn[11];
+  };
+  DirCacheEntry m_dirCache[FAT_DIR_CACHE_ENTRIES];
+  // Hash bits of the short names of the last directory scanned.  Once the
+  // scan reached the end, a clear bit means the name is absent.
+  uint8_t m_dirScanNames[FAT_DIR_SCAN_BITS/8];
+  uint32_t m_dirScanCluster;
+  uint16_t m_dirScanEnd;           // Index of the first free entry at end.
+  uint8_t m_dirScanState;          // DIR_SCAN_NONE, _BUILD or _DONE.
+  bool m_dirScanHoles;             // Deleted entries before the end.
+  bool m_dirCacheOn;               // Use the cache.
+  // Last short name the scan of that directory did not find.  It stays
+  // absent after the hash bits are full, until the name is added.
+  uint8_t m_dirMissSfn[11];
+  bool m_dirMissValid;
+  static const uint8_t DIR_SCAN_NONE = 0;
+  static const uint8_t DIR_SCAN_BUILD = 1;
+  static const uint8_t DIR_SCAN_DONE = 2;
+  static uint16_t dirCacheHash(uint32_t dirCluster, const uint8_t* sfn);
+  void dirCacheAdd(uint32_t dirCluster, const uint8_t* sfn,
+                   uint16_t dirIndex, uint8_t lfnOrd);
+  bool dirCacheFind(uint32_t dirCluster, const uint8_t* sfn,
+                    uint16_t* dirIndex, uint8_t* lfnOrd);
+  void dirCacheInit();
+  void dirCacheRemove(uint32_t dirCluster, uint16_t dirIndex,
+                      uint32_t firstCluster);
+  bool dirScanAbsent(uint32_t dirCluster, const uint8_t* sfn,
+                     uint16_t* end);
+  void dirScanBegin(uint32_t dirCluster);
+  void dirScanEnd(uint16_t end, const uint8_t* sfn);
+  void dirScanHole() {
+    m_dirScanHoles = true;
+  }
+  void dirScanName(const uint8_t* sfn) {
+    if (m_dirScanState == DIR_SCAN_BUILD) {
+      uint16_t b = dirCacheHash(m_dirScanCluster, sfn) % FAT_DIR_SCAN_BITS;
+      m_dirScanNames[b >> 3] |= 1 << (b & 7);
+    }
+  }
+#else  // FAT_DIR_CACHE_ENTRIES
+  void dirCacheAdd(uint32_t dirCluster, const uint8_t* sfn,
+                   uint16_t dirIndex, uint8_t lfnOrd) {
+    (void)dirCluster;
+    (void)sfn;
+    (void)dirIndex;
+    (void)lfnOrd;
+  }
+  bool dirCacheFind(uint32_t dirCluster, const uint8_t* sfn,
+                    uint16_t* dirIndex, uint8_t* lfnOrd) {
+    (void)dirCluster;
+    (void)sfn;
+    (void)dirIndex;
+    (void)lfnOrd;
+    return false;
+  }
+  void dirCacheInit() {}
+  void dirCacheRemove(uint32_t dirCluster, uint16_t dirIndex,
+                      uint32_t firstCluster) {
+    (void)dirCluster;
+    (void)dirIndex;
+    (void)firstCluster;
+  }
+  bool dirScanAbsent(uint32_t dirCluster, const uint8_t* sfn,
+                     uint16_t* end) {
+    (void)dirCluster;
+    (void)sfn;
+    (void)end;
+    return false;
+  }
+  void dirScanBegin(uint32_t dirCluster) {
+    (void)dirCluster;
+  }
+  void dirScanEnd(uint16_t end, const uint8_t* sfn) {
+    (void)end;
+    (void)sfn;
+  }
+  void dirScanHole() {}
+  void dirScanName(const uint8_t* sfn) {
+    (void)sfn;
+  }
+#endif  // FAT_DIR_CACHE_ENTRIES
 
 // block caches
   FatCache m_cache;
@@ -346,6 +617,15 @@ class FatVolume {
   bool cacheSyncData() {
     return m_cache.sync();
   }
+  bool cacheSyncData(uint32_t lbn, uint32_t nb) {
+    return m_cache.sync(lbn, nb);
+  }
+  bool cacheContains(uint32_t lbn) {
+    return m_cache.contains(lbn);
+  }
+  bool cacheWriteBehind() {
+    return m_cache.writeBehind();
+  }
   cache_t *cacheAddress() {
     return m_cache.block();
   }
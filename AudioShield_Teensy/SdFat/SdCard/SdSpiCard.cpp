@@ -324,8 +324,9 @@ uint8_t SdSpiCard::cardCommand(uint8_t cmd, uint32_t arg) {
   if (!m_spiActive) {
     spiStart();
   }
-  // wait if busy unless CMD0
-  if (cmd != CMD0) {
+  // wait if busy unless CMD0, or CMD12 that stops the data of a multiple
+  // block read: the card streams the next block until it gets the command.
+  if (cmd != CMD0 && cmd != CMD12) {
     DBG_BEGIN_TIME(DBG_CMD_BUSY);
     waitNotBusy(SD_CMD_TIMEOUT);
     DBG_END_TIME(DBG_CMD_BUSY);
@@ -792,6 +793,9 @@ bool SdSpiCard::writeStop() {
   }
   DBG_END_TIME(DBG_WRITE_STOP);
   spiSend(STOP_TRAN_TOKEN);
+  // Skip the stuff byte, the card signals busy after it.  Otherwise the
+  // next command may take the stuff byte for the end of busy.
+  spiReceive();
   spiStop();
   return true;
 
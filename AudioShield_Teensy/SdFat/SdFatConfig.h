@@ -118,7 +118,7 @@
  * updated.  This will increase the speed of the freeClusterCount() call
  * after the first call.  Extra flash will be required.
  */
-#define MAINTAIN_FREE_CLUSTER_COUNT 0
+#define MAINTAIN_FREE_CLUSTER_COUNT 1
 //------------------------------------------------------------------------------
 /**
  * To enable SD card CRC checking set USE_SD_CRC nonzero.
@@ -197,6 +197,63 @@
 #else  // RAMEND
 #define USE_MULTI_BLOCK_IO 1
 #endif  // RAMEND
+//------------------------------------------------------------------------------
+/**
+ * Number of 512 byte blocks in the data cache, and in the FAT cache if
+ * USE_SEPARATE_FAT_CACHE is nonzero.  Blocks are replaced least recently
+ * used first.  Set FAT_CACHE_BLOCKS to one for the single block cache.
+ */
+#if defined(RAMEND) && RAMEND < 3000
+#define FAT_CACHE_BLOCKS 1
+#else  // RAMEND
+#define FAT_CACHE_BLOCKS 4
+#endif  // RAMEND
+/**
+ * Number of blocks read by a single multi-block read when a cache miss
+ * follows the previous one.  Set FAT_CACHE_READ_AHEAD to one to disable
+ * read-ahead.  Requires USE_MULTI_BLOCK_IO.  One block less than the cache
+ * keeps the directory or FAT block in use while a file is read.
+ */
+#if defined(RAMEND) && RAMEND < 3000
+#define FAT_CACHE_READ_AHEAD 1
+#else  // RAMEND
+#define FAT_CACHE_READ_AHEAD 3
+#endif  // RAMEND
+/**
+ * Set FAT_CACHE_WRITE_BEHIND nonzero to keep full blocks written through
+ * the cache dirty until they are replaced or synced, so that consecutive
+ * blocks are written by a single multi-block write.  The busy time after
+ * a multi-block write makes short runs slower than single block writes,
+ * it only pays off with many cache blocks.
+ */
+#define FAT_CACHE_WRITE_BEHIND 0
+/**
+ * Size in bytes of the free cluster map, zero for none.  Each bit of the
+ * map covers a group of clusters and is cleared once the group is known to
+ * be full, so cluster allocation skips the full part of the FAT instead of
+ * reading it.  The map is built at mount by the FAT scan that counts the
+ * free clusters, which needs MAINTAIN_FREE_CLUSTER_COUNT.  1024 bytes cover
+ * a 64 GB card with 32 KB clusters at two FAT blocks per bit.
+ */
+#if defined(RAMEND) && RAMEND < 3000
+#define FAT_FREE_MAP_BYTES 0
+#else  // RAMEND
+#define FAT_FREE_MAP_BYTES 1024
+#endif  // RAMEND
+/**
+ * Number of entries of the directory cache, zero for none.  Opening a short
+ * name found or created before in the same directory reads its entry
+ * directly instead of scanning the directory.  The short names of the last
+ * directory scanned to its end are also kept as FAT_DIR_SCAN_BITS hash
+ * bits, so that a name missing there is created without a second scan.
+ */
+#if defined(RAMEND) && RAMEND < 3000
+#define FAT_DIR_CACHE_ENTRIES 0
+#else  // RAMEND
+#define FAT_DIR_CACHE_ENTRIES 32
+#endif  // RAMEND
+/** Hash bits of the short names of the last directory scanned. */
+#define FAT_DIR_SCAN_BITS 512
 //-----------------------------------------------------------------------------
 /** Enable SDIO driver if available. */
 #if defined(__MK64FX512__) || defined(__MK66FX1M0__)
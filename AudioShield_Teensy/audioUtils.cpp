@@ -18,18 +18,21 @@ const int audioInput = AUDIO_INPUT_LINEIN;
 
 /*** Variables ***************************************************************/
 // GUItool: begin automatically generated code
-AudioInputI2S i2sRec;      // xy=76,36
-AudioPlaySdWav playWav;    // xy=78,114
-AudioMixer4 monMixer;      // xy=260,114
-AudioAnalyzePeak peak;     // xy=445,65
-AudioOutputI2S i2sMon;     // xy=447,118
-AudioRecordQueue queueSdc; // xy=456,30
+AudioInputI2S i2sRec;       // xy=76,36
+AudioPlaySdWav playWav;     // xy=78,114
+AudioMixer4 monMixer;       // xy=260,114
+AudioAnalyzeLevel levelRec; // xy=445,65
+AudioOutputI2S i2sMon;      // xy=447,118
+AudioRecordRing ringSdc;    // xy=456,30
+AudioAnalyzeBands bandsRec; // xy=456,160
 AudioConnection patchCord1(i2sRec, 0, monMixer, 0);
-AudioConnection patchCord2(i2sRec, 0, peak, 0);
-AudioConnection patchCord3(i2sRec, 0, queueSdc, 0);
+AudioConnection patchCord2(i2sRec, 0, levelRec, 0);
+AudioConnection patchCord3(i2sRec, 0, ringSdc, 0);
 AudioConnection patchCord4(playWav, 0, monMixer, 1);
 AudioConnection patchCord5(monMixer, 0, i2sMon, 0);
 AudioConnection patchCord6(monMixer, 0, i2sMon, 1);
+AudioConnection patchCord7(i2sRec, 1, ringSdc, 1);
+AudioConnection patchCord8(i2sRec, 0, bandsRec, 0);
 AudioControlSGTL5000 sgtl5000; // xy=251,186
 // GUItool: end automatically generated code
 
@@ -38,12 +41,75 @@ int vol_ctrl;
 float vol_value = 0.52;
 elapsedMillis peak_interval;
 elapsedMillis hpgain_interval;
+elapsedMillis checkpoint_interval;
+elapsedMillis evt_quiet;
+// Highest input peak since the last event check
+float peak_level = 0.0;
+// Record ring running without recording file (pre-trigger audio)
+bool rec_armed = false;
+// Pre-trigger audio kept in the record ring (sectors)
+unsigned int pretrig_sectors = 0;
 
 /*** Function prototypes *****************************************************/
+unsigned long getRecFileSize(void);
+void applyCapProfile(void);
+
 /*** Macros ******************************************************************/
 /*** Constant objects ********************************************************/
 /*** Functions implementation ************************************************/
 
+/*****************************************************************************/
+/* getRecFileSize(void)
+ * --------------------
+ * Compute the size of the WAV file for the current recording window,
+ * with the same duration as the record timer set in prepareRecording()
+ * plus a security margin, rounded up to whole sectors. A continuous
+ * recording gets REC_CONT_PREALLOC_SEC and goes on through the file
+ * system beyond that.
+ * IN:	- none
+ * OUT:	- file size in bytes (unsigned long)
+ */
+unsigned long getRecFileSize(void) {
+  unsigned long dur = rec_window.duration.Second +
+                      (rec_window.duration.Minute * SECS_PER_MIN) +
+                      (rec_window.duration.Hour * SECS_PER_HOUR);
+  if (dur == 0) {
+    dur = REC_CONT_PREALLOC_SEC;
+  } else {
+    dur = (unsigned long)((float)(dur + 1) * REC_DUR_CORRECTION_RATIO);
+    dur += REC_PREALLOC_MARGIN_SEC;
+  }
+  unsigned long size = WAVE_HEADER_SIZE + (dur * wave_header.bytes_per_sec);
+  // Armed ring: one-sector header and pre-trigger audio come first
+  if (rec_armed)
+    size += (REC_SECTOR_SIZE - WAVE_HEADER_SIZE) +
+            (pretrig_sectors * REC_SECTOR_SIZE);
+  return (((size + REC_SECTOR_SIZE - 1) / REC_SECTOR_SIZE) * REC_SECTOR_SIZE);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* applyCapProfile(void)
+ * ---------------------
+ * Set the capture profile of the record ring and the WAV header format.
+ * An invalid profile is replaced by the default one.
+ * IN:	- none
+ * OUT:	- none
+ */
+void applyCapProfile(void) {
+  if (!ringSdc.setProfile(cap_profile.channels, cap_profile.decim,
+                          cap_profile.bits)) {
+    if (debug)
+      snooze_usb.println("Audio:   invalid capture profile, using default");
+    cap_profile.channels = REC_CHANNELS_DEF;
+    cap_profile.decim = REC_DECIM_DEF;
+    cap_profile.bits = REC_BITS_DEF;
+    ringSdc.setProfile(REC_CHANNELS_DEF, REC_DECIM_DEF, REC_BITS_DEF);
+  }
+  setWaveFormat(&cap_profile);
+}
+/*****************************************************************************/
+
 /*** EXPORTED OBJECTS ********************************************************/
 /*****************************************************************************/
 /*** Functions ***************************************************************/
@@ -58,8 +124,20 @@ elapsedMillis hpgain_interval;
  * OUT:	- none
  */
 void prepareRecording(bool sync) {
+  fixRecPosition(sync);
+  prepareRecFile();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fixRecPosition(bool)
+ * --------------------
+ * Fetch a GPS fix (if demanded) for the next recording(s).
+ * IN:	- sync with GPS (bool)
+ * OUT:	- none
+ */
+void fixRecPosition(bool sync) {
   bool gps_fix = true;
-  tmElements_t tm;
 
   if (sync) {
     // gpsPowerOn();
@@ -84,6 +162,20 @@ void prepareRecording(bool sync) {
     Alarm.delay((GPS_ENCODE_TIME_MS * GPS_ENCODE_RETRIES_MAX));
     startLED(&leds[LED_RECORD], LED_MODE_ON);
   }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* prepareRecFile(void)
+ * --------------------
+ * Set the record timestamp to now(), create the file path according to
+ * it, save all record information and start the record timer.
+ * IN:	- none
+ * OUT:	- none
+ */
+void prepareRecFile(void) {
+  tmElements_t tm;
+
   next_record.tss = now();
   breakTime(next_record.tss, tm);
   rec_path = createSDpath();
@@ -91,6 +183,10 @@ void prepareRecording(bool sync) {
   unsigned long dur = next_record.dur.Second +
                       (next_record.dur.Minute * SECS_PER_MIN) +
                       (next_record.dur.Hour * SECS_PER_HOUR) + 1;
+  // Without window duration, an event recording lasts until the input
+  // gets quiet
+  if (evt_trigger.enabled && (dur == 1))
+    dur = 0;
   dur = (unsigned long)((float)dur * REC_DUR_CORRECTION_RATIO);
   if (debug)
     snooze_usb.printf("Audio:   Set recording duration to %d\n", dur);
@@ -125,26 +221,256 @@ void setRecInfos(struct recInfo *rec, String path) {
   rec->per.Hour = rec_window.period.Hour;
   rec->rpath.remove(0);
   rec->rpath.concat(path.c_str());
-  rec->mpath = rec->rpath;
-  rec->mpath.replace(".wav", ".txt");
+  rec->mpath = rec->rpath.substring(0, rec->rpath.lastIndexOf('.'));
+  rec->mpath.concat(".txt");
+  rec->spath = rec->rpath.substring(0, rec->rpath.lastIndexOf('.'));
+  rec->spath.concat(".spc");
   rec->t_set = (bool)rec->tss;
-  rec->rec_tot = rec_window.occurences;
+  rec->rec_tot = getRecOccurences();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* getRecFormat(void)
+ * ------------------
+ * File format of the next recording. The block-floating-point format
+ * only applies to 16-bit samples with a valid mantissa width, other
+ * recordings fall back to WAV.
+ * IN:	- none
+ * OUT:	- file format (enum recFormat)
+ */
+enum recFormat getRecFormat(void) {
+  if ((cap_profile.format == RECFMT_BFP) &&
+      ((cap_profile.bits != 16) || (cap_profile.width < BFP_WIDTH_MIN) ||
+       (cap_profile.width > BFP_WIDTH_MAX)))
+    return RECFMT_WAV;
+  return cap_profile.format;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* getRecBytesPerSec(void)
+ * -----------------------
+ * Bytes written per second of recording with the current capture profile
+ * and file format. FLAC has no fixed rate: its worst case is a verbatim
+ * frame every FLAC_BLOCK_SAMPLES samples, the PCM data plus the frame
+ * header, one subframe header per channel and the CRC-16.
+ * IN:	- none
+ * OUT:	- bytes per second (unsigned long)
+ */
+unsigned long getRecBytesPerSec(void) {
+  unsigned long srate = WAVE_SAMPLING_RATE / cap_profile.decim;
+
+  if (getRecFormat() == RECFMT_BFP)
+    return ((srate + BFP_BLOCK_SAMPLES - 1) / BFP_BLOCK_SAMPLES) *
+           cap_profile.channels *
+           (1 + (((BFP_BLOCK_SAMPLES * cap_profile.width) + 7) / 8));
+  if (getRecFormat() == RECFMT_FLAC)
+    return ((srate + FLAC_BLOCK_SAMPLES - 1) / FLAC_BLOCK_SAMPLES) *
+           (FLAC_FRAME_HEADER_MAX + 2 +
+            (cap_profile.channels *
+             (1 + ((FLAC_BLOCK_SAMPLES * cap_profile.bits) / 8))));
+  return (srate * cap_profile.channels * cap_profile.bits) / 8;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* getRecSecondsLeft(void)
+ * -----------------------
+ * Recording time left on the SD card with the current capture profile,
+ * out of the free cluster count kept by the file system. While recording,
+ * the file of the recording in progress is already allocated.
+ * IN:	- none
+ * OUT:	- seconds of recording (unsigned long)
+ */
+unsigned long getRecSecondsLeft(void) {
+  uint64_t free = (uint64_t)sdFreeClusters() * sdClusterBytes();
+
+  return (unsigned long)(free / getRecBytesPerSec());
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fitRecWindow(void)
+ * ------------------
+ * Check the recording window against the free space of the SD card and
+ * limit the recording sequence (next_record.rec_fit) to the recordings
+ * fitting, also for infinite repetitions. The window itself is left as
+ * set, each start of a sequence checks it again. Each recording takes its
+ * audio rounded up to whole clusters plus REC_META_CLUSTERS; the
+ * pre-allocated file of the last one may be larger than the audio it
+ * keeps, room is left for it. A continuous window only needs its
+ * pre-allocated file to fit.
+ * IN:	- none
+ * OUT:	- result of the check (enum rwinFit)
+ */
+enum rwinFit fitRecWindow(void) {
+  unsigned long dur = rec_window.duration.Second +
+                      (rec_window.duration.Minute * SECS_PER_MIN) +
+                      (rec_window.duration.Hour * SECS_PER_HOUR);
+  unsigned long free = sdFreeClusters();
+  unsigned long cb = sdClusterBytes();
+  unsigned long pre = 0, audio, per, n;
+
+  if (REC_CONTIGUOUS_MODE)
+    pre = (getRecFileSize() + cb - 1) / cb;
+  if (dur == 0) {
+    if (free < (pre + REC_META_CLUSTERS))
+      return RWIN_FIT_NONE;
+    next_record.rec_fit = 0;
+    return RWIN_FIT_OK;
+  }
+  dur = (unsigned long)((float)(dur + 1) * REC_DUR_CORRECTION_RATIO);
+  audio = (unsigned long)(((uint64_t)dur * getRecBytesPerSec() +
+                           REC_SECTOR_SIZE + cb - 1) /
+                          cb);
+  per = audio + REC_META_CLUSTERS;
+  if (pre > audio)
+    free = (free > (pre - audio)) ? (free - (pre - audio)) : 0;
+  n = free / per;
+  if (debug)
+    snooze_usb.printf("SD:      %lu recordings of %lus fit, %lu requested\n",
+                      n, dur, (unsigned long)rec_window.occurences);
+  if (n == 0)
+    return RWIN_FIT_NONE;
+  if ((rec_window.occurences != 0) && (rec_window.occurences <= n)) {
+    next_record.rec_fit = 0;
+    return RWIN_FIT_OK;
+  }
+  next_record.rec_fit = n;
+  return RWIN_FIT_SHORT;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* getRecOccurences(void)
+ * ----------------------
+ * Occurences of the recording sequence: those of the recording window,
+ * limited to the recordings fitting on the SD card by fitRecWindow().
+ * IN:	- none
+ * OUT:	- number of occurences, 0 for infinite repetitions (unsigned int)
+ */
+unsigned int getRecOccurences(void) {
+  if (next_record.rec_fit && ((rec_window.occurences == 0) ||
+                              (rec_window.occurences > next_record.rec_fit)))
+    return next_record.rec_fit;
+  return rec_window.occurences;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* armRecording(void)
+ * ------------------
+ * Start the record ring without recording file, for an event-triggered
+ * recording. Until the event, only the last evt_trigger.pre_ms of audio
+ * are kept in the ring.
+ * IN:	- none
+ * OUT:	- none
+ */
+void armRecording(void) {
+  applyCapProfile();
+  pretrig_sectors =
+      ((unsigned long)evt_trigger.pre_ms * wave_header.bytes_per_sec / 1000) /
+      REC_SECTOR_SIZE;
+  if (pretrig_sectors > EVT_PRETRIG_SECTORS_MAX)
+    pretrig_sectors = EVT_PRETRIG_SECTORS_MAX;
+  rec_path = "--";
+  ringSdc.begin();
+  resetRecStats();
+  rec_armed = true;
+  peak_level = 0.0;
+  startLED(&leds[LED_RECORD], LED_MODE_IDLE_SLOW);
+  if (debug)
+    snooze_usb.printf("Audio:   Armed, threshold %0.3f, pre-trigger %d "
+                      "sectors\n",
+                      evt_trigger.threshold, pretrig_sectors);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* keepPreTrigger(void)
+ * --------------------
+ * Drop the oldest audio of the record ring beyond the pre-trigger time.
+ * IN:	- none
+ * OUT:	- none
+ */
+void keepPreTrigger(void) {
+  unsigned int cnt = ringSdc.available();
+
+  if (cnt > pretrig_sectors)
+    ringSdc.freeSectors(cnt - pretrig_sectors);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* eventDetected(void)
+ * -------------------
+ * Check the input peak level against the event threshold. The time
+ * since the last loud peak is kept in evt_quiet.
+ * IN:	- none
+ * OUT:	- input above the threshold since the last check (bool)
+ */
+bool eventDetected(void) {
+  bool loud;
+
+  detectPeaks();
+  loud = (peak_level >= evt_trigger.threshold);
+  peak_level = 0.0;
+  if (loud)
+    evt_quiet = 0;
+  return loud;
 }
 /*****************************************************************************/
 
 /*****************************************************************************/
 /* startRecording(String)
  * ----------------------
- * Open the file path and start the recording queue.
+ * Open the file path and start the record ring. The WAV header space is
+ * reserved at the start of the ring, so that the audio data written to
+ * the SD card stays sector-aligned. With REC_CONTIGUOUS_MODE, the
+ * recording is pre-allocated in one contiguous range of clusters and
+ * streamed by the raw recorder. The capture profile is applied to the
+ * ring and to the WAV header before the file size is computed. FLAC and
+ * block-floating-point recordings get no WAV header: their encoder
+ * writes its own.
+ * If the ring is armed, it keeps running and its pre-trigger audio
+ * becomes the start of the recording. A WAV file then gets a whole
+ * header sector, so that the ring data stays sector-aligned.
  * IN:	- file path (String)
  * OUT:	- none
  *
  */
 void startRecording(String path) {
-  frec = SD.open(path.c_str(), FILE_WRITE);
-  if (frec) {
-    queueSdc.begin();
-    tot_rec_bytes = 0;
+  unsigned long size = 0;
+
+  if (!rec_armed)
+    applyCapProfile();
+  rec_enc = NULL;
+  if (getRecFormat() == RECFMT_FLAC) {
+    flac_enc.begin(cap_profile.channels, wave_header.srate, cap_profile.bits);
+    rec_enc = &flac_enc;
+  } else if (getRecFormat() == RECFMT_BFP) {
+    bfp_pack.begin(cap_profile.channels, wave_header.srate, cap_profile.bits,
+                   cap_profile.width);
+    rec_enc = &bfp_pack;
+  }
+  if (REC_CONTIGUOUS_MODE)
+    size = getRecFileSize();
+  if (openRecFile(path, size)) {
+    if (rec_armed) {
+      if (!rec_enc)
+        writeWaveSector();
+      rec_armed = false;
+    } else {
+      if (rec_enc)
+        ringSdc.begin();
+      else
+        ringSdc.begin((uint8_t *)&wave_header, WAVE_HEADER_SIZE);
+      resetRecStats();
+    }
+    levelRec.resetStats();
+    bandsRec.begin();
+    checkpoint_interval = 0;
   } else {
     if (debug)
       snooze_usb.println("Audio:   file opening error");
@@ -157,53 +483,80 @@ void startRecording(String path) {
 /*****************************************************************************/
 /* continueRecording(void)
  * -----------------------
- * Write to the SD card and free the recording queue every 512 samples
+ * Flush the full sectors of the record ring to the SD card. Sectors are
+ * written in bursts of at least REC_RING_BURST_MIN in order to keep the
+ * number of SD transactions low. Every REC_CHECKPOINT_SEC, the file header
+ * and the directory entry are updated with the current length, so that a
+ * power loss costs at most the audio since the last checkpoint. The
+ * checkpoint waits until the ring has enough room to absorb it.
  * IN:	- none
  * OUT:	- none
  */
 void continueRecording(void) {
-  if (queueSdc.available() >= 2) {
-    byte buffer[REC_WRITE_BUF_SIZE];
-    // Fetch 2 blocks from the audio library and copy
-    // into a 512 byte buffer.  The Arduino SD library
-    // is most efficient when full 512 byte sector size
-    // writes are used.
-    memcpy(buffer, queueSdc.readBuffer(), REC_READ_BUF_SIZE);
-    queueSdc.freeBuffer();
-    memcpy(buffer + REC_READ_BUF_SIZE, queueSdc.readBuffer(),
-           REC_READ_BUF_SIZE);
-    queueSdc.freeBuffer();
-    // elapsedMicros usec = 0;
-    frec.write(buffer, REC_WRITE_BUF_SIZE);
-    tot_rec_bytes += REC_WRITE_BUF_SIZE;
-    // if(debug) snooze_usb.print("Audio:   SD write, us=");
-    // if(debug) snooze_usb.println(usec);
+  unsigned int cnt;
+  uint8_t *buf;
+
+  bandsRec.process();
+  if (ringSdc.available() < REC_RING_BURST_MIN)
+    return;
+  buf = ringSdc.readSectors(&cnt);
+  // elapsedMicros usec = 0;
+  writeRecData(buf, cnt * REC_SECTOR_SIZE);
+  ringSdc.freeSectors(cnt);
+  if ((checkpoint_interval > (REC_CHECKPOINT_SEC * 1000)) &&
+      (ringSdc.available() <= REC_CHECKPOINT_RING_MAX)) {
+    updateRecHeader();
+    if (bandsRec.records() >= SPEC_RECORDS_FLUSH)
+      writeSpectrum(&next_record);
+    checkpoint_interval = 0;
   }
+  // if(debug) snooze_usb.print("Audio:   SD write, us=");
+  // if(debug) snooze_usb.println(usec);
 }
 /*****************************************************************************/
 
 /*****************************************************************************/
 /* stopRecording(String)
  * ---------------------
- * Stop the recording queue, write the remaining data
- * and the WAV header values to the SD card.
+ * Stop the record ring, write the remaining data
+ * and the final file header values to the SD card.
+ * Without recording file (armed ring), the ring is just stopped.
  * IN:	- none
  * OUT:	- none
  */
 void stopRecording(String path) {
-  queueSdc.end();
+  unsigned int cnt;
+  uint8_t *buf;
+
+  ringSdc.end();
+  stopRecStats();
+  bandsRec.end();
+  rec_armed = false;
+  if (!frec.isOpen()) {
+    // Armed without event, or file opening error: nothing recorded
+    if (debug)
+      snooze_usb.println("Audio:   Recording stopped, no file");
+    return;
+  }
   if (working_state.rec_state) {
-    while (queueSdc.available() > 0) {
-      frec.write((byte *)queueSdc.readBuffer(), REC_READ_BUF_SIZE);
-      queueSdc.freeBuffer();
-      tot_rec_bytes += REC_READ_BUF_SIZE;
+    while ((buf = ringSdc.readSectors(&cnt)) != NULL) {
+      writeRecData(buf, cnt * REC_SECTOR_SIZE);
+      ringSdc.freeSectors(cnt);
     }
-    frec.close();
-
-    writeWaveHeader(path, tot_rec_bytes);
+    cnt = ringSdc.readPartial(&buf);
+    if (cnt)
+      writeRecData(buf, cnt);
+    closeRecFile();
+    writeSpectrum(&next_record);
   }
   if (debug)
-    snooze_usb.println("Audio:   Recording stopped, writing metadata");
+    snooze_usb.printf("Audio:   Recording stopped (ring high-water mark: %d/%d "
+                      "sectors, %lu blocks dropped), writing metadata\n",
+                      ringSdc.highWater(), REC_RING_SECTORS,
+                      ringSdc.overruns());
+  if (debug)
+    snooze_usb.printf("Audio:   Record interrupt (cycles): mean %lu, max %lu\n",
+                      ringSdc.meanUpdateCycles(), ringSdc.maxUpdateCycles());
 
   createMetadata(&next_record);
   Alarm.free(alarm_rem_id);
@@ -257,11 +610,13 @@ void resetRecInfo(struct recInfo *rec) {
   rec->t_set = false;
   rec->rpath.remove(0);
   rec->mpath.remove(0);
+  rec->spath.remove(0);
   rec->gps_lat = 1000.0;
   rec->gps_long = 1000.0;
   rec->gps_source = GPS_NONE;
   rec->cnt = 0;
   rec->rec_tot = 0;
+  rec->rec_fit = 0;
   rec->man_stop = false;
 }
 /*****************************************************************************/
@@ -342,13 +697,19 @@ void setHpGain(void) {
 /* detectPeaks(void)
  * -----------------
  * Detect possible peaks at line input and
- * notify them with the peak LED.
+ * notify them with the peak LED. The highest
+ * peak is kept for eventDetected().
  * IN:	- none
  * OUT:	- none
  */
 void detectPeaks(void) {
-  if (peak.available()) {
-    if (peak.read() >= 1.0) {
+  float level;
+
+  if (levelRec.available()) {
+    level = levelRec.readPeak();
+    if (level > peak_level)
+      peak_level = level;
+    if (level >= 1.0) {
       startLED(&leds[LED_PEAK], LED_MODE_ON);
     } else {
       stopLED(&leds[LED_PEAK]);
@@ -370,7 +731,7 @@ void initAudio(void) {
   pinMode(AUDIO_VOLUME_PIN, INPUT);
 
   // Memory buffer for the record queue
-  AudioMemory(60);
+  AudioMemory(AUDIO_MEMORY_BLOCKS);
 
   // Enable the audio shield, select input, enable output
   sgtl5000.enable();
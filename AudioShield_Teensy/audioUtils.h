@@ -12,10 +12,37 @@
 /*****************************************************************************/
 
 /*** Constants ***************************************************************/
+// Scaling of the recording duration timer (Alarm.timerOnce)
+#ifndef REC_DUR_CORRECTION_RATIO
 #define REC_DUR_CORRECTION_RATIO 1.00
-
-#define REC_READ_BUF_SIZE 256
-#define REC_WRITE_BUF_SIZE (2 * REC_READ_BUF_SIZE)
+#endif
+// Pre-allocate recordings as contiguous files (0: disabled)
+#define REC_CONTIGUOUS_MODE 1
+// Extra recording time pre-allocated on top of the window duration
+#define REC_PREALLOC_MARGIN_SEC 2
+// Recording time pre-allocated for continuous recordings
+#define REC_CONT_PREALLOC_SEC 3600
+// Clusters of the metadata and spectrum files of each recording
+#define REC_META_CLUSTERS 2
+// Checkpoint interval of the recording file (WAV header + directory entry)
+#define REC_CHECKPOINT_SEC 30
+// Checkpoints are postponed while the record ring holds more sectors
+#define REC_CHECKPOINT_RING_MAX (REC_RING_SECTORS / 4)
+// Default capture profile: mono, 44.1 kHz, 16-bit
+#define REC_CHANNELS_DEF 1
+#define REC_DECIM_DEF 1
+#define REC_BITS_DEF 16
+// Recording file format (RECFMT_WAV, RECFMT_FLAC or RECFMT_BFP)
+#define REC_FORMAT_DEF RECFMT_WAV
+// Mantissa width of the block-floating-point format (25 % smaller than PCM)
+#define REC_BFP_WIDTH_DEF 12
+// Event-triggered recording defaults (0: time-windowed recordings)
+#define EVT_TRIGGER_DEF 0
+#define EVT_THRESHOLD_DEF 0.05 // input peak level, 1.0 -> full scale
+#define EVT_PRETRIG_MS_DEF 500 // audio kept before the event
+#define EVT_HANG_SEC_DEF 5     // quiet time ending the event recording
+// Longest pre-trigger audio, leaving room in the ring to open the file
+#define EVT_PRETRIG_SECTORS_MAX (REC_RING_SECTORS / 2)
 
 // Audio mixer channels
 #define MIXER_CH_REC 0
@@ -68,19 +95,41 @@
 #define VOL_MAX_VAL_HEX 15
 #define HPGAIN_INTERVAL_MS 100
 #define PEAK_INTERVAL_MS 100
+// Audio library memory (blocks)
+#define AUDIO_MEMORY_BLOCKS 60
 
 /*** Types *******************************************************************/
+// Recording window against the free space of the SD card
+enum rwinFit {
+  RWIN_FIT_OK,    // all the recordings fit
+  RWIN_FIT_SHORT, // recordings limited to those fitting (rec_fit)
+  RWIN_FIT_NONE   // not a single recording fits (window unchanged)
+};
 
 /*** Variables ***************************************************************/
+extern AudioRecordRing ringSdc;
+extern AudioAnalyzeLevel levelRec;
+extern AudioAnalyzeBands bandsRec;
 extern String rec_path;
 extern elapsedMillis hpgain_interval;
 extern elapsedMillis peak_interval;
+extern elapsedMillis evt_quiet;
 extern int vol_ctrl;
 extern float vol_value;
 
 /*** Functions ***************************************************************/
 void prepareRecording(bool sync);
+void fixRecPosition(bool sync);
+void prepareRecFile(void);
 void setRecInfos(struct recInfo *rec, String path);
+enum recFormat getRecFormat(void);
+unsigned long getRecBytesPerSec(void);
+unsigned long getRecSecondsLeft(void);
+enum rwinFit fitRecWindow(void);
+unsigned int getRecOccurences(void);
+void armRecording(void);
+void keepPreTrigger(void);
+bool eventDetected(void);
 void startRecording(String path);
 void continueRecording(void);
 void stopRecording(String path);
@@ -0,0 +1,222 @@
+/*
+ * Block-floating-point packer
+ *
+ * Packed storage of the recorded audio with one
+ * exponent per block and reduced-width mantissas.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "bfpPacker.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+BfpPacker bfp_pack;
+
+/*** Function prototypes *****************************************************/
+void bfpPut16(uint8_t *buf, uint16_t val);
+void bfpPut32(uint8_t *buf, uint32_t val);
+
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* bfpPut16(uint8_t*, uint16_t) / bfpPut32(uint8_t*, uint32_t)
+ * ------------------------------------------------------------
+ * Store a little endian header field.
+ * IN:	- pointer to the field (uint8_t*)
+ *			- value (uint16_t / uint32_t)
+ * OUT:	- none
+ */
+void bfpPut16(uint8_t *buf, uint16_t val) {
+  buf[0] = (uint8_t)val;
+  buf[1] = (uint8_t)(val >> 8);
+}
+void bfpPut32(uint8_t *buf, uint32_t val) {
+  bfpPut16(buf, (uint16_t)val);
+  bfpPut16(&buf[2], (uint16_t)(val >> 16));
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::packFrame(const uint8_t*, unsigned int)
+ * --------------------------------------------------
+ * Pack a frame at the end of the output buffer. A short block is padded
+ * with silence.
+ * IN:	- pointer to the interleaved 16-bit PCM samples (const uint8_t*)
+ *			- number of samples per channel (unsigned int)
+ * OUT:	- none
+ */
+void BfpPacker::packFrame(const uint8_t *pcm, unsigned int n) {
+  int32_t x[BFP_BLOCK_SAMPLES];
+  int32_t m, lim = (1L << (width - 1)) - 1;
+  uint32_t peak, acc;
+  unsigned int ch, i, need, exp, nbits;
+  uint8_t *bp = &out[out_len];
+
+  for (ch = 0; ch < channels; ch++) {
+    peak = 0;
+    for (i = 0; i < BFP_BLOCK_SAMPLES; i++) {
+      if (i < n) {
+        x[i] = (int16_t)(pcm[2 * (i * channels + ch)] |
+                         (pcm[2 * (i * channels + ch) + 1] << 8));
+      } else {
+        x[i] = 0;
+      }
+      peak |= (uint32_t)(x[i] ^ (x[i] >> 31));
+    }
+    // Significant bits of the block peak, sign included
+    need = (peak ? (32 - __builtin_clz(peak)) : 0) + 1;
+    exp = (need > width) ? (need - width) : 0;
+    *bp++ = (uint8_t)exp;
+
+    acc = 0;
+    nbits = 0;
+    for (i = 0; i < BFP_BLOCK_SAMPLES; i++) {
+      m = exp ? ((x[i] + (1L << (exp - 1))) >> exp) : x[i];
+      if (m > lim)
+        m = lim; // rounding overflow of a peak
+      acc = (acc << width) | ((uint32_t)m & ((1UL << width) - 1));
+      nbits += width;
+      while (nbits >= 8) {
+        nbits -= 8;
+        *bp++ = (uint8_t)(acc >> nbits);
+      }
+    }
+    if (nbits)
+      *bp++ = (uint8_t)(acc << (8 - nbits));
+  }
+  out_len += frame_size;
+  samples += n;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::begin(unsigned int, unsigned long, unsigned int, unsigned int)
+ * -------------------------------------------------------------------------
+ * Start a new packed stream. The file header is placed in the output
+ * buffer, to be patched by the checkpoints.
+ * IN:	- number of channels (unsigned int)
+ *			- sampling rate in Hz (unsigned long)
+ *			- bits per sample of the PCM data, must be 16 (unsigned int)
+ *			- mantissa width, BFP_WIDTH_MIN to BFP_WIDTH_MAX (unsigned int)
+ * OUT:	- valid format (bool)
+ */
+bool BfpPacker::begin(unsigned int nb_chans, unsigned long srate,
+                      unsigned int nb_bits, unsigned int nb_width) {
+  if ((nb_bits != 16) || (nb_width < BFP_WIDTH_MIN) ||
+      (nb_width > BFP_WIDTH_MAX))
+    return false;
+  channels = nb_chans;
+  rate = srate;
+  width = nb_width;
+  frame_size = channels * (1 + ((BFP_BLOCK_SAMPLES * width + 7) / 8));
+  out_base = 0;
+  samples = 0;
+  out_len = header(out);
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::header(uint8_t*)
+ * ---------------------------
+ * Build the file header for the frames handed out so far.
+ * IN:	- pointer to a BFP_HEADER_SIZE bytes buffer (uint8_t*)
+ * OUT:	- header size in bytes (unsigned int)
+ */
+unsigned int BfpPacker::header(uint8_t *buf) {
+  uint32_t synced = 0;
+
+  if (out_base > BFP_HEADER_SIZE)
+    synced = ((out_base - BFP_HEADER_SIZE) / frame_size) * BFP_BLOCK_SAMPLES;
+  if (synced > samples)
+    synced = samples;
+  memset(buf, 0, BFP_HEADER_SIZE);
+  memcpy(buf, BFP_MAGIC, 4);
+  bfpPut16(&buf[4], BFP_VERSION);
+  bfpPut16(&buf[6], channels);
+  bfpPut32(&buf[8], rate);
+  bfpPut16(&buf[12], BFP_BLOCK_SAMPLES);
+  bfpPut16(&buf[14], width);
+  bfpPut32(&buf[16], synced);
+  bfpPut32(&buf[20], frame_size);
+  return BFP_HEADER_SIZE;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::encode(const uint8_t*, unsigned int)
+ * -----------------------------------------------
+ * Pack PCM data, block by block, as long as the output buffer has room.
+ * Only the last call of a recording may end with a shorter block.
+ * IN:	- pointer to the interleaved 16-bit PCM data (const uint8_t*)
+ *			- number of bytes (unsigned int)
+ * OUT:	- number of bytes consumed (unsigned int)
+ */
+unsigned int BfpPacker::encode(const uint8_t *pcm, unsigned int len) {
+  unsigned int smp_bytes = channels * 2;
+  unsigned int done = 0;
+  unsigned int n;
+
+  while (((len - done) >= smp_bytes) &&
+         ((out_len + frame_size) <= sizeof(out))) {
+    n = (len - done) / smp_bytes;
+    if (n > BFP_BLOCK_SAMPLES)
+      n = BFP_BLOCK_SAMPLES;
+    packFrame(&pcm[done], n);
+    done += n * smp_bytes;
+  }
+  return done;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::output(unsigned int*)
+ * --------------------------------
+ * Get the packed data available in whole sectors.
+ * IN:	- pointer to the number of bytes (unsigned int*)
+ * OUT:	- pointer to the data (uint8_t*)
+ */
+uint8_t *BfpPacker::output(unsigned int *len) {
+  *len = out_len - (out_len % REC_SECTOR_SIZE);
+  return out;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::flush(unsigned int*)
+ * -------------------------------
+ * Get all the packed data, at the end of the recording.
+ * IN:	- pointer to the number of bytes (unsigned int*)
+ * OUT:	- pointer to the data (uint8_t*)
+ */
+uint8_t *BfpPacker::flush(unsigned int *len) {
+  *len = out_len;
+  return out;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* BfpPacker::consume(unsigned int)
+ * --------------------------------
+ * Drop data written to the SD card from the output buffer.
+ * IN:	- number of bytes written (unsigned int)
+ * OUT:	- none
+ */
+void BfpPacker::consume(unsigned int len) {
+  if (len > out_len)
+    len = out_len;
+  memmove(out, &out[len], out_len - len);
+  out_len -= len;
+  out_base += len;
+}
+/*****************************************************************************/
@@ -0,0 +1,80 @@
+/*
+ * bfpPacker.h
+ */
+#ifndef _BFPPACKER_H_
+#define _BFPPACKER_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "main.h"
+#include "recEncoder.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Samples per channel sharing an exponent (one audio block)
+#define BFP_BLOCK_SAMPLES AUDIO_BLOCK_SAMPLES
+// Mantissa width limits (bits, sign included)
+#define BFP_WIDTH_MIN 8
+#define BFP_WIDTH_MAX 15
+// File header: "SSBF", version, format, samples per channel written
+#define BFP_HEADER_SIZE 32
+#define BFP_MAGIC "SSBF"
+#define BFP_VERSION 1
+// Largest frame: one exponent byte and the mantissas of each channel
+#define BFP_FRAME_MAX                                                          \
+  (REC_CHANNELS_MAX * (1 + ((BFP_BLOCK_SAMPLES * BFP_WIDTH_MAX) / 8)))
+// Output buffer, in sectors (plus room for one frame)
+#define BFP_OUT_SECTORS 8
+
+/*** Types *******************************************************************/
+/* BfpPacker
+ * ---------
+ * Block-floating-point storage of 16-bit recordings. For every block of
+ * BFP_BLOCK_SAMPLES samples, each channel gets one exponent byte, the
+ * smallest right shift fitting its peak into the mantissa width, and
+ * the rounded mantissas packed MSB first. Blocks below the mantissa
+ * range are stored exactly; louder blocks lose their 'exponent' lowest
+ * bits, with rounding (error up to 2^(exponent-1), below 2^exponent for
+ * a clipped peak).
+ * File layout (little endian): "SSBF", version (u16), channels (u16),
+ * sampling rate (u32), block samples (u16), mantissa width (u16),
+ * samples per channel (u32), frame size (u32), reserved up to
+ * BFP_HEADER_SIZE, then the frames. The last frame is padded with
+ * silence. The number of samples is patched by the checkpoints and
+ * only covers frames handed out.
+ */
+class BfpPacker : public RecEncoder {
+public:
+  BfpPacker(void) {
+    out_len = 0;
+    out_base = 0;
+  }
+  bool begin(unsigned int nb_chans, unsigned long srate, unsigned int nb_bits,
+             unsigned int nb_width);
+  unsigned int header(uint8_t *buf);
+  unsigned int encode(const uint8_t *pcm, unsigned int len);
+  uint8_t *output(unsigned int *len);
+  uint8_t *flush(unsigned int *len);
+  void consume(unsigned int len);
+  unsigned int frameSize(void) { return frame_size; }
+
+private:
+  void packFrame(const uint8_t *pcm, unsigned int n);
+  unsigned int channels;   // number of channels
+  unsigned long rate;      // sampling rate (Hz)
+  unsigned int width;      // mantissa width (bits)
+  unsigned int frame_size; // bytes per frame
+  uint8_t out[(BFP_OUT_SECTORS * REC_SECTOR_SIZE) + BFP_FRAME_MAX];
+  unsigned int out_len;    // packed bytes in the output buffer
+  uint32_t out_base;       // stream offset of the output buffer
+  uint32_t samples;        // samples per channel packed
+};
+
+/*** Variables ***************************************************************/
+extern BfpPacker bfp_pack;
+
+/*** Functions ***************************************************************/
+
+#endif /* _BFPPACKER_H_ */
@@ -0,0 +1,181 @@
+/*
+ * BLE status
+ *
+ * Compact status frame for the BLE app: the state of the recorder in one
+ * SEND, instead of one text notification per value. The frame is binary
+ * and goes out in base64, the BC127 SEND command carrying text only.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "bleStatus.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+static const char b64_chars[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+static uint8_t *put16(uint8_t *p, uint32_t v) {
+  if (v > 0xFFFF)
+    v = 0xFFFF;
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v) {
+  p[0] = v & 0xFF;
+  p[1] = (v >> 8) & 0xFF;
+  p[2] = (v >> 16) & 0xFF;
+  p[3] = (v >> 24) & 0xFF;
+  return p + 4;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* crc16(const uint8_t*, unsigned int)
+ * -----------------------------------
+ * CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF), bitwise: the
+ * frame is short and sent at most a few times per second.
+ * IN:	- data (const uint8_t*)
+ *			- length (unsigned int)
+ * OUT:	- CRC (uint16_t)
+ */
+static uint16_t crc16(const uint8_t *data, unsigned int len) {
+  uint16_t crc = 0xFFFF;
+
+  for (unsigned int i = 0; i < len; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int b = 0; b < 8; b++)
+      crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+  }
+  return crc;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+static uint32_t rwinSeconds(const tmElements_t *tm) {
+  return tm->Second + (tm->Minute * SECS_PER_MIN) + (tm->Hour * SECS_PER_HOUR);
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* bleStatusFrame(uint8_t*)
+ * ------------------------
+ * Build the status frame from the current state (layout in bleStatus.h).
+ * IN:	- frame, BLE_STATUS_LEN bytes (uint8_t*)
+ * OUT:	- length of the frame (unsigned int)
+ */
+unsigned int bleStatusFrame(uint8_t *frame) {
+  struct recStats st;
+  uint8_t *p = frame;
+  uint8_t rec, flags = 0;
+  bool gps_ok =
+      (next_record.gps_lat < 1000.0) && (next_record.gps_long < 1000.0);
+
+  // Same grouping of the recording states as the REC notification
+  if ((working_state.rec_state == RECSTATE_ON) ||
+      (working_state.rec_state == RECSTATE_REQ_REARM))
+    rec = 2;
+  else if ((working_state.rec_state == RECSTATE_WAIT) ||
+           (working_state.rec_state == RECSTATE_IDLE) ||
+           (working_state.rec_state == RECSTATE_ARMED))
+    rec = 1;
+  else
+    rec = 0;
+  if (working_state.mon_state == MONSTATE_ON)
+    flags |= BLE_STATUS_F_MON;
+  if ((working_state.bt_state == BTSTATE_CONNECTED) ||
+      (working_state.bt_state == BTSTATE_PLAY))
+    flags |= BLE_STATUS_F_BT;
+  if (working_state.bt_state == BTSTATE_INQUIRY)
+    flags |= BLE_STATUS_F_INQ;
+  if (next_record.t_set)
+    flags |= BLE_STATUS_F_TIME;
+  if (gps_ok)
+    flags |= BLE_STATUS_F_GPS;
+  getRecStats(&st);
+
+  *p++ = BLE_STATUS_VERSION;
+  *p++ = BLE_STATUS_LEN - 4;
+  *p++ = rec;
+  *p++ = flags;
+  p = put32(p, (uint32_t)rec_rem);
+  p = put32(p, (uint32_t)next_record.tss);
+  p = put16(p, next_record.cnt + 1);
+  p = put16(p, next_record.rec_tot);
+  p = put32(p, gps_ok ? (uint32_t)(int32_t)lround(next_record.gps_lat * 1e6)
+                      : 0);
+  p = put32(p, gps_ok ? (uint32_t)(int32_t)lround(next_record.gps_long * 1e6)
+                      : 0);
+  *p++ = next_record.gps_source;
+  *p++ = (uint8_t)((vol_value * 100.0) + 0.5);
+  p = put32(p, rwinSeconds(&rec_window.duration));
+  p = put32(p, rwinSeconds(&rec_window.period));
+  p = put16(p, rec_window.occurences);
+  p = put32(p, st.expected);
+  p = put32(p, st.received);
+  p = put32(p, st.dropped);
+  p = put32(p, st.missing);
+  p = put16(p, st.ring_hwm);
+  p = put16(p, st.mem_max);
+  p = put16(p, (uint32_t)((st.cpu_max * 10.0) + 0.5));
+  p = put16(p, crc16(frame, p - frame));
+  return p - frame;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bleStatusText(char*)
+ * --------------------
+ * Build the status frame and encode it in base64.
+ * IN:	- text, BLE_STATUS_B64_LEN + 1 characters (char*)
+ * OUT:	- length of the text (unsigned int)
+ */
+unsigned int bleStatusText(char *text) {
+  uint8_t frame[BLE_STATUS_LEN];
+
+  return bleBase64(frame, bleStatusFrame(frame), text);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bleBase64(const uint8_t*, unsigned int, char*)
+ * ----------------------------------------------
+ * Encode binary data in base64 (RFC 4648, padded), for a SEND line.
+ * IN:	- data (const uint8_t*)
+ *			- length of the data (unsigned int)
+ *			- text, BLE_B64_LEN(length) + 1 characters (char*)
+ * OUT:	- length of the text (unsigned int)
+ */
+unsigned int bleBase64(const uint8_t *data, unsigned int len, char *text) {
+  unsigned int n = 0;
+
+  for (unsigned int i = 0; i < len; i += 3) {
+    uint32_t v = (uint32_t)data[i] << 16;
+    if ((i + 1) < len)
+      v |= (uint32_t)data[i + 1] << 8;
+    if ((i + 2) < len)
+      v |= data[i + 2];
+    text[n++] = b64_chars[(v >> 18) & 0x3F];
+    text[n++] = b64_chars[(v >> 12) & 0x3F];
+    text[n++] = ((i + 1) < len) ? b64_chars[(v >> 6) & 0x3F] : '=';
+    text[n++] = ((i + 2) < len) ? b64_chars[v & 0x3F] : '=';
+  }
+  text[n] = '\0';
+  return n;
+}
+/*****************************************************************************/
@@ -0,0 +1,60 @@
+/*
+ * bleStatus.h
+ */
+#ifndef _BLESTATUS_H_
+#define _BLESTATUS_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "main.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Version of the status frame, first byte of the frame. Later versions only
+// append fields: the app skips the ones it does not know using the length.
+#define BLE_STATUS_VERSION 1
+// Status frame, little endian:
+//  0 u8  version
+//  1 u8  length of the fields (bytes 2 to 57)
+//  2 u8  recording: 0 off, 1 waiting, 2 on
+//  3 u8  flags (BLE_STATUS_F_*)
+//  4 u32 remaining recording time (s)
+//  8 u32 next start (UNIX time)
+// 12 u16 recording number
+// 14 u16 total number of recordings
+// 16 s32 latitude (1e-6 deg)
+// 20 s32 longitude (1e-6 deg)
+// 24 u8  GPS source
+// 25 u8  volume (%)
+// 26 u32 recording window: duration (s)
+// 30 u32 recording window: period (s)
+// 34 u16 recording window: occurrences
+// 36 u32 audio blocks expected       }
+// 40 u32 audio blocks received       }
+// 44 u32 audio blocks dropped        } recording pipeline statistics,
+// 48 u32 audio blocks missing        } as in STATS
+// 52 u16 record ring high water mark }
+// 54 u16 audio memory max            }
+// 56 u16 audio CPU max (0.1 %)       }
+// 58 u16 CRC-16/CCITT of bytes 0 to 57
+#define BLE_STATUS_LEN 60
+// Base64 text of n bytes, terminator excluded
+#define BLE_B64_LEN(n) ((((n) + 2) / 3) * 4)
+#define BLE_STATUS_B64_LEN BLE_B64_LEN(BLE_STATUS_LEN)
+// Flags of the status frame
+#define BLE_STATUS_F_MON 0x01  // monitoring on
+#define BLE_STATUS_F_BT 0x02   // BT device connected
+#define BLE_STATUS_F_INQ 0x04  // BT inquiry running
+#define BLE_STATUS_F_TIME 0x08 // time synchronized
+#define BLE_STATUS_F_GPS 0x10  // position known
+
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+unsigned int bleStatusFrame(uint8_t *frame);
+unsigned int bleStatusText(char *text);
+unsigned int bleBase64(const uint8_t *data, unsigned int len, char *text);
+
+#endif /* _BLESTATUS_H_ */
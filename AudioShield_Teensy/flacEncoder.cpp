@@ -0,0 +1,557 @@
+/*
+ * FLAC encoder
+ *
+ * Lossless compression of the recorded audio
+ * into a FLAC stream (fixed predictors, Rice coding).
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "flacEncoder.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+FlacEncoder flac_enc;
+
+/*** Function prototypes *****************************************************/
+uint8_t flacCrc8(const uint8_t *buf, unsigned int len);
+uint16_t flacCrc16(const uint8_t *buf, unsigned int len);
+
+/*** Macros ******************************************************************/
+// CPU cycle counter (DWT), used to measure the encoding time
+#ifdef ARM_DWT_CYCCNT
+#define FLAC_CYCLES() ARM_DWT_CYCCNT
+#else
+#define FLAC_CYCLES() 0
+#endif
+
+/*** Constant objects ********************************************************/
+// CRC-16 of the frames, polynomial x^16 + x^15 + x^2 + 1
+const uint16_t flac_crc16_table[256] = {
+    0x0000, 0x8005, 0x800F, 0x000A, 0x801B, 0x001E, 0x0014, 0x8011,
+    0x8033, 0x0036, 0x003C, 0x8039, 0x0028, 0x802D, 0x8027, 0x0022,
+    0x8063, 0x0066, 0x006C, 0x8069, 0x0078, 0x807D, 0x8077, 0x0072,
+    0x0050, 0x8055, 0x805F, 0x005A, 0x804B, 0x004E, 0x0044, 0x8041,
+    0x80C3, 0x00C6, 0x00CC, 0x80C9, 0x00D8, 0x80DD, 0x80D7, 0x00D2,
+    0x00F0, 0x80F5, 0x80FF, 0x00FA, 0x80EB, 0x00EE, 0x00E4, 0x80E1,
+    0x00A0, 0x80A5, 0x80AF, 0x00AA, 0x80BB, 0x00BE, 0x00B4, 0x80B1,
+    0x8093, 0x0096, 0x009C, 0x8099, 0x0088, 0x808D, 0x8087, 0x0082,
+    0x8183, 0x0186, 0x018C, 0x8189, 0x0198, 0x819D, 0x8197, 0x0192,
+    0x01B0, 0x81B5, 0x81BF, 0x01BA, 0x81AB, 0x01AE, 0x01A4, 0x81A1,
+    0x01E0, 0x81E5, 0x81EF, 0x01EA, 0x81FB, 0x01FE, 0x01F4, 0x81F1,
+    0x81D3, 0x01D6, 0x01DC, 0x81D9, 0x01C8, 0x81CD, 0x81C7, 0x01C2,
+    0x0140, 0x8145, 0x814F, 0x014A, 0x815B, 0x015E, 0x0154, 0x8151,
+    0x8173, 0x0176, 0x017C, 0x8179, 0x0168, 0x816D, 0x8167, 0x0162,
+    0x8123, 0x0126, 0x012C, 0x8129, 0x0138, 0x813D, 0x8137, 0x0132,
+    0x0110, 0x8115, 0x811F, 0x011A, 0x810B, 0x010E, 0x0104, 0x8101,
+    0x8303, 0x0306, 0x030C, 0x8309, 0x0318, 0x831D, 0x8317, 0x0312,
+    0x0330, 0x8335, 0x833F, 0x033A, 0x832B, 0x032E, 0x0324, 0x8321,
+    0x0360, 0x8365, 0x836F, 0x036A, 0x837B, 0x037E, 0x0374, 0x8371,
+    0x8353, 0x0356, 0x035C, 0x8359, 0x0348, 0x834D, 0x8347, 0x0342,
+    0x03C0, 0x83C5, 0x83CF, 0x03CA, 0x83DB, 0x03DE, 0x03D4, 0x83D1,
+    0x83F3, 0x03F6, 0x03FC, 0x83F9, 0x03E8, 0x83ED, 0x83E7, 0x03E2,
+    0x83A3, 0x03A6, 0x03AC, 0x83A9, 0x03B8, 0x83BD, 0x83B7, 0x03B2,
+    0x0390, 0x8395, 0x839F, 0x039A, 0x838B, 0x038E, 0x0384, 0x8381,
+    0x0280, 0x8285, 0x828F, 0x028A, 0x829B, 0x029E, 0x0294, 0x8291,
+    0x82B3, 0x02B6, 0x02BC, 0x82B9, 0x02A8, 0x82AD, 0x82A7, 0x02A2,
+    0x82E3, 0x02E6, 0x02EC, 0x82E9, 0x02F8, 0x82FD, 0x82F7, 0x02F2,
+    0x02D0, 0x82D5, 0x82DF, 0x02DA, 0x82CB, 0x02CE, 0x02C4, 0x82C1,
+    0x8243, 0x0246, 0x024C, 0x8249, 0x0258, 0x825D, 0x8257, 0x0252,
+    0x0270, 0x8275, 0x827F, 0x027A, 0x826B, 0x026E, 0x0264, 0x8261,
+    0x0220, 0x8225, 0x822F, 0x022A, 0x823B, 0x023E, 0x0234, 0x8231,
+    0x8213, 0x0216, 0x021C, 0x8219, 0x0208, 0x820D, 0x8207, 0x0202,
+};
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* flacCrc8(const uint8_t*, unsigned int)
+ * --------------------------------------
+ * CRC-8 of a frame header, polynomial x^8 + x^2 + x + 1.
+ * IN:	- pointer to the bytes (const uint8_t*)
+ *			- number of bytes (unsigned int)
+ * OUT:	- CRC (uint8_t)
+ */
+uint8_t flacCrc8(const uint8_t *buf, unsigned int len) {
+  uint8_t crc = 0;
+  unsigned int i;
+
+  while (len--) {
+    crc ^= *buf++;
+    for (i = 0; i < 8; i++)
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+  }
+  return crc;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* flacCrc16(const uint8_t*, unsigned int)
+ * ---------------------------------------
+ * CRC-16 of a whole frame.
+ * IN:	- pointer to the bytes (const uint8_t*)
+ *			- number of bytes (unsigned int)
+ * OUT:	- CRC (uint16_t)
+ */
+uint16_t flacCrc16(const uint8_t *buf, unsigned int len) {
+  uint16_t crc = 0;
+
+  while (len--)
+    crc = (crc << 8) ^ flac_crc16_table[(crc >> 8) ^ *buf++];
+  return crc;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::putBits(uint32_t, unsigned int)
+ * --------------------------------------------
+ * Append bits to the output, most significant bit first.
+ * IN:	- value, higher bits ignored (uint32_t)
+ *			- number of bits, up to 32 (unsigned int)
+ * OUT:	- none
+ */
+void FlacEncoder::putBits(uint32_t val, unsigned int n) {
+  if (n < 32)
+    val &= (1UL << n) - 1;
+  acc = (acc << n) | val;
+  nbits += n;
+  while (nbits >= 8) {
+    nbits -= 8;
+    *bp++ = (uint8_t)(acc >> nbits);
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::putUtf8(uint32_t)
+ * ------------------------------
+ * Append a frame number, coded like UTF-8 characters.
+ * IN:	- value, up to 31 bits (uint32_t)
+ * OUT:	- none
+ */
+void FlacEncoder::putUtf8(uint32_t val) {
+  unsigned int cont;
+
+  if (val < 0x80) {
+    putBits(val, 8);
+    return;
+  }
+  if (val < 0x800)
+    cont = 1;
+  else if (val < 0x10000)
+    cont = 2;
+  else if (val < 0x200000)
+    cont = 3;
+  else if (val < 0x4000000)
+    cont = 4;
+  else
+    cont = 5;
+  // Leading byte: (cont + 1) ones, a zero and the highest value bits
+  putBits((0xFF00 >> (cont + 1)) | (val >> (6 * cont)), 8);
+  while (cont--)
+    putBits(0x80 | ((val >> (6 * cont)) & 0x3F), 8);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::alignBits(void)
+ * ----------------------------
+ * Pad the output with zero bits up to the next byte.
+ * IN:	- none
+ * OUT:	- none
+ */
+void FlacEncoder::alignBits(void) {
+  if (nbits)
+    putBits(0, 8 - nbits);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::encodeRice(const int32_t*, unsigned int, unsigned int)
+ * -------------------------------------------------------------------
+ * Append a residual as a single Rice partition.
+ * IN:	- pointer to the residual (const int32_t*)
+ *			- number of residual samples (unsigned int)
+ *			- Rice parameter (unsigned int)
+ * OUT:	- none
+ */
+void FlacEncoder::encodeRice(const int32_t *res, unsigned int n,
+                             unsigned int k) {
+  uint32_t u, q, r;
+  unsigned int i;
+
+  putBits(0, 2); // 4-bit Rice parameters
+  putBits(0, 4); // partition order 0
+  putBits(k, 4);
+  for (i = 0; i < n; i++) {
+    u = ((uint32_t)res[i] << 1) ^ (uint32_t)(res[i] >> 31);
+    q = u >> k;
+    r = u & ((1UL << k) - 1);
+    if ((q + 1 + k) <= 32) {
+      // Unary quotient, stop bit and remainder in one go
+      putBits((1UL << k) | r, q + 1 + k);
+    } else {
+      while (q > 24) {
+        putBits(0, 24);
+        q -= 24;
+      }
+      putBits(0, q);
+      putBits((1UL << k) | r, k + 1);
+    }
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::encodeSubframe(const int32_t*, unsigned int)
+ * ---------------------------------------------------------
+ * Append the subframe of one channel. The fixed predictor order giving
+ * the smallest residual sum is selected, as in the reference encoder,
+ * then the Rice parameter is estimated from the mean residual and
+ * refined on its neighbours. A constant or verbatim subframe is used
+ * when smaller.
+ * IN:	- pointer to the channel samples (const int32_t*)
+ *			- number of samples (unsigned int)
+ * OUT:	- none
+ */
+void FlacEncoder::encodeSubframe(const int32_t *x, unsigned int n) {
+  int32_t res[FLAC_BLOCK_SAMPLES];
+  uint32_t sum[FLAC_MAX_ORDER + 1] = {0};
+  int32_t e0, e1, e2, e3, e4, l0, l1, l2, l3;
+  uint32_t u, mean, bits, best_bits, k_bits;
+  unsigned int i, o, order, k, best_k;
+
+  for (i = 1; (i < n) && (x[i] == x[0]); i++)
+    ;
+  if (i == n) {
+    putBits(0x00, 8); // CONSTANT
+    putBits(x[0], bps);
+    return;
+  }
+  if (n <= FLAC_MAX_ORDER) {
+    putBits(0x02, 8); // VERBATIM
+    for (i = 0; i < n; i++)
+      putBits(x[i], bps);
+    return;
+  }
+
+  // Residual sums of the fixed predictors, by successive differences
+  l0 = x[3];
+  l1 = x[3] - x[2];
+  l2 = l1 - (x[2] - x[1]);
+  l3 = l2 - (x[2] - 2 * x[1] + x[0]);
+  for (i = FLAC_MAX_ORDER; i < n; i++) {
+    e0 = x[i];
+    e1 = e0 - l0;
+    e2 = e1 - l1;
+    e3 = e2 - l2;
+    e4 = e3 - l3;
+    sum[0] += (uint32_t)abs(e0);
+    sum[1] += (uint32_t)abs(e1);
+    sum[2] += (uint32_t)abs(e2);
+    sum[3] += (uint32_t)abs(e3);
+    sum[4] += (uint32_t)abs(e4);
+    l0 = e0;
+    l1 = e1;
+    l2 = e2;
+    l3 = e3;
+  }
+  order = 0;
+  for (o = 1; o <= FLAC_MAX_ORDER; o++) {
+    if (sum[o] < sum[order])
+      order = o;
+  }
+
+  // Residual of the selected predictor
+  for (i = order; i < n; i++) {
+    switch (order) {
+    case 0:
+      res[i - order] = x[i];
+      break;
+    case 1:
+      res[i - order] = x[i] - x[i - 1];
+      break;
+    case 2:
+      res[i - order] = x[i] - 2 * x[i - 1] + x[i - 2];
+      break;
+    case 3:
+      res[i - order] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+      break;
+    default:
+      res[i - order] =
+          x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+      break;
+    }
+  }
+
+  // Rice parameter: log2 of the mean folded residual, then neighbours
+  mean = 0;
+  for (i = 0; i < (n - order); i++)
+    mean += ((uint32_t)res[i] << 1) ^ (uint32_t)(res[i] >> 31);
+  mean /= (n - order);
+  k = mean ? (31 - __builtin_clz(mean)) : 0;
+  if (k > FLAC_MAX_RICE_PARAM)
+    k = FLAC_MAX_RICE_PARAM;
+  best_k = k;
+  best_bits = 0xFFFFFFFF;
+  for (k = (k ? (k - 1) : 0);
+       (k <= (best_k + 1)) && (k <= FLAC_MAX_RICE_PARAM); k++) {
+    k_bits = (n - order) * (k + 1);
+    for (i = 0; i < (n - order); i++) {
+      u = ((uint32_t)res[i] << 1) ^ (uint32_t)(res[i] >> 31);
+      k_bits += u >> k;
+    }
+    if (k_bits < best_bits) {
+      best_bits = k_bits;
+      best_k = k;
+    }
+  }
+
+  bits = 8 + (order * bps) + 10 + best_bits;
+  if (bits >= (8 + (n * bps))) {
+    putBits(0x02, 8); // VERBATIM
+    for (i = 0; i < n; i++)
+      putBits(x[i], bps);
+    return;
+  }
+  putBits(0x10 | (order << 1), 8); // FIXED, order
+  for (i = 0; i < order; i++)
+    putBits(x[i], bps);
+  encodeRice(res, n - order, best_k);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::encodeFrame(const uint8_t*, unsigned int)
+ * ------------------------------------------------------
+ * Encode a frame at the end of the output buffer.
+ * IN:	- pointer to the interleaved PCM samples (const uint8_t*)
+ *			- number of samples per channel (unsigned int)
+ * OUT:	- frame size in bytes (unsigned int)
+ */
+unsigned int FlacEncoder::encodeFrame(const uint8_t *pcm, unsigned int n) {
+  int32_t x[REC_CHANNELS_MAX][FLAC_BLOCK_SAMPLES];
+  uint8_t *frame = &out[out_len];
+  unsigned int ch, i, len;
+  uint16_t crc;
+
+  // De-interleave (16-bit little endian or 8-bit unsigned)
+  for (i = 0; i < n; i++) {
+    for (ch = 0; ch < channels; ch++) {
+      if (bps == 8) {
+        x[ch][i] = (int32_t)(*pcm++) - 128;
+      } else {
+        x[ch][i] = (int16_t)(pcm[0] | (pcm[1] << 8));
+        pcm += 2;
+      }
+    }
+  }
+
+  bp = frame;
+  acc = 0;
+  nbits = 0;
+  putBits(0xFFF8, 16); // sync code, fixed block size
+  putBits(((n - 1) < 256) ? 0x6 : 0x7, 4);
+  if (rate == 44100)
+    putBits(0x9, 4);
+  else if (rate == 22050)
+    putBits(0x6, 4);
+  else
+    putBits(0x0, 4); // from STREAMINFO
+  putBits(channels - 1, 4); // independent channels
+  putBits((bps == 8) ? 0x1 : 0x4, 3);
+  putBits(0, 1);
+  putUtf8(frame_num);
+  if ((n - 1) < 256)
+    putBits(n - 1, 8);
+  else
+    putBits(n - 1, 16);
+  putBits(flacCrc8(frame, bp - frame), 8);
+
+  for (ch = 0; ch < channels; ch++)
+    encodeSubframe(x[ch], n);
+  alignBits();
+  crc = flacCrc16(frame, bp - frame);
+  putBits(crc, 16);
+
+  len = bp - frame;
+  out_len += len;
+  frame_num++;
+  return len;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::begin(unsigned int, unsigned long, unsigned int)
+ * -------------------------------------------------------------
+ * Start a new stream. The stream header is placed in the output buffer,
+ * to be patched by the checkpoints.
+ * IN:	- number of channels (unsigned int)
+ *			- sampling rate in Hz (unsigned long)
+ *			- bits per sample, 8 or 16 (unsigned int)
+ * OUT:	- none
+ */
+void FlacEncoder::begin(unsigned int nb_chans, unsigned long srate,
+                        unsigned int nb_bits) {
+  channels = nb_chans;
+  rate = srate;
+  bps = nb_bits;
+  out_len = 0;
+  out_base = 0;
+  fifo_first = 0;
+  fifo_cnt = 0;
+  frame_num = 0;
+  synced_end = FLAC_HEADER_SIZE;
+  synced_smp = 0;
+  min_frame = 0xFFFFFF;
+  max_frame = 0;
+  frames = 0;
+  max_cyc = 0;
+  sum_cyc = 0;
+#ifdef ARM_DWT_CYCCNT
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+  out_len = header(out);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::header(uint8_t*)
+ * -----------------------------
+ * Build the stream header for the frames handed out so far: the total
+ * number of samples and the stream length in the checkpoint block only
+ * cover whole frames.
+ * IN:	- pointer to a FLAC_HEADER_SIZE bytes buffer (uint8_t*)
+ * OUT:	- header size in bytes (unsigned int)
+ */
+unsigned int FlacEncoder::header(uint8_t *buf) {
+  uint32_t min_fs = (max_frame ? min_frame : 0);
+
+  bp = buf;
+  acc = 0;
+  nbits = 0;
+  putBits(0x664C6143, 32); // "fLaC"
+  // STREAMINFO
+  putBits(0, 1);
+  putBits(0, 7);
+  putBits(34, 24);
+  putBits(FLAC_BLOCK_SAMPLES, 16);
+  putBits(FLAC_BLOCK_SAMPLES, 16);
+  putBits(min_fs, 24);
+  putBits(max_frame, 24);
+  putBits(rate, 20);
+  putBits(channels - 1, 3);
+  putBits(bps - 1, 5);
+  putBits((uint32_t)(synced_smp >> 32), 4);
+  putBits((uint32_t)synced_smp, 32);
+  for (unsigned int i = 0; i < 4; i++)
+    putBits(0, 32); // no MD5 signature
+  // APPLICATION, last metadata block: stream length at the checkpoint
+  putBits(1, 1);
+  putBits(2, 7);
+  putBits(8, 24);
+  memcpy(bp, FLAC_APP_ID, 4);
+  bp += 4;
+  putBits(synced_end, 32);
+  return (bp - buf);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::encode(const uint8_t*, unsigned int)
+ * -------------------------------------------------
+ * Encode PCM data, frame by frame, as long as the output buffer has
+ * room. Only the last call of a stream may end with a shorter frame.
+ * IN:	- pointer to the interleaved PCM data (const uint8_t*)
+ *			- number of bytes (unsigned int)
+ * OUT:	- number of bytes consumed (unsigned int)
+ */
+unsigned int FlacEncoder::encode(const uint8_t *pcm, unsigned int len) {
+  unsigned int smp_bytes = channels * (bps / 8);
+  unsigned int done = 0;
+  unsigned int n, last;
+  uint32_t cyc, size;
+
+  while (((len - done) >= smp_bytes) && (fifo_cnt < FLAC_FRAMES_MAX) &&
+         ((out_len + FLAC_FRAME_MAX) <= sizeof(out))) {
+    n = (len - done) / smp_bytes;
+    if (n > FLAC_BLOCK_SAMPLES)
+      n = FLAC_BLOCK_SAMPLES;
+    cyc = FLAC_CYCLES();
+    size = encodeFrame(&pcm[done], n);
+    cyc = FLAC_CYCLES() - cyc;
+    done += n * smp_bytes;
+
+    last = (fifo_first + fifo_cnt) % FLAC_FRAMES_MAX;
+    fifo_end[last] = out_base + out_len;
+    fifo_smp[last] = n;
+    fifo_cnt++;
+    if (size < min_frame)
+      min_frame = size;
+    if (size > max_frame)
+      max_frame = size;
+    frames++;
+    sum_cyc += cyc;
+    if (cyc > max_cyc)
+      max_cyc = cyc;
+  }
+  return done;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::output(unsigned int*)
+ * ----------------------------------
+ * Get the encoded data available in whole sectors.
+ * IN:	- pointer to the number of bytes (unsigned int*)
+ * OUT:	- pointer to the data (uint8_t*)
+ */
+uint8_t *FlacEncoder::output(unsigned int *len) {
+  *len = out_len - (out_len % REC_SECTOR_SIZE);
+  return out;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::flush(unsigned int*)
+ * ---------------------------------
+ * Get all the encoded data, at the end of the stream.
+ * IN:	- pointer to the number of bytes (unsigned int*)
+ * OUT:	- pointer to the data (uint8_t*)
+ */
+uint8_t *FlacEncoder::flush(unsigned int *len) {
+  *len = out_len;
+  return out;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* FlacEncoder::consume(unsigned int)
+ * ----------------------------------
+ * Drop data written to the SD card from the output buffer and account
+ * for the frames it completes.
+ * IN:	- number of bytes written (unsigned int)
+ * OUT:	- none
+ */
+void FlacEncoder::consume(unsigned int len) {
+  if (len > out_len)
+    len = out_len;
+  memmove(out, &out[len], out_len - len);
+  out_len -= len;
+  out_base += len;
+  while (fifo_cnt && (fifo_end[fifo_first] <= out_base)) {
+    synced_end = fifo_end[fifo_first];
+    synced_smp += fifo_smp[fifo_first];
+    fifo_first = (fifo_first + 1) % FLAC_FRAMES_MAX;
+    fifo_cnt--;
+  }
+}
+/*****************************************************************************/
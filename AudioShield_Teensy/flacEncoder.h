@@ -0,0 +1,103 @@
+/*
+ * flacEncoder.h
+ */
+#ifndef _FLACENCODER_H_
+#define _FLACENCODER_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "main.h"
+#include "recEncoder.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Samples per channel in a FLAC frame (one audio block)
+#define FLAC_BLOCK_SAMPLES AUDIO_BLOCK_SAMPLES
+// Highest order of the fixed linear predictors
+#define FLAC_MAX_ORDER 4
+// Largest Rice parameter (15 is the escape code)
+#define FLAC_MAX_RICE_PARAM 14
+// Stream header: "fLaC", STREAMINFO and an APPLICATION block holding the
+// length of the stream at the last checkpoint
+#define FLAC_HEADER_SIZE 54
+// Application ID of the checkpoint block ("SSOL")
+#define FLAC_APP_ID "SSOL"
+// Largest frame header, CRC-8 included
+#define FLAC_FRAME_HEADER_MAX 18
+// Largest frame: header, verbatim 16-bit stereo subframes and CRC-16
+#define FLAC_FRAME_MAX                                                         \
+  (FLAC_FRAME_HEADER_MAX + (2 * (1 + (FLAC_BLOCK_SAMPLES * 2))) + 2)
+// Output buffer, in sectors (plus room for one frame)
+#define FLAC_OUT_SECTORS 8
+// Encoded frames not yet handed out to the SD card
+#define FLAC_FRAMES_MAX 64
+
+/*** Types *******************************************************************/
+/* FlacEncoder
+ * -----------
+ * Lossless encoder turning the PCM data of the record ring into a FLAC
+ * stream. Each frame holds FLAC_BLOCK_SAMPLES samples per channel, the
+ * channels are coded independently with the best fixed linear predictor
+ * (order 0 to FLAC_MAX_ORDER) and a single Rice partition, or verbatim
+ * or as a constant when cheaper. The MD5 signature is left blank.
+ * The encoded stream is handed out in whole sectors, so that the raw
+ * recorder keeps streaming. The encoder keeps track of the frames
+ * completely handed out, so that a checkpoint of the header only covers
+ * whole frames.
+ */
+class FlacEncoder : public RecEncoder {
+public:
+  FlacEncoder(void) {
+    out_len = 0;
+    out_base = 0;
+  }
+  void begin(unsigned int nb_chans, unsigned long srate, unsigned int nb_bits);
+  unsigned int header(uint8_t *buf);
+  unsigned int encode(const uint8_t *pcm, unsigned int len);
+  uint8_t *output(unsigned int *len);
+  uint8_t *flush(unsigned int *len);
+  void consume(unsigned int len);
+  uint32_t syncedBytes(void) { return synced_end; }
+  uint32_t meanFrameCycles(void) {
+    return (frames ? (uint32_t)(sum_cyc / frames) : 0);
+  }
+  uint32_t maxFrameCycles(void) { return max_cyc; }
+
+private:
+  void putBits(uint32_t val, unsigned int n);
+  void putUtf8(uint32_t val);
+  void alignBits(void);
+  unsigned int encodeFrame(const uint8_t *pcm, unsigned int n);
+  void encodeSubframe(const int32_t *x, unsigned int n);
+  void encodeRice(const int32_t *res, unsigned int n, unsigned int k);
+  unsigned int channels;              // number of channels
+  unsigned long rate;                 // sampling rate (Hz)
+  unsigned int bps;                   // bits per sample
+  uint8_t *bp;                        // bit writer: next output byte
+  uint64_t acc;                       // bit writer: pending bits
+  unsigned int nbits;                 // bit writer: number of pending bits
+  uint8_t out[(FLAC_OUT_SECTORS * REC_SECTOR_SIZE) + FLAC_FRAME_MAX];
+  unsigned int out_len;               // encoded bytes in the output buffer
+  uint32_t out_base;                  // stream offset of the output buffer
+  uint32_t fifo_end[FLAC_FRAMES_MAX]; // stream offset after each frame
+  uint16_t fifo_smp[FLAC_FRAMES_MAX]; // samples of each frame
+  unsigned int fifo_first;            // oldest frame not handed out
+  unsigned int fifo_cnt;              // frames not handed out
+  uint32_t frame_num;                 // next frame number
+  uint32_t synced_end;                // end of the last frame handed out
+  uint64_t synced_smp;                // samples of the frames handed out
+  uint32_t min_frame;                 // smallest frame (bytes)
+  uint32_t max_frame;                 // largest frame (bytes)
+  uint32_t frames;                    // number of encoded frames
+  uint32_t max_cyc;                   // longest frame encoding (CPU cycles)
+  uint64_t sum_cyc;                   // total encoding time (CPU cycles)
+};
+
+/*** Variables ***************************************************************/
+extern FlacEncoder flac_enc;
+
+/*** Functions ***************************************************************/
+
+#endif /* _FLACENCODER_H_ */
@@ -0,0 +1,158 @@
+/*
+ * Level analyzer
+ *
+ * Input level statistics computed in the audio update interrupt,
+ * for the peak LED, the event trigger and the recording metadata.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "levelAnalyzer.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeLevel::readPeak(void)
+ * ---------------------------------
+ * Scaled by 32767, as AudioAnalyzePeak::read(), so that a full scale
+ * sample of either sign reads 1.0 or more (peak LED).
+ * IN:	- none
+ * OUT:	- highest sample magnitude since the last call, 1.0 -> full
+ *			  scale (float)
+ */
+float AudioAnalyzeLevel::readPeak(void) {
+  uint32_t pk;
+
+  __disable_irq();
+  pk = int_peak;
+  int_peak = 0;
+  new_output = false;
+  __enable_irq();
+  return (float)pk / 32767.0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeLevel::readRms(void)
+ * --------------------------------
+ * IN:	- none
+ * OUT:	- RMS level since the last call, 1.0 -> full scale (float)
+ */
+float AudioAnalyzeLevel::readRms(void) {
+  uint64_t sq;
+  uint32_t cnt;
+
+  __disable_irq();
+  sq = int_sq;
+  cnt = int_cnt;
+  int_sq = 0;
+  int_cnt = 0;
+  new_output = false;
+  __enable_irq();
+  if (!cnt)
+    return 0.0;
+  return sqrtf((float)sq / (float)cnt) / 32768.0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeLevel::resetStats(void)
+ * -----------------------------------
+ * Restart the rolling statistics (start of a recording).
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeLevel::resetStats(void) {
+  __disable_irq();
+  tot_peak = 0;
+  tot_sum = 0;
+  tot_sq = 0;
+  max_blk_sq = 0;
+  tot_clips = 0;
+  tot_blocks = 0;
+  __enable_irq();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeLevel::readStats(struct levelSummary*)
+ * --------------------------------------------------
+ * Summarize the rolling statistics since the last resetStats().
+ * IN:	- pointer to the summary, overwritten (struct levelSummary*)
+ * OUT:	- none
+ */
+void AudioAnalyzeLevel::readStats(struct levelSummary *sum) {
+  uint32_t pk, clips, blocks;
+  int64_t s;
+  uint64_t sq, max_sq;
+  float n;
+
+  __disable_irq();
+  pk = tot_peak;
+  s = tot_sum;
+  sq = tot_sq;
+  max_sq = max_blk_sq;
+  clips = tot_clips;
+  blocks = tot_blocks;
+  __enable_irq();
+  memset(sum, 0, sizeof(struct levelSummary));
+  sum->clips = clips;
+  sum->blocks = blocks;
+  if (!blocks)
+    return;
+  n = (float)blocks * AUDIO_BLOCK_SAMPLES;
+  sum->peak = (float)pk / 32768.0;
+  sum->rms = sqrtf((float)sq / n) / 32768.0;
+  sum->loudest = sqrtf((float)max_sq / AUDIO_BLOCK_SAMPLES) / 32768.0;
+  sum->dc = ((float)s / n) / 32768.0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeLevel::update(void)
+ * -------------------------------
+ * Audio interrupt: analyze the received block and update both sets of
+ * statistics.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeLevel::update(void) {
+  audio_block_t *block;
+  struct levelStats st;
+  uint32_t pk;
+
+  block = receiveReadOnly(0);
+  if (!block)
+    return;
+  levelBlock(block->data, AUDIO_BLOCK_SAMPLES, &st);
+  release(block);
+
+  pk = (st.max > -st.min) ? st.max : -st.min;
+  if (int_cnt >= LEVEL_INTERVAL_MAX) {
+    int_sq = 0;
+    int_cnt = 0;
+  }
+  if (pk > int_peak)
+    int_peak = pk;
+  int_sq += st.sum_sq;
+  int_cnt += AUDIO_BLOCK_SAMPLES;
+  if (pk > tot_peak)
+    tot_peak = pk;
+  tot_sum += st.sum;
+  tot_sq += st.sum_sq;
+  if (st.sum_sq > max_blk_sq)
+    max_blk_sq = st.sum_sq;
+  tot_clips += st.clips;
+  tot_blocks++;
+  new_output = true;
+}
+/*****************************************************************************/
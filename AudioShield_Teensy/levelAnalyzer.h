@@ -0,0 +1,77 @@
+/*
+ * levelAnalyzer.h
+ */
+#ifndef _LEVELANALYZER_H_
+#define _LEVELANALYZER_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#include "levelKernel.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Level reported for silence (dBFS)
+#define LEVEL_DB_FLOOR -120.0
+// Samples of an unread peak/RMS interval before it restarts (~6 min)
+#define LEVEL_INTERVAL_MAX (1UL << 24)
+
+/*** Types *******************************************************************/
+// Input level statistics since the last resetStats(), relative to full
+// scale (1.0)
+struct levelSummary {
+  float peak;           // highest sample magnitude
+  float rms;            // RMS level
+  float loudest;        // RMS level of the loudest audio block
+  float dc;             // DC offset
+  unsigned long clips;  // samples at full scale
+  unsigned long blocks; // analyzed audio blocks
+};
+
+/* AudioAnalyzeLevel
+ * -----------------
+ * Audio sink computing the peak, RMS, DC offset and clipping statistics
+ * of every incoming block in the audio update interrupt (see
+ * levelKernel.cpp). Two sets of statistics are kept: the peak and RMS
+ * level since the last readPeak() / readRms() (LED, event trigger), and
+ * the rolling statistics of a whole recording, restarted with
+ * resetStats().
+ */
+class AudioAnalyzeLevel : public AudioStream {
+public:
+  AudioAnalyzeLevel(void) : AudioStream(1, inputQueueArray) {
+    new_output = false;
+    int_peak = 0;
+    int_sq = 0;
+    int_cnt = 0;
+    resetStats();
+  }
+  bool available(void) { return new_output; }
+  float readPeak(void);
+  float readRms(void);
+  void resetStats(void);
+  void readStats(struct levelSummary *sum);
+  virtual void update(void);
+
+private:
+  audio_block_t *inputQueueArray[1];
+  volatile bool new_output; // block analyzed since the last read
+  uint32_t int_peak;        // interval: highest sample magnitude
+  uint64_t int_sq;          // interval: sum of the squared samples
+  uint32_t int_cnt;         // interval: number of samples
+  uint32_t tot_peak;        // recording: highest sample magnitude
+  int64_t tot_sum;          // recording: sum of the samples
+  uint64_t tot_sq;          // recording: sum of the squared samples
+  uint64_t max_blk_sq;      // recording: loudest block sum of squares
+  uint32_t tot_clips;       // recording: samples at full scale
+  uint32_t tot_blocks;      // recording: number of blocks
+};
+
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+
+#endif /* _LEVELANALYZER_H_ */
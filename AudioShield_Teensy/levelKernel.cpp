@@ -0,0 +1,122 @@
+/*
+ * Level kernel
+ *
+ * Peak, DC offset, RMS and clipping statistics of a block of samples,
+ * shared by the level analyzer (audio interrupt) and its host benchmark.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "levelKernel.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+
+/*** Functions implementation ************************************************/
+
+#if defined(__ARM_FEATURE_DSP)
+/*****************************************************************************/
+/* SIMD instructions of the Cortex-M4, on two 16-bit samples per word.
+ * ssub16 sets the GE flags read by sel, so each pair stays in a single
+ * asm statement.
+ */
+static inline int32_t smlad(uint32_t a, uint32_t b, int32_t acc) {
+  int32_t out;
+  __asm__("smlad %0, %1, %2, %3" : "=r"(out) : "r"(a), "r"(b), "r"(acc));
+  return out;
+}
+static inline uint64_t smlald(uint32_t a, uint32_t b, uint64_t acc) {
+  uint32_t lo = (uint32_t)acc;
+  uint32_t hi = (uint32_t)(acc >> 32);
+  __asm__("smlald %0, %1, %2, %3" : "+r"(lo), "+r"(hi) : "r"(a), "r"(b));
+  return ((uint64_t)hi << 32) | lo;
+}
+static inline uint32_t max16x2(uint32_t a, uint32_t b) {
+  uint32_t out;
+  __asm__("ssub16 %0, %1, %2\n\t"
+          "sel %0, %1, %2"
+          : "=&r"(out)
+          : "r"(a), "r"(b)
+          : "cc");
+  return out;
+}
+static inline uint32_t min16x2(uint32_t a, uint32_t b) {
+  uint32_t out;
+  __asm__("ssub16 %0, %2, %1\n\t"
+          "sel %0, %1, %2"
+          : "=&r"(out)
+          : "r"(a), "r"(b)
+          : "cc");
+  return out;
+}
+/*****************************************************************************/
+#endif
+
+/*****************************************************************************/
+/* levelBlock(const int16_t*, unsigned int, struct levelStats*)
+ * ------------------------------------------------------------
+ * Compute the statistics of a block of samples. On a Cortex-M4, four
+ * samples are processed per iteration with the SIMD instructions: dual
+ * multiply-accumulates for the sums (smlad, smlald) and dual compares
+ * for the extremes (ssub16 + sel). The samples at full scale are only
+ * counted in the (rare) blocks reaching it.
+ * IN:	- pointer to the samples, 4-byte aligned (const int16_t*)
+ *			- number of samples (unsigned int)
+ *			- pointer to the statistics, overwritten (struct levelStats*)
+ * OUT:	- none
+ */
+void levelBlock(const int16_t *x, unsigned int n, struct levelStats *st) {
+  int32_t max = -32768, min = 32767, sum = 0;
+  uint64_t sum_sq = 0;
+  unsigned int i = 0;
+
+#if defined(__ARM_FEATURE_DSP)
+  const uint32_t *p = (const uint32_t *)x;
+  uint32_t mx = 0x80008000, mn = 0x7FFF7FFF, a, b;
+
+  for (; (i + 4) <= n; i += 4) {
+    a = *p++;
+    b = *p++;
+    sum = smlad(a, 0x00010001, sum);
+    sum = smlad(b, 0x00010001, sum);
+    sum_sq = smlald(a, a, sum_sq);
+    sum_sq = smlald(b, b, sum_sq);
+    mx = max16x2(a, mx);
+    mx = max16x2(b, mx);
+    mn = min16x2(a, mn);
+    mn = min16x2(b, mn);
+  }
+  max = (int16_t)(mx >> 16);
+  if ((int16_t)mx > max)
+    max = (int16_t)mx;
+  min = (int16_t)(mn >> 16);
+  if ((int16_t)mn < min)
+    min = (int16_t)mn;
+#endif
+  for (; i < n; i++) {
+    sum += x[i];
+    sum_sq += (uint64_t)((int32_t)x[i] * x[i]);
+    if (x[i] > max)
+      max = x[i];
+    if (x[i] < min)
+      min = x[i];
+  }
+  st->max = (int16_t)max;
+  st->min = (int16_t)min;
+  st->sum = sum;
+  st->sum_sq = sum_sq;
+  st->clips = 0;
+  if ((max >= LEVEL_CLIP) || (min <= -LEVEL_CLIP)) {
+    for (i = 0; i < n; i++) {
+      if ((x[i] >= LEVEL_CLIP) || (x[i] <= -LEVEL_CLIP))
+        st->clips++;
+    }
+  }
+}
+/*****************************************************************************/
@@ -0,0 +1,32 @@
+/*
+ * levelKernel.h
+ */
+#ifndef _LEVELKERNEL_H_
+#define _LEVELKERNEL_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdint.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Sample magnitude counted as clipped (full scale)
+#define LEVEL_CLIP 32767
+
+/*** Types *******************************************************************/
+// Statistics of one block of 16-bit samples
+struct levelStats {
+  int16_t max;     // highest sample
+  int16_t min;     // lowest sample
+  int32_t sum;     // sum of the samples (DC offset)
+  uint64_t sum_sq; // sum of the squared samples (RMS)
+  uint32_t clips;  // samples at full scale
+};
+
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+void levelBlock(const int16_t *x, unsigned int n, struct levelStats *st);
+
+#endif /* _LEVELKERNEL_H_ */
@@ -10,8 +10,7 @@
 #include <Audio.h>
 #include <Bounce.h>
 #include <SPI.h>
-// #include <SdFat.h>
-#include <SD.h>
+#include <SdFat.h>
 #include <SerialFlash.h>
 #include <Snooze.h>
 #include <TimeAlarms.h>
@@ -19,14 +18,6 @@
 #include <TinyGPS.h>
 #include <Wire.h>
 
-// Own headers
-#include "BC127.h"
-#include "IOutils.h"
-#include "SDutils.h"
-#include "audioUtils.h"
-#include "gpsRoutines.h"
-#include "timeUtils.h"
-
 /*** EXPORTED OBJECTS ********************************************************/
 /*****************************************************************************/
 
@@ -70,7 +61,10 @@ enum recState {
   RECSTATE_IDLE,      // 6 -> idle mode (SLEEP state)
   RECSTATE_REQ_RESTART, // 7 -> requesting to restart recording (after wait or
                         // idle mode)
-  RECSTATE_REQ_OFF // 8 -> requesting to stop recording (REC button pressed)
+  RECSTATE_REQ_OFF, // 8 -> requesting to stop recording (REC button pressed)
+  RECSTATE_ARMED,   // 9 -> waiting for an audio event (pre-trigger ring)
+  RECSTATE_REQ_REARM // 10 -> requesting to close the event recording and
+                     // wait for the next event
 };
 extern enum recState rec_state;
 // Monitoring states...
@@ -133,11 +127,13 @@ struct recInfo {
   bool t_set;                // time synced?
   String rpath;              // record path on SD card
   String mpath;              // metadata path on SD card
+  String spath;              // spectral summary path on SD card
   float gps_lat;             // GPS latitude (signed dd)
   float gps_long;            // GPS longitude (signed dd)
   enum gpsSource gps_source; // GPS source
   unsigned int cnt;          // record counter
   unsigned int rec_tot;      // total number of records
+  unsigned int rec_fit;      // records fitting on the SD card (0 -> all)
   bool man_stop;             // recording sequence manually stopped
 };
 extern struct recInfo last_record;
@@ -149,6 +145,25 @@ struct rWindow {
   unsigned int occurences; // # of occurences (0 -> infinite repetitions)
 };
 extern struct rWindow rec_window;
+// Recording file formats
+enum recFormat { RECFMT_WAV, RECFMT_FLAC, RECFMT_BFP };
+// Capture profile
+struct capProfile {
+  unsigned int channels; // 1 -> mono, 2 -> stereo
+  unsigned int decim;    // decimation factor of 44.1 kHz (1, 2 or 4)
+  unsigned int bits;     // bits per sample (8 or 16)
+  enum recFormat format; // file format
+  unsigned int width;    // mantissa width (RECFMT_BFP)
+};
+extern struct capProfile cap_profile;
+// Event trigger
+struct evTrigger {
+  bool enabled;          // event-triggered recordings
+  float threshold;       // input peak level starting a recording (0.0-1.0)
+  unsigned int pre_ms;   // audio kept before the event (ms)
+  unsigned int hang_sec; // quiet time ending a recording (s)
+};
+extern struct evTrigger evt_trigger;
 
 /*** Variables ***************************************************************/
 extern const bool debug;
@@ -156,4 +171,24 @@ extern time_t rec_rem;
 
 /*** Functions ***************************************************************/
 
+/*** Own headers *************************************************************/
+// Included after the project-wide types, which they use. The headers not
+// depending on main.h come first.
+#include "levelAnalyzer.h"
+#include "recEncoder.h"
+#include "recordRing.h"
+#include "spectrumAnalyzer.h"
+
+#include "BC127.h"
+#include "IOutils.h"
+#include "SDutils.h"
+#include "audioUtils.h"
+#include "bfpPacker.h"
+#include "bleStatus.h"
+#include "flacEncoder.h"
+#include "gpsRoutines.h"
+#include "rawRecorder.h"
+#include "recStats.h"
+#include "timeUtils.h"
+
 #endif /* _MAIN_H_ */
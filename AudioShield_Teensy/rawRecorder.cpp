@@ -0,0 +1,271 @@
+/*
+ * Raw recorder
+ *
+ * Sector streaming of the recorded audio into a
+ * pre-allocated file, bypassing the file system.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "rawRecorder.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+RawRecorder raw_rec;
+
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::startSegment(void)
+ * -------------------------------
+ * Start a multi-block write from the next block up to the end of the
+ * contiguous range, or up to the longest transfer of the card interface.
+ * Copies of these blocks left in the volume cache (read-ahead) would be
+ * stale once written, they are dropped first.
+ * IN:	- none
+ * OUT:	- multi-block write started (bool)
+ */
+bool RawRecorder::startSegment(void) {
+  uint32_t cnt = end_block - block + 1;
+  if (cnt > RAW_SEGMENT_BLOCKS_MAX)
+    cnt = RAW_SEGMENT_BLOCKS_MAX;
+  seg_end = block + cnt - 1;
+  file->volume()->cacheInvalidate(block, cnt);
+  raw = card->writeStart(block, cnt);
+  return raw;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::leaveRaw(void)
+ * ---------------------------
+ * Stop the multi-block write and place the file position after the
+ * data written so far, so that the file system takes over.
+ * IN:	- none
+ * OUT:	- success (bool)
+ */
+bool RawRecorder::leaveRaw(void) {
+  bool ok = card->writeStop();
+  raw = false;
+  return file->seekSet(bytes) && ok;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::begin(sdCard_t*, FatFile*)
+ * ---------------------------------------
+ * Attach the SD card driver and the file handle used for the recordings.
+ * IN:	- pointer to the SD card driver (sdCard_t*)
+ *			- pointer to the recording file handle (FatFile*)
+ * OUT:	- none
+ */
+void RawRecorder::begin(sdCard_t *sd_card, FatFile *rec_file) {
+  card = sd_card;
+  file = rec_file;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::open(const char*, uint32_t)
+ * ----------------------------------------
+ * Create the recording file. With a non-zero size, the file is allocated
+ * contiguously and the multi-block write is started on its first block.
+ * Without size, or if there is no contiguous space left, a regular file
+ * is created.
+ * IN:	- file path (const char*)
+ *			- file size to pre-allocate in bytes, 0 if unknown (uint32_t)
+ * OUT:	- file successfully opened (bool)
+ */
+bool RawRecorder::open(const char *path, uint32_t size) {
+  uint32_t bgn;
+
+  raw = false;
+  bytes = 0;
+  writes = 0;
+  max_us = 0;
+  sum_us = 0;
+  if (size && file->createContiguous(path, size)) {
+    if (file->contiguousRange(&bgn, &end_block)) {
+      block = bgn;
+      if (startSegment())
+        return true;
+    }
+    file->remove();
+  }
+  if (size && debug)
+    snooze_usb.println("SD:      Contiguous pre-allocation failed");
+  return file->open(path, O_RDWR | O_CREAT | O_TRUNC);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::write(const uint8_t*, uint32_t)
+ * --------------------------------------------
+ * Write recorded data. Whole sectors go straight to the card as long as
+ * the pre-allocated range lasts. A partial sector, a card error or the
+ * end of the range terminates the raw streaming: the rest is appended
+ * through the file system.
+ * IN:	- pointer to the data (const uint8_t*)
+ *			- number of bytes (uint32_t)
+ * OUT:	- number of bytes written (uint32_t)
+ */
+uint32_t RawRecorder::write(const uint8_t *buf, uint32_t len) {
+  uint32_t us = micros();
+  uint32_t done = 0;
+
+  while (raw && (len >= REC_SECTOR_SIZE)) {
+    if (block > seg_end) {
+      // Next segment of a range too long for a single transfer
+      if (!card->writeStop() || !startSegment()) {
+        raw = false;
+        file->seekSet(bytes);
+        break;
+      }
+    }
+    if (!card->writeData(buf)) {
+      if (debug)
+        snooze_usb.println("SD:      Raw sector write error");
+      break;
+    }
+    block++;
+    buf += REC_SECTOR_SIZE;
+    len -= REC_SECTOR_SIZE;
+    done += REC_SECTOR_SIZE;
+    bytes += REC_SECTOR_SIZE;
+    if (block > end_block)
+      leaveRaw();
+  }
+  if (len) {
+    if (raw)
+      leaveRaw();
+    int n = file->write(buf, len);
+    if (n > 0) {
+      done += n;
+      bytes += n;
+    }
+  }
+
+  us = micros() - us;
+  logWriteLatency(us);
+  writes++;
+  sum_us += us;
+  if (us > max_us)
+    max_us = us;
+  return done;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::patch(uint32_t, const void*, uint32_t)
+ * ---------------------------------------------------
+ * Overwrite already written bytes (i.e. the file header) through the
+ * still-open file. A running multi-block write is suspended and resumed
+ * on the next block, without touching the FAT.
+ * IN:	- file position of the bytes (uint32_t)
+ *			- pointer to the new bytes (const void*)
+ *			- number of bytes (uint32_t)
+ * OUT:	- success (bool)
+ */
+bool RawRecorder::patch(uint32_t pos, const void *buf, uint32_t len) {
+  bool ok;
+
+  if ((pos + len) > bytes)
+    return false;
+  if (!suspend())
+    return false;
+  ok = file->seekSet(pos) && (file->write(buf, len) == (int)len) &&
+       file->sync();
+  return resume() && ok;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::suspend(void)
+ * --------------------------
+ * Stop the running multi-block write, so that the card can be used
+ * through the file system (header patch, other files), until resume().
+ * If the card refuses, the file system takes over for good.
+ * IN:	- none
+ * OUT:	- success (bool)
+ */
+bool RawRecorder::suspend(void) {
+  bool ok;
+
+  resume_raw = false;
+  if (!raw)
+    return true;
+  ok = card->writeStop();
+  raw = false;
+  if (!ok) {
+    file->seekSet(bytes);
+    return false;
+  }
+  resume_raw = true;
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::resume(void)
+ * -------------------------
+ * Place the file position back after the recorded data and restart the
+ * multi-block write stopped by suspend(), on the next block. Nothing to
+ * do before begin() or without an open recording.
+ * IN:	- none
+ * OUT:	- success (bool)
+ */
+bool RawRecorder::resume(void) {
+  bool ok = !file || !file->isOpen() || file->seekSet(bytes);
+
+  if (resume_raw) {
+    resume_raw = false;
+    ok = startSegment() && ok;
+  }
+  return ok;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::finish(void)
+ * -------------------------
+ * Terminate the multi-block write and cut the pre-allocated file down to
+ * the recorded length. The file stays open for a last patch().
+ * IN:	- none
+ * OUT:	- success (bool)
+ */
+bool RawRecorder::finish(void) {
+  bool ok = true;
+
+  if (raw) {
+    ok = card->writeStop();
+    raw = false;
+  }
+  if (file->fileSize() > bytes)
+    ok = file->truncate(bytes) && ok;
+  return ok;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* RawRecorder::close(void)
+ * ------------------------
+ * Finish the recording file and close it. Together with open(), this is
+ * the only place where the FAT gets updated.
+ * IN:	- none
+ * OUT:	- success (bool)
+ */
+bool RawRecorder::close(void) {
+  bool ok = finish();
+  return file->close() && ok;
+}
+/*****************************************************************************/
@@ -0,0 +1,77 @@
+/*
+ * rawRecorder.h
+ */
+#ifndef _RAWRECORDER_H_
+#define _RAWRECORDER_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "main.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Longest multi-block write (CMD25) supported by the card interface. The
+// Teensy SDHC has no infinite block transfer mode (K66 errata), its block
+// counter is 16-bit wide.
+#if SDCARD_SDIO
+#define RAW_SEGMENT_BLOCKS_MAX 0xFFFF
+#else
+#define RAW_SEGMENT_BLOCKS_MAX 0xFFFFFFFF
+#endif
+
+/*** Types *******************************************************************/
+/* RawRecorder
+ * -----------
+ * Recording file writer streaming sectors straight to the SD card. The
+ * file is pre-allocated as one contiguous range of clusters and kept in
+ * a single open multi-block write for the whole recording, so the FAT
+ * and the directory entry are only touched when opening and closing.
+ * If the file could not be pre-allocated, or once the pre-allocated
+ * range is full, the data goes through the file system as usual.
+ */
+class RawRecorder {
+public:
+  RawRecorder(void) {
+    card = NULL;
+    file = NULL;
+    raw = false;
+    resume_raw = false;
+    bytes = 0;
+  }
+  void begin(sdCard_t *sd_card, FatFile *rec_file);
+  bool open(const char *path, uint32_t size);
+  uint32_t write(const uint8_t *buf, uint32_t len);
+  bool patch(uint32_t pos, const void *buf, uint32_t len);
+  bool suspend(void);
+  bool resume(void);
+  bool finish(void);
+  bool close(void);
+  bool isRaw(void) { return raw; }
+  uint32_t fileBytes(void) { return bytes; }
+  uint32_t maxWriteMicros(void) { return max_us; }
+  uint32_t meanWriteMicros(void) { return (writes ? (sum_us / writes) : 0); }
+
+private:
+  bool startSegment(void);
+  bool leaveRaw(void);
+  sdCard_t *card;     // SD card driver
+  FatFile *file;      // recording file
+  bool raw;           // multi-block write running
+  bool resume_raw;    // multi-block write suspended
+  uint32_t block;     // next block to be written
+  uint32_t seg_end;   // last block of the running multi-block write
+  uint32_t end_block; // last block of the contiguous range
+  uint32_t bytes;     // bytes written to the file
+  uint32_t writes;    // number of write() calls
+  uint32_t max_us;    // longest write() call (us)
+  uint64_t sum_us;    // total time spent in write() (us)
+};
+
+/*** Variables ***************************************************************/
+extern RawRecorder raw_rec;
+
+/*** Functions ***************************************************************/
+
+#endif /* _RAWRECORDER_H_ */
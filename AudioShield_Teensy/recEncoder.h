@@ -0,0 +1,40 @@
+/*
+ * recEncoder.h
+ */
+#ifndef _RECENCODER_H_
+#define _RECENCODER_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <Arduino.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Largest file header of the encoders
+#define REC_ENC_HEADER_MAX 64
+
+/*** Types *******************************************************************/
+/* RecEncoder
+ * ----------
+ * Storage stage between the record ring and the SD card, turning the PCM
+ * sectors of the ring into another file format. The encoded data is
+ * handed out in whole sectors with output() and given back with
+ * consume(); flush() hands out the rest at the end of the recording.
+ * header() builds the file header for the data handed out so far, to
+ * be patched at the start of the file by the checkpoints.
+ */
+class RecEncoder {
+public:
+  virtual unsigned int header(uint8_t *buf) = 0;
+  virtual unsigned int encode(const uint8_t *pcm, unsigned int len) = 0;
+  virtual uint8_t *output(unsigned int *len) = 0;
+  virtual uint8_t *flush(unsigned int *len) = 0;
+  virtual void consume(unsigned int len) = 0;
+};
+
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+
+#endif /* _RECENCODER_H_ */
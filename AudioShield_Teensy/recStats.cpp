@@ -0,0 +1,109 @@
+/*
+ * Recording statistics
+ *
+ * Instrumentation of the recording pipeline (audio interrupt, record
+ * ring, SD card writes), for the metadata file and the BLE app.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "recStats.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+// SD write latency histogram
+uint32_t lat_hist[STATS_LAT_BUCKETS];
+// Start and stop time of the record ring (ms)
+unsigned long stats_start_ms = 0;
+unsigned long stats_stop_ms = 0;
+bool stats_running = false;
+
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+/*** Functions implementation ************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* resetRecStats(void)
+ * -------------------
+ * Restart the statistics, together with the record ring.
+ * IN:	- none
+ * OUT:	- none
+ */
+void resetRecStats(void) {
+  memset(lat_hist, 0, sizeof(lat_hist));
+  AudioMemoryUsageMaxReset();
+  AudioProcessorUsageMaxReset();
+  stats_start_ms = millis();
+  stats_running = true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* stopRecStats(void)
+ * ------------------
+ * Freeze the elapsed time, together with the record ring.
+ * IN:	- none
+ * OUT:	- none
+ */
+void stopRecStats(void) {
+  if (stats_running)
+    stats_stop_ms = millis();
+  stats_running = false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* logWriteLatency(uint32_t)
+ * -------------------------
+ * Count an SD card write in the latency histogram.
+ * IN:	- duration of the write (uint32_t, us)
+ * OUT:	- none
+ */
+void logWriteLatency(uint32_t us) {
+  unsigned int b = 0;
+
+  while ((b < (STATS_LAT_BUCKETS - 1)) && (us >= (STATS_LAT_BASE_US << b)))
+    b++;
+  lat_hist[b]++;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* getRecStats(struct recStats*)
+ * -----------------------------
+ * Snapshot of the statistics. The audio blocks expected from the
+ * elapsed time are compared with the blocks received by the record
+ * ring, so that blocks lost before the ring (audio library starvation)
+ * show up as well as the blocks the ring had to drop.
+ * IN:	- pointer to the snapshot, overwritten (struct recStats*)
+ * OUT:	- none
+ */
+void getRecStats(struct recStats *st) {
+  st->elapsed_ms =
+      (stats_running ? millis() : stats_stop_ms) - stats_start_ms;
+  // Integer math: a float count is off by blocks after a few hours
+  st->expected =
+      (unsigned long)(((uint64_t)st->elapsed_ms * STATS_RATE_NUM) /
+                      (STATS_RATE_DEN * 1000U * AUDIO_BLOCK_SAMPLES));
+  st->received = ringSdc.blocks();
+  st->dropped = ringSdc.overruns();
+  st->missing = (st->expected > st->received) ? (st->expected - st->received)
+                                              : 0;
+  st->ring_hwm = ringSdc.highWater();
+  st->mem_max = AudioMemoryUsageMax();
+  st->cpu_max = AudioProcessorUsageMax();
+  st->isr_mean_cyc = ringSdc.meanUpdateCycles();
+  st->isr_max_cyc = ringSdc.maxUpdateCycles();
+  st->wr_mean_us = raw_rec.meanWriteMicros();
+  st->wr_max_us = raw_rec.maxWriteMicros();
+  memcpy(st->lat_hist, lat_hist, sizeof(lat_hist));
+}
+/*****************************************************************************/
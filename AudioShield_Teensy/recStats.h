@@ -0,0 +1,50 @@
+/*
+ * recStats.h
+ */
+#ifndef _RECSTATS_H_
+#define _RECSTATS_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "main.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// SD write latency histogram: bucket b counts the writes shorter than
+// STATS_LAT_BASE_US << b, the last one the longer writes (~0.5 ms to
+// 131 ms and more)
+#define STATS_LAT_BUCKETS 10
+#define STATS_LAT_BASE_US 512U
+// AUDIO_SAMPLE_RATE_EXACT as a ratio (96 MHz * 2 / 17 / 256 = 750000 / 17
+// Hz), for block counts exact over runs of several days
+#define STATS_RATE_NUM 750000ULL
+#define STATS_RATE_DEN 17U
+
+/*** Types *******************************************************************/
+// Recording pipeline statistics, since the record ring was started
+struct recStats {
+  unsigned long elapsed_ms;  // time since the start of the ring
+  unsigned long expected;    // audio blocks expected in that time
+  unsigned long received;    // audio blocks received by the ring
+  unsigned long dropped;     // blocks dropped by the ring (ring full)
+  unsigned long missing;     // blocks never received (audio library)
+  unsigned int ring_hwm;     // highest ring depth (sectors)
+  unsigned int mem_max;      // highest audio memory usage (blocks)
+  float cpu_max;             // highest audio interrupt CPU usage (%)
+  uint32_t isr_mean_cyc;     // record ring interrupt, mean (CPU cycles)
+  uint32_t isr_max_cyc;      // record ring interrupt, max (CPU cycles)
+  uint32_t wr_mean_us;       // SD write time, mean (us)
+  uint32_t wr_max_us;        // SD write time, max (us)
+  uint32_t lat_hist[STATS_LAT_BUCKETS]; // SD write latency histogram
+};
+
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+void resetRecStats(void);
+void stopRecStats(void);
+void logWriteLatency(uint32_t us);
+void getRecStats(struct recStats *st);
+
+#endif /* _RECSTATS_H_ */
@@ -0,0 +1,405 @@
+/*
+ * Record ring
+ *
+ * Sector ring buffer between the audio update interrupt
+ * and the SD card writer running in the main loop.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "recordRing.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+// Keep the compiler from moving buffer stores after an index update
+#define RING_BARRIER() __asm__ volatile("" ::: "memory")
+// CPU cycle counter (DWT), used to measure the audio interrupt time
+#ifdef ARM_DWT_CYCCNT
+#define RING_CYCLES() ARM_DWT_CYCCNT
+#else
+#define RING_CYCLES() 0
+#endif
+
+/*** Constant objects ********************************************************/
+// Half-band low-pass (Q15), cut-off at a quarter of the input rate. Only
+// the center tap and the odd taps on each side of it are non-zero.
+const int16_t decim_center = 16380;
+const int16_t decim_coefs[(REC_DECIM_TAPS + 1) / 4] = {
+    10352, -3246, 1721, -1015, 606, -349, 187, -89, 35, -8};
+// Missing second channel
+const int16_t ring_silence[AUDIO_BLOCK_SAMPLES] = {0};
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::decimate(int16_t*, unsigned int, int16_t*)
+ * -----------------------------------------------------------
+ * Low-pass filter and halve the sample rate of a buffer, in place.
+ * IN:	- pointer to the samples (int16_t*)
+ *			- number of samples, even (unsigned int)
+ *			- pointer to the REC_DECIM_TAPS - 1 last input samples of the
+ *			  previous call, updated (int16_t*)
+ * OUT:	- number of output samples (unsigned int)
+ */
+unsigned int AudioRecordRing::decimate(int16_t *buf, unsigned int n,
+                                       int16_t *hist) {
+  int16_t w[REC_DECIM_TAPS - 1 + AUDIO_BLOCK_SAMPLES];
+  const int16_t *c;
+  int32_t acc;
+  unsigned int k;
+  int m;
+
+  memcpy(w, hist, (REC_DECIM_TAPS - 1) * 2);
+  memcpy(&w[REC_DECIM_TAPS - 1], buf, n * 2);
+  for (k = 0; k < (n / 2); k++) {
+    // Window w[2k+1 .. 2k+REC_DECIM_TAPS], centered on c
+    c = &w[(2 * k) + 1 + (REC_DECIM_TAPS / 2)];
+    acc = (int32_t)decim_center * c[0];
+    for (m = 0; m < ((REC_DECIM_TAPS + 1) / 4); m++)
+      acc += (int32_t)decim_coefs[m] * (c[-(2 * m + 1)] + c[2 * m + 1]);
+    acc = (acc + (1 << 14)) >> 15;
+    if (acc > 32767)
+      acc = 32767;
+    else if (acc < -32768)
+      acc = -32768;
+    buf[k] = (int16_t)acc;
+  }
+  memcpy(hist, &w[n], (REC_DECIM_TAPS - 1) * 2);
+  return (n / 2);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::push(const uint8_t*, unsigned int)
+ * ---------------------------------------------------
+ * Audio interrupt: copy bytes into the head sector and commit it once
+ * full. The bytes may straddle two sectors.
+ * IN:	- pointer to the bytes (const uint8_t*)
+ *			- number of bytes (unsigned int)
+ * OUT:	- none
+ */
+void AudioRecordRing::push(const uint8_t *src, unsigned int len) {
+  unsigned int n;
+
+  while (len) {
+    n = REC_SECTOR_SIZE - fill;
+    if (n > len)
+      n = len;
+    memcpy(&ring[head][fill], src, n);
+    src += n;
+    len -= n;
+    fill += n;
+    if (fill < REC_SECTOR_SIZE)
+      break;
+    commit();
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::commit(void)
+ * -----------------------------
+ * Audio interrupt: hand the full head sector to the main loop and start
+ * the next one. If the ring is full, the sector is dropped.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioRecordRing::commit(void) {
+  unsigned int next, cnt;
+
+  fill = 0;
+  next = (head + 1) % REC_RING_SECTORS;
+  if (next == tail) {
+    // No room left: overwrite the sector with the next blocks
+    ovr += REC_SECTOR_SIZE / blockBytes();
+    return;
+  }
+  RING_BARRIER();
+  head = next;
+  cnt = available();
+  if (cnt > hwm)
+    hwm = cnt;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::storeDirect(const int16_t*, const int16_t*)
+ * ------------------------------------------------------------
+ * Audio interrupt: store a 16-bit undecimated block straight into the
+ * ring sectors, reading each sample once. Stereo samples are packed by
+ * pairs into whole words, the head sector fill must be a multiple of 4.
+ * IN:	- pointer to the samples of the first channel (const int16_t*)
+ *			- pointer to the samples of the second channel, NULL in mono
+ *			  (const int16_t*)
+ * OUT:	- none
+ */
+void AudioRecordRing::storeDirect(const int16_t *left, const int16_t *right) {
+  uint32_t *dst;
+  unsigned int i, k, n;
+
+  if (!right) {
+    push((const uint8_t *)left, AUDIO_BLOCK_SAMPLES * 2);
+    return;
+  }
+  i = 0;
+  while (i < AUDIO_BLOCK_SAMPLES) {
+    n = (REC_SECTOR_SIZE - fill) / 4;
+    if (n > (AUDIO_BLOCK_SAMPLES - i))
+      n = AUDIO_BLOCK_SAMPLES - i;
+    dst = (uint32_t *)&ring[head][fill];
+    for (k = 0; k < n; k++, i++)
+      dst[k] = (uint16_t)left[i] | ((uint32_t)(uint16_t)right[i] << 16);
+    fill += n * 4;
+    if (fill == REC_SECTOR_SIZE)
+      commit();
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::storeBlock(audio_block_t**)
+ * --------------------------------------------
+ * Audio interrupt: decimate the block(s), interleave the channels,
+ * convert to the profile sample size and push the result into the
+ * ring. The blocks are released as soon as copied.
+ * IN:	- pointers to the blocks of each channel, the second one may be
+ *			  NULL (audio_block_t**)
+ * OUT:	- none
+ */
+void AudioRecordRing::storeBlock(audio_block_t **block) {
+  int16_t smp[REC_CHANNELS_MAX][AUDIO_BLOCK_SAMPLES];
+  uint8_t out[REC_BLOCK_BYTES_MAX];
+  unsigned int ch, st, i, n, len;
+
+  for (ch = 0; ch < channels; ch++) {
+    if (block[ch])
+      memcpy(smp[ch], block[ch]->data, AUDIO_BLOCK_SAMPLES * 2);
+    else
+      memset(smp[ch], 0, AUDIO_BLOCK_SAMPLES * 2);
+  }
+  release(block[0]);
+  if (block[1])
+    release(block[1]);
+
+  n = AUDIO_BLOCK_SAMPLES;
+  for (st = 0; st < stages; st++) {
+    for (ch = 0; ch < channels; ch++)
+      decimate(smp[ch], n, hist[st][ch]);
+    n /= 2;
+  }
+
+  len = 0;
+  for (i = 0; i < n; i++) {
+    for (ch = 0; ch < channels; ch++) {
+      if (bits == 8) {
+        // 8-bit WAV samples are unsigned
+        out[len++] = (uint8_t)((smp[ch][i] >> 8) + 128);
+      } else {
+        out[len++] = (uint8_t)(smp[ch][i] & 0xFF);
+        out[len++] = (uint8_t)(smp[ch][i] >> 8);
+      }
+    }
+  }
+  push(out, len);
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::setProfile(unsigned int, unsigned int, unsigned int)
+ * ---------------------------------------------------------------------
+ * Select the capture profile. To be called while the ring is stopped.
+ * IN:	- number of channels, 1 or 2 (unsigned int)
+ *			- decimation factor, 1, 2 or 4 (unsigned int)
+ *			- bits per sample, 8 or 16 (unsigned int)
+ * OUT:	- valid profile (bool)
+ */
+bool AudioRecordRing::setProfile(unsigned int nb_chans, unsigned int decim,
+                                 unsigned int nb_bits) {
+  if ((nb_chans < 1) || (nb_chans > REC_CHANNELS_MAX))
+    return false;
+  if ((decim != 1) && (decim != 2) && (decim != 4))
+    return false;
+  if ((nb_bits != 8) && (nb_bits != 16))
+    return false;
+  channels = nb_chans;
+  stages = (decim == 4) ? 2 : (decim - 1);
+  bits = nb_bits;
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::blockBytes(void)
+ * ---------------------------------
+ * IN:	- none
+ * OUT:	- bytes stored per audio block with the current profile
+ *			  (unsigned int)
+ */
+unsigned int AudioRecordRing::blockBytes(void) {
+  return (((AUDIO_BLOCK_SAMPLES >> stages) * channels * bits) / 8);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::begin(const uint8_t*, unsigned int)
+ * ----------------------------------------------------
+ * Empty the ring, reset the counters and start accepting audio blocks.
+ * The optional prefix (i.e. the file header) is copied at the start of
+ * the first sector, so that the following sectors stay aligned with
+ * the SD card sectors.
+ * IN:	- pointer to the prefix bytes (const uint8_t*)
+ *			- prefix length, smaller than REC_SECTOR_SIZE (unsigned int)
+ * OUT:	- none
+ */
+void AudioRecordRing::begin(const uint8_t *prefix, unsigned int len) {
+  __disable_irq();
+  head = 0;
+  tail = 0;
+  if (prefix && (len < REC_SECTOR_SIZE)) {
+    memcpy(ring[0], prefix, len);
+    fill = len;
+  } else {
+    fill = 0;
+  }
+  hwm = 0;
+  ovr = 0;
+  upd_cnt = 0;
+  upd_max_cyc = 0;
+  upd_sum_cyc = 0;
+  memset(hist, 0, sizeof(hist));
+#ifdef ARM_DWT_CYCCNT
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+#endif
+  enabled = true;
+  __enable_irq();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::end(void)
+ * --------------------------
+ * Stop accepting audio blocks. Full sectors and the partially filled
+ * one stay available until read.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioRecordRing::end(void) {
+  __disable_irq();
+  enabled = false;
+  __enable_irq();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::available(void)
+ * --------------------------------
+ * IN:	- none
+ * OUT:	- number of full sectors ready to be written (unsigned int)
+ */
+unsigned int AudioRecordRing::available(void) {
+  unsigned int h = head;
+  unsigned int t = tail;
+  return (h >= t) ? (h - t) : (REC_RING_SECTORS + h - t);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::readSectors(unsigned int*)
+ * -------------------------------------------
+ * Get the oldest full sectors as one contiguous buffer. The amount is
+ * limited by the end of the ring and by REC_RING_BURST_MAX.
+ * IN:	- pointer to the number of sectors (unsigned int*)
+ * OUT:	- pointer to the first sector, NULL if none (uint8_t*)
+ */
+uint8_t *AudioRecordRing::readSectors(unsigned int *count) {
+  unsigned int t = tail;
+  unsigned int cnt = available();
+  if (cnt > (REC_RING_SECTORS - t))
+    cnt = REC_RING_SECTORS - t;
+  if (cnt > REC_RING_BURST_MAX)
+    cnt = REC_RING_BURST_MAX;
+  *count = cnt;
+  return (cnt ? ring[t] : NULL);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::freeSectors(unsigned int)
+ * ------------------------------------------
+ * Give back sectors obtained with readSectors() to the audio interrupt.
+ * IN:	- number of written sectors (unsigned int)
+ * OUT:	- none
+ */
+void AudioRecordRing::freeSectors(unsigned int count) {
+  RING_BARRIER();
+  tail = (tail + count) % REC_RING_SECTORS;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::readPartial(uint8_t**)
+ * ---------------------------------------
+ * Get the last, partially filled sector. Only meaningful after end()
+ * and once all full sectors have been written.
+ * IN:	- pointer to the buffer pointer (uint8_t**)
+ * OUT:	- number of valid bytes in the buffer (unsigned int)
+ */
+unsigned int AudioRecordRing::readPartial(uint8_t **buf) {
+  *buf = ring[head];
+  return fill;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioRecordRing::update(void)
+ * -----------------------------
+ * Audio interrupt: store the received block(s) into the ring, straight
+ * from the audio library memory with a 16-bit undecimated profile, or
+ * through the generic conversion. A missing block of the second channel
+ * is recorded as silence. The time spent is measured with the DWT cycle
+ * counter.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioRecordRing::update(void) {
+  audio_block_t *block[REC_CHANNELS_MAX];
+  uint32_t cyc = RING_CYCLES();
+
+  block[0] = receiveReadOnly(0);
+  block[1] = receiveReadOnly(1);
+  if (!block[0] || !enabled) {
+    if (block[0])
+      release(block[0]);
+    if (block[1])
+      release(block[1]);
+    return;
+  }
+  if (REC_RING_DIRECT && !stages && (bits == 16) && !(fill & 3)) {
+    if (channels == 1)
+      storeDirect(block[0]->data, NULL);
+    else
+      storeDirect(block[0]->data, block[1] ? block[1]->data : ring_silence);
+    release(block[0]);
+    if (block[1])
+      release(block[1]);
+  } else {
+    storeBlock(block);
+  }
+
+  cyc = RING_CYCLES() - cyc;
+  upd_cnt++;
+  upd_sum_cyc += cyc;
+  if (cyc > upd_max_cyc)
+    upd_max_cyc = cyc;
+}
+/*****************************************************************************/
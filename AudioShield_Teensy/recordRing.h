@@ -0,0 +1,114 @@
+/*
+ * recordRing.h
+ */
+#ifndef _RECORDRING_H_
+#define _RECORDRING_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <Arduino.h>
+#include <AudioStream.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// SD card sector size (bytes)
+#define REC_SECTOR_SIZE 512
+// Largest output of one audio block (stereo, 16-bit, no decimation)
+#define REC_BLOCK_BYTES_MAX (AUDIO_BLOCK_SAMPLES * 2 * 2)
+// Number of sectors in the ring (128 -> ~740 ms of 44.1 kHz mono audio)
+#define REC_RING_SECTORS 128
+// Minimum number of full sectors before flushing a burst to the SD card
+#define REC_RING_BURST_MIN 4
+// Maximum number of sectors flushed in a single burst
+#define REC_RING_BURST_MAX 32
+// Capture profile limits
+#define REC_CHANNELS_MAX 2
+#define REC_DECIM_STAGES_MAX 2 // decimation by up to 2^2 = 4
+// Half-band decimation filter length (39 taps, > 60 dB stop-band)
+#define REC_DECIM_TAPS 39
+// 16-bit undecimated blocks: 1 -> stored straight into the ring sectors,
+// 0 -> through the generic conversion (reference for cycle counts)
+#ifndef REC_RING_DIRECT
+#define REC_RING_DIRECT 1
+#endif
+
+/*** Types *******************************************************************/
+/* AudioRecordRing
+ * ---------------
+ * Audio sink copying every incoming block from the audio update interrupt
+ * into a ring of sector-sized buffers. The main loop reads full sectors
+ * only and is therefore decoupled from the audio interrupt timing: a slow
+ * SD write just lets the ring fill up instead of exhausting the audio
+ * memory pool. When the ring is full, incoming blocks are dropped and
+ * counted as overruns.
+ * The capture profile selects mono (input 0) or stereo (inputs 0 and 1,
+ * interleaved), a decimation of the 44.1 kHz input by 1, 2 or 4 and 8-
+ * or 16-bit samples, as stored in a PCM WAV file.
+ * With 16-bit undecimated profiles (the default), the samples of the
+ * audio blocks are copied once, straight into the ring sectors, which
+ * the raw recorder hands to the card without further copies.
+ */
+class AudioRecordRing : public AudioStream {
+public:
+  AudioRecordRing(void) : AudioStream(2, inputQueueArray) {
+    head = 0;
+    tail = 0;
+    fill = 0;
+    enabled = false;
+    hwm = 0;
+    ovr = 0;
+    channels = 1;
+    stages = 0;
+    bits = 16;
+    upd_cnt = 0;
+    upd_max_cyc = 0;
+    upd_sum_cyc = 0;
+  }
+  bool setProfile(unsigned int nb_chans, unsigned int decim,
+                  unsigned int nb_bits);
+  unsigned int blockBytes(void);
+  void begin(const uint8_t *prefix = NULL, unsigned int len = 0);
+  void end(void);
+  unsigned int available(void);
+  uint8_t *readSectors(unsigned int *count);
+  void freeSectors(unsigned int count);
+  unsigned int readPartial(uint8_t **buf);
+  unsigned int highWater(void) { return hwm; }
+  unsigned long overruns(void) { return ovr; }
+  uint32_t meanUpdateCycles(void) {
+    return (upd_cnt ? (uint32_t)(upd_sum_cyc / upd_cnt) : 0);
+  }
+  uint32_t maxUpdateCycles(void) { return upd_max_cyc; }
+  unsigned long blocks(void) { return upd_cnt; }
+  virtual void update(void);
+  static unsigned int decimate(int16_t *buf, unsigned int n, int16_t *hist);
+
+private:
+  void push(const uint8_t *src, unsigned int len);
+  void commit(void);
+  void storeDirect(const int16_t *left, const int16_t *right);
+  void storeBlock(audio_block_t **block);
+  audio_block_t *inputQueueArray[2];
+  uint8_t ring[REC_RING_SECTORS][REC_SECTOR_SIZE] __attribute__((aligned(4)));
+  volatile unsigned int head;  // sector being filled by the audio interrupt
+  volatile unsigned int tail;  // oldest full sector not yet written
+  volatile unsigned int fill;  // bytes already copied into the head sector
+  volatile bool enabled;       // recording running
+  volatile unsigned int hwm;   // high-water mark (full sectors)
+  volatile unsigned long ovr;  // dropped audio blocks
+  unsigned int channels;       // 1 -> mono, 2 -> stereo
+  unsigned int stages;         // decimation stages (rate / 2^stages)
+  unsigned int bits;           // bits per sample (8 or 16)
+  uint32_t upd_cnt;            // update() calls with a stored block
+  uint32_t upd_max_cyc;        // longest update() (CPU cycles)
+  uint64_t upd_sum_cyc;        // total update() time (CPU cycles)
+  // decimation filter history [stage][channel][sample]
+  int16_t hist[REC_DECIM_STAGES_MAX][REC_CHANNELS_MAX][REC_DECIM_TAPS - 1];
+};
+
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+
+#endif /* _RECORDRING_H_ */
@@ -0,0 +1,331 @@
+/*
+ * Spectrum analyzer
+ *
+ * Per-minute spectral summary (octave band powers and acoustic
+ * indices) of the recorded input, written next to each recording.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "spectrumAnalyzer.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Band power reported for silence (dBFS)
+#define SPEC_DB_FLOOR -120.0
+
+/*** Types *******************************************************************/
+/*** Variables ***************************************************************/
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+// Keep the compiler from moving frame accesses across a flag update
+#define SPEC_BARRIER() __asm__ volatile("" ::: "memory")
+
+/*** Constant objects ********************************************************/
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::fft(void)
+ * ----------------------------
+ * In-place radix-2 FFT of re/im (decimation in time). The samples are
+ * 32-bit with Q15 twiddle factors and no scaling between the stages: the
+ * windowed input fits in 19 bits, the output in 29 bits.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeBands::fft(void) {
+  unsigned int i, j, k, len, half, step;
+  int32_t tr, ti, wr, wi;
+
+  // Bit-reversed order
+  for (i = 1, j = 0; i < SPEC_FFT_SIZE; i++) {
+    k = SPEC_FFT_SIZE >> 1;
+    while (j & k) {
+      j ^= k;
+      k >>= 1;
+    }
+    j |= k;
+    if (i < j) {
+      tr = re[i];
+      re[i] = re[j];
+      re[j] = tr;
+      ti = im[i];
+      im[i] = im[j];
+      im[j] = ti;
+    }
+  }
+  // Butterflies
+  for (len = 2; len <= SPEC_FFT_SIZE; len <<= 1) {
+    half = len >> 1;
+    step = SPEC_FFT_SIZE / len;
+    for (k = 0; k < half; k++) {
+      wr = tw_cos[k * step];
+      wi = -tw_sin[k * step];
+      for (i = k; i < SPEC_FFT_SIZE; i += len) {
+        j = i + half;
+        tr = (int32_t)((((int64_t)re[j] * wr) - ((int64_t)im[j] * wi)) >> 15);
+        ti = (int32_t)((((int64_t)re[j] * wi) + ((int64_t)im[j] * wr)) >> 15);
+        re[j] = re[i] - tr;
+        im[j] = im[i] - ti;
+        re[i] += tr;
+        im[i] += ti;
+      }
+    }
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::closeRecord(void)
+ * ------------------------------------
+ * Summarize the accumulated spectra into a record and restart the
+ * accumulation. The band powers are scaled so that they add up to the
+ * mean square of the input (Parseval), relative to full scale.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeBands::closeRecord(void) {
+  struct specRecord *r;
+  float norm, p, tot, h;
+  unsigned int b, k;
+  uint32_t skp;
+
+  __disable_irq();
+  skp = skipped;
+  skipped = 0;
+  __enable_irq();
+
+  if (rec_cnt < SPEC_RECORDS_MAX) {
+    r = &recs[rec_cnt++];
+    memset(r, 0, sizeof(struct specRecord));
+    r->offset = rec_idx * SPEC_RECORD_SEC;
+    r->frames = frames;
+    r->skipped = skp;
+    if (!frames)
+      frames = 1; // all frames skipped: zero spectra
+    // One-sided spectrum of the window-weighted, (2^(15-SPEC_WIN_SHIFT))
+    // times amplified input, in full scale units
+    norm = 2.0 / ((float)SPEC_FFT_SIZE * win_pow * (float)frames);
+    norm /= (float)(1UL << (2 * (15 - SPEC_WIN_SHIFT)));
+    norm /= 32768.0 * 32768.0;
+    for (b = 0; b < SPEC_BANDS; b++) {
+      p = 0.0;
+      for (k = (1U << b); k < (2U << b); k++)
+        p += pow_sum[k];
+      p *= norm;
+      r->band_db[b] = (p > 0.0) ? (10.0 * log10f(p)) : SPEC_DB_FLOOR;
+      if (r->band_db[b] < SPEC_DB_FLOOR)
+        r->band_db[b] = SPEC_DB_FLOOR;
+    }
+    tot = 0.0;
+    for (k = 1; k < (SPEC_FFT_SIZE / 2); k++)
+      tot += pow_sum[k];
+    h = 0.0;
+    for (k = 1; (tot > 0.0) && (k < (SPEC_FFT_SIZE / 2)); k++) {
+      p = pow_sum[k] / tot;
+      if (p > 0.0)
+        h -= p * logf(p);
+    }
+    r->entropy = h / logf((float)((SPEC_FFT_SIZE / 2) - 1));
+    for (k = 1; k < (SPEC_FFT_SIZE / 2); k++) {
+      if (amp_sum[k] > 0.0)
+        r->aci += amp_diff[k] / amp_sum[k];
+    }
+  }
+  memset(pow_sum, 0, sizeof(pow_sum));
+  memset(amp_sum, 0, sizeof(amp_sum));
+  memset(amp_diff, 0, sizeof(amp_diff));
+  frames = 0;
+  rec_idx++;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::begin(void)
+ * ------------------------------
+ * Reset the analysis and the records and start accepting audio blocks
+ * (start of a recording). The window and twiddle tables are computed on
+ * the first call.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeBands::begin(void) {
+  unsigned int k;
+
+  end();
+  if (!tables) {
+    win_pow = 0.0;
+    for (k = 0; k < SPEC_FFT_SIZE; k++) {
+      win[k] = (int16_t)(16383.5 *
+                         (1.0 - cosf((2.0 * PI * k) / SPEC_FFT_SIZE)));
+      win_pow += ((float)win[k] / 32768.0) * ((float)win[k] / 32768.0);
+    }
+    for (k = 0; k < (SPEC_FFT_SIZE / 2); k++) {
+      tw_cos[k] = (int16_t)lroundf(32767.0 * cosf((2.0 * PI * k) /
+                                                  SPEC_FFT_SIZE));
+      tw_sin[k] = (int16_t)lroundf(32767.0 * sinf((2.0 * PI * k) /
+                                                  SPEC_FFT_SIZE));
+    }
+    tables = true;
+  }
+  memset(pow_sum, 0, sizeof(pow_sum));
+  memset(amp_sum, 0, sizeof(amp_sum));
+  memset(amp_diff, 0, sizeof(amp_diff));
+  have_prev = false;
+  frames = 0;
+  rec_idx = 0;
+  rec_cnt = 0;
+  __disable_irq();
+  memset(hist, 0, sizeof(hist));
+  fill_idx = 0;
+  fill = 0;
+  ready = false;
+  skipped = 0;
+  enabled = true;
+  __enable_irq();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::end(void)
+ * ----------------------------
+ * Stop accepting audio blocks and summarize the last, partial record.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeBands::end(void) {
+  bool was_enabled = enabled;
+
+  __disable_irq();
+  enabled = false;
+  __enable_irq();
+  if (!was_enabled)
+    return;
+  process();
+  if (frames || skipped)
+    closeRecord();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::process(void)
+ * --------------------------------
+ * Main loop: analyze the waiting frame, if any, and close the record
+ * once it covers SPEC_RECORD_SEC.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeBands::process(void) {
+  const int16_t *x;
+  unsigned int k;
+  float p, a;
+
+  if (!ready)
+    return;
+  SPEC_BARRIER();
+  x = frame[ready_idx];
+  for (k = 0; k < SPEC_FFT_SIZE; k++) {
+    re[k] = ((int32_t)x[k] * win[k]) >> SPEC_WIN_SHIFT;
+    im[k] = 0;
+  }
+  // The frame is copied, the interrupt may fill it again
+  SPEC_BARRIER();
+  ready = false;
+  fft();
+  for (k = 1; k < (SPEC_FFT_SIZE / 2); k++) {
+    p = ((float)re[k] * (float)re[k]) + ((float)im[k] * (float)im[k]);
+    a = sqrtf(p);
+    pow_sum[k] += p;
+    amp_sum[k] += a;
+    if (have_prev)
+      amp_diff[k] += fabsf(a - amp_prev[k]);
+    amp_prev[k] = a;
+  }
+  have_prev = true;
+  frames++;
+  if ((frames + skipped) >= SPEC_RECORD_FRAMES)
+    closeRecord();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::header(uint8_t*, uint32_t)
+ * ---------------------------------------------
+ * Build the header of the sidecar file:
+ * 0: "SSSP", 4: version (u16), 6: record size (u16), 8: recording
+ * start (u32, Unix time), 12: analysis rate (u32, Hz), 16: FFT length
+ * (u16), 18: number of bands (u16), 20: record duration (u16, s),
+ * 22: zero padding.
+ * IN:	- pointer to the buffer, SPEC_HEADER_SIZE bytes (uint8_t*)
+ *			- recording start timestamp (uint32_t)
+ * OUT:	- header size in bytes (unsigned int)
+ */
+unsigned int AudioAnalyzeBands::header(uint8_t *buf, uint32_t tss) {
+  uint16_t v16;
+  uint32_t v32;
+
+  memset(buf, 0, SPEC_HEADER_SIZE);
+  memcpy(buf, SPEC_MAGIC, 4);
+  v16 = SPEC_VERSION;
+  memcpy(&buf[4], &v16, 2);
+  v16 = sizeof(struct specRecord);
+  memcpy(&buf[6], &v16, 2);
+  memcpy(&buf[8], &tss, 4);
+  v32 = SPEC_RATE;
+  memcpy(&buf[12], &v32, 4);
+  v16 = SPEC_FFT_SIZE;
+  memcpy(&buf[16], &v16, 2);
+  v16 = SPEC_BANDS;
+  memcpy(&buf[18], &v16, 2);
+  v16 = SPEC_RECORD_SEC;
+  memcpy(&buf[20], &v16, 2);
+  return SPEC_HEADER_SIZE;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioAnalyzeBands::update(void)
+ * -------------------------------
+ * Audio interrupt: decimate the received block into the current frame.
+ * A full frame is handed to process(), or dropped if the previous one
+ * is still waiting.
+ * IN:	- none
+ * OUT:	- none
+ */
+void AudioAnalyzeBands::update(void) {
+  audio_block_t *block;
+  int16_t smp[AUDIO_BLOCK_SAMPLES];
+  unsigned int st, n;
+
+  block = receiveReadOnly(0);
+  if (!block)
+    return;
+  if (!enabled) {
+    release(block);
+    return;
+  }
+  memcpy(smp, block->data, AUDIO_BLOCK_SAMPLES * 2);
+  release(block);
+
+  n = AUDIO_BLOCK_SAMPLES;
+  for (st = 0; st < SPEC_DECIM_STAGES; st++)
+    n = AudioRecordRing::decimate(smp, n, hist[st]);
+  memcpy(&frame[fill_idx][fill], smp, n * 2);
+  fill += n;
+  if (fill >= SPEC_FFT_SIZE) {
+    fill = 0;
+    if (!ready) {
+      ready_idx = fill_idx;
+      ready = true;
+      fill_idx ^= 1;
+    } else {
+      skipped++;
+    }
+  }
+}
+/*****************************************************************************/
@@ -0,0 +1,118 @@
+/*
+ * spectrumAnalyzer.h
+ */
+#ifndef _SPECTRUMANALYZER_H_
+#define _SPECTRUMANALYZER_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <Arduino.h>
+#include <AudioStream.h>
+
+#include "recordRing.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Decimation of the 44.1 kHz input before the analysis (by 2^2 = 4)
+#define SPEC_DECIM_STAGES 2
+// Analysis sampling rate (Hz)
+#define SPEC_RATE 11025
+// FFT length (samples), ~93 ms at SPEC_RATE, 10.8 Hz per bin
+#define SPEC_FFT_SIZE 1024
+// Extra bits kept from the windowed samples (Q15 window product >> 12)
+#define SPEC_WIN_SHIFT 12
+// Octave bands: band k holds the bins 2^k to 2^(k+1) - 1 (10.8 Hz to
+// 5.5 kHz)
+#define SPEC_BANDS 9
+// Time covered by a summary record (s)
+#define SPEC_RECORD_SEC 60
+// Frames (analyzed or skipped) of a summary record
+#define SPEC_RECORD_FRAMES                                                    \
+  (((SPEC_RECORD_SEC * SPEC_RATE) + (SPEC_FFT_SIZE / 2)) / SPEC_FFT_SIZE)
+// Summary records kept in memory until written to the SD card
+#define SPEC_RECORDS_MAX 16
+// Records written at the next checkpoint (see continueRecording)
+#define SPEC_RECORDS_FLUSH 8
+// Sidecar file: header and records, little endian
+#define SPEC_HEADER_SIZE 32
+#define SPEC_MAGIC "SSSP"
+#define SPEC_VERSION 1
+
+/*** Types *******************************************************************/
+// Summary record of SPEC_RECORD_SEC of audio
+struct specRecord {
+  uint32_t offset;             // start, seconds from the recording start
+  uint16_t frames;             // analyzed frames
+  uint16_t skipped;            // frames lost while the main loop was busy
+  float band_db[SPEC_BANDS];   // mean band power (dBFS)
+  float entropy;               // spectral entropy of the mean spectrum (0-1)
+  float aci;                   // acoustic complexity index
+} __attribute__((packed));
+
+/* AudioAnalyzeBands
+ * -----------------
+ * Spectral summary of the recorded input, for field triage without
+ * downloading the audio. The audio interrupt only decimates the input
+ * (see AudioRecordRing::decimate) into double-buffered frames. The main
+ * loop windows each frame (Hann), runs a fixed-point FFT and accumulates
+ * the power spectrum, the mean amplitude and the frame-to-frame
+ * amplitude variations. Every SPEC_RECORD_SEC, they are summarized into
+ * octave band powers, the spectral entropy and the acoustic complexity
+ * index (ACI). A frame completed while the previous one is still waiting
+ * is dropped and counted: the recording itself never waits for the
+ * analysis.
+ */
+class AudioAnalyzeBands : public AudioStream {
+public:
+  AudioAnalyzeBands(void) : AudioStream(1, inputQueueArray) {
+    enabled = false;
+    tables = false;
+    rec_cnt = 0;
+  }
+  void begin(void);
+  void end(void);
+  void process(void);
+  unsigned int records(void) { return rec_cnt; }
+  const struct specRecord *getRecords(void) { return recs; }
+  void clearRecords(void) { rec_cnt = 0; }
+  unsigned int header(uint8_t *buf, uint32_t tss);
+  virtual void update(void);
+
+private:
+  void fft(void);
+  void closeRecord(void);
+  audio_block_t *inputQueueArray[1];
+  volatile bool enabled;              // analysis running
+  int16_t frame[2][SPEC_FFT_SIZE];    // decimated frames
+  volatile unsigned int fill_idx;     // frame filled by the interrupt
+  volatile unsigned int fill;         // samples in the filled frame
+  volatile unsigned int ready_idx;    // frame waiting for process()
+  volatile bool ready;                // a frame is waiting
+  volatile uint32_t skipped;          // frames dropped (current record)
+  bool tables;                        // window and twiddles computed
+  int16_t win[SPEC_FFT_SIZE];         // Hann window (Q15)
+  int16_t tw_cos[SPEC_FFT_SIZE / 2];  // twiddle factors (Q15)
+  int16_t tw_sin[SPEC_FFT_SIZE / 2];
+  float win_pow;                      // sum of the squared window values
+  int32_t re[SPEC_FFT_SIZE];          // FFT work buffers
+  int32_t im[SPEC_FFT_SIZE];
+  float pow_sum[SPEC_FFT_SIZE / 2];   // accumulated power spectrum
+  float amp_sum[SPEC_FFT_SIZE / 2];   // accumulated amplitude spectrum
+  float amp_diff[SPEC_FFT_SIZE / 2];  // accumulated amplitude variations
+  float amp_prev[SPEC_FFT_SIZE / 2];  // amplitude spectrum of the last frame
+  bool have_prev;                     // amp_prev is valid
+  uint32_t frames;                    // frames analyzed (current record)
+  uint32_t rec_idx;                   // index of the current record
+  unsigned int rec_cnt;               // number of records in recs
+  // records not yet written to the SD card
+  struct specRecord recs[SPEC_RECORDS_MAX];
+  // decimation filter history [stage][sample]
+  int16_t hist[SPEC_DECIM_STAGES][REC_DECIM_TAPS - 1];
+};
+
+/*** Variables ***************************************************************/
+/*** Functions ***************************************************************/
+
+#endif /* _SPECTRUMANALYZER_H_ */
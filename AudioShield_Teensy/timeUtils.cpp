@@ -213,8 +213,15 @@ void timerRecDone(void) {
   if (debug)
     snooze_usb.printf("Time:    Recording#%d done.", (next_record.cnt + 1));
 
-  if ((rec_window.occurences == 0) ||
-      (next_record.cnt < (rec_window.occurences - 1))) {
+  // Event-triggered recording: re-arm, or stop after the last occurrence
+  if (evt_trigger.enabled) {
+    if (debug)
+      snooze_usb.println(" Re-arming...");
+    working_state.rec_state = RECSTATE_REQ_REARM;
+    return;
+  }
+  if ((getRecOccurences() == 0) ||
+      (next_record.cnt < (getRecOccurences() - 1))) {
     if (debug)
       snooze_usb.println(" Going on...");
     working_state.rec_state = RECSTATE_REQ_PAUSE;
@@ -17,7 +17,7 @@
 #define WAVE_FORMAT_PCM 1
 #define WAVE_NUM_CHANNELS 1
 #define WAVE_SAMPLING_RATE 44100
-#define WAVE_BYTES_PER_SEC 705600 // 44100 * 16
+#define WAVE_BYTES_PER_SEC 88200 // 44100 * 2
 #define WAVE_BYTES_PER_SAMP 2
 #define WAVE_BITS_PER_SAMP 16
 
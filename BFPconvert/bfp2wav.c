@@ -0,0 +1,154 @@
+/*
+ * bfp2wav
+ *
+ * Desktop converter of the block-floating-point recordings (.bfp)
+ * of the SoundingSoil recorder back to 16-bit PCM WAV files.
+ *
+ * Build: cc -O2 -o bfp2wav bfp2wav.c
+ * Usage: bfp2wav <recording.bfp> [<output.wav>]
+ *
+ * The file layout is described in AudioShield_Teensy/bfpPacker.h.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BFP_HEADER_SIZE 32
+#define BFP_CHANNELS_MAX 2
+#define BFP_BLOCK_MAX 4096
+
+/* get16(const uint8_t*) / get32(const uint8_t*)
+ * ---------------------------------------------
+ * Read a little endian field.
+ */
+static uint32_t get16(const uint8_t *b) { return b[0] | (b[1] << 8); }
+static uint32_t get32(const uint8_t *b) {
+  return get16(b) | (get16(&b[2]) << 16);
+}
+
+/* put16(FILE*, uint32_t) / put32(FILE*, uint32_t)
+ * -----------------------------------------------
+ * Write a little endian field.
+ */
+static void put16(FILE *f, uint32_t v) {
+  fputc(v & 0xFF, f);
+  fputc((v >> 8) & 0xFF, f);
+}
+static void put32(FILE *f, uint32_t v) {
+  put16(f, v & 0xFFFF);
+  put16(f, v >> 16);
+}
+
+/* writeWaveHeader(FILE*, unsigned int, uint32_t, uint32_t)
+ * --------------------------------------------------------
+ * Write a 16-bit PCM WAV header.
+ */
+static void writeWaveHeader(FILE *f, unsigned int chans, uint32_t rate,
+                            uint32_t dlen) {
+  fwrite("RIFF", 1, 4, f);
+  put32(f, dlen + 36);
+  fwrite("WAVEfmt ", 1, 8, f);
+  put32(f, 16);
+  put16(f, 1);
+  put16(f, chans);
+  put32(f, rate);
+  put32(f, rate * chans * 2);
+  put16(f, chans * 2);
+  put16(f, 16);
+  fwrite("data", 1, 4, f);
+  put32(f, dlen);
+}
+
+int main(int argc, char **argv) {
+  uint8_t hd[BFP_HEADER_SIZE];
+  uint8_t *frame;
+  int16_t pcm[BFP_BLOCK_MAX * BFP_CHANNELS_MAX];
+  char out_path[1024];
+  unsigned int chans, block, width, frame_size, ch, i, nbits, e;
+  uint32_t rate, samples, done, n, acc;
+  const uint8_t *bp;
+  int32_t m;
+  FILE *fin, *fout;
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <recording.bfp> [<output.wav>]\n", argv[0]);
+    return 1;
+  }
+  if (argc > 2) {
+    snprintf(out_path, sizeof(out_path), "%s", argv[2]);
+  } else {
+    snprintf(out_path, sizeof(out_path) - 4, "%s", argv[1]);
+    char *dot = strrchr(out_path, '.');
+    if (dot)
+      *dot = '\0';
+    strcat(out_path, ".wav");
+  }
+
+  fin = fopen(argv[1], "rb");
+  if (!fin || (fread(hd, 1, BFP_HEADER_SIZE, fin) != BFP_HEADER_SIZE) ||
+      memcmp(hd, "SSBF", 4) || (get16(&hd[4]) != 1)) {
+    fprintf(stderr, "%s: not a block-floating-point recording\n", argv[1]);
+    return 1;
+  }
+  chans = get16(&hd[6]);
+  rate = get32(&hd[8]);
+  block = get16(&hd[12]);
+  width = get16(&hd[14]);
+  samples = get32(&hd[16]);
+  frame_size = get32(&hd[20]);
+  if ((chans < 1) || (chans > BFP_CHANNELS_MAX) || (block > BFP_BLOCK_MAX) ||
+      (width < 2) || (width > 16) ||
+      (frame_size != chans * (1 + ((block * width + 7) / 8)))) {
+    fprintf(stderr, "%s: unsupported format\n", argv[1]);
+    return 1;
+  }
+
+  fout = fopen(out_path, "wb");
+  if (!fout) {
+    fprintf(stderr, "%s: cannot create\n", out_path);
+    return 1;
+  }
+  frame = malloc(frame_size);
+  writeWaveHeader(fout, chans, rate, 0);
+  done = 0;
+  while ((done < samples) && (fread(frame, 1, frame_size, fin) == frame_size)) {
+    bp = frame;
+    for (ch = 0; ch < chans; ch++) {
+      e = *bp++;
+      acc = 0;
+      nbits = 0;
+      for (i = 0; i < block; i++) {
+        while (nbits < width) {
+          acc = (acc << 8) | *bp++;
+          nbits += 8;
+        }
+        nbits -= width;
+        m = (acc >> nbits) & ((1UL << width) - 1);
+        if (m & (1L << (width - 1)))
+          m -= (1L << width); // sign extension
+        m *= (1L << e);
+        if (m > 32767)
+          m = 32767;
+        pcm[i * chans + ch] = (int16_t)m;
+      }
+    }
+    n = samples - done;
+    if (n > block)
+      n = block;
+    for (i = 0; i < n * chans; i++)
+      put16(fout, (uint16_t)pcm[i]);
+    done += n;
+  }
+  if (done < samples)
+    fprintf(stderr, "%s: truncated, %u of %u samples\n", argv[1], done,
+            samples);
+  fseek(fout, 0, SEEK_SET);
+  writeWaveHeader(fout, chans, rate, done * chans * 2);
+  fclose(fout);
+  fclose(fin);
+  free(frame);
+  printf("%s: %u ch, %u Hz, %u-bit mantissas -> %s (%u samples)\n", argv[1],
+         chans, rate, width, out_path, done);
+  return 0;
+}
@@ -0,0 +1,425 @@
+/*
+ * bc127Bench
+ *
+ * Benchmark and fuzzer of the BC127 line parser of the firmware
+ * (bc127Tokenize() and parseSerialIn() in AudioShield_Teensy/BC127.cpp),
+ * linked with the firmware objects of the host simulation and fed with
+ * recorded BC127 traffic.
+ *
+ * Build: make bc127Bench
+ * Usage: bc127Bench [-t <trace>] [-i <image>] [-n <passes>] [-f <lines>]
+ *                   [-r <seed>]
+ *   -t  recorded traffic, one line per notification (default
+ *       bc127Trace.txt); lines of the firmware debug output
+ *       ("BC127->: <line>") are accepted as well, '#' starts a comment
+ *   -i  scratch card image, formatted and mounted first with the default
+ *       settings of the firmware, for the commands that use the SD card
+ *       (default bench.img)
+ *   -n  benchmark passes over the trace (default 20000)
+ *   -f  fuzzed lines (default 1000000, 0 skips the fuzzer)
+ *   -r  seed of the fuzzer (default 1)
+ *
+ * The benchmark parses the trace with parseSerialIn() and with the
+ * former String parser, kept here for reference (indexOf/substring
+ * slicing, String comparisons and parameters passed by value), and
+ * reports the time and the heap allocations per line. On the host,
+ * String keeps short texts inline, so the allocations of the former
+ * parser are a lower bound of the ones on the target.
+ *
+ * The fuzzer mutates the trace lines (bit flips, inserted and removed
+ * bytes, separators and quotes, splices, overlong lines), checks the
+ * words of bc127Tokenize() against a plain strtok() split, then feeds
+ * the line to parseSerialIn(). Build with
+ * CXXFLAGS="-O1 -g -fsanitize=address,undefined" to catch memory errors.
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "sdCardSim.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Most lines read from the trace
+#define TRACE_LINES_MAX 4096
+// Size of the fuzzed line buffer: up to 4 times the longest UART line
+#define FUZZ_LINE_MAX (4 * BC127_LINE_MAX)
+// Size of the scratch card image (sparse)
+#define BENCH_IMAGE_SIZE (1ULL << 30)
+
+/*** Function prototypes *****************************************************/
+// Firmware sketch (sketch.cpp)
+void setDefaultValues(void);
+
+/*** Variables ***************************************************************/
+// Heap allocations counter (operator new)
+static unsigned long heap_allocs = 0;
+
+// Recorded traffic
+static char *trace[TRACE_LINES_MAX];
+static unsigned int trace_lines = 0;
+
+// Words of the former parser
+static String leg_notif, leg_param[BC127_TOKENS_MAX];
+static unsigned long leg_sink = 0;
+
+// Fuzzer state
+static uint32_t fuzz_seed = 1;
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+void *operator new(size_t size) {
+  void *p = malloc(size ? size : 1);
+
+  if (!p)
+    throw std::bad_alloc();
+  heap_allocs++;
+  return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* nowNs(void)
+ * -----------
+ * Host monotonic time (ns).
+ */
+static uint64_t nowNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* loadTrace(const char*)
+ * ----------------------
+ * Read the recorded traffic, without comments, empty lines and the
+ * prefix of the firmware debug output.
+ * IN:	- path of the trace (const char*)
+ * OUT:	- success (bool)
+ */
+static bool loadTrace(const char *path) {
+  static const char prefix[] = "BC127->: ";
+  char buf[FUZZ_LINE_MAX];
+  FILE *f = fopen(path, "r");
+
+  if (!f)
+    return false;
+  while (fgets(buf, sizeof(buf), f) && (trace_lines < TRACE_LINES_MAX)) {
+    char *line = buf;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (!strncmp(line, prefix, sizeof(prefix) - 1))
+      line += sizeof(prefix) - 1;
+    if ((line[0] == '\0') || (line[0] == '#'))
+      continue;
+    trace[trace_lines++] = strdup(line);
+  }
+  fclose(f);
+  return (trace_lines > 0);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* legacyHandler(String, String, String, String)
+ * ---------------------------------------------
+ * Stand-in of a handler of the former parser: parameters by value.
+ */
+static void legacyHandler(String p1, String p2, String p3, String p4) {
+  leg_sink += p1.length() + p2.length() + p3.length() + p4.length();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* legacyParse(String)
+ * -------------------
+ * The former parser: slicing into global Strings with indexOf() and
+ * substring(), then comparisons of the notification name with String
+ * keywords along the amount of parameters, then a handler call with
+ * parameters by value.
+ * IN:	- received line (String)
+ * OUT:	- amount of parameters (unsigned int)
+ */
+static unsigned int legacyParse(String input) {
+  static const char *names[] = {
+      "INQU_OK", "READY", "AVRCP_PLAY", "AVRCP_PAUSE", "ABS_VOL",
+      "LINK_LOSS", "NAME", "ROLE_OK", "CLOSE_OK", "OPEN_OK",
+      "RECV", "INQUIRY", "STATE", "LINK"};
+  int slice[BC127_TOKENS_MAX + 1];
+  unsigned int nb;
+
+  slice[0] = input.indexOf(" ");
+  for (nb = 1; nb <= BC127_TOKENS_MAX; nb++)
+    slice[nb] = input.indexOf(" ", slice[nb - 1] + 1);
+  if (slice[0] == -1) {
+    leg_notif = input;
+    nb = 0;
+  } else {
+    leg_notif = input.substring(0, slice[0]);
+    for (nb = 1; nb < BC127_TOKENS_MAX; nb++) {
+      if (slice[nb] == -1) {
+        leg_param[nb - 1] = input.substring(slice[nb - 1] + 1);
+        break;
+      }
+      leg_param[nb - 1] = input.substring(slice[nb - 1] + 1, slice[nb]);
+    }
+  }
+  for (unsigned int i = 0; i < (sizeof(names) / sizeof(names[0])); i++) {
+    if (leg_notif.equalsIgnoreCase(names[i])) {
+      legacyHandler(leg_param[0], leg_param[1], leg_param[2], leg_param[3]);
+      break;
+    }
+  }
+  return nb;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bench(unsigned long)
+ * --------------------
+ * Parse the trace with both parsers and report time and heap
+ * allocations per line.
+ * IN:	- passes over the trace (unsigned long)
+ * OUT:	- none
+ */
+static void bench(unsigned long passes) {
+  char line[BC127_LINE_MAX + 1];
+  unsigned long lines = passes * trace_lines, allocs;
+  uint64_t t0, dt;
+  unsigned int i;
+
+  allocs = heap_allocs;
+  t0 = nowNs();
+  for (unsigned long p = 0; p < passes; p++) {
+    for (i = 0; i < trace_lines; i++) {
+      // As bc127Receive(): copy into the line buffer, cut
+      strncpy(line, trace[i], BC127_LINE_MAX);
+      line[BC127_LINE_MAX] = '\0';
+      parseSerialIn(line);
+    }
+  }
+  dt = nowNs() - t0;
+  allocs = heap_allocs - allocs;
+  printf("parseSerialIn:  %8.1f ns/line, %6.3f allocations/line\n",
+         (double)dt / lines, (double)allocs / lines);
+
+  allocs = heap_allocs;
+  t0 = nowNs();
+  for (unsigned long p = 0; p < passes; p++) {
+    // As readStringUntil(): a new String per line
+    for (i = 0; i < trace_lines; i++)
+      legacyParse(String(trace[i]));
+  }
+  dt = nowNs() - t0;
+  allocs = heap_allocs - allocs;
+  printf("String parser:  %8.1f ns/line, %6.3f allocations/line\n",
+         (double)dt / lines, (double)allocs / lines);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fuzzRand(uint32_t)
+ * ------------------
+ * Random value below the given bound (linear congruential generator).
+ */
+static uint32_t fuzzRand(uint32_t bound) {
+  fuzz_seed = (fuzz_seed * 1664525UL) + 1013904223UL;
+  return (uint32_t)(((uint64_t)(fuzz_seed >> 8) * bound) >> 24);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fuzzMutate(char*)
+ * -----------------
+ * Apply one random mutation to a line of at most FUZZ_LINE_MAX - 1
+ * characters.
+ * IN:	- line (char*)
+ * OUT:	- none
+ */
+static void fuzzMutate(char *line) {
+  static const char bytes[] = " \"\t\n?+-:[]0123456789_";
+  size_t len = strlen(line), pos = fuzzRand(len + 1);
+
+  switch (fuzzRand(7)) {
+  case 0: // bit flip
+    if (len > 0)
+      line[pos % len] ^= 1 << fuzzRand(8);
+    break;
+  case 1: // inserted byte, mostly separators, quotes and digits
+    if (len < (FUZZ_LINE_MAX - 1)) {
+      memmove(&line[pos + 1], &line[pos], len - pos + 1);
+      line[pos] = fuzzRand(2) ? bytes[fuzzRand(sizeof(bytes) - 1)]
+                              : (char)(1 + fuzzRand(255));
+    }
+    break;
+  case 2: // removed bytes
+    if (len > 0) {
+      pos %= len;
+      size_t n = 1 + fuzzRand(len - pos);
+      memmove(&line[pos], &line[pos + n], len - pos - n + 1);
+    }
+    break;
+  case 3: // separators run
+    for (unsigned int n = 1 + fuzzRand(4); n > 0; n--) {
+      if (++len >= FUZZ_LINE_MAX)
+        break;
+      memmove(&line[pos + 1], &line[pos], len - pos);
+      line[pos] = ' ';
+    }
+    break;
+  case 4: // splice with the tail of another line
+    if (trace_lines > 0) {
+      const char *other = trace[fuzzRand(trace_lines)];
+      const char *tail = &other[fuzzRand(strlen(other) + 1)];
+      snprintf(&line[pos], FUZZ_LINE_MAX - pos, "%s", tail);
+    }
+    break;
+  case 5: // truncation
+    line[pos] = '\0';
+    break;
+  case 6: // overlong line: repeat the line
+    while ((len > 0) && ((2 * len) < FUZZ_LINE_MAX)) {
+      for (size_t i = 0; i < len; i++)
+        line[len + i] = line[i];
+      len *= 2;
+      line[len] = '\0';
+    }
+    break;
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fuzzCheck(const char*)
+ * ----------------------
+ * Check the words of bc127Tokenize() against a strtok() split of the
+ * same line.
+ * IN:	- line (const char*)
+ * OUT:	- words match (bool)
+ */
+static bool fuzzCheck(const char *line) {
+  char buf[FUZZ_LINE_MAX], ref[FUZZ_LINE_MAX], *save, *word;
+  struct bcToken tok[BC127_TOKENS_MAX];
+  unsigned int nb, i = 0;
+  size_t len = strlen(line);
+
+  memcpy(buf, line, len + 1);
+  memcpy(ref, line, len + 1);
+  nb = bc127Tokenize(buf, tok, BC127_TOKENS_MAX);
+  for (word = strtok_r(ref, " \t\n", &save); word;
+       word = strtok_r(NULL, " \t\n", &save), i++) {
+    if (i >= BC127_TOKENS_MAX)
+      continue;
+    if ((i >= nb) || (tok[i].str < buf) || (tok[i].str >= &buf[len]) ||
+        (tok[i].len != strlen(word)) || (tok[i].str[tok[i].len] != '\0') ||
+        memcmp(tok[i].str, word, tok[i].len))
+      return false;
+  }
+  return (nb == i);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fuzz(unsigned long)
+ * -------------------
+ * Feed mutated trace lines to the tokenizer and to the parser.
+ * IN:	- amount of fuzzed lines (unsigned long)
+ * OUT:	- amount of failures (unsigned long)
+ */
+static unsigned long fuzz(unsigned long lines) {
+  char line[FUZZ_LINE_MAX];
+  unsigned long errors = 0;
+  enum serialMsg msg;
+
+  for (unsigned long l = 0; l < lines; l++) {
+    snprintf(line, sizeof(line), "%s", trace[fuzzRand(trace_lines)]);
+    for (unsigned int m = 1 + fuzzRand(4); m > 0; m--)
+      fuzzMutate(line);
+    if (!fuzzCheck(line)) {
+      if (errors++ < 10)
+        printf("Tokenizer mismatch: \"%s\"\n", line);
+    }
+    msg = parseSerialIn(line);
+    if ((unsigned int)msg >= MAX_OUTPUTS) {
+      if (errors++ < 10)
+        printf("Bad message %d\n", msg);
+    }
+  }
+  return errors;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  const char *path = "bc127Trace.txt";
+  const char *image = "bench.img";
+  unsigned long passes = 20000, fuzz_lines = 1000000, errors, seed;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "t:i:n:f:r:")) != -1) {
+    switch (opt) {
+    case 't':
+      path = optarg;
+      break;
+    case 'i':
+      image = optarg;
+      break;
+    case 'n':
+      passes = strtoul(optarg, NULL, 10);
+      break;
+    case 'f':
+      fuzz_lines = strtoul(optarg, NULL, 10);
+      break;
+    case 'r':
+      fuzz_seed = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr,
+              "usage: %s [-t <trace>] [-i <image>] [-n <passes>] "
+              "[-f <lines>] [-r <seed>]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+  if (!loadTrace(path)) {
+    fprintf(stderr, "%s: no trace lines\n", path);
+    return 1;
+  }
+  if (!sdSimOpen(image, BENCH_IMAGE_SIZE, true, SDCARD_CS_PIN)) {
+    fprintf(stderr, "%s: unable to open the card image\n", image);
+    return 1;
+  }
+  setDefaultValues();
+  initSDcard();
+
+  printf("Trace:          %u lines, %lu passes\n", trace_lines, passes);
+  bench(passes);
+  if (fuzz_lines == 0) {
+    sdSimClose();
+    return 0;
+  }
+  seed = fuzz_seed;
+  errors = fuzz(fuzz_lines);
+  sdSimClose();
+  printf("Fuzzer:         %lu lines (seed %lu), %lu errors\n", fuzz_lines,
+         seed, errors);
+  return errors ? 1 : 0;
+}
+/*****************************************************************************/
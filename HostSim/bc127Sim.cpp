@@ -0,0 +1,174 @@
+/*
+ * BC127 model
+ *
+ * Bluetooth module on BLUEPORT. The module boots when its reset pin is
+ * released and sends READY, answers every command line with OK, and
+ * sends the notifications of the scenario (BLE messages of the app,
+ * link events) at their virtual time. Its lines go out byte by byte at
+ * the speed of the port, one after the other. The lines sent by the
+ * firmware can be echoed on the host console.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdio.h>
+#include <string.h>
+
+#include <deque>
+
+#include "Arduino.h"
+#include "bc127Sim.h"
+
+#include "BC127.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+static char tx_line[BC127SIM_LINE_MAX];
+static unsigned int tx_len = 0;
+static unsigned long tx_lines = 0;
+static bool tx_echo = false;
+// Incremented on each reset, to drop the READY of an aborted boot
+static unsigned long boot_gen = 0;
+// Bytes of the module lines not sent yet
+static std::deque<char> out_q;
+static bool out_busy = false;
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* sendByte(void*)
+ * ---------------
+ * Event: next byte of the module on the UART, 10 bits at the speed of
+ * the port.
+ */
+static void sendByte(void *arg) {
+  unsigned long baud = BLUEPORT.simBaud();
+  char b[2] = {0, 0};
+
+  (void)arg;
+  if (out_q.empty()) {
+    out_busy = false;
+    return;
+  }
+  b[0] = out_q.front();
+  out_q.pop_front();
+  BLUEPORT.simFeed(b);
+  simAt(sim_ns + (baud ? (SIM_SEC(10) / baud) : 0), sendByte, NULL);
+}
+
+/* sendLine(const char*)
+ * ---------------------
+ * Queue a line of the module, with its '\r' ending.
+ */
+static void sendLine(const char *line) {
+  while (*line)
+    out_q.push_back(*line++);
+  out_q.push_back('\r');
+  if (!out_busy) {
+    out_busy = true;
+    sendByte(NULL);
+  }
+}
+
+/* feedLine(void*)
+ * ---------------
+ * Event: send a line (heap copy, freed here) to the firmware.
+ */
+static void feedLine(void *arg) {
+  char *line = (char *)arg;
+
+  sendLine(line);
+  delete[] line;
+}
+
+/* feedReady(void*)
+ * ----------------
+ * Event: end of the boot sequence.
+ */
+static void feedReady(void *arg) {
+  if ((unsigned long)(uintptr_t)arg == boot_gen)
+    sendLine("READY");
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127Rx(uint8_t, void*)
+ * -----------------------
+ * Byte sent by the firmware: commands are lines ended by '\r'.
+ */
+static void bc127Rx(uint8_t b, void *arg) {
+  (void)arg;
+  if (b != '\r') {
+    if (tx_len < (BC127SIM_LINE_MAX - 1))
+      tx_line[tx_len++] = (char)b;
+    return;
+  }
+  tx_line[tx_len] = 0;
+  tx_len = 0;
+  if (!tx_line[0])
+    return;
+  tx_lines++;
+  if (tx_echo)
+    printf("[%10.3f] ->BC127: %s\n", (double)sim_ns / 1e9, tx_line);
+  bc127SimInject(sim_ns + BC127SIM_REPLY_NS, "OK");
+}
+
+/* bc127ResetPin(uint8_t, uint8_t)
+ * -------------------------------
+ * Reset pin change: the module boots on the rising edge.
+ */
+static void bc127ResetPin(uint8_t pin, uint8_t val) {
+  (void)pin;
+  boot_gen++;
+  tx_len = 0;
+  out_q.clear();
+  if (val == HIGH)
+    simAt(sim_ns + BC127SIM_BOOT_NS, feedReady, (void *)(uintptr_t)boot_gen);
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* bc127SimInit(bool)
+ * ------------------
+ * Attach the model to BLUEPORT and to the reset pin.
+ * IN:	- echo the command lines on the console (bool)
+ * OUT:	- none
+ */
+void bc127SimInit(bool echo) {
+  tx_echo = echo;
+  BLUEPORT.simAttach(bc127Rx, NULL);
+  simPinHook(BC127_RST_PIN, bc127ResetPin);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127SimInject(uint64_t, const char*)
+ * -------------------------------------
+ * Schedule a line sent by the module (without the '\r' ending), e.g.
+ * "RECV BLE_1 4 rec:1".
+ * IN:	- virtual time (ns)
+ *			- line (const char*)
+ * OUT:	- none
+ */
+void bc127SimInject(uint64_t at_ns, const char *line) {
+  char *copy = new char[strlen(line) + 1];
+
+  strcpy(copy, line);
+  simAt(at_ns, feedLine, copy);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* bc127SimLines(void)
+ * -------------------
+ * Number of command lines sent by the firmware.
+ * IN:	- none
+ * OUT:	- number of lines (unsigned long)
+ */
+unsigned long bc127SimLines(void) { return tx_lines; }
+/*****************************************************************************/
@@ -0,0 +1,27 @@
+/*
+ * bc127Sim.h
+ */
+#ifndef _BC127SIM_H_
+#define _BC127SIM_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdint.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Boot time of the module after the reset pin is released (ns)
+#define BC127SIM_BOOT_NS 150000000ULL
+// Time from a command line to its answer (ns)
+#define BC127SIM_REPLY_NS 2000000ULL
+// Longest command/notification line
+#define BC127SIM_LINE_MAX 256
+
+/*** Functions ***************************************************************/
+void bc127SimInit(bool echo);
+void bc127SimInject(uint64_t at_ns, const char *line);
+unsigned long bc127SimLines(void);
+
+#endif /* _BC127SIM_H_ */
@@ -0,0 +1,348 @@
+/*
+ * bfpBench
+ *
+ * Round-trip test and benchmark of the block-floating-point storage: the
+ * packer of the firmware (AudioShield_Teensy/bfpPacker.cpp), linked with
+ * the firmware objects of the host simulation, and the desktop converter
+ * (BFPconvert/bfp2wav.c), run on the packed files.
+ *
+ * Build: make bfpBench bfp2wav
+ * Usage: bfpBench [-c <converter>]
+ *   -c  converter to run (default ./bfp2wav)
+ *
+ * The PCM data goes through the packer sector by sector, as
+ * writeRecData() and closeRecFile() feed it, the final header is placed
+ * at the start of the file as updateRecHeader() does, and the file is
+ * converted back to a WAV file by bfp2wav. The converted samples must
+ * match the input in number, channel order and value: for each block and
+ * channel, with the exponent e of its peak (the smallest shift fitting it
+ * into the mantissa width), the error is at most 2^(e-1), or below 2^e
+ * for a positive peak clipped by the rounding, and 0 for e = 0.
+ *
+ * Signals, in mono and stereo (second channel: impulses, so that the
+ * exponents of the channels differ), with a short last block: silence,
+ * full scale square, full scale noise, impulses, sweep with a decaying
+ * level. Each is packed with the narrowest, the default and the widest
+ * mantissas. The packing time per block is the host time of the encode()
+ * calls.
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bfpPacker.h"
+#include "main.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Length of the signals (samples per channel, not a multiple of
+// BFP_BLOCK_SAMPLES, for a short last block)
+#define BFP_BENCH_SAMPLES ((2 * 44100) + 77)
+
+/*** Types *******************************************************************/
+// PCM source: interleaved signed samples
+struct pcmSource {
+  char name[32];
+  unsigned int channels;
+  unsigned long samples; // per channel
+  int16_t *x;
+};
+
+/*** Variables ***************************************************************/
+static const char *conv = "./bfp2wav";
+static char tmp_dir[] = "/tmp/bfpBench.XXXXXX";
+static unsigned int failures = 0;
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* nowNs(void)
+ * -----------
+ * Host monotonic time (ns).
+ */
+static uint64_t nowNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fail(const char*, const char*, unsigned long)
+ * ---------------------------------------------
+ * Report a round-trip error of a case.
+ */
+static bool fail(const char *name, const char *what, unsigned long where) {
+  printf("%s: %s (%lu)\n", name, what, where);
+  failures++;
+  return false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* synth(struct pcmSource*, const char*, unsigned int)
+ * ---------------------------------------------------
+ * Build a signal of BFP_BENCH_SAMPLES samples per channel.
+ * IN:	- source, overwritten (struct pcmSource*)
+ *			- signal: silence, square, noise, impulses or sweep (const char*)
+ *			- number of channels (unsigned int)
+ * OUT:	- success (bool)
+ */
+static bool synth(struct pcmSource *src, const char *sig, unsigned int chans) {
+  unsigned long i;
+  double ph = 0.0;
+  int16_t *x = (int16_t *)malloc(BFP_BENCH_SAMPLES * chans * sizeof(int16_t));
+
+  if (!x)
+    return false;
+  srand(1);
+  for (i = 0; i < BFP_BENCH_SAMPLES; i++) {
+    if (!strcmp(sig, "silence")) {
+      x[i * chans] = 0;
+    } else if (!strcmp(sig, "square")) {
+      x[i * chans] = ((i / 37) % 2) ? 32767 : -32768;
+    } else if (!strcmp(sig, "noise")) {
+      x[i * chans] = (int16_t)((rand() & 0xFFFF) - 32768);
+    } else if (!strcmp(sig, "impulses")) {
+      x[i * chans] = (i % 301) ? 0 : ((i % 2) ? 32767 : -32768);
+    } else {
+      // 20 Hz to 20 kHz, from full scale down by 90 dB
+      ph += 2.0 * M_PI * (20.0 + 19980.0 * i / BFP_BENCH_SAMPLES) / 44100.0;
+      x[i * chans] = (int16_t)lrint(
+          32767.0 * pow(10.0, -4.5 * i / BFP_BENCH_SAMPLES) * sin(ph));
+    }
+    if (chans == 2)
+      x[(i * chans) + 1] = (i % 211) ? (int16_t)((i % 7) - 3) : -20000;
+  }
+  snprintf(src->name, sizeof(src->name), "%s %s", sig,
+           (chans == 1) ? "mono" : "stereo");
+  src->channels = chans;
+  src->samples = BFP_BENCH_SAMPLES;
+  src->x = x;
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* pack(const struct pcmSource*, unsigned int, const char*, double*)
+ * -----------------------------------------------------------------
+ * Pack a source with the firmware packer into a file, sector by sector.
+ * IN:	- source (const struct pcmSource*)
+ *			- mantissa width (unsigned int)
+ *			- file path (const char*)
+ *			- packing time per block in us, overwritten (double*)
+ * OUT:	- success (bool)
+ */
+static bool pack(const struct pcmSource *src, unsigned int width,
+                 const char *path, double *us_block) {
+  size_t pcm_len = src->samples * src->channels * 2, off = 0, i;
+  uint8_t *pcm = (uint8_t *)malloc(pcm_len);
+  uint8_t hd[BFP_HEADER_SIZE];
+  unsigned int len, n, olen;
+  uint64_t t_enc = 0, t0;
+  uint8_t *obuf;
+  FILE *f = fopen(path, "wb");
+  bool ok = (pcm && f);
+
+  for (i = 0; ok && (i < (src->samples * src->channels)); i++) {
+    pcm[2 * i] = (uint8_t)src->x[i];
+    pcm[(2 * i) + 1] = (uint8_t)((uint16_t)src->x[i] >> 8);
+  }
+  ok = ok && bfp_pack.begin(src->channels, WAVE_SAMPLING_RATE, 16, width);
+  // writeRecData()
+  while (ok && (off < pcm_len)) {
+    len = ((pcm_len - off) < REC_SECTOR_SIZE) ? (pcm_len - off)
+                                              : REC_SECTOR_SIZE;
+    while (len) {
+      t0 = nowNs();
+      n = bfp_pack.encode(&pcm[off], len);
+      t_enc += nowNs() - t0;
+      off += n;
+      len -= n;
+      obuf = bfp_pack.output(&olen);
+      if (olen) {
+        ok = ok && (fwrite(obuf, 1, olen, f) == olen);
+        bfp_pack.consume(olen);
+      } else if (!n) {
+        break;
+      }
+    }
+  }
+  // closeRecFile(), updateRecHeader()
+  if (ok) {
+    obuf = bfp_pack.flush(&olen);
+    ok = (fwrite(obuf, 1, olen, f) == olen);
+    bfp_pack.consume(olen);
+    ok = ok && !fseek(f, 0, SEEK_SET) &&
+         (fwrite(hd, 1, bfp_pack.header(hd), f) == BFP_HEADER_SIZE);
+  }
+  if (f)
+    fclose(f);
+  free(pcm);
+  *us_block = (double)t_enc / 1000.0 /
+              ((src->samples + BFP_BLOCK_SAMPLES - 1) / BFP_BLOCK_SAMPLES);
+  return ok;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* check(const char*, const struct pcmSource*, unsigned int, const char*,
+ *       unsigned int*)
+ * ---------------------------------------------------------------------
+ * Check the WAV file converted by bfp2wav against the source.
+ * IN:	- case name (const char*)
+ *			- source (const struct pcmSource*)
+ *			- mantissa width (unsigned int)
+ *			- WAV file path (const char*)
+ *			- largest error, overwritten (unsigned int*)
+ * OUT:	- success (bool)
+ */
+static bool check(const char *name, const struct pcmSource *src,
+                  unsigned int width, const char *path,
+                  unsigned int *max_err) {
+  unsigned long blk, i, nb = src->samples * src->channels;
+  unsigned int ch, need, e, peak, err, bound;
+  int32_t x, m, lim = (1L << (width - 1)) - 1;
+  uint8_t hd[WAVE_HEADER_SIZE];
+  int16_t *y = (int16_t *)malloc(nb * sizeof(int16_t));
+  FILE *f = fopen(path, "rb");
+  uint32_t dlen, rate;
+  bool ok = true;
+
+  *max_err = 0;
+  if (!y || !f || (fread(hd, 1, sizeof(hd), f) != sizeof(hd)) ||
+      memcmp(hd, "RIFF", 4) || memcmp(&hd[36], "data", 4))
+    ok = fail(name, "no WAV file from the converter", 0);
+  if (ok) {
+    memcpy(&rate, &hd[24], 4);
+    memcpy(&dlen, &hd[40], 4);
+    if ((hd[22] != src->channels) || (rate != WAVE_SAMPLING_RATE) ||
+        (hd[34] != 16))
+      ok = fail(name, "WAV format", hd[22]);
+    else if (dlen != (nb * 2))
+      ok = fail(name, "WAV data size", dlen);
+    else if (fread(y, sizeof(int16_t), nb, f) != nb)
+      ok = fail(name, "WAV data truncated", 0);
+  }
+  for (blk = 0; ok && (blk < src->samples); blk += BFP_BLOCK_SAMPLES) {
+    for (ch = 0; ok && (ch < src->channels); ch++) {
+      // Exponent of the block peak, as the packer should choose it
+      peak = 0;
+      for (i = blk; (i < (blk + BFP_BLOCK_SAMPLES)) && (i < src->samples);
+           i++) {
+        x = src->x[(i * src->channels) + ch];
+        peak |= (uint32_t)(x ^ (x >> 31));
+      }
+      need = (peak ? (32 - __builtin_clz(peak)) : 0) + 1;
+      e = (need > width) ? (need - width) : 0;
+      for (i = blk; ok && (i < (blk + BFP_BLOCK_SAMPLES)) &&
+                    (i < src->samples);
+           i++) {
+        x = src->x[(i * src->channels) + ch];
+        err = abs(x - y[(i * src->channels) + ch]);
+        m = e ? ((x + (1L << (e - 1))) >> e) : x;
+        bound = e ? ((m > lim) ? ((1U << e) - 1) : (1U << (e - 1))) : 0;
+        if (err > bound)
+          ok = fail(name, "error above the mantissa bound at sample", i);
+        if (err > *max_err)
+          *max_err = err;
+      }
+    }
+  }
+  if (f)
+    fclose(f);
+  free(y);
+  return ok;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runCase(const struct pcmSource*, unsigned int)
+ * ----------------------------------------------
+ * Pack a source, convert it with bfp2wav and check it, print one line.
+ * IN:	- source (const struct pcmSource*)
+ *			- mantissa width (unsigned int)
+ * OUT:	- success (bool)
+ */
+static bool runCase(const struct pcmSource *src, unsigned int width) {
+  char name[48], bfp[64], wav[64], cmd[256];
+  unsigned int max_err = 0;
+  double us_block = 0.0;
+  long size = 0;
+  FILE *f;
+  bool ok;
+
+  snprintf(name, sizeof(name), "%s %u-bit", src->name, width);
+  snprintf(bfp, sizeof(bfp), "%s/rec.bfp", tmp_dir);
+  snprintf(wav, sizeof(wav), "%s/rec.wav", tmp_dir);
+  snprintf(cmd, sizeof(cmd), "%s %s %s > /dev/null", conv, bfp, wav);
+  ok = pack(src, width, bfp, &us_block);
+  if (!ok)
+    fail(name, "packing failed", 0);
+  if (ok && (f = fopen(bfp, "rb"))) {
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fclose(f);
+  }
+  if (ok && system(cmd))
+    ok = fail(name, "converter failed", 0);
+  if (ok)
+    ok = check(name, src, width, wav, &max_err);
+  printf("%-26s %6.1f %8.3f %8u %s\n", name,
+         100.0 * size / (src->samples * src->channels * 2), us_block,
+         max_err, ok ? "ok" : "FAILED");
+  unlink(bfp);
+  unlink(wav);
+  return ok;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  static const char *sigs[] = {"silence", "square", "noise", "impulses",
+                               "sweep"};
+  static const unsigned int widths[] = {BFP_WIDTH_MIN, REC_BFP_WIDTH_DEF,
+                                        BFP_WIDTH_MAX};
+  struct pcmSource src;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "c:")) != -1) {
+    switch (opt) {
+    case 'c':
+      conv = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-c <converter>]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (access(conv, X_OK) || !mkdtemp(tmp_dir)) {
+    fprintf(stderr, "%s: converter not found (make bfp2wav)\n", conv);
+    return 1;
+  }
+  printf("%-26s %6s %8s %8s\n", "case", "size%", "us/block", "max err");
+  for (unsigned int c = 1; c <= 2; c++) {
+    for (unsigned int s = 0; s < (sizeof(sigs) / sizeof(sigs[0])); s++) {
+      if (!synth(&src, sigs[s], c))
+        continue;
+      for (unsigned int w = 0; w < (sizeof(widths) / sizeof(widths[0])); w++)
+        runCase(&src, widths[w]);
+      free(src.x);
+    }
+  }
+  rmdir(tmp_dir);
+  printf("Round-trip errors: %u\n", failures);
+  return failures ? 1 : 0;
+}
+/*****************************************************************************/
@@ -0,0 +1,915 @@
+/*
+ * flacBench
+ *
+ * Round-trip test and benchmark of the FLAC encoder of the firmware
+ * (AudioShield_Teensy/flacEncoder.cpp), linked with the firmware objects
+ * of the host simulation. The PCM data goes through the encoder sector by
+ * sector, as writeRecData() and closeRecFile() feed it, the stream is
+ * decoded by an independent decoder and compared bit-exactly with the
+ * input.
+ *
+ * Build: make flacBench
+ * Usage: flacBench [-i <image>] [-r <recordings>] [-s <seconds>]
+ *                  [<file.wav> ...]
+ *   -i  card image of the host simulation to take WAV recordings from
+ *       (default sdcard.img, as left by make run; skipped if missing)
+ *   -r  recordings taken from the image (default 2)
+ *   -s  seconds taken from each recording (default 5)
+ *   WAV files of the host, 8 or 16-bit PCM, are taken as well.
+ *
+ * Each source is encoded in mono and stereo, 16 and 8-bit: synthetic
+ * signals (sweep at 44.1, 22.05 and 11.025 kHz, silence, full scale
+ * noise, square and impulses, with a short last frame) and the
+ * recordings, whose first channel is duplicated (delayed and inverted)
+ * for the stereo cases and cut to its high byte for the 8-bit ones.
+ *
+ * The decoder checks the CRC-8 of each frame header, the CRC-16 of each
+ * frame, the frame numbers and sizes and the STREAMINFO of the final
+ * header, and that the stream stays within the verbatim frame bound the
+ * recording time left is computed with. A checkpoint header taken halfway
+ * is checked as well: the stream cut at the length it records must decode
+ * to the samples it counts.
+ *
+ * The time per 128-sample frame is the host time of the encode() calls;
+ * the cycles are the figures the firmware prints at the end of a
+ * recording (ARM_DWT_CYCCNT, host time at the nominal CPU clock here).
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "flacEncoder.h"
+#include "main.h"
+#include "sdCardSim.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Length of the synthetic signals (samples per channel, not a multiple of
+// FLAC_BLOCK_SAMPLES, for a short last frame)
+#define SYNTH_SAMPLES ((3 * 44100) + 77)
+// Delay of the second channel derived from a mono source (samples)
+#define STEREO_DELAY 7
+// Longest WAV header read
+#define WAV_HEADER_MAX REC_SECTOR_SIZE
+
+/*** Types *******************************************************************/
+// PCM source: interleaved signed samples
+struct pcmSource {
+  char name[40];
+  unsigned int channels;
+  unsigned long rate;
+  unsigned long samples; // per channel
+  int32_t *x;
+};
+
+// Decoded stream properties (STREAMINFO and frames)
+struct flacInfo {
+  unsigned int min_block;
+  unsigned int max_block;
+  uint32_t min_frame;
+  uint32_t max_frame;
+  unsigned long rate;
+  unsigned int channels;
+  unsigned int bps;
+  uint64_t total;
+  uint32_t app_len;
+  uint32_t frames;
+};
+
+// Bit reader
+struct bitReader {
+  const uint8_t *buf;
+  size_t len;
+  size_t pos; // bits
+  bool over;  // read past the end
+};
+
+/*** Variables ***************************************************************/
+static const char *image = "sdcard.img";
+static unsigned int rec_max = 2;
+static unsigned int rec_secs = 5;
+static unsigned int failures = 0;
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* nowNs(void)
+ * -----------
+ * Host monotonic time (ns).
+ */
+static uint64_t nowNs(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* crc8(const uint8_t*, size_t) / crc16(const uint8_t*, size_t)
+ * ------------------------------------------------------------
+ * CRCs of the FLAC frames, bit by bit (not the tables of the encoder).
+ */
+static uint8_t crc8(const uint8_t *b, size_t n) {
+  unsigned int crc = 0;
+
+  while (n--) {
+    crc ^= *b++;
+    for (int i = 0; i < 8; i++)
+      crc = ((crc << 1) ^ ((crc & 0x80) ? 0x07 : 0)) & 0xFF;
+  }
+  return crc;
+}
+
+static uint16_t crc16(const uint8_t *b, size_t n) {
+  unsigned int crc = 0;
+
+  while (n--) {
+    crc ^= (unsigned int)(*b++) << 8;
+    for (int i = 0; i < 8; i++)
+      crc = ((crc << 1) ^ ((crc & 0x8000) ? 0x8005 : 0)) & 0xFFFF;
+  }
+  return crc;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Bit reader
+ * ----------
+ * getBits:   unsigned field of up to 32 bits, most significant bit first
+ * getSigned: two's complement field
+ * getUnary:  zero bits up to a one
+ * getUtf8:   frame number coded like UTF-8 characters
+ */
+static uint32_t getBits(struct bitReader *br, unsigned int n) {
+  uint32_t v = 0;
+
+  while (n--) {
+    if (br->pos >= (br->len * 8)) {
+      br->over = true;
+      return 0;
+    }
+    v = (v << 1) | ((br->buf[br->pos >> 3] >> (7 - (br->pos & 7))) & 1);
+    br->pos++;
+  }
+  return v;
+}
+
+static int32_t getSigned(struct bitReader *br, unsigned int n) {
+  uint32_t v;
+
+  if (n == 0)
+    return 0;
+  v = getBits(br, n);
+  if ((n < 32) && (v & (1UL << (n - 1))))
+    v |= ~((1UL << n) - 1);
+  return (int32_t)v;
+}
+
+static uint32_t getUnary(struct bitReader *br) {
+  uint32_t q = 0;
+
+  while (!getBits(br, 1) && !br->over)
+    q++;
+  return q;
+}
+
+static uint32_t getUtf8(struct bitReader *br) {
+  uint32_t v = getBits(br, 8);
+  unsigned int cont = 0;
+
+  while ((cont < 6) && (v & (0x80 >> cont)))
+    cont++;
+  if (cont == 0)
+    return v;
+  v &= 0xFF >> (cont + 1);
+  while (--cont)
+    v = (v << 6) | (getBits(br, 8) & 0x3F);
+  return v;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fail(const char*, const char*, unsigned long)
+ * ---------------------------------------------
+ * Report a round-trip error of a case.
+ */
+static bool fail(const char *name, const char *what, unsigned long where) {
+  printf("%s: %s (%lu)\n", name, what, where);
+  failures++;
+  return false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* readHeader(const uint8_t*, size_t, struct flacInfo*)
+ * ----------------------------------------------------
+ * Parse the "fLaC" marker, STREAMINFO and the checkpoint block.
+ * IN:	- stream (const uint8_t*)
+ *			- stream length (size_t)
+ *			- properties, overwritten (struct flacInfo*)
+ * OUT:	- offset of the first frame, 0 on error (size_t)
+ */
+static size_t readHeader(const uint8_t *s, size_t len, struct flacInfo *fi) {
+  struct bitReader br = {s, len, 0, false};
+  unsigned int last, type;
+  uint32_t size;
+
+  memset(fi, 0, sizeof(*fi));
+  if ((len < 4) || memcmp(s, "fLaC", 4))
+    return 0;
+  br.pos = 32;
+  do {
+    last = getBits(&br, 1);
+    type = getBits(&br, 7);
+    size = getBits(&br, 24);
+    if (br.over || (((br.pos / 8) + size) > len))
+      return 0;
+    if ((type == 0) && (size == 34)) {
+      fi->min_block = getBits(&br, 16);
+      fi->max_block = getBits(&br, 16);
+      fi->min_frame = getBits(&br, 24);
+      fi->max_frame = getBits(&br, 24);
+      fi->rate = getBits(&br, 20);
+      fi->channels = getBits(&br, 3) + 1;
+      fi->bps = getBits(&br, 5) + 1;
+      fi->total = (uint64_t)getBits(&br, 4) << 32;
+      fi->total |= getBits(&br, 32);
+      br.pos += 128; // MD5
+    } else if ((type == 2) && (size == 8) &&
+               !memcmp(&s[br.pos / 8], FLAC_APP_ID, 4)) {
+      br.pos += 32;
+      fi->app_len = getBits(&br, 32);
+    } else {
+      br.pos += size * 8;
+    }
+  } while (!last);
+  return br.over ? 0 : (br.pos / 8);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* readResidual(struct bitReader*, unsigned int, unsigned int, int32_t*)
+ * ---------------------------------------------------------------------
+ * Decode a Rice coded residual (4 or 5-bit parameters, partitions,
+ * escaped partitions).
+ * IN:	- bit reader (struct bitReader*)
+ *			- block size (unsigned int)
+ *			- predictor order (unsigned int)
+ *			- residual, after the warm-up samples (int32_t*)
+ * OUT:	- success (bool)
+ */
+static bool readResidual(struct bitReader *br, unsigned int bs,
+                         unsigned int order, int32_t *res) {
+  unsigned int method = getBits(br, 2);
+  unsigned int porder = getBits(br, 4);
+  unsigned int pbits = method ? 5 : 4;
+  unsigned int esc = method ? 31 : 15;
+  unsigned int parts = 1U << porder;
+  unsigned int p, i, n, k, o = 0;
+  uint32_t u;
+
+  if ((method > 1) || ((bs >> porder) < order) || (bs % parts))
+    return false;
+  for (p = 0; p < parts; p++) {
+    n = (bs >> porder) - (p ? 0 : order);
+    k = getBits(br, pbits);
+    if (k == esc) {
+      k = getBits(br, 5);
+      for (i = 0; i < n; i++)
+        res[o++] = getSigned(br, k);
+    } else {
+      for (i = 0; i < n; i++) {
+        u = (getUnary(br) << k) | getBits(br, k);
+        res[o++] = (int32_t)((u >> 1) ^ -(u & 1));
+      }
+    }
+  }
+  return !br->over;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* readSubframe(struct bitReader*, unsigned int, unsigned int, int32_t*)
+ * ---------------------------------------------------------------------
+ * Decode a subframe: constant, verbatim, fixed or LPC predictor, with
+ * wasted bits.
+ * IN:	- bit reader (struct bitReader*)
+ *			- block size (unsigned int)
+ *			- bits per sample of the subframe (unsigned int)
+ *			- samples (int32_t*)
+ * OUT:	- success (bool)
+ */
+static bool readSubframe(struct bitReader *br, unsigned int bs,
+                         unsigned int bps, int32_t *x) {
+  static const int32_t fixed[5][4] = {
+      {0, 0, 0, 0}, {1, 0, 0, 0}, {2, -1, 0, 0}, {3, -3, 1, 0},
+      {4, -6, 4, -1}};
+  int32_t coef[32];
+  unsigned int type, wasted = 0, order, i, j, prec;
+  int shift;
+  int64_t sum;
+
+  if (getBits(br, 1))
+    return false;
+  type = getBits(br, 6);
+  if (getBits(br, 1))
+    wasted = getUnary(br) + 1;
+  if (wasted >= bps)
+    return false;
+  bps -= wasted;
+
+  if (type == 0) {
+    x[0] = getSigned(br, bps);
+    for (i = 1; i < bs; i++)
+      x[i] = x[0];
+  } else if (type == 1) {
+    for (i = 0; i < bs; i++)
+      x[i] = getSigned(br, bps);
+  } else if ((type >= 8) && (type <= 12)) {
+    order = type - 8;
+    if (order > bs)
+      return false;
+    for (i = 0; i < order; i++)
+      x[i] = getSigned(br, bps);
+    if (!readResidual(br, bs, order, &x[order]))
+      return false;
+    for (i = order; i < bs; i++) {
+      sum = 0;
+      for (j = 0; j < order; j++)
+        sum += (int64_t)fixed[order][j] * x[i - 1 - j];
+      x[i] += (int32_t)sum;
+    }
+  } else if (type >= 32) {
+    order = type - 31;
+    if (order > bs)
+      return false;
+    for (i = 0; i < order; i++)
+      x[i] = getSigned(br, bps);
+    prec = getBits(br, 4) + 1;
+    shift = getSigned(br, 5);
+    if ((prec == 16) || (shift < 0))
+      return false;
+    for (i = 0; i < order; i++)
+      coef[i] = getSigned(br, prec);
+    if (!readResidual(br, bs, order, &x[order]))
+      return false;
+    for (i = order; i < bs; i++) {
+      sum = 0;
+      for (j = 0; j < order; j++)
+        sum += (int64_t)coef[j] * x[i - 1 - j];
+      x[i] += (int32_t)(sum >> shift);
+    }
+  } else {
+    return false;
+  }
+  if (wasted) {
+    for (i = 0; i < bs; i++)
+      x[i] = (int32_t)((uint32_t)x[i] << wasted);
+  }
+  return !br->over;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* decode(const char*, const uint8_t*, size_t, const struct pcmSource*,
+ *        unsigned int, uint64_t)
+ * ------------------------------------------------------------------
+ * Decode the frames of a stream and compare them with the source
+ * samples, coded with the given bits per sample (8-bit: high byte).
+ * IN:	- case name (const char*)
+ *			- stream (const uint8_t*)
+ *			- stream length (size_t)
+ *			- source (const struct pcmSource*)
+ *			- bits per sample of the encoding (unsigned int)
+ *			- samples per channel expected (uint64_t)
+ * OUT:	- success (bool)
+ */
+static bool decode(const char *name, const uint8_t *s, size_t len,
+                   const struct pcmSource *src, unsigned int bits,
+                   uint64_t samples) {
+  static const unsigned long rates[12] = {
+      0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100,
+      48000, 96000};
+  static const unsigned int sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+  static int32_t x[8][65536];
+  struct flacInfo fi;
+  struct bitReader br;
+  size_t pos, start;
+  uint64_t smp = 0;
+  unsigned int bs, rc, ca, sc, nch, ch, i, sbps;
+  unsigned long rate;
+  uint32_t num, flen;
+  int32_t a, b;
+
+  pos = readHeader(s, len, &fi);
+  if (!pos)
+    return fail(name, "bad stream header", 0);
+  if ((fi.channels != src->channels) || (fi.bps != bits) ||
+      (fi.rate != src->rate) || (fi.min_block != FLAC_BLOCK_SAMPLES) ||
+      (fi.max_block != FLAC_BLOCK_SAMPLES))
+    return fail(name, "STREAMINFO mismatch", 0);
+  if ((fi.total != samples) || (fi.app_len > len))
+    return fail(name, "STREAMINFO length mismatch", (unsigned long)fi.total);
+  len = fi.app_len;
+  fi.frames = 0;
+  while (pos < len) {
+    start = pos;
+    br.buf = s;
+    br.len = len;
+    br.pos = pos * 8;
+    br.over = false;
+    if (getBits(&br, 15) != 0x7FFC)
+      return fail(name, "lost frame sync", smp);
+    getBits(&br, 1);
+    bs = getBits(&br, 4);
+    rc = getBits(&br, 4);
+    ca = getBits(&br, 4);
+    sc = getBits(&br, 3);
+    getBits(&br, 1);
+    num = getUtf8(&br);
+    if (bs == 1)
+      bs = 192;
+    else if ((bs >= 2) && (bs <= 5))
+      bs = 576 << (bs - 2);
+    else if (bs == 6)
+      bs = getBits(&br, 8) + 1;
+    else if (bs == 7)
+      bs = getBits(&br, 16) + 1;
+    else if (bs >= 8)
+      bs = 256 << (bs - 8);
+    else
+      return fail(name, "reserved block size", smp);
+    if (rc == 0)
+      rate = fi.rate;
+    else if (rc < 12)
+      rate = rates[rc];
+    else if (rc == 12)
+      rate = getBits(&br, 8) * 1000;
+    else if (rc == 13)
+      rate = getBits(&br, 16);
+    else if (rc == 14)
+      rate = getBits(&br, 16) * 10;
+    else
+      return fail(name, "bad sample rate code", smp);
+    sbps = sc ? sizes[sc] : fi.bps;
+    if (br.over || (crc8(&s[start], br.pos / 8 - start) != getBits(&br, 8)))
+      return fail(name, "frame header CRC-8", smp);
+    nch = (ca < 8) ? (ca + 1) : 2;
+    if ((ca > 10) || (nch != fi.channels) || (sbps != fi.bps) ||
+        (rate != fi.rate) || (num != fi.frames))
+      return fail(name, "frame header mismatch", smp);
+    if ((bs > FLAC_BLOCK_SAMPLES) ||
+        ((bs < FLAC_BLOCK_SAMPLES) && ((smp + bs) != samples)))
+      return fail(name, "bad frame size", smp);
+
+    for (ch = 0; ch < nch; ch++) {
+      unsigned int side = (((ca == 8) || (ca == 10)) && (ch == 1)) ||
+                          ((ca == 9) && (ch == 0));
+      if (!readSubframe(&br, bs, sbps + side, x[ch]))
+        return fail(name, "bad subframe", smp);
+    }
+    br.pos = (br.pos + 7) & ~(size_t)7;
+    if (br.over || (crc16(&s[start], br.pos / 8 - start) != getBits(&br, 16)))
+      return fail(name, "frame CRC-16", smp);
+    for (i = 0; i < bs; i++) {
+      a = x[0][i];
+      b = x[1][i];
+      if (ca == 8) {
+        x[1][i] = a - b;
+      } else if (ca == 9) {
+        x[0][i] = a + b;
+      } else if (ca == 10) {
+        a = (a << 1) | (b & 1);
+        x[0][i] = (a + b) >> 1;
+        x[1][i] = (a - b) >> 1;
+      }
+    }
+    flen = br.pos / 8 - start;
+    if ((flen < fi.min_frame) || (flen > fi.max_frame))
+      return fail(name, "frame size outside STREAMINFO", smp);
+
+    for (i = 0; i < bs; i++) {
+      for (ch = 0; ch < nch; ch++) {
+        a = src->x[((smp + i) * src->channels) + ch];
+        if (bits == 8)
+          a >>= 8;
+        if (x[ch][i] != a)
+          return fail(name, "sample mismatch", smp + i);
+      }
+    }
+    smp += bs;
+    fi.frames++;
+    pos = br.pos / 8;
+  }
+  if ((pos != len) || (smp != samples))
+    return fail(name, "stream length mismatch", smp);
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runCase(const struct pcmSource*, unsigned int)
+ * ----------------------------------------------
+ * Encode a source with the firmware encoder, sector by sector, check
+ * the round trip and the halfway checkpoint, print one line.
+ * IN:	- source (const struct pcmSource*)
+ *			- bits per sample of the encoding, 8 or 16 (unsigned int)
+ * OUT:	- success (bool)
+ */
+static bool runCase(const struct pcmSource *src, unsigned int bits) {
+  unsigned int smp_bytes = src->channels * (bits / 8);
+  size_t pcm_len = src->samples * smp_bytes;
+  size_t frames = (src->samples + FLAC_BLOCK_SAMPLES - 1) / FLAC_BLOCK_SAMPLES;
+  size_t cap = FLAC_HEADER_SIZE + (frames * FLAC_FRAME_MAX);
+  uint8_t *pcm = (uint8_t *)malloc(pcm_len);
+  uint8_t *stream = (uint8_t *)malloc(cap);
+  uint8_t *cut = NULL;
+  uint8_t ckpt[FLAC_HEADER_SIZE];
+  unsigned int n, olen, ckpt_len = 0, len;
+  size_t off = 0, slen = 0, i;
+  uint64_t t_enc = 0, t0;
+  uint8_t *obuf;
+  struct flacInfo fi;
+  char name[64];
+  bool ok;
+
+  snprintf(name, sizeof(name), "%s %s %u-bit", src->name,
+           (src->channels == 1) ? "mono" : "stereo", bits);
+  if (!pcm || !stream) {
+    free(pcm);
+    free(stream);
+    return fail(name, "out of memory", 0);
+  }
+  // Interleaved PCM as in the record ring: 16-bit little endian or 8-bit
+  // unsigned
+  for (i = 0; i < (src->samples * src->channels); i++) {
+    if (bits == 8) {
+      pcm[i] = (uint8_t)((src->x[i] >> 8) + 128);
+    } else {
+      pcm[2 * i] = (uint8_t)src->x[i];
+      pcm[(2 * i) + 1] = (uint8_t)(src->x[i] >> 8);
+    }
+  }
+
+  // Sectors of the ring through writeRecData(), then closeRecFile()
+  flac_enc.begin(src->channels, src->rate, bits);
+  while (off < pcm_len) {
+    len = ((pcm_len - off) < REC_SECTOR_SIZE) ? (pcm_len - off)
+                                              : REC_SECTOR_SIZE;
+    while (len) {
+      t0 = nowNs();
+      n = flac_enc.encode(&pcm[off], len);
+      t_enc += nowNs() - t0;
+      off += n;
+      len -= n;
+      obuf = flac_enc.output(&olen);
+      if (olen) {
+        memcpy(&stream[slen], obuf, olen);
+        slen += olen;
+        flac_enc.consume(olen);
+      } else if (!n) {
+        break;
+      }
+    }
+    if (!ckpt_len && (off >= (pcm_len / 2)))
+      ckpt_len = flac_enc.header(ckpt);
+  }
+  obuf = flac_enc.flush(&olen);
+  memcpy(&stream[slen], obuf, olen);
+  slen += olen;
+  flac_enc.consume(olen);
+  memcpy(stream, ckpt, FLAC_HEADER_SIZE); // header area of the file
+  flac_enc.header(stream);
+
+  ok = decode(name, stream, slen, src, bits, src->samples);
+  // Worst case of getRecBytesPerSec(): verbatim frames
+  if (ok && (slen > (FLAC_HEADER_SIZE +
+                     (frames * (FLAC_FRAME_HEADER_MAX + 2 +
+                                (src->channels *
+                                 (1 + (FLAC_BLOCK_SAMPLES * bits / 8))))))))
+    ok = fail(name, "stream larger than verbatim frames", slen);
+  // Checkpoint: the file cut at its recorded length, with that header
+  if (ok && (ckpt_len == FLAC_HEADER_SIZE) &&
+      readHeader(ckpt, sizeof(ckpt), &fi) && (fi.app_len <= slen)) {
+    cut = (uint8_t *)malloc(fi.app_len);
+    if (cut) {
+      memcpy(cut, stream, fi.app_len);
+      memcpy(cut, ckpt, FLAC_HEADER_SIZE);
+      ok = decode(name, cut, fi.app_len, src, bits, fi.total);
+      free(cut);
+    }
+  } else if (ok) {
+    ok = fail(name, "bad checkpoint header", 0);
+  }
+  printf("%-32s %8lu %6.1f %8.2f %8lu %8lu %s\n", name, src->samples,
+         100.0 * (double)slen / (double)pcm_len,
+         (double)t_enc / 1000.0 / (double)frames,
+         (unsigned long)flac_enc.meanFrameCycles(),
+         (unsigned long)flac_enc.maxFrameCycles(), ok ? "ok" : "FAILED");
+  free(pcm);
+  free(stream);
+  return ok;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runSource(const struct pcmSource*)
+ * ----------------------------------
+ * Encode a mono source in mono and stereo, 16 and 8-bit. The second
+ * channel is the first one delayed and inverted; a stereo source is
+ * taken as is for the stereo cases.
+ * IN:	- mono or stereo source (const struct pcmSource*)
+ * OUT:	- none
+ */
+static void runSource(const struct pcmSource *src) {
+  struct pcmSource mono = *src, stereo = *src;
+  unsigned long i;
+  int32_t *m = NULL, *s = NULL;
+
+  if (src->channels == 1) {
+    s = (int32_t *)malloc(src->samples * 2 * sizeof(int32_t));
+    if (!s)
+      return;
+    for (i = 0; i < src->samples; i++) {
+      s[2 * i] = src->x[i];
+      s[(2 * i) + 1] =
+          (i >= STEREO_DELAY) ? -src->x[i - STEREO_DELAY] : 0;
+      if (s[(2 * i) + 1] > 32767)
+        s[(2 * i) + 1] = 32767;
+    }
+    stereo.channels = 2;
+    stereo.x = s;
+  } else {
+    m = (int32_t *)malloc(src->samples * sizeof(int32_t));
+    if (!m)
+      return;
+    for (i = 0; i < src->samples; i++)
+      m[i] = src->x[2 * i];
+    mono.channels = 1;
+    mono.x = m;
+  }
+  runCase(&mono, 16);
+  runCase(&stereo, 16);
+  runCase(&mono, 8);
+  runCase(&stereo, 8);
+  free(m);
+  free(s);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* synth(struct pcmSource*, const char*, unsigned long)
+ * ----------------------------------------------------
+ * Build a synthetic mono source of SYNTH_SAMPLES samples.
+ * IN:	- source, overwritten (struct pcmSource*)
+ *			- signal: sweep, silence, noise, square or impulses
+ *			  (const char*)
+ *			- sampling rate (unsigned long)
+ * OUT:	- success (bool)
+ */
+static bool synth(struct pcmSource *src, const char *sig, unsigned long rate) {
+  double ph = 0.0, v;
+  unsigned long i;
+  int32_t *x = (int32_t *)malloc(SYNTH_SAMPLES * sizeof(int32_t));
+
+  if (!x)
+    return false;
+  srand(1);
+  for (i = 0; i < SYNTH_SAMPLES; i++) {
+    if (!strcmp(sig, "sweep")) {
+      // 20 Hz to Nyquist, clipped at the loudest, DC offset, noise
+      ph += 2.0 * M_PI *
+            (20.0 + ((rate / 2.0) - 20.0) * i / SYNTH_SAMPLES) / rate;
+      v = 40000.0 * sin(ph) * i / SYNTH_SAMPLES + 300.0 +
+          ((rand() % 65) - 32);
+      if (v > 32767.0)
+        v = 32767.0;
+      else if (v < -32768.0)
+        v = -32768.0;
+      x[i] = (int32_t)v;
+    } else if (!strcmp(sig, "silence")) {
+      // Digital silence, then constant steps (CONSTANT subframes)
+      x[i] = (i < (SYNTH_SAMPLES / 2)) ? 0 : ((i / 1000) % 2 ? -32768 : 5);
+    } else if (!strcmp(sig, "noise")) {
+      // Full scale white noise (VERBATIM subframes)
+      x[i] = (int32_t)(rand() & 0xFFFF) - 32768;
+    } else if (!strcmp(sig, "square")) {
+      // Full scale square wave, largest fixed predictor residuals
+      x[i] = ((i / 37) % 2) ? 32767 : -32768;
+    } else {
+      // Isolated full scale spikes in silence, long Rice quotients
+      x[i] = (i % 301) ? 0 : ((i % 2) ? 32767 : -32768);
+    }
+  }
+  snprintf(src->name, sizeof(src->name), "%s %.5g kHz", sig, rate / 1000.0);
+  src->channels = 1;
+  src->rate = rate;
+  src->samples = SYNTH_SAMPLES;
+  src->x = x;
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* parseWav(struct pcmSource*, const uint8_t*, size_t, const char*)
+ * ----------------------------------------------------------------
+ * Take the PCM samples of a WAV file read (at least partly) in memory.
+ * IN:	- source, overwritten (struct pcmSource*)
+ *			- file data (const uint8_t*)
+ *			- amount of data (size_t)
+ *			- source name (const char*)
+ * OUT:	- success (bool)
+ */
+static bool parseWav(struct pcmSource *src, const uint8_t *b, size_t len,
+                     const char *name) {
+  size_t pos = 12, csize;
+  unsigned int fmt = 0, chans = 0, bits = 0;
+  unsigned long rate = 0, i, n;
+
+  if ((len < 44) || memcmp(b, "RIFF", 4) || memcmp(&b[8], "WAVE", 4))
+    return false;
+  while ((pos + 8) <= len) {
+    csize = b[pos + 4] | (b[pos + 5] << 8) | (b[pos + 6] << 16) |
+            ((uint32_t)b[pos + 7] << 24);
+    if (!memcmp(&b[pos], "fmt ", 4) && ((pos + 24) <= len)) {
+      fmt = b[pos + 8] | (b[pos + 9] << 8);
+      chans = b[pos + 10] | (b[pos + 11] << 8);
+      rate = b[pos + 12] | (b[pos + 13] << 8) | (b[pos + 14] << 16);
+      bits = b[pos + 22] | (b[pos + 23] << 8);
+    } else if (!memcmp(&b[pos], "data", 4)) {
+      pos += 8;
+      break;
+    }
+    pos += 8 + csize + (csize & 1);
+  }
+  if ((fmt != 1) || (chans < 1) || (chans > REC_CHANNELS_MAX) ||
+      ((bits != 8) && (bits != 16)) || (pos > len))
+    return false;
+  n = (len - pos) / (chans * (bits / 8));
+  if (((unsigned long)rec_secs * rate) < n)
+    n = rec_secs * rate;
+  if (n == 0)
+    return false;
+  src->x = (int32_t *)malloc(n * chans * sizeof(int32_t));
+  if (!src->x)
+    return false;
+  for (i = 0; i < (n * chans); i++) {
+    if (bits == 8)
+      src->x[i] = ((int32_t)b[pos + i] - 128) * 256;
+    else
+      src->x[i] = (int16_t)(b[pos + (2 * i)] | (b[pos + (2 * i) + 1] << 8));
+  }
+  snprintf(src->name, sizeof(src->name), "%s", name);
+  src->channels = chans;
+  src->rate = rate;
+  src->samples = n;
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runRecordings(void)
+ * -------------------
+ * Run the WAV recordings of the day folders of the card image.
+ * IN:	- none
+ * OUT:	- none
+ */
+static void runRecordings(void) {
+  FatFile root, day, f;
+  struct pcmSource src;
+  char fname[16], dname[16], name[40];
+  unsigned int found = 0;
+  size_t len, got;
+  uint8_t *b;
+
+  if (access(image, F_OK) ||
+      !sdSimOpen(image, SDSIM_SIZE_DEF, false, SDCARD_CS_PIN) ||
+      !sd.begin(SDCARD_CS_PIN) || !root.open("/", O_RDONLY)) {
+    printf("%s: no card image, no recordings\n", image);
+    return;
+  }
+  while ((found < rec_max) && day.openNext(&root, O_RDONLY)) {
+    if (day.isDir()) {
+      day.getName(dname, sizeof(dname));
+      while ((found < rec_max) && f.openNext(&day, O_RDONLY)) {
+        f.getName(fname, sizeof(fname));
+        len = strlen(fname);
+        if ((len > 4) && !strcasecmp(&fname[len - 4], ".wav")) {
+          // Header and up to rec_secs of 16-bit stereo audio
+          len = WAV_HEADER_MAX + (rec_secs * 44100UL * 4);
+          if (len > f.fileSize())
+            len = f.fileSize();
+          b = (uint8_t *)malloc(len);
+          got = b ? f.read(b, len) : 0;
+          snprintf(name, sizeof(name), "%s/%s", dname, fname);
+          if ((got == len) && parseWav(&src, b, len, name)) {
+            found++;
+            runSource(&src);
+            free(src.x);
+          }
+          free(b);
+        }
+        f.close();
+      }
+    }
+    day.close();
+  }
+  root.close();
+  sdSimClose();
+  if (!found)
+    printf("%s: no WAV recordings\n", image);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runWavFile(const char*)
+ * -----------------------
+ * Run a WAV file of the host.
+ * IN:	- path (const char*)
+ * OUT:	- none
+ */
+static void runWavFile(const char *path) {
+  struct pcmSource src;
+  FILE *f = fopen(path, "rb");
+  size_t len = WAV_HEADER_MAX + (rec_secs * 44100UL * 4);
+  uint8_t *b = (uint8_t *)malloc(len);
+  const char *base = strrchr(path, '/');
+
+  if (!f || !b) {
+    printf("%s: unreadable\n", path);
+    failures++;
+  } else {
+    len = fread(b, 1, len, f);
+    if (parseWav(&src, b, len, base ? (base + 1) : path)) {
+      runSource(&src);
+      free(src.x);
+    } else {
+      printf("%s: not an 8 or 16-bit PCM WAV file\n", path);
+      failures++;
+    }
+  }
+  if (f)
+    fclose(f);
+  free(b);
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  static const char *sigs[] = {"silence", "noise", "square", "impulses"};
+  static const unsigned long rates[] = {44100, 22050, 11025};
+  struct pcmSource src;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:r:s:")) != -1) {
+    switch (opt) {
+    case 'i':
+      image = optarg;
+      break;
+    case 'r':
+      rec_max = atoi(optarg);
+      break;
+    case 's':
+      rec_secs = atoi(optarg);
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-i image] [-r recordings] [-s seconds] "
+              "[file.wav ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  printf("%-32s %8s %6s %8s %8s %8s\n", "case", "samples", "size%",
+         "us/frame", "cycles", "max");
+  for (unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++) {
+    if (synth(&src, "sweep", rates[r])) {
+      runSource(&src);
+      free(src.x);
+    }
+  }
+  for (unsigned int s = 0; s < sizeof(sigs) / sizeof(sigs[0]); s++) {
+    if (synth(&src, sigs[s], WAVE_SAMPLING_RATE)) {
+      runSource(&src);
+      free(src.x);
+    }
+  }
+  if (rec_max)
+    runRecordings();
+  for (int a = optind; a < argc; a++)
+    runWavFile(argv[a]);
+  printf("Round-trip errors: %u\n", failures);
+  return failures ? 1 : 0;
+}
+/*****************************************************************************/
@@ -0,0 +1,275 @@
+/*
+ * headerTest
+ *
+ * Test of the WAV header written up front and patched in place while
+ * recording (updateRecHeader() in AudioShield_Teensy/SDutils.cpp and
+ * RawRecorder::patch() in rawRecorder.cpp), linked with the firmware
+ * objects of the host simulation.
+ *
+ * Build: make headerTest
+ * Usage: headerTest [-i <image>] [-s <seconds>]
+ *   -i  scratch card image, formatted first (default header.img)
+ *   -s  seconds recorded per case (default 5)
+ *
+ * Each case records through the storage path of the firmware
+ * (openRecFile(), writeRecData(), as startRecording() and
+ * continueRecording() call them) and patches the header every second,
+ * as the checkpoints do. After each patch, the header is read back from
+ * the card image itself, behind the volume cache: the RIFF and data
+ * sizes must match the bytes written so far, with the recorder still
+ * streaming. After closeRecFile(), the file must have been cut from its
+ * pre-allocated size down to the recorded length, with the clusters
+ * beyond it freed, the final sizes in its header and its audio intact.
+ *
+ * Cases: pre-allocated mono and stereo 8-bit, a pre-allocation too short
+ * for the recording (the file system takes over), no pre-allocation,
+ * one-sector header with its JUNK chunk. The recordings end with a
+ * partial sector.
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "sdCardSim.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Size of the scratch card image (sparse)
+#define HEADER_IMAGE_SIZE (1ULL << 30)
+// Folder of the test recordings
+#define HEADER_DIR "/header"
+// Data handed to writeRecData() at a time (continueRecording() bursts)
+#define HEADER_CHUNK (8 * REC_SECTOR_SIZE)
+// Bytes of the partial sector ending each recording
+#define HEADER_TAIL 300
+
+/*** Types *******************************************************************/
+// Pre-allocation of a case
+enum headerAlloc {
+  ALLOC_FULL,  // getRecFileSize(), as REC_CONTIGUOUS_MODE
+  ALLOC_SHORT, // a tenth of the recording
+  ALLOC_NONE   // the file grows through the file system
+};
+
+// Recording of a case
+struct headerCase {
+  const char *name;
+  unsigned int channels;
+  unsigned int bits;
+  enum headerAlloc alloc;
+  bool junk; // one-sector header (armed ring)
+};
+
+/*** Function prototypes *****************************************************/
+// Firmware sketch (sketch.cpp)
+void setDefaultValues(void);
+// Firmware (audioUtils.cpp)
+unsigned long getRecFileSize(void);
+
+/*** Variables ***************************************************************/
+static const char *image = "header.img";
+static unsigned int rec_secs = 5;
+static unsigned int failures = 0;
+static FILE *img_file = NULL;
+
+static const struct headerCase cases[] = {
+    {"mono 16-bit", 1, 16, ALLOC_FULL, false},
+    {"stereo 8-bit", 2, 8, ALLOC_FULL, false},
+    {"short pre-allocation", 1, 16, ALLOC_SHORT, false},
+    {"no pre-allocation", 2, 16, ALLOC_NONE, false},
+    {"junk header", 1, 16, ALLOC_FULL, true},
+};
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* fail(const char*, const char*, unsigned long)
+ * ---------------------------------------------
+ * Report an error of a case.
+ */
+static bool fail(const char *name, const char *what, unsigned long val) {
+  printf("%s: %s (%lu)\n", name, what, val);
+  failures++;
+  return false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* checkSizes(const char*, const uint8_t*, uint32_t, uint32_t)
+ * -----------------------------------------------------------
+ * Check the chunks and the RIFF and data sizes of a WAV header.
+ * IN:	- case name (const char*)
+ *			- header (const uint8_t*)
+ *			- header size, WAVE_HEADER_SIZE or REC_SECTOR_SIZE (uint32_t)
+ *			- file bytes the header should cover (uint32_t)
+ * OUT:	- success (bool)
+ */
+static bool checkSizes(const char *name, const uint8_t *hd, uint32_t hd_size,
+                       uint32_t bytes) {
+  uint32_t flength, dlength;
+
+  memcpy(&flength, &hd[WAVE_FLENGTH_POS], 4);
+  memcpy(&dlength, &hd[hd_size - 4], 4);
+  if (memcmp(hd, "RIFF", 4) || memcmp(&hd[8], "WAVE", 4) ||
+      memcmp(&hd[hd_size - 8], "data", 4) ||
+      ((hd_size == REC_SECTOR_SIZE) && memcmp(&hd[WAVE_JUNK_POS], "JUNK", 4)))
+    return fail(name, "bad header chunks", 0);
+  if (flength != (bytes - 8))
+    return fail(name, "RIFF size", flength);
+  if (dlength != (bytes - hd_size))
+    return fail(name, "data size", dlength);
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runCase(const struct headerCase*, unsigned int)
+ * -----------------------------------------------
+ * Record a case, checking the header on the card after each patch and
+ * the file after closing.
+ * IN:	- case (const struct headerCase*)
+ *			- case number (unsigned int)
+ * OUT:	- success (bool)
+ */
+static bool runCase(const struct headerCase *c, unsigned int num) {
+  uint32_t hd_size = c->junk ? REC_SECTOR_SIZE : WAVE_HEADER_SIZE;
+  uint8_t hd[REC_SECTOR_SIZE], buf[HEADER_CHUNK];
+  unsigned long len, off = 0, n, next_ck, size = 0, free0, cb, i;
+  unsigned int patches = 0;
+  char path[REC_PATH_SIZE];
+  uint8_t *pcm;
+  SdBaseFile fh;
+  int v, r;
+  bool ok = true;
+
+  snprintf(path, sizeof(path), HEADER_DIR "/rec%u.wav", num);
+  cap_profile.channels = c->channels;
+  cap_profile.bits = c->bits;
+  cap_profile.format = RECFMT_WAV;
+  setWaveFormat(&cap_profile);
+  len = (rec_secs * wave_header.bytes_per_sec) + HEADER_TAIL;
+  len -= len % wave_header.bytes_per_samp;
+  pcm = (uint8_t *)malloc(len);
+  if (!pcm)
+    return fail(c->name, "out of memory", len);
+  srand(num);
+  for (i = 0; i < len; i++) {
+    v = (int)(12000.0 * sin(i * 0.01)) + (rand() % 512) - 256;
+    pcm[i] = (c->bits == 8) ? (uint8_t)((v >> 8) + 128)
+                            : ((i & 1) ? (uint8_t)(v >> 8) : (uint8_t)v);
+  }
+  if (c->alloc == ALLOC_FULL)
+    size = getRecFileSize();
+  else if (c->alloc == ALLOC_SHORT)
+    size = ((len / 10) / REC_SECTOR_SIZE) * REC_SECTOR_SIZE;
+  free0 = sdFreeClusters();
+  cb = sdClusterBytes();
+
+  // startRecording()
+  rec_enc = NULL;
+  if (!openRecFile(path, size)) {
+    free(pcm);
+    return fail(c->name, "file opening error", 0);
+  }
+  if (c->junk)
+    writeWaveSector();
+  else
+    writeRecData((uint8_t *)&wave_header, WAVE_HEADER_SIZE);
+
+  // continueRecording(), a checkpoint every second
+  next_ck = wave_header.bytes_per_sec;
+  while (off < len) {
+    n = ((len - off) < HEADER_CHUNK) ? (len - off) : HEADER_CHUNK;
+    writeRecData(&pcm[off], n);
+    off += n;
+    if (ok && (off >= next_ck) && (off < len)) {
+      updateRecHeader();
+      patches++;
+      next_ck += wave_header.bytes_per_sec;
+      // Read back from the card, behind the volume cache
+      if (!frec.firstBlock() ||
+          (pread(fileno(img_file), hd, hd_size,
+                 (off_t)frec.firstBlock() * REC_SECTOR_SIZE) !=
+           (ssize_t)hd_size))
+        ok = fail(c->name, "header not on the card", patches);
+      else
+        ok = checkSizes(c->name, hd, hd_size, tot_rec_bytes);
+    }
+  }
+  if (ok && (tot_rec_bytes != (len + hd_size)))
+    ok = fail(c->name, "bytes written", tot_rec_bytes);
+  closeRecFile();
+
+  // finish(): cut down to the recorded length, final header
+  if (ok && !fh.open(path, O_RDONLY))
+    ok = fail(c->name, "recording lost", 0);
+  if (ok && (fh.fileSize() != (len + hd_size)))
+    ok = fail(c->name, "file size", fh.fileSize());
+  if (ok && (sdFreeClusters() != (free0 - ((len + hd_size + cb - 1) / cb))))
+    ok = fail(c->name, "clusters not freed", free0 - sdFreeClusters());
+  if (ok && (fh.read(hd, hd_size) != (int)hd_size))
+    ok = fail(c->name, "header unreadable", 0);
+  if (ok)
+    ok = checkSizes(c->name, hd, hd_size, fh.fileSize());
+  for (i = 0; ok && (i < len); i += r) {
+    r = fh.read(buf, ((len - i) < sizeof(buf)) ? (len - i) : sizeof(buf));
+    if ((r <= 0) || memcmp(buf, &pcm[i], r))
+      ok = fail(c->name, "audio data mismatch at", i);
+  }
+  printf("%-22s %10lu %10lu %8u %s\n", c->name, size,
+         (unsigned long)fh.fileSize(), patches, ok ? "ok" : "FAILED");
+  fh.close();
+  free(pcm);
+  return ok;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:s:")) != -1) {
+    switch (opt) {
+    case 'i':
+      image = optarg;
+      break;
+    case 's':
+      rec_secs = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-i <image>] [-s <seconds>]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!sdSimOpen(image, HEADER_IMAGE_SIZE, true, SDCARD_CS_PIN) ||
+      ((img_file = fopen(image, "rb")) == NULL)) {
+    fprintf(stderr, "%s: unable to open the card image\n", image);
+    return 1;
+  }
+  setDefaultValues();
+  initSDcard();
+  initWaveHeader();
+  if (!sd.mkdir(HEADER_DIR)) {
+    fprintf(stderr, "%s: unable to create " HEADER_DIR "\n", image);
+    return 1;
+  }
+
+  printf("%-22s %10s %10s %8s\n", "case", "allocated", "final", "patches");
+  for (unsigned int i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++)
+    runCase(&cases[i], i);
+  fclose(img_file);
+  sdSimClose();
+  printf("Header errors: %u\n", failures);
+  return failures ? 1 : 0;
+}
+/*****************************************************************************/
@@ -0,0 +1,414 @@
+/*
+ * recoverTest
+ *
+ * Test of the boot-time repair of a recording interrupted by a power loss
+ * (recoverRecording() in AudioShield_Teensy/SDutils.cpp), linked with the
+ * firmware objects of the host simulation.
+ *
+ * Build: make recoverTest
+ * Usage: recoverTest [-i <image>] [-s <seconds>]
+ *   -i  scratch card image, formatted first (default recover.img)
+ *   -s  seconds recorded before the checkpoint (default 3)
+ *
+ * For each case, a child process records through the storage path of the
+ * firmware (openRecFile(), writeRecData() and updateRecHeader(), as
+ * startRecording() and continueRecording() call them), takes one
+ * checkpoint, records one more second and dies: the card image is mapped
+ * shared, so the blocks written so far stay on it, while the volume cache
+ * and the open file are lost with the process, as with the power. The
+ * parent then boots on the image (initSDcard() and recoverRecording(), as
+ * setup() does) and checks that /RECORD.CUR is gone, that the repaired
+ * file ends with the checkpointed data, that its header sizes match, that
+ * the audio data is intact and that the recording index got a recovered
+ * entry. The playable length of each repaired file is reported.
+ *
+ * Cases: 44-byte WAV header (pre-allocated, and grown through the file
+ * system), one-sector WAV header with its JUNK chunk, power loss before
+ * the first checkpoint, FLAC mono 8-bit and stereo 16-bit, block floating
+ * point.
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "sdCardSim.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Size of the scratch card image (sparse)
+#define RECOVER_IMAGE_SIZE (1ULL << 30)
+// Folder of the test recordings
+#define RECOVER_DIR "/recover"
+// Data handed to writeRecData() at a time (continueRecording() bursts)
+#define RECOVER_CHUNK (8 * REC_SECTOR_SIZE)
+
+/*** Types *******************************************************************/
+// Recording interrupted by the power loss
+struct recoverCase {
+  const char *name;
+  enum recFormat format;
+  unsigned int channels;
+  unsigned int bits;
+  bool prealloc;   // contiguous pre-allocation (REC_CONTIGUOUS_MODE)
+  bool junk;       // one-sector WAV header (armed ring)
+  bool checkpoint; // checkpoint taken before the power loss
+};
+
+// State of the recording at the power loss, from the child
+struct recoverState {
+  uint32_t ck_bytes;  // file bytes written at the checkpoint
+  uint32_t end_bytes; // file bytes written at the power loss
+  uint32_t pcm_bytes; // PCM bytes encoded at the checkpoint
+  unsigned int hd_len;
+  uint8_t hd[REC_ENC_HEADER_MAX]; // header patched by the checkpoint
+};
+
+/*** Function prototypes *****************************************************/
+// Firmware sketch (sketch.cpp)
+void setDefaultValues(void);
+// Firmware (audioUtils.cpp)
+unsigned long getRecFileSize(void);
+
+/*** Variables ***************************************************************/
+static const char *image = "recover.img";
+static unsigned int ck_secs = 3;
+static unsigned int failures = 0;
+
+static const struct recoverCase cases[] = {
+    {"wav", RECFMT_WAV, 1, 16, true, false, true},
+    {"wav fs", RECFMT_WAV, 2, 16, false, false, true},
+    {"wav junk", RECFMT_WAV, 1, 16, true, true, true},
+    {"wav no checkpoint", RECFMT_WAV, 1, 16, true, false, false},
+    {"flac", RECFMT_FLAC, 2, 16, true, false, true},
+    {"flac 8-bit", RECFMT_FLAC, 1, 8, true, false, true},
+    {"bfp", RECFMT_BFP, 1, 16, true, false, true},
+};
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* fail(const char*, const char*, unsigned long)
+ * ---------------------------------------------
+ * Report an error of a case.
+ */
+static bool fail(const char *name, const char *what, unsigned long val) {
+  printf("%s: %s (%lu)\n", name, what, val);
+  failures++;
+  return false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* makePcm(const struct recoverCase*, unsigned long)
+ * -------------------------------------------------
+ * Interleaved PCM data of a case, as the record ring holds it: a tone
+ * with some noise, 16-bit little endian or 8-bit unsigned.
+ * IN:	- case (const struct recoverCase*)
+ *			- number of bytes (unsigned long)
+ * OUT:	- PCM data, to be freed (uint8_t*)
+ */
+static uint8_t *makePcm(const struct recoverCase *c, unsigned long len) {
+  uint8_t *pcm = (uint8_t *)malloc(len);
+  unsigned long i;
+  int v;
+
+  if (!pcm)
+    return NULL;
+  srand(1);
+  for (i = 0; i < len; i++) {
+    v = (int)(12000.0 * sin(i * 0.01)) + (rand() % 512) - 256;
+    if (c->bits == 8)
+      pcm[i] = (uint8_t)((v >> 8) + 128);
+    else
+      pcm[i] = (i & 1) ? (uint8_t)(v >> 8) : (uint8_t)v;
+  }
+  return pcm;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* record(const struct recoverCase*, const char*, int)
+ * ---------------------------------------------------
+ * Child process: record a case up to the power loss and send the state
+ * of the recording to the parent. Does not return.
+ * IN:	- case (const struct recoverCase*)
+ *			- recording path (const char*)
+ *			- pipe to the parent (int)
+ * OUT:	- none
+ */
+static void record(const struct recoverCase *c, const char *path, int fd) {
+  struct recoverState st;
+  unsigned long bps, ck_len, len, off = 0, n;
+  uint8_t *pcm;
+
+  memset(&st, 0, sizeof(st));
+  if (!sdSimOpen(image, RECOVER_IMAGE_SIZE, false, SDCARD_CS_PIN))
+    _exit(1);
+  setDefaultValues();
+  initSDcard();
+  initWaveHeader();
+  cap_profile.channels = c->channels;
+  cap_profile.bits = c->bits;
+  cap_profile.format = c->format;
+  setWaveFormat(&cap_profile);
+  bps = wave_header.bytes_per_sec;
+  ck_len = ck_secs * bps;
+  len = ck_len + bps;
+  pcm = makePcm(c, len);
+  if (!pcm)
+    _exit(1);
+
+  // startRecording()
+  rec_enc = NULL;
+  if (c->format == RECFMT_FLAC) {
+    flac_enc.begin(c->channels, wave_header.srate, c->bits);
+    rec_enc = &flac_enc;
+  } else if (c->format == RECFMT_BFP) {
+    bfp_pack.begin(c->channels, wave_header.srate, c->bits,
+                   REC_BFP_WIDTH_DEF);
+    rec_enc = &bfp_pack;
+  }
+  if (!openRecFile(path, c->prealloc ? getRecFileSize() : 0))
+    _exit(1);
+  if (c->junk) {
+    writeWaveSector();
+  } else if (!rec_enc) {
+    // Header at the start of the ring, followed by the audio
+    writeRecData((uint8_t *)&wave_header, WAVE_HEADER_SIZE);
+  }
+
+  // continueRecording(), with one checkpoint
+  while (off < len) {
+    n = ((len - off) < RECOVER_CHUNK) ? (len - off) : RECOVER_CHUNK;
+    writeRecData(&pcm[off], n);
+    off += n;
+    if (c->checkpoint && !st.ck_bytes && (off >= ck_len)) {
+      updateRecHeader();
+      st.ck_bytes = tot_rec_bytes;
+      st.pcm_bytes = off;
+      st.hd_len = rec_enc ? rec_enc->header(st.hd) : 0;
+    }
+  }
+  st.end_bytes = tot_rec_bytes;
+  // Power loss: no close, the volume cache and the open file are lost
+  if (write(fd, &st, sizeof(st)) != (ssize_t)sizeof(st))
+    _exit(1);
+  _exit(0);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* checkWav(const struct recoverCase*, SdBaseFile*, const struct
+ *          recoverState*, double*)
+ * ------------------------------------------------------------
+ * Check a repaired WAV file: header sizes, file size and audio data.
+ * IN:	- case (const struct recoverCase*)
+ *			- repaired file (SdBaseFile*)
+ *			- state at the power loss (const struct recoverState*)
+ *			- playable length in s, overwritten (double*)
+ * OUT:	- success (bool)
+ */
+static bool checkWav(const struct recoverCase *c, SdBaseFile *fh,
+                     const struct recoverState *st, double *secs) {
+  uint32_t hd_size = c->junk ? REC_SECTOR_SIZE : WAVE_HEADER_SIZE;
+  uint32_t size = fh->fileSize(), expected, flength, dlength, i;
+  uint8_t hd[REC_SECTOR_SIZE], buf[RECOVER_CHUNK];
+  uint8_t *pcm;
+  int n;
+
+  expected = c->checkpoint ? st->ck_bytes : hd_size;
+  if (size != expected)
+    return fail(c->name, "file size, expected", expected);
+  if (!fh->seekSet(0) || (fh->read(hd, hd_size) != (int)hd_size))
+    return fail(c->name, "header unreadable", 0);
+  memcpy(&flength, &hd[WAVE_FLENGTH_POS], 4);
+  memcpy(&dlength, &hd[hd_size - 4], 4);
+  if (memcmp(hd, "RIFF", 4) || memcmp(&hd[hd_size - 8], "data", 4) ||
+      (c->junk && memcmp(&hd[WAVE_JUNK_POS], "JUNK", 4)))
+    return fail(c->name, "bad header chunks", 0);
+  if (flength != (size - 8))
+    return fail(c->name, "RIFF size", flength);
+  if ((dlength != (size - hd_size)) ||
+      (dlength % ((c->channels * c->bits) / 8)))
+    return fail(c->name, "data size", dlength);
+
+  pcm = makePcm(c, dlength ? dlength : 1);
+  for (i = 0; pcm && (i < dlength); i += n) {
+    n = fh->read(buf, ((dlength - i) < sizeof(buf)) ? (dlength - i)
+                                                    : sizeof(buf));
+    if ((n <= 0) || memcmp(buf, &pcm[i], n)) {
+      free(pcm);
+      return fail(c->name, "audio data mismatch at", i);
+    }
+  }
+  free(pcm);
+  *secs = (double)dlength /
+          ((WAVE_SAMPLING_RATE * c->channels * c->bits) / 8.0);
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* checkEncoded(const struct recoverCase*, SdBaseFile*, const struct
+ *              recoverState*, double*)
+ * ----------------------------------------------------------------
+ * Check a repaired FLAC or block-floating-point file: header of the
+ * checkpoint, file cut after the last frame it covers.
+ * IN:	- case (const struct recoverCase*)
+ *			- repaired file (SdBaseFile*)
+ *			- state at the power loss (const struct recoverState*)
+ *			- playable length in s, overwritten (double*)
+ * OUT:	- success (bool)
+ */
+static bool checkEncoded(const struct recoverCase *c, SdBaseFile *fh,
+                         const struct recoverState *st, double *secs) {
+  uint32_t size = fh->fileSize(), expected, smp, frame;
+  uint8_t hd[REC_ENC_HEADER_MAX];
+  const uint8_t *p;
+  uint64_t total;
+
+  if (!fh->seekSet(0) || (fh->read(hd, st->hd_len) != (int)st->hd_len) ||
+      memcmp(hd, st->hd, st->hd_len))
+    return fail(c->name, "header differs from the checkpoint", 0);
+  if (c->format == RECFMT_FLAC) {
+    // STREAMINFO total samples, checkpoint block stream length
+    p = &hd[8];
+    total = ((uint64_t)(p[13] & 0x0F) << 32) | ((uint32_t)p[14] << 24) |
+            ((uint32_t)p[15] << 16) | ((uint32_t)p[16] << 8) | p[17];
+    p = &hd[FLAC_HEADER_SIZE - 4];
+    expected = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+               ((uint32_t)p[2] << 8) | p[3];
+    smp = (uint32_t)total;
+  } else {
+    smp = hd[16] | (hd[17] << 8) | ((uint32_t)hd[18] << 16) |
+          ((uint32_t)hd[19] << 24);
+    frame = hd[20] | (hd[21] << 8) | ((uint32_t)hd[22] << 16) |
+            ((uint32_t)hd[23] << 24);
+    expected = BFP_HEADER_SIZE + ((smp / BFP_BLOCK_SAMPLES) * frame);
+  }
+  if (size != expected)
+    return fail(c->name, "file size, expected", expected);
+  if ((expected > st->ck_bytes) || (smp % AUDIO_BLOCK_SAMPLES) ||
+      (smp > (st->pcm_bytes / ((c->channels * c->bits) / 8))))
+    return fail(c->name, "checkpoint beyond the data written", smp);
+  if (smp == 0)
+    return fail(c->name, "no frame covered by the checkpoint", 0);
+  *secs = (double)smp / WAVE_SAMPLING_RATE;
+  return true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runCase(const struct recoverCase*, unsigned int)
+ * ------------------------------------------------
+ * Record a case up to the power loss, boot and check the repair.
+ * IN:	- case (const struct recoverCase*)
+ *			- case number (unsigned int)
+ * OUT:	- success (bool)
+ */
+static bool runCase(const struct recoverCase *c, unsigned int num) {
+  static const char *ext[] = {".wav", ".flac", ".bfp"};
+  struct recoverState st;
+  struct recIndexEntry e;
+  unsigned long entries;
+  SdBaseFile fh;
+  char path[REC_PATH_SIZE];
+  double secs = 0.0;
+  int fds[2], status;
+  pid_t pid;
+  bool ok;
+
+  snprintf(path, sizeof(path), RECOVER_DIR "/rec%u%s", num, ext[c->format]);
+  fflush(stdout);
+  if (pipe(fds))
+    return fail(c->name, "pipe", 0);
+  pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    record(c, path, fds[1]);
+  }
+  close(fds[1]);
+  ok = (pid > 0) && (read(fds[0], &st, sizeof(st)) == (ssize_t)sizeof(st));
+  close(fds[0]);
+  if (pid > 0)
+    waitpid(pid, &status, 0);
+  if (!ok)
+    return fail(c->name, "recording failed", 0);
+
+  // Boot
+  if (!sdSimOpen(image, RECOVER_IMAGE_SIZE, false, SDCARD_CS_PIN))
+    return fail(c->name, "card image", 0);
+  initSDcard();
+  entries = recIndexCount();
+  if (!sd.exists(REC_MARKER_PATH)) {
+    sdSimClose();
+    return fail(c->name, "no " REC_MARKER_PATH " left", 0);
+  }
+  recoverRecording();
+
+  if (sd.exists(REC_MARKER_PATH))
+    ok = fail(c->name, REC_MARKER_PATH " left after the repair", 0);
+  else if (!fh.open(path, O_RDONLY))
+    ok = fail(c->name, "recording lost", 0);
+  else if (c->format == RECFMT_WAV)
+    ok = checkWav(c, &fh, &st, &secs);
+  else
+    ok = checkEncoded(c, &fh, &st, &secs);
+  if (ok && ((recIndexCount() != (entries + 1)) ||
+             (readRecIndex(entries, &e, 1) != 1) || strcmp(e.path, path) ||
+             !(e.flags & REC_INDEX_F_RECOVERED) ||
+             (e.bytes != fh.fileSize()) || (e.format != c->format)))
+    ok = fail(c->name, "no recovered index entry", recIndexCount());
+  printf("%-18s %10lu %10lu %10lu %8.3f %s\n", c->name,
+         (unsigned long)st.end_bytes, (unsigned long)st.ck_bytes,
+         fh.isOpen() ? (unsigned long)fh.fileSize() : 0UL, secs,
+         ok ? "ok" : "FAILED");
+  fh.close();
+  sdSimClose();
+  return ok;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:s:")) != -1) {
+    switch (opt) {
+    case 'i':
+      image = optarg;
+      break;
+    case 's':
+      ck_secs = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-i <image>] [-s <seconds>]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (!sdSimOpen(image, RECOVER_IMAGE_SIZE, true, SDCARD_CS_PIN) ||
+      !sd.begin(SDCARD_CS_PIN) || !sd.mkdir(RECOVER_DIR)) {
+    fprintf(stderr, "%s: unable to prepare the card image\n", image);
+    return 1;
+  }
+  sdSimClose();
+
+  printf("%-18s %10s %10s %10s %8s\n", "case", "written", "checkpoint",
+         "repaired", "playable");
+  for (unsigned int i = 0; i < (sizeof(cases) / sizeof(cases[0])); i++)
+    runCase(&cases[i], i);
+  printf("Repair errors: %u\n", failures);
+  return failures ? 1 : 0;
+}
+/*****************************************************************************/
@@ -0,0 +1,279 @@
+/*
+ * ringTest
+ *
+ * Test of the record ring (AudioShield_Teensy/recordRing.cpp), linked with
+ * the firmware objects of the host simulation. The Makefile builds it
+ * twice: ringTest with the direct store of the 16-bit undecimated blocks
+ * (storeDirect()) and ringTestRef with recordRing.cpp compiled with
+ * REC_RING_DIRECT=0, every block through the generic conversion
+ * (storeBlock()). Both must hand out the same bytes.
+ *
+ * Build: make ringTest ringTestRef
+ * Usage: ringTest [-n <blocks>] [-o <file>]
+ *   -n  audio blocks per case (default 20000)
+ *   -o  file receiving the length and hash of the stream of each case
+ *
+ * Each case selects a capture profile, starts the ring with a prefix and
+ * feeds it blocks of pseudo-random samples, full scale peaks included,
+ * from the audio update, with the second channel block missing now and
+ * then. The sectors are drained as the recorder does (bursts of
+ * REC_RING_BURST_MIN sectors, then the partial sector after end()). The
+ * undecimated streams are checked against the prefix followed by the
+ * interleaved samples (silence for a missing block), 8-bit ones made
+ * unsigned; the decimated ones only through the comparison of the two
+ * builds (make ring). The update() time is the ring's own DWT figures
+ * (host time at the nominal CPU clock here).
+ *
+ * Cases: mono and stereo, decimation by 1, 2 and 4, 8 and 16 bits, with
+ * a WAV header prefix (44 bytes, word aligned), without prefix, and with
+ * a 42-byte prefix (the head sector fill is then never word aligned and
+ * the generic conversion takes over in both builds).
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "recordRing.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Audio memory pool (blocks)
+#define RING_TEST_POOL 8
+// Every RING_TEST_GAP-th block of the second channel is missing
+#define RING_TEST_GAP 7
+
+/*** Types *******************************************************************/
+// Audio source of the test: both channels, as the I2S input
+class RingTestSource : public AudioStream {
+public:
+  RingTestSource(void) : AudioStream(0, NULL) {
+    active = true;
+    seed = 1;
+    cnt = 0;
+  }
+  void restart(void) {
+    seed = 1;
+    cnt = 0;
+  }
+  virtual void update(void);
+  int16_t last[REC_CHANNELS_MAX][AUDIO_BLOCK_SAMPLES]; // last samples sent
+  bool last_right;                                     // second block sent
+
+private:
+  uint32_t seed;
+  unsigned long cnt;
+};
+
+/*** Variables ***************************************************************/
+static unsigned long nb_blocks = 20000;
+static const char *out_path = NULL;
+static unsigned int failures = 0;
+
+static RingTestSource src;
+static AudioRecordRing ring;
+static AudioConnection cord0(src, 0, ring, 0);
+static AudioConnection cord1(src, 1, ring, 1);
+
+static const unsigned int prefixes[] = {44, 0, 42};
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* RingTestSource::update(void)
+ * ----------------------------
+ * Send a block of pseudo-random samples on each channel, with a full
+ * scale peak of each sign; skip the second channel every RING_TEST_GAP
+ * blocks.
+ */
+void RingTestSource::update(void) {
+  audio_block_t *block;
+  unsigned int ch, i;
+
+  cnt++;
+  for (ch = 0; ch < REC_CHANNELS_MAX; ch++) {
+    if ((ch == 1) && !(cnt % RING_TEST_GAP)) {
+      last_right = false;
+      continue;
+    }
+    block = allocate();
+    if (!block)
+      continue;
+    for (i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+      seed = (seed * 1664525UL) + 1013904223UL;
+      block->data[i] = (int16_t)(seed >> 16);
+    }
+    block->data[cnt % AUDIO_BLOCK_SAMPLES] = 32767;
+    block->data[(cnt + 64) % AUDIO_BLOCK_SAMPLES] = -32768;
+    memcpy(last[ch], block->data, sizeof(last[ch]));
+    if (ch == 1)
+      last_right = true;
+    transmit(block, ch);
+    release(block);
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* fail(const char*, const char*, unsigned long)
+ * ---------------------------------------------
+ * Report an error of a case.
+ */
+static bool fail(const char *name, const char *what, unsigned long val) {
+  printf("%s: %s (%lu)\n", name, what, val);
+  failures++;
+  return false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* drain(uint8_t*, unsigned long*, unsigned int)
+ * ---------------------------------------------
+ * Read the full sectors of the ring, as the recorder writes them.
+ * IN:	- stream, appended (uint8_t*)
+ *			- stream length, updated (unsigned long*)
+ *			- sectors to wait for (unsigned int)
+ * OUT:	- none
+ */
+static void drain(uint8_t *stream, unsigned long *len, unsigned int min) {
+  unsigned int cnt;
+  uint8_t *p;
+
+  while (ring.available() && (ring.available() >= min)) {
+    p = ring.readSectors(&cnt);
+    memcpy(&stream[*len], p, cnt * REC_SECTOR_SIZE);
+    *len += cnt * REC_SECTOR_SIZE;
+    ring.freeSectors(cnt);
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runCase(unsigned int, unsigned int, unsigned int, unsigned int, FILE*)
+ * ----------------------------------------------------------------------
+ * Feed a capture profile and check the stream.
+ * IN:	- number of channels (unsigned int)
+ *			- decimation factor (unsigned int)
+ *			- bits per sample (unsigned int)
+ *			- prefix length (unsigned int)
+ *			- file of the stream hashes, NULL if none (FILE*)
+ * OUT:	- success (bool)
+ */
+static bool runCase(unsigned int chans, unsigned int decim, unsigned int bits,
+                    unsigned int pre, FILE *out) {
+  unsigned long len = 0, exp = 0, blk, i;
+  unsigned int ch, plen;
+  uint8_t prefix[REC_SECTOR_SIZE], *stream, *ref, *p;
+  uint32_t hash = 2166136261UL;
+  int16_t x;
+  char name[40];
+  bool ok = true;
+
+  snprintf(name, sizeof(name), "%s /%u %2u-bit +%u",
+           (chans == 1) ? "mono" : "stereo", decim, bits, pre);
+  for (i = 0; i < pre; i++)
+    prefix[i] = (uint8_t)(0xA5 ^ i);
+  stream = (uint8_t *)malloc(pre + (nb_blocks * REC_BLOCK_BYTES_MAX) +
+                             REC_SECTOR_SIZE);
+  ref = (uint8_t *)malloc(pre + (nb_blocks * REC_BLOCK_BYTES_MAX));
+  if (!stream || !ref) {
+    free(stream);
+    free(ref);
+    return fail(name, "out of memory", 0);
+  }
+  memcpy(ref, prefix, pre);
+  exp = pre;
+
+  src.restart();
+  ring.setProfile(chans, decim, bits);
+  ring.begin(pre ? prefix : NULL, pre);
+  for (blk = 0; blk < nb_blocks; blk++) {
+    // Audio interrupt
+    src.update();
+    ring.update();
+    for (i = 0; (decim == 1) && (i < AUDIO_BLOCK_SAMPLES); i++) {
+      for (ch = 0; ch < chans; ch++) {
+        x = ((ch == 0) || src.last_right) ? src.last[ch][i] : 0;
+        if (bits == 8) {
+          ref[exp++] = (uint8_t)((x >> 8) + 128);
+        } else {
+          ref[exp++] = (uint8_t)(x & 0xFF);
+          ref[exp++] = (uint8_t)(x >> 8);
+        }
+      }
+    }
+    // Main loop
+    drain(stream, &len, REC_RING_BURST_MIN);
+  }
+  ring.end();
+  drain(stream, &len, 0);
+  plen = ring.readPartial(&p);
+  memcpy(&stream[len], p, plen);
+  len += plen;
+
+  if (ring.overruns())
+    ok = fail(name, "overruns", ring.overruns());
+  if (ok && (len != (pre + (nb_blocks * ring.blockBytes()))))
+    ok = fail(name, "stream length", len);
+  for (i = 0; ok && (decim == 1) && (i < len); i++) {
+    if (stream[i] != ref[i])
+      ok = fail(name, "stream mismatch at", i);
+  }
+  for (i = 0; i < len; i++)
+    hash = (hash ^ stream[i]) * 16777619UL;
+  if (out)
+    fprintf(out, "%-24s %10lu %08x\n", name, len, hash);
+  printf("%-24s %10lu %08x %8lu %8lu %s\n", name, len, hash,
+         (unsigned long)ring.meanUpdateCycles(),
+         (unsigned long)ring.maxUpdateCycles(), ok ? "ok" : "FAILED");
+  free(stream);
+  free(ref);
+  return ok;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  FILE *out = NULL;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:o:")) != -1) {
+    switch (opt) {
+    case 'n':
+      nb_blocks = strtoul(optarg, NULL, 10);
+      break;
+    case 'o':
+      out_path = optarg;
+      break;
+    default:
+      fprintf(stderr, "usage: %s [-n <blocks>] [-o <file>]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (out_path && ((out = fopen(out_path, "w")) == NULL)) {
+    fprintf(stderr, "%s: unable to create\n", out_path);
+    return 1;
+  }
+  AudioMemory(RING_TEST_POOL);
+
+  printf("REC_RING_DIRECT %d, update() cycles at %llu MHz\n", REC_RING_DIRECT,
+         SIM_CPU_HZ / 1000000ULL);
+  printf("%-24s %10s %8s %8s %8s\n", "case", "bytes", "hash", "mean", "max");
+  for (unsigned int p = 0; p < (sizeof(prefixes) / sizeof(prefixes[0])); p++)
+    for (unsigned int c = 1; c <= REC_CHANNELS_MAX; c++)
+      for (unsigned int d = 1; d <= 4; d *= 2)
+        for (unsigned int b = 16; b >= 8; b -= 8)
+          runCase(c, d, b, prefixes[p], out);
+  if (out)
+    fclose(out);
+  printf("Ring errors: %u\n", failures);
+  return failures ? 1 : 0;
+}
+/*****************************************************************************/
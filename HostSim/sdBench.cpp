@@ -0,0 +1,426 @@
+/*
+ * sdBench
+ *
+ * Benchmark of the SdFat block cache (FatCache in
+ * AudioShield_Teensy/SdFat/FatLib/FatVolume.cpp), of the free cluster map
+ * and of the directory cache on the SD card model of the host simulation:
+ * a card image file behind the SPI bus, with its command and programming
+ * times charged to the virtual clock.
+ *
+ * Build: make sdBench
+ * Usage: sdBench [-i <image>] [-f <files>] [-m <files>] [-k <kbytes>]
+ *                [-b <bytes>]
+ *   -i  scratch card image, formatted for each pass (default bench.img)
+ *   -f  files created in the directory (default 200)
+ *   -m  empty files of the crowded day folder (default 1000, 0 to skip)
+ *   -k  size of the large file in KiB (default 2048)
+ *   -b  size of each read() and write() call (default 100)
+ *
+ * The workloads run on a freshly formatted card for each cache setup:
+ *   1 block  the former single block cache
+ *   lru      FAT_CACHE_BLOCKS blocks, least recently used replacement
+ *   ahead    the same, reading ahead the whole cache on sequential misses
+ *   behind   the same, with full blocks written behind (coalesced)
+ *   config   FAT_CACHE_READ_AHEAD and FAT_CACHE_WRITE_BEHIND of
+ *            SdFatConfig.h
+ *   no map   the same, without the free cluster map (FAT_FREE_MAP_BYTES)
+ *   no dir   config, without the directory cache (FAT_DIR_CACHE_ENTRIES)
+ * The virtual time, the card commands and the blocks transferred are
+ * reported, with the host CPU time, mostly the file system code that the
+ * virtual clock does not charge, and the data read back is checked. The
+ * card counts the block it streams past the end of each multi-block read
+ * as read. Card stalls (SDSIM_STALL_BLOCKS) add 40 ms to some of the
+ * write passes.
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "sdCardSim.h"
+#include "simClock.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+// Size of the scratch card image (sparse)
+#define BENCH_IMAGE_SIZE (1ULL << 30)
+// Largest read() and write() call
+#define BENCH_CHUNK_MAX 4096
+// Passes of the directory scan
+#define BENCH_SCAN_PASSES 3
+// Clusters left free when the card is filled
+#define BENCH_FREE_LEFT 1024
+
+/*** Types *******************************************************************/
+// Cache configuration under test
+struct benchCache {
+  const char *name;
+  uint8_t blocks;
+  uint8_t read_ahead;
+  bool write_behind;
+  bool free_map;
+  bool dir_cache;
+};
+
+// Workload
+struct benchWork {
+  const char *name;
+  bool (*run)(void);
+};
+
+/*** Variables ***************************************************************/
+static const char *image = "bench.img";
+static unsigned int files = 200;
+static unsigned int many = 1000;
+static uint32_t big_bytes = 2048UL * 1024;
+static unsigned int chunk = 100;
+
+static uint8_t buf[BENCH_CHUNK_MAX];
+static uint32_t errors = 0;
+
+static const struct benchCache caches[] = {
+    {"1 block", 1, 1, false, true, true},
+    {"lru", FAT_CACHE_BLOCKS, 1, false, true, true},
+    {"ahead", FAT_CACHE_BLOCKS, FAT_CACHE_BLOCKS, false, true, true},
+    {"behind", FAT_CACHE_BLOCKS, 1, true, true, true},
+    {"config", FAT_CACHE_BLOCKS, FAT_CACHE_READ_AHEAD,
+     FAT_CACHE_WRITE_BEHIND != 0, true, true},
+    {"no map", FAT_CACHE_BLOCKS, FAT_CACHE_READ_AHEAD,
+     FAT_CACHE_WRITE_BEHIND != 0, false, true},
+    {"no dir", FAT_CACHE_BLOCKS, FAT_CACHE_READ_AHEAD,
+     FAT_CACHE_WRITE_BEHIND != 0, true, false},
+};
+static const struct benchCache *cache;
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* pattern(uint32_t, uint32_t)
+ * ---------------------------
+ * Content of the test files: a byte of the file position and file number.
+ */
+static uint8_t pattern(uint32_t file, uint32_t pos) {
+  return (uint8_t)((pos * 7) + (pos >> 9) + file);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* writeFile(const char*, uint32_t, uint32_t)
+ * ------------------------------------------
+ * Create a file and fill it with the test pattern in chunk sized writes.
+ * IN:	- file path (const char*)
+ *			- file number (uint32_t)
+ *			- file size (uint32_t)
+ * OUT:	- success (bool)
+ */
+static bool writeFile(const char *path, uint32_t num, uint32_t size) {
+  FatFile f;
+  uint32_t pos = 0;
+
+  if (!f.open(path, O_RDWR | O_CREAT | O_TRUNC))
+    return false;
+  while (pos < size) {
+    uint32_t n = (size - pos) < chunk ? (size - pos) : chunk;
+    for (uint32_t i = 0; i < n; i++)
+      buf[i] = pattern(num, pos + i);
+    if (f.write(buf, n) != (int)n)
+      return false;
+    pos += n;
+  }
+  return f.close();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* checkFile(const char*, uint32_t, uint32_t)
+ * ------------------------------------------
+ * Read a file back in chunk sized reads, count the wrong bytes.
+ * IN:	- file path (const char*)
+ *			- file number (uint32_t)
+ *			- file size (uint32_t)
+ * OUT:	- success (bool)
+ */
+static bool checkFile(const char *path, uint32_t num, uint32_t size) {
+  FatFile f;
+  uint32_t pos = 0;
+  int n;
+
+  if (!f.open(path, O_RDONLY) || (f.fileSize() != size))
+    return false;
+  while ((n = f.read(buf, chunk)) > 0) {
+    for (int i = 0; i < n; i++) {
+      if (buf[i] != pattern(num, pos + i))
+        errors++;
+    }
+    pos += n;
+  }
+  return (n == 0) && (pos == size) && f.close();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Workloads
+ * ---------
+ * createFiles: small files in a day folder, as the recorder metadata
+ * scanDir:     openNext() listing of that folder
+ * recordFiles: a tenth of the small files as recordings, with the path
+ *              checks of createSDpath() and the WAV, metadata and
+ *              spectrum files
+ * manyFiles:   empty files with recorder names in a second day folder,
+ *              each checked absent first, for the directory creation cost
+ * reopenFiles: each of them opened again by path
+ * writeBig:    large file in small writes
+ * readBig:     the same file read back in small reads
+ * fillCard:    contiguous file leaving BENCH_FREE_LEFT clusters free
+ * remount:     mount of the nearly full card
+ * allocFiles:  a tenth of the small files again, past the full part
+ * freeCount:   free cluster count (full FAT scan without the map)
+ */
+static bool createFiles(void) {
+  char path[32];
+
+  if (!sd.mkdir("/210601"))
+    return false;
+  for (unsigned int i = 0; i < files; i++) {
+    snprintf(path, sizeof(path), "/210601/%06u.txt", i);
+    if (!writeFile(path, i, 900))
+      return false;
+  }
+  return true;
+}
+
+static bool scanDir(void) {
+  FatFile dir, f;
+  unsigned int n = 0;
+
+  for (unsigned int p = 0; p < BENCH_SCAN_PASSES; p++) {
+    if (!dir.open("/210601", O_RDONLY))
+      return false;
+    while (f.openNext(&dir, O_RDONLY)) {
+      n++;
+      f.close();
+    }
+    dir.close();
+  }
+  return n == (files * BENCH_SCAN_PASSES);
+}
+
+static bool recordFiles(void) {
+  char path[32];
+
+  for (unsigned int i = 0; i < files / 10; i++) {
+    snprintf(path, sizeof(path), "/210601/R%05u.wav", i);
+    if (!sd.exists("210601") || sd.exists(path) ||
+        !writeFile(path, i, 4096))
+      return false;
+    snprintf(path, sizeof(path), "/210601/R%05u.txt", i);
+    if (!writeFile(path, i, 900))
+      return false;
+    snprintf(path, sizeof(path), "/210601/R%05u.spc", i);
+    if (!writeFile(path, i, 512))
+      return false;
+  }
+  return true;
+}
+
+static bool manyFiles(void) {
+  char path[32];
+
+  if (!sd.mkdir("/210602"))
+    return false;
+  for (unsigned int i = 0; i < many; i++) {
+    snprintf(path, sizeof(path), "/210602/%06u.wav", i);
+    if (sd.exists(path) || !writeFile(path, i, 0))
+      return false;
+  }
+  return true;
+}
+
+static bool reopenFiles(void) {
+  char path[32];
+
+  for (unsigned int i = 0; i < many; i++) {
+    snprintf(path, sizeof(path), "/210602/%06u.wav", i);
+    if (!checkFile(path, i, 0))
+      return false;
+  }
+  return true;
+}
+
+static bool writeBig(void) {
+  return writeFile("/BIG.BIN", 1, big_bytes);
+}
+
+static bool readBig(void) {
+  return checkFile("/BIG.BIN", 1, big_bytes);
+}
+
+static bool fillCard(void) {
+  int32_t n = sd.freeClusterCount() - BENCH_FREE_LEFT;
+  uint8_t shift = sd.vol()->clusterSizeShift() + 9;
+  FatFile f;
+
+  if ((n <= 0) || !f.createContiguous("/FILL.BIN", (uint32_t)n << shift))
+    return false;
+  return f.close();
+}
+
+static bool remount(void) {
+  if (!sd.begin(SDCARD_CS_PIN))
+    return false;
+  sd.vol()->dirCacheSetup(cache->dir_cache);
+  return sd.cacheSetup(cache->blocks, cache->read_ahead, cache->write_behind);
+}
+
+static bool allocFiles(void) {
+  char path[32];
+
+  for (unsigned int i = 0; i < files / 10; i++) {
+    snprintf(path, sizeof(path), "/210601/A%05u.txt", i);
+    if (!writeFile(path, i, 900))
+      return false;
+  }
+  return true;
+}
+
+static bool freeCount(void) {
+  return sd.freeClusterCount() > 0;
+}
+
+static const struct benchWork works[] = {
+    {"create", createFiles}, {"scan", scanDir},       {"record", recordFiles},
+    {"many", manyFiles},     {"reopen", reopenFiles}, {"write", writeBig},
+    {"read", readBig},       {"fill", fillCard},      {"mount", remount},
+    {"alloc", allocFiles},   {"free", freeCount},
+};
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* runPass(const struct benchCache*)
+ * ---------------------------------
+ * Format the card, mount it with the given cache and free cluster map
+ * configuration and run the workloads in turn, printing one line each.
+ * IN:	- cache configuration (const struct benchCache*)
+ * OUT:	- success (bool)
+ */
+static bool runPass(const struct benchCache *c) {
+  struct sdSimStats s0, s1;
+  uint64_t t0;
+  clock_t c0;
+  char path[32];
+
+  sdSimClose();
+  if (!sdSimOpen(image, BENCH_IMAGE_SIZE, true, SDCARD_CS_PIN) ||
+      !sd.begin(SDCARD_CS_PIN)) {
+    fprintf(stderr, "%s: unable to mount the card image\n", image);
+    return false;
+  }
+  cache = c;
+  sd.vol()->dirCacheSetup(c->dir_cache);
+  if (!sd.vol()->freeMapSetup(c->free_map) ||
+      !sd.cacheSetup(c->blocks, c->read_ahead, c->write_behind)) {
+    fprintf(stderr, "cache setup failed\n");
+    return false;
+  }
+  for (unsigned int w = 0; w < sizeof(works) / sizeof(works[0]); w++) {
+    if ((many == 0) && ((works[w].run == manyFiles) ||
+                        (works[w].run == reopenFiles)))
+      continue;
+    sdSimGetStats(&s0);
+    t0 = sim_ns;
+    c0 = clock();
+    if (!works[w].run()) {
+      fprintf(stderr, "%s: %s failed\n", c->name, works[w].name);
+      return false;
+    }
+    sdSimGetStats(&s1);
+    printf("%-8s %-7s %10.1f %8.1f %9llu %9llu %9llu\n", c->name,
+           works[w].name, (double)(sim_ns - t0) / 1e6,
+           (double)(clock() - c0) * 1e3 / CLOCKS_PER_SEC,
+           (unsigned long long)(s1.commands - s0.commands),
+           (unsigned long long)(s1.blocks_read - s0.blocks_read),
+           (unsigned long long)(s1.blocks_written - s0.blocks_written));
+  }
+  // Everything written must read back, whatever the cache
+  for (unsigned int i = 0; i < files; i++) {
+    snprintf(path, sizeof(path), "/210601/%06u.txt", i);
+    if (!checkFile(path, i, 900)) {
+      fprintf(stderr, "%s: %s unreadable\n", c->name, path);
+      return false;
+    }
+  }
+  for (unsigned int i = 0; i < files / 10; i++) {
+    snprintf(path, sizeof(path), "/210601/A%05u.txt", i);
+    if (!checkFile(path, i, 900)) {
+      fprintf(stderr, "%s: %s unreadable\n", c->name, path);
+      return false;
+    }
+    snprintf(path, sizeof(path), "/210601/R%05u.wav", i);
+    if (!checkFile(path, i, 4096)) {
+      fprintf(stderr, "%s: %s unreadable\n", c->name, path);
+      return false;
+    }
+  }
+  return true;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int main(int argc, char **argv) {
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:f:m:k:b:")) != -1) {
+    switch (opt) {
+    case 'i':
+      image = optarg;
+      break;
+    case 'f':
+      files = atoi(optarg);
+      break;
+    case 'm':
+      many = atoi(optarg);
+      break;
+    case 'k':
+      big_bytes = atol(optarg) * 1024UL;
+      break;
+    case 'b':
+      chunk = atoi(optarg);
+      if ((chunk < 1) || (chunk > BENCH_CHUNK_MAX)) {
+        fprintf(stderr, "-b: 1 to %d bytes\n", BENCH_CHUNK_MAX);
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-i image] [-f files] [-m files] "
+                      "[-k kbytes] [-b bytes]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  sim_end_ns = UINT64_MAX;
+  printf("Cache: %d blocks, read-ahead %d, write-behind %d; "
+         "%u and %u files, %lu KiB in %u byte calls\n",
+         FAT_CACHE_BLOCKS, FAT_CACHE_READ_AHEAD, FAT_CACHE_WRITE_BEHIND,
+         files, many, (unsigned long)(big_bytes / 1024), chunk);
+  printf("%-8s %-7s %10s %8s %9s %9s %9s\n", "config", "work", "ms",
+         "cpu ms", "commands", "read", "written");
+  for (unsigned int c = 0; c < sizeof(caches) / sizeof(caches[0]); c++) {
+    if (!runPass(&caches[c])) {
+      sdSimClose();
+      return 1;
+    }
+  }
+  sdSimClose();
+  printf("Data errors: %lu\n", (unsigned long)errors);
+  return errors ? 1 : 0;
+}
+/*****************************************************************************/
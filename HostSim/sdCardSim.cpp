@@ -0,0 +1,602 @@
+/*
+ * SD card model
+ *
+ * SDHC card in SPI mode, on the SPI bus (SPI.h stand-in) with its chip
+ * select on the given pin. The unmodified SdFat library talks to it byte
+ * by byte: commands, R1/R2/R3/R7 responses, data tokens, data responses
+ * and busy signalling, with a simple timing model (read latency, block
+ * programming time, periodic housekeeping stalls). The card content is
+ * an image file mapped in memory, formatted as FAT32 when created.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Arduino.h"
+#include "SPI.h"
+#include "sdCardSim.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+#define SECTOR_SIZE 512
+// Tokens and responses
+#define TOKEN_START_BLOCK 0xFE
+#define TOKEN_START_MULTI 0xFC
+#define TOKEN_STOP_MULTI 0xFD
+#define DATA_ACCEPTED 0x05
+#define R1_READY 0x00
+#define R1_IDLE 0x01
+#define R1_ILLEGAL 0x04
+#define R1_ADDRESS 0x20
+// OCR: powered up, card capacity status (SDHC), 2.7-3.6 V
+#define OCR_SDHC 0xC0FF8000UL
+// FAT32 layout
+#define FAT_RESERVED 32
+#define FAT_COPIES 2
+#define FAT_FSINFO 1
+#define FAT_BACKUP_BOOT 6
+#define FAT_ROOT_CLUSTER 2
+
+/*** Types *******************************************************************/
+// Card state, as seen on the bus
+enum sdState {
+  SD_IDLE,        // waiting for a command
+  SD_CMD,         // receiving a command
+  SD_WR_TOKEN,    // single block write, waiting for the data token
+  SD_WR_DATA,     // receiving the data block
+  SD_WR_MULTI,    // multi-block write, waiting for a token
+  SD_WR_MULTI_DATA
+};
+
+/*** Variables ***************************************************************/
+static int img_fd = -1;
+static uint8_t *img = NULL;
+static uint64_t img_size = 0;
+static uint32_t img_blocks = 0;
+
+static enum sdState state = SD_IDLE;
+static bool selected = false;
+static bool idle = true;
+static bool app_cmd = false;
+static unsigned int acmd41_cnt = 0;
+static uint8_t cmd[6];
+static unsigned int cmd_len = 0;
+// Output queue (responses, data blocks)
+static uint8_t out[SECTOR_SIZE + 8];
+static unsigned int out_len = 0;
+static unsigned int out_pos = 0;
+// Pending read: block loaded into the queue once ready
+static bool rd_pending = false;
+static bool rd_multi = false;
+static uint32_t rd_block = 0;
+static uint64_t rd_ready_ns = 0;
+// Write in progress
+static uint32_t wr_block = 0;
+static uint8_t wr_buf[SECTOR_SIZE + 2];
+static unsigned int wr_len = 0;
+static uint64_t busy_until_ns = 0;
+// Erase range
+static uint32_t erase_start = 0;
+static uint32_t erase_end = 0;
+
+static struct sdSimTiming timing = {
+    SDSIM_READ_NS,    SDSIM_WRITE_NS,     SDSIM_WRITE_MULTI_NS,
+    SDSIM_STOP_NS,    SDSIM_STALL_BLOCKS, SDSIM_STALL_NS};
+static struct sdSimStats stats;
+
+/*** Function prototypes *****************************************************/
+static uint8_t sdTransfer(uint8_t in, void *arg);
+static void sdChipSelect(uint8_t pin, uint8_t val);
+
+/*** Macros ******************************************************************/
+#define PUT16(p, v)                                                           \
+  do {                                                                        \
+    (p)[0] = (uint8_t)(v);                                                    \
+    (p)[1] = (uint8_t)((v) >> 8);                                             \
+  } while (0)
+#define PUT32(p, v)                                                           \
+  do {                                                                        \
+    PUT16((p), (v));                                                          \
+    PUT16((p) + 2, (v) >> 16);                                                \
+  } while (0)
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* queue(const uint8_t*, unsigned int) / queueByte(uint8_t)
+ * --------------------------------------------------------
+ * Replace or extend the bytes sent to the host.
+ */
+static void queueReset(void) {
+  out_len = 0;
+  out_pos = 0;
+}
+
+static void queueByte(uint8_t b) {
+  if (out_len < sizeof(out))
+    out[out_len++] = b;
+}
+
+static void queue(const uint8_t *buf, unsigned int len) {
+  while (len--)
+    queueByte(*buf++);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* loadBlock(void)
+ * ---------------
+ * Queue the pending read block: data token, data and CRC.
+ * IN:	- none
+ * OUT:	- none
+ */
+static void loadBlock(void) {
+  queueReset();
+  queueByte(TOKEN_START_BLOCK);
+  queue(&img[(uint64_t)rd_block * SECTOR_SIZE], SECTOR_SIZE);
+  queueByte(0xFF);
+  queueByte(0xFF);
+  stats.blocks_read++;
+  if (rd_multi) {
+    rd_block++;
+    rd_ready_ns = sim_ns + timing.read_ns / 4;
+    rd_pending = (rd_block < img_blocks);
+  } else {
+    rd_pending = false;
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* programBlock(bool)
+ * ------------------
+ * Store the received block and start the busy time of its programming.
+ * IN:	- block of a multi-block write (bool)
+ * OUT:	- none
+ */
+static void programBlock(bool multi) {
+  uint64_t t = multi ? timing.write_multi_ns : timing.write_ns;
+
+  if (wr_block < img_blocks)
+    memcpy(&img[(uint64_t)wr_block * SECTOR_SIZE], wr_buf, SECTOR_SIZE);
+  stats.blocks_written++;
+  if (timing.stall_blocks && !(stats.blocks_written % timing.stall_blocks)) {
+    t += timing.stall_ns;
+    stats.stalls++;
+  }
+  wr_block++;
+  queueReset();
+  queueByte(DATA_ACCEPTED);
+  busy_until_ns = sim_ns + t;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* registerCsd(uint8_t*) / registerCid(uint8_t*)
+ * ---------------------------------------------
+ * Card registers: CSD version 2.0 (C_SIZE from the image size) and a
+ * card identification.
+ */
+static void registerCsd(uint8_t *csd) {
+  uint32_t c_size = (img_blocks >> 10) - 1;
+
+  memset(csd, 0, 16);
+  csd[0] = 0x40;                              // CSD_STRUCTURE 1
+  csd[1] = 0x0E;                              // TAAC
+  csd[3] = 0x5A;                              // TRAN_SPEED 50 MHz
+  csd[4] = 0x5B;                              // CCC
+  csd[5] = 0x59;                              // CCC, READ_BL_LEN 9
+  csd[7] = (c_size >> 16) & 0x3F;             // C_SIZE
+  csd[8] = (c_size >> 8) & 0xFF;
+  csd[9] = c_size & 0xFF;
+  csd[10] = 0x7F;                             // ERASE_BLK_EN, SECTOR_SIZE
+  csd[11] = 0x80;
+  csd[12] = 0x0A;                             // R2W_FACTOR, WRITE_BL_LEN
+  csd[13] = 0x40;
+  csd[15] = 0x01;
+}
+
+static void registerCid(uint8_t *cid) {
+  static const uint8_t id[16] = {0x03, 'S', 'D', 'S', 'I', 'M', 'S', 'D',
+                                 0x10, 0x12, 0x34, 0x56, 0x78, 0x01, 0x4A,
+                                 0x01};
+  memcpy(cid, id, 16);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* eraseBlocks(uint32_t, uint32_t)
+ * -------------------------------
+ * Erased blocks read as zeros: the pages are given back to the file
+ * system of the host.
+ */
+static void eraseBlocks(uint32_t first, uint32_t last) {
+  uint64_t from, len;
+
+  if ((first > last) || (last >= img_blocks))
+    return;
+  from = (uint64_t)first * SECTOR_SIZE;
+  len = ((uint64_t)(last - first) + 1) * SECTOR_SIZE;
+  memset(&img[from], 0, len);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* execute(void)
+ * -------------
+ * Run a received command and queue its response, after one fill byte.
+ * IN:	- none
+ * OUT:	- none
+ */
+static void execute(void) {
+  uint8_t index = cmd[0] & 0x3F;
+  uint32_t arg = ((uint32_t)cmd[1] << 24) | ((uint32_t)cmd[2] << 16) |
+                 ((uint32_t)cmd[3] << 8) | cmd[4];
+  uint8_t r1 = idle ? R1_IDLE : R1_READY;
+  uint8_t reg[16];
+  bool acmd = app_cmd;
+
+  stats.commands++;
+  app_cmd = false;
+  state = SD_IDLE;
+  queueReset();
+  queueByte(0xFF);
+  if (acmd) {
+    switch (index) {
+    case 41: // SD_SEND_OP_COND
+      if (++acmd41_cnt >= 2)
+        idle = false;
+      queueByte(idle ? R1_IDLE : R1_READY);
+      return;
+    case 13: // SD_STATUS
+      queueByte(r1);
+      queueByte(0x00);
+      return;
+    case 23: // SET_WR_BLK_ERASE_COUNT
+      queueByte(r1);
+      return;
+    default:
+      break;
+    }
+  }
+  switch (index) {
+  case 0: // GO_IDLE_STATE
+    idle = true;
+    acmd41_cnt = 0;
+    rd_pending = false;
+    queueByte(R1_IDLE);
+    break;
+  case 8: // SEND_IF_COND
+    queueByte(r1);
+    queueByte(0x00);
+    queueByte(0x00);
+    queueByte(0x01);
+    queueByte(arg & 0xFF);
+    break;
+  case 9: // SEND_CSD
+  case 10: // SEND_CID
+    queueByte(r1);
+    queueByte(0xFF);
+    queueByte(TOKEN_START_BLOCK);
+    if (index == 9)
+      registerCsd(reg);
+    else
+      registerCid(reg);
+    queue(reg, 16);
+    queueByte(0xFF);
+    queueByte(0xFF);
+    break;
+  case 12: // STOP_TRANSMISSION
+    rd_pending = false;
+    queueByte(r1);
+    break;
+  case 13: // SEND_STATUS
+    queueByte(r1);
+    queueByte(0x00);
+    break;
+  case 17: // READ_SINGLE_BLOCK
+  case 18: // READ_MULTIPLE_BLOCK
+    if (arg >= img_blocks) {
+      queueByte(r1 | R1_ADDRESS);
+      break;
+    }
+    queueByte(r1);
+    rd_block = arg;
+    rd_multi = (index == 18);
+    rd_pending = true;
+    rd_ready_ns = sim_ns + timing.read_ns;
+    break;
+  case 24: // WRITE_BLOCK
+  case 25: // WRITE_MULTIPLE_BLOCK
+    if (arg >= img_blocks) {
+      queueByte(r1 | R1_ADDRESS);
+      break;
+    }
+    queueByte(r1);
+    wr_block = arg;
+    state = (index == 24) ? SD_WR_TOKEN : SD_WR_MULTI;
+    break;
+  case 32: // ERASE_WR_BLK_START
+    erase_start = arg;
+    queueByte(r1);
+    break;
+  case 33: // ERASE_WR_BLK_END
+    erase_end = arg;
+    queueByte(r1);
+    break;
+  case 38: // ERASE
+    eraseBlocks(erase_start, erase_end);
+    queueByte(r1);
+    busy_until_ns = sim_ns + timing.stop_ns;
+    break;
+  case 55: // APP_CMD
+    app_cmd = true;
+    queueByte(r1);
+    break;
+  case 58: // READ_OCR
+    queueByte(r1);
+    queueByte((OCR_SDHC >> 24) & 0xFF);
+    queueByte((OCR_SDHC >> 16) & 0xFF);
+    queueByte((OCR_SDHC >> 8) & 0xFF);
+    queueByte(OCR_SDHC & 0xFF);
+    break;
+  case 59: // CRC_ON_OFF
+    queueByte(r1);
+    break;
+  default:
+    queueByte(r1 | R1_ILLEGAL);
+    break;
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* sdTransfer(uint8_t, void*)
+ * --------------------------
+ * One byte on the SPI bus: the byte sent to the host is chosen first
+ * (queue, busy, pending read), then the received byte is handled.
+ * IN:	- byte from the host (uint8_t)
+ *			- unused (void*)
+ * OUT:	- byte to the host (uint8_t)
+ */
+static uint8_t sdTransfer(uint8_t in, void *arg) {
+  uint8_t o = 0xFF;
+
+  (void)arg;
+  if (!selected || !img)
+    return 0xFF;
+
+  // Output
+  if (out_pos < out_len) {
+    o = out[out_pos++];
+  } else if (sim_ns < busy_until_ns) {
+    o = 0x00;
+  } else if (rd_pending && (sim_ns >= rd_ready_ns)) {
+    loadBlock();
+    o = out[out_pos++];
+  }
+
+  // Input
+  switch (state) {
+  case SD_IDLE:
+    if ((in & 0xC0) == 0x40) {
+      cmd[0] = in;
+      cmd_len = 1;
+      state = SD_CMD;
+    }
+    break;
+  case SD_CMD:
+    cmd[cmd_len++] = in;
+    if (cmd_len == 6)
+      execute();
+    break;
+  case SD_WR_TOKEN:
+    if (in == TOKEN_START_BLOCK) {
+      wr_len = 0;
+      state = SD_WR_DATA;
+    } else if ((in & 0xC0) == 0x40) {
+      cmd[0] = in;
+      cmd_len = 1;
+      state = SD_CMD;
+    }
+    break;
+  case SD_WR_MULTI:
+    if (in == TOKEN_START_MULTI) {
+      wr_len = 0;
+      state = SD_WR_MULTI_DATA;
+    } else if (in == TOKEN_STOP_MULTI) {
+      queueReset();
+      queueByte(0xFF);
+      busy_until_ns = sim_ns + timing.stop_ns;
+      state = SD_IDLE;
+    } else if ((in & 0xC0) == 0x40) {
+      cmd[0] = in;
+      cmd_len = 1;
+      state = SD_CMD;
+    }
+    break;
+  case SD_WR_DATA:
+  case SD_WR_MULTI_DATA:
+    wr_buf[wr_len++] = in;
+    if (wr_len == sizeof(wr_buf)) {
+      programBlock(state == SD_WR_MULTI_DATA);
+      state = (state == SD_WR_MULTI_DATA) ? SD_WR_MULTI : SD_IDLE;
+    }
+    break;
+  }
+  return o;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+static void sdChipSelect(uint8_t pin, uint8_t val) {
+  (void)pin;
+  selected = (val == LOW);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* formatFat32(void)
+ * -----------------
+ * Partition and format the image as an SD card is shipped: one FAT32
+ * partition starting at SDSIM_PART_START, 32 KiB clusters from 4 GiB on.
+ * The data region is left as it is (zeros of a new sparse file).
+ * IN:	- none
+ * OUT:	- success (bool)
+ */
+static bool formatFat32(void) {
+  uint32_t part_size, spc, fat_size, clusters, tmp1, tmp2;
+  uint8_t *mbr, *boot, *info, *fat;
+  unsigned int i;
+
+  if (img_blocks <= SDSIM_PART_START)
+    return false;
+  part_size = img_blocks - SDSIM_PART_START;
+  spc = (img_size >= (4ULL << 30)) ? 64 : 8;
+  tmp1 = part_size - FAT_RESERVED;
+  tmp2 = ((256 * spc) + FAT_COPIES) / 2;
+  fat_size = (tmp1 + (tmp2 - 1)) / tmp2;
+  clusters = (part_size - FAT_RESERVED - (FAT_COPIES * fat_size)) / spc;
+  if (clusters < 65525)
+    return false;
+
+  // Master boot record
+  mbr = img;
+  memset(mbr, 0, SECTOR_SIZE);
+  mbr[446 + 1] = 0xFE; // CHS start/end (LBA only)
+  mbr[446 + 2] = 0xFF;
+  mbr[446 + 3] = 0xFF;
+  mbr[446 + 4] = 0x0C; // FAT32 LBA
+  mbr[446 + 5] = 0xFE;
+  mbr[446 + 6] = 0xFF;
+  mbr[446 + 7] = 0xFF;
+  PUT32(&mbr[446 + 8], SDSIM_PART_START);
+  PUT32(&mbr[446 + 12], part_size);
+  mbr[510] = 0x55;
+  mbr[511] = 0xAA;
+
+  // Volume boot record
+  boot = &img[(uint64_t)SDSIM_PART_START * SECTOR_SIZE];
+  memset(boot, 0, SECTOR_SIZE);
+  boot[0] = 0xEB;
+  boot[1] = 0x58;
+  boot[2] = 0x90;
+  memcpy(&boot[3], "SIMSD1.0", 8);
+  PUT16(&boot[11], SECTOR_SIZE);
+  boot[13] = spc;
+  PUT16(&boot[14], FAT_RESERVED);
+  boot[16] = FAT_COPIES;
+  boot[21] = 0xF8;
+  PUT16(&boot[24], 63);
+  PUT16(&boot[26], 255);
+  PUT32(&boot[28], SDSIM_PART_START);
+  PUT32(&boot[32], part_size);
+  PUT32(&boot[36], fat_size);
+  PUT32(&boot[44], FAT_ROOT_CLUSTER);
+  PUT16(&boot[48], FAT_FSINFO);
+  PUT16(&boot[50], FAT_BACKUP_BOOT);
+  boot[64] = 0x80;
+  boot[66] = 0x29;
+  PUT32(&boot[67], 0x53534F4CUL);
+  memcpy(&boot[71], "SOUNDSOIL  ", 11);
+  memcpy(&boot[82], "FAT32   ", 8);
+  boot[510] = 0x55;
+  boot[511] = 0xAA;
+
+  // File system information
+  info = boot + (FAT_FSINFO * SECTOR_SIZE);
+  memset(info, 0, SECTOR_SIZE);
+  PUT32(&info[0], 0x41615252UL);
+  PUT32(&info[484], 0x61417272UL);
+  PUT32(&info[488], clusters - 1);
+  PUT32(&info[492], FAT_ROOT_CLUSTER + 1);
+  PUT32(&info[508], 0xAA550000UL);
+  memcpy(boot + (FAT_BACKUP_BOOT * SECTOR_SIZE), boot, 2 * SECTOR_SIZE);
+
+  // FATs: media, reserved entry, root directory (one cluster)
+  for (i = 0; i < FAT_COPIES; i++) {
+    fat = boot + ((FAT_RESERVED + (i * fat_size)) * (uint64_t)SECTOR_SIZE);
+    memset(fat, 0, (uint64_t)fat_size * SECTOR_SIZE);
+    PUT32(&fat[0], 0x0FFFFFF8UL);
+    PUT32(&fat[4], 0x0FFFFFFFUL);
+    PUT32(&fat[8], 0x0FFFFFFFUL);
+  }
+  // Root directory cluster
+  memset(boot + ((FAT_RESERVED + (FAT_COPIES * fat_size)) *
+                 (uint64_t)SECTOR_SIZE),
+         0, (uint64_t)spc * SECTOR_SIZE);
+  return true;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* sdSimOpen(const char*, uint64_t, bool, uint8_t)
+ * -----------------------------------------------
+ * Insert the card: map its image file, created (sparse) and formatted
+ * if it does not exist or if asked to, and attach the card to the SPI
+ * bus and its chip select pin.
+ * IN:	- image file path (const char*)
+ *			- size of a new image (bytes, multiple of 512 KiB)
+ *			- format the image (bool)
+ *			- chip select pin (uint8_t)
+ * OUT:	- success (bool)
+ */
+bool sdSimOpen(const char *path, uint64_t size, bool format, uint8_t cs_pin) {
+  struct stat st;
+  bool created = false;
+
+  img_fd = open(path, O_RDWR | O_CREAT, 0644);
+  if ((img_fd < 0) || fstat(img_fd, &st))
+    return false;
+  if (st.st_size == 0) {
+    if (ftruncate(img_fd, (off_t)size))
+      return false;
+    created = true;
+  } else {
+    size = st.st_size;
+  }
+  img_size = size & ~((512ULL << 10) - 1);
+  img_blocks = img_size / SECTOR_SIZE;
+  img = (uint8_t *)mmap(NULL, img_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                        img_fd, 0);
+  if (img == MAP_FAILED) {
+    img = NULL;
+    return false;
+  }
+  if ((created || format) && !formatFat32()) {
+    fprintf(stderr, "sdcard: image too small for FAT32\n");
+    return false;
+  }
+  SPI.simAttach(sdTransfer, NULL);
+  simPinHook(cs_pin, sdChipSelect);
+  return true;
+}
+
+void sdSimClose(void) {
+  if (img) {
+    munmap(img, img_size);
+    img = NULL;
+  }
+  if (img_fd >= 0) {
+    close(img_fd);
+    img_fd = -1;
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void sdSimSetTiming(const struct sdSimTiming *tm) { timing = *tm; }
+
+void sdSimGetStats(struct sdSimStats *st) { *st = stats; }
+/*****************************************************************************/
@@ -0,0 +1,57 @@
+/*
+ * sdCardSim.h
+ */
+#ifndef _SDCARDSIM_H_
+#define _SDCARDSIM_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdint.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Default card image size (8 GiB, sparse)
+#define SDSIM_SIZE_DEF (8ULL << 30)
+// First sector of the FAT32 partition (4 MiB, one allocation unit)
+#define SDSIM_PART_START 8192
+// Time from a read command to the data token (ns)
+#define SDSIM_READ_NS 200000ULL
+// Programming time of a single block write (ns)
+#define SDSIM_WRITE_NS 250000ULL
+// Programming time of a block in a multi-block write (ns)
+#define SDSIM_WRITE_MULTI_NS 60000ULL
+// Busy time after the stop token of a multi-block write (ns)
+#define SDSIM_STOP_NS 1000000ULL
+// Internal housekeeping: every SDSIM_STALL_BLOCKS written blocks, the
+// card stays busy for SDSIM_STALL_NS
+#define SDSIM_STALL_BLOCKS 8192
+#define SDSIM_STALL_NS 40000000ULL
+
+/*** Types *******************************************************************/
+// Card timing model (ns)
+struct sdSimTiming {
+  uint64_t read_ns;
+  uint64_t write_ns;
+  uint64_t write_multi_ns;
+  uint64_t stop_ns;
+  uint32_t stall_blocks;
+  uint64_t stall_ns;
+};
+
+// Card activity counters
+struct sdSimStats {
+  uint64_t blocks_read;
+  uint64_t blocks_written;
+  uint64_t commands;
+  uint64_t stalls;
+};
+
+/*** Functions ***************************************************************/
+bool sdSimOpen(const char *path, uint64_t size, bool format, uint8_t cs_pin);
+void sdSimClose(void);
+void sdSimSetTiming(const struct sdSimTiming *tm);
+void sdSimGetStats(struct sdSimStats *st);
+
+#endif /* _SDCARDSIM_H_ */
@@ -0,0 +1,397 @@
+/*
+ * Virtual clock
+ *
+ * Time base of the host simulation. The firmware never sees the host
+ * clock: millis(), micros(), the RTC and the timers all derive from a
+ * virtual time which only advances when the firmware waits (delays,
+ * busy-waits, SPI transfers, hibernation). The periodic interrupts
+ * (audio, interval timers) and the scheduled events (buttons, UART
+ * bytes) are dispatched at their virtual time while it advances.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <time.h>
+
+#include <map>
+
+#include "simClock.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+/*** Types *******************************************************************/
+// Periodic interrupt source
+struct simIrqSrc {
+  simIrq_t fn;
+  void *arg;
+  uint64_t period;
+  uint64_t next;
+};
+
+// One-shot event
+struct simEvent {
+  simIrq_t fn;
+  void *arg;
+};
+
+/*** Variables ***************************************************************/
+uint64_t sim_ns = 0;
+uint64_t sim_sleep_ns = 0;
+uint64_t sim_end_ns = UINT64_MAX;
+uint64_t sim_call_ns = SIM_CALL_NS;
+bool sim_warp = false;
+
+static struct simIrqSrc irqs[SIM_IRQ_MAX];
+// (constructed on first use: peripherals may schedule from static objects)
+static std::multimap<uint64_t, struct simEvent> &eventQueue(void) {
+  static std::multimap<uint64_t, struct simEvent> q;
+  return q;
+}
+// Earliest time at which something may be due, 0 when to be recomputed
+static uint64_t due_cache = 0;
+static unsigned int irq_mask = 0;
+static bool in_irq = false;
+static void (*idle_hook)(void) = NULL;
+static void (*loop_hook)(void) = NULL;
+
+/*** Function prototypes *****************************************************/
+/*** Macros ******************************************************************/
+/*** Constant objects ********************************************************/
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* nextDue(bool)
+ * -------------
+ * Time of the next interrupt or event. Periodic interrupts are left out
+ * while masked or when asked to (hibernation).
+ * IN:	- include the periodic interrupts (bool)
+ * OUT:	- virtual time (uint64_t), UINT64_MAX if none
+ */
+static uint64_t nextDue(bool periodic) {
+  uint64_t t = UINT64_MAX;
+  unsigned int i;
+
+  if (!eventQueue().empty())
+    t = eventQueue().begin()->first;
+  if (periodic && !irq_mask) {
+    for (i = 0; i < SIM_IRQ_MAX; i++) {
+      if (irqs[i].fn && (irqs[i].next < t))
+        t = irqs[i].next;
+    }
+  }
+  return t;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* dispatch(bool)
+ * --------------
+ * Run the interrupts and events due at the current virtual time. A
+ * periodic interrupt late by more than one period only runs once, as a
+ * pended interrupt does.
+ * IN:	- include the periodic interrupts (bool)
+ * OUT:	- none
+ */
+static void dispatch(bool periodic) {
+  unsigned int i;
+
+  if (in_irq)
+    return;
+  in_irq = true;
+  while (!eventQueue().empty() && (eventQueue().begin()->first <= sim_ns)) {
+    struct simEvent ev = eventQueue().begin()->second;
+    eventQueue().erase(eventQueue().begin());
+    ev.fn(ev.arg);
+  }
+  if (periodic && !irq_mask) {
+    for (i = 0; i < SIM_IRQ_MAX; i++) {
+      if (irqs[i].fn && (irqs[i].next <= sim_ns)) {
+        while (irqs[i].next <= sim_ns)
+          irqs[i].next += irqs[i].period;
+        irqs[i].fn(irqs[i].arg);
+      }
+    }
+  }
+  in_irq = false;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* checkEnd(void)
+ * --------------
+ * End the simulation once the virtual time limit is reached.
+ * IN:	- none
+ * OUT:	- none
+ */
+static void checkEnd(void) {
+  if ((sim_ns >= sim_end_ns) && !in_irq) {
+    struct SimEnd end = {"time limit reached"};
+    throw end;
+  }
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* simAdvance(uint64_t)
+ * --------------------
+ * Let the virtual time run, as the CPU does while executing, and
+ * dispatch the interrupts and events falling in that time.
+ * IN:	- duration (ns)
+ * OUT:	- none
+ */
+void simAdvance(uint64_t ns) {
+  uint64_t target = sim_ns + ns;
+  uint64_t t;
+
+  // Fast path of the SPI bytes and millis() calls: nothing due meanwhile
+  if ((target < due_cache) && (target < sim_end_ns)) {
+    sim_ns = target;
+    return;
+  }
+  if (!in_irq) {
+    while ((t = nextDue(true)) <= target) {
+      if (t > sim_ns)
+        sim_ns = t;
+      dispatch(true);
+    }
+    due_cache = t;
+  }
+  sim_ns = target;
+  checkEnd();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simYield(uint64_t)
+ * ------------------
+ * Waiting loop of the firmware (delays, polling): jump straight to the
+ * next interrupt or event, or to the limit if nothing happens before.
+ * IN:	- latest virtual time to return at (ns)
+ * OUT:	- none
+ */
+void simYield(uint64_t limit_ns) {
+  uint64_t t;
+
+  if (idle_hook && !in_irq)
+    idle_hook();
+  t = nextDue(true);
+  if (t > limit_ns)
+    t = limit_ns;
+  if (t > sim_ns)
+    simAdvance(t - sim_ns);
+  else
+    simAdvance(0);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simSleep(uint64_t)
+ * ------------------
+ * Hibernation: the time runs without periodic interrupts and without
+ * SysTick. The periodic interrupts restart one period after the wakeup.
+ * IN:	- duration (ns)
+ * OUT:	- none
+ */
+void simSleep(uint64_t ns) {
+  uint64_t target = sim_ns + ns;
+  uint64_t t;
+  unsigned int i;
+
+  while ((t = nextDue(false)) <= target) {
+    if (t > sim_ns)
+      sim_ns = t;
+    dispatch(false);
+  }
+  sim_sleep_ns += target - sim_ns;
+  sim_ns = target;
+  for (i = 0; i < SIM_IRQ_MAX; i++) {
+    if (irqs[i].fn)
+      irqs[i].next = sim_ns + irqs[i].period;
+  }
+  due_cache = 0;
+  checkEnd();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simNextEvent(void)
+ * ------------------
+ * IN:	- none
+ * OUT:	- virtual time of the next one-shot event (ns), UINT64_MAX if none
+ */
+uint64_t simNextEvent(void) { return nextDue(false); }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simAt(uint64_t, simIrq_t, void*)
+ * --------------------------------
+ * Schedule a one-shot event (scenario step, peripheral response).
+ * IN:	- virtual time (ns)
+ *			- handler (simIrq_t)
+ *			- handler argument (void*)
+ * OUT:	- none
+ */
+void simAt(uint64_t at_ns, simIrq_t fn, void *arg) {
+  struct simEvent ev = {fn, arg};
+
+  eventQueue().insert(std::make_pair(at_ns, ev));
+  due_cache = 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simIrqAttach(simIrq_t, void*, uint64_t)
+ * ---------------------------------------
+ * Start a periodic interrupt, first run one period from now.
+ * IN:	- handler (simIrq_t)
+ *			- handler argument (void*)
+ *			- period (ns)
+ * OUT:	- interrupt id (int), -1 if none left
+ */
+int simIrqAttach(simIrq_t fn, void *arg, uint64_t period_ns) {
+  unsigned int i;
+
+  for (i = 0; i < SIM_IRQ_MAX; i++) {
+    if (!irqs[i].fn) {
+      irqs[i].fn = fn;
+      irqs[i].arg = arg;
+      irqs[i].period = period_ns ? period_ns : 1;
+      irqs[i].next = sim_ns + irqs[i].period;
+      due_cache = 0;
+      return i;
+    }
+  }
+  return -1;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simIrqPeriod(int, uint64_t)
+ * ---------------------------
+ * Change the period of a running interrupt, from the next run on.
+ * IN:	- interrupt id (int)
+ *			- period (ns)
+ * OUT:	- none
+ */
+void simIrqPeriod(int id, uint64_t period_ns) {
+  if ((id < 0) || (id >= SIM_IRQ_MAX) || !irqs[id].fn)
+    return;
+  irqs[id].period = period_ns ? period_ns : 1;
+  due_cache = 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simIrqDetach(int)
+ * -----------------
+ * IN:	- interrupt id (int)
+ * OUT:	- none
+ */
+void simIrqDetach(int id) {
+  if ((id < 0) || (id >= SIM_IRQ_MAX))
+    return;
+  irqs[id].fn = NULL;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simIrqMask(void) / simIrqUnmask(void)
+ * -------------------------------------
+ * __disable_irq()/__enable_irq(): the periodic interrupts due meanwhile
+ * run when unmasked.
+ * IN:	- none
+ * OUT:	- none
+ */
+void simIrqMask(void) { irq_mask++; }
+
+void simIrqUnmask(void) {
+  if (irq_mask)
+    irq_mask--;
+  due_cache = 0;
+  if (!irq_mask && !in_irq)
+    dispatch(true);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simSetIdleHook(void (*)(void))
+ * ------------------------------
+ * Function called each time the firmware waits (state tracing).
+ * IN:	- hook (void (*)(void))
+ * OUT:	- none
+ */
+void simSetIdleHook(void (*hook)(void)) { idle_hook = hook; }
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simSetLoopHook(void (*)(void)) / simLoopMark(void)
+ * --------------------------------------------------
+ * Function called at the top of each iteration of the firmware main
+ * loop, marked by its Alarm.delay(0) (loop timing).
+ * IN:	- hook (void (*)(void))
+ * OUT:	- none
+ */
+void simSetLoopHook(void (*hook)(void)) { loop_hook = hook; }
+
+void simLoopMark(void) {
+  if (loop_hook)
+    loop_hook();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simSetWarp(bool)
+ * ----------------
+ * Schedule mode: the polling loops get coarser (SIM_WARP_CALL_NS per
+ * call) and the idle loop iterations jump to the next alarm. Time
+ * conditions polled by the firmware are then met late by up to
+ * SIM_WARP_STEP_MAX_NS, the alarms, timers and wake-ups stay on time.
+ * IN:	- schedule mode (bool)
+ * OUT:	- none
+ */
+void simSetWarp(bool warp) {
+  sim_warp = warp;
+  sim_call_ns = warp ? SIM_WARP_CALL_NS : SIM_CALL_NS;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simMillis(void) / simMicros(void)
+ * ---------------------------------
+ * SysTick time, stopped during hibernation. Each call costs sim_call_ns.
+ * IN:	- none
+ * OUT:	- milliseconds/microseconds since startup (uint32_t)
+ */
+uint32_t simMillis(void) {
+  simAdvance(sim_call_ns);
+  return (uint32_t)((sim_ns - sim_sleep_ns) / 1000000ULL);
+}
+
+uint32_t simMicros(void) {
+  simAdvance(sim_call_ns);
+  return (uint32_t)((sim_ns - sim_sleep_ns) / 1000ULL);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simCycles(void)
+ * ---------------
+ * Cycle counter (ARM_DWT_CYCCNT): host execution time at the nominal CPU
+ * clock, so that the firmware's own cycle statistics measure the code
+ * as built for the host.
+ * IN:	- none
+ * OUT:	- cycles (uint32_t, wrapping)
+ */
+uint32_t simCycles(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)((((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec) *
+                    (SIM_CPU_HZ / 1000000ULL) / 1000ULL);
+}
+/*****************************************************************************/
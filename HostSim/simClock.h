@@ -0,0 +1,70 @@
+/*
+ * simClock.h
+ */
+#ifndef _SIMCLOCK_H_
+#define _SIMCLOCK_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdint.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Nominal CPU clock of the Teensy 3.6 (ARM_DWT_CYCCNT)
+#define SIM_CPU_HZ 180000000ULL
+// Time charged to each millis()/micros() call (polling loop iteration), so
+// that busy-waits end
+#define SIM_CALL_NS 250
+// Schedule mode: cost of a polling loop iteration, and longest jump of an
+// idle loop iteration (Alarm.delay(0)) towards the next alarm
+#define SIM_WARP_CALL_NS 10000
+#define SIM_WARP_STEP_MAX_NS SIM_SEC(1)
+// Largest number of periodic interrupt sources
+#define SIM_IRQ_MAX 8
+// Nanoseconds helpers
+#define SIM_MS(x) ((uint64_t)(x) * 1000000ULL)
+#define SIM_SEC(x) ((uint64_t)(x) * 1000000000ULL)
+
+/*** Types *******************************************************************/
+// Interrupt or event handler
+typedef void (*simIrq_t)(void *arg);
+
+// Thrown to end the simulation from anywhere in the firmware
+struct SimEnd {
+  const char *reason;
+};
+
+/*** Variables ***************************************************************/
+// Virtual time since the simulation start (ns)
+extern uint64_t sim_ns;
+// Virtual time spent in hibernation (ns): the SysTick (millis) stops
+extern uint64_t sim_sleep_ns;
+// Virtual time at which the simulation ends (ns)
+extern uint64_t sim_end_ns;
+// Time charged to each polling call (ns)
+extern uint64_t sim_call_ns;
+// Schedule mode: the idle loop iterations jump to the next alarm
+extern bool sim_warp;
+
+/*** Functions ***************************************************************/
+void simAdvance(uint64_t ns);
+void simYield(uint64_t limit_ns);
+void simSleep(uint64_t ns);
+uint64_t simNextEvent(void);
+void simAt(uint64_t at_ns, simIrq_t fn, void *arg);
+int simIrqAttach(simIrq_t fn, void *arg, uint64_t period_ns);
+void simIrqPeriod(int id, uint64_t period_ns);
+void simIrqDetach(int id);
+void simIrqMask(void);
+void simIrqUnmask(void);
+void simSetIdleHook(void (*hook)(void));
+void simSetLoopHook(void (*hook)(void));
+void simLoopMark(void);
+void simSetWarp(bool warp);
+uint32_t simMillis(void);
+uint32_t simMicros(void);
+uint32_t simCycles(void);
+
+#endif /* _SIMCLOCK_H_ */
@@ -0,0 +1,407 @@
+/*
+ * simMain
+ *
+ * Host simulation of the AudioShield firmware. The unmodified sketch
+ * and modules of AudioShield_Teensy run on stand-ins of the Teensyduino
+ * core and libraries (stubs/), in virtual time (simClock.cpp), with an
+ * SD card model backed by an image file (sdCardSim.cpp) and a BC127
+ * model on its UART (bc127Sim.cpp). Hours of recording windows run in
+ * seconds.
+ *
+ * Build: make
+ * Usage: simMain [-i <image>] [-n] [-s <scenario>] [-t <epoch>]
+ *                [-l <hours>] [-d <ppm>] [-w <dur>:<per>:<occ>] [-S]
+ *                [-L <ms>] [-v]
+ *   -i  SD card image (default sdcard.img, created when missing)
+ *   -n  create a new, freshly formatted image
+ *   -s  scenario file, one event per line:
+ *         <seconds> press <pin> [<ms>]   button press (default 150 ms)
+ *         <seconds> uart <line>          line sent by the BC127
+ *         <seconds> stream <n> <ms> <line>
+ *                                        the same line n times, every ms
+ *       (default: REC button pressed at 5 s)
+ *   -t  RTC value at startup (default 1622534400, 01.06.2021)
+ *   -l  virtual time limit in hours (default 25)
+ *   -d  RTC frequency error in ppm (> 0 runs fast)
+ *   -w  recording window set after startup: duration, period (s) and
+ *       occurrences
+ *   -S  schedule mode: no audio, idle loop iterations jumping to the next
+ *       alarm (simSetWarp). Weeks of recording windows run in seconds,
+ *       the recordings stay empty.
+ *   -L  fail (exit status 2) when a main loop iteration during a recording
+ *       takes longer than <ms>
+ *   -v  trace the states and the BC127 command lines
+ *
+ * The simulation ends at the time limit, or when the firmware hibernates
+ * with no wake-up source left (scenario done). The report lists each
+ * recording with its planned start (first start plus the window
+ * period), its actual start, the offset and its change from the
+ * previous recording (drift), the actual duration and the RTC error.
+ * It also gives the longest main loop iteration, outside of
+ * hibernation, overall and during the recordings, and the bytes lost by the BC127
+ * port on receive buffer overflows.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "Arduino.h"
+#include "bc127Sim.h"
+#include "sdCardSim.h"
+
+#include "main.h"
+
+#define IMAGE_DEF "sdcard.img"
+#define START_DEF 1622534400UL
+#define LIMIT_DEF_H 25.0
+#define PRESS_DEF_MS 150
+#define SCEN_LINE_MAX 256
+
+void setup(void);
+void loop(void);
+
+// Recording, in true time (s since the epoch)
+struct recTrace {
+  double start;
+  double stop;
+  long rtc_err; // RTC - true time at the start (s)
+};
+
+static bool verbose = false;
+static unsigned long start_epoch = START_DEF;
+static std::vector<struct recTrace> recs;
+// Longest loop() iteration, overall and during the recordings (ns)
+static uint64_t loop_max_ns = 0;
+static uint64_t loop_rec_max_ns = 0;
+
+/* ConsoleWriter
+ * -------------
+ * Console output of the SdFat listings.
+ */
+class ConsoleWriter : public CharWriter {
+public:
+  size_t write(char c) { return (putchar(c) == EOF) ? 0 : 1; }
+  size_t write(const char *s) { return fputs(s, stdout) < 0 ? 0 : strlen(s); }
+};
+
+/* usbTx(uint8_t, void*)
+ * ---------------------
+ * USB serial port of the firmware -> console.
+ */
+static void usbTx(uint8_t b, void *arg) {
+  (void)arg;
+  putchar(b);
+}
+
+/* pinRelease(void*) / pinPress(void*)
+ * -----------------------------------
+ * Scenario events on the buttons (active low): the argument holds the
+ * pin in its low byte and the press duration (ms) above it.
+ */
+static void pinRelease(void *arg) { simPinSet((uintptr_t)arg & 0xFF, HIGH); }
+
+static void pinPress(void *arg) {
+  uintptr_t v = (uintptr_t)arg;
+
+  if (verbose)
+    printf("[%10.3f] button %u\n", (double)sim_ns / 1e9,
+           (unsigned int)(v & 0xFF));
+  simPinSet(v & 0xFF, LOW);
+  simAt(sim_ns + SIM_MS(v >> 8), pinRelease, (void *)(v & 0xFF));
+}
+
+static double trueTime(void) { return start_epoch + (sim_ns / 1e9); }
+
+/* traceStates(void)
+ * -----------------
+ * Idle hook: log the recordings and trace the state changes.
+ */
+static void traceStates(void) {
+  static struct wState last = {RECSTATE_OFF, MONSTATE_OFF, BTSTATE_OFF,
+                               BLESTATE_OFF};
+  struct wState cur;
+
+  cur.rec_state = working_state.rec_state;
+  cur.mon_state = working_state.mon_state;
+  cur.bt_state = working_state.bt_state;
+  cur.ble_state = working_state.ble_state;
+  if (!memcmp(&cur, &last, sizeof(cur)))
+    return;
+  if ((cur.rec_state == RECSTATE_ON) && (last.rec_state != RECSTATE_ON)) {
+    struct recTrace r;
+    r.start = trueTime();
+    r.stop = 0.0;
+    r.rtc_err = (long)Teensy3Clock.get() - (long)floor(r.start);
+    recs.push_back(r);
+  } else if ((last.rec_state == RECSTATE_ON) && !recs.empty()) {
+    recs.back().stop = trueTime();
+  }
+  if (verbose)
+    printf("[%10.3f] rec %d mon %d bt %d ble %d\n", (double)sim_ns / 1e9,
+           cur.rec_state, cur.mon_state, cur.bt_state, cur.ble_state);
+  last = cur;
+}
+
+/* loadScenario(const char*)
+ * -------------------------
+ * Schedule the events of a scenario file, or the default REC button
+ * press when no file is given.
+ */
+static bool loadScenario(const char *path) {
+  char line[SCEN_LINE_MAX];
+  char cmd[16];
+  double t;
+  int pos, pos2;
+  unsigned int pin, ms, n;
+  FILE *f;
+
+  if (!path) {
+    simAt(SIM_SEC(5), pinPress,
+          (void *)(uintptr_t)(BUTTON_RECORD_PIN | (PRESS_DEF_MS << 8)));
+    return true;
+  }
+  f = fopen(path, "r");
+  if (!f) {
+    perror(path);
+    return false;
+  }
+  while (fgets(line, sizeof(line), f)) {
+    line[strcspn(line, "\r\n")] = 0;
+    if ((line[0] == '#') || (sscanf(line, "%lf %15s %n", &t, cmd, &pos) < 2))
+      continue;
+    if (!strcmp(cmd, "press")) {
+      ms = PRESS_DEF_MS;
+      if (sscanf(line + pos, "%u %u", &pin, &ms) < 1)
+        continue;
+      simAt((uint64_t)(t * 1e9), pinPress,
+            (void *)(uintptr_t)((pin & 0xFF) | (ms << 8)));
+    } else if (!strcmp(cmd, "uart")) {
+      bc127SimInject((uint64_t)(t * 1e9), line + pos);
+    } else if (!strcmp(cmd, "stream")) {
+      if (sscanf(line + pos, "%u %u %n", &n, &ms, &pos2) < 2)
+        continue;
+      for (unsigned int i = 0; i < n; i++)
+        bc127SimInject((uint64_t)(t * 1e9) + SIM_MS(i * ms),
+                       line + pos + pos2);
+    } else {
+      fprintf(stderr, "%s: unknown event '%s'\n", path, cmd);
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+/* loopTime(void)
+ * --------------
+ * Loop hook: time of the main loop iteration just done, unless the
+ * firmware hibernated in it.
+ */
+static void loopTime(void) {
+  static uint64_t last_ns = 0, last_sleep_ns = 0;
+  static bool last_rec = false;
+  bool rec = (working_state.rec_state == RECSTATE_ON);
+  uint64_t dt = sim_ns - last_ns;
+
+  if (last_ns && (sim_sleep_ns == last_sleep_ns)) {
+    if (dt > loop_max_ns)
+      loop_max_ns = dt;
+    if (last_rec && rec && (dt > loop_rec_max_ns))
+      loop_rec_max_ns = dt;
+  }
+  last_ns = sim_ns;
+  last_sleep_ns = sim_sleep_ns;
+  last_rec = rec;
+}
+
+/* windowSeconds(const tmElements_t&)
+ * -----------------------------------
+ * Duration or period of the recording window, as the firmware reads it.
+ */
+static unsigned long windowSeconds(const tmElements_t &tm) {
+  return tm.Second + (tm.Minute * SECS_PER_MIN) + (tm.Hour * SECS_PER_HOUR);
+}
+
+static void printTime(double t) {
+  time_t s = (time_t)floor(t);
+  struct tm tm;
+  char buf[32];
+
+  gmtime_r(&s, &tm);
+  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+  printf("%s.%03d", buf, (int)((t - floor(t)) * 1000.0));
+}
+
+/* reportSchedule(void)
+ * --------------------
+ * Planned and actual start of each recording, drift and duration.
+ */
+static void reportSchedule(void) {
+  unsigned long dur = windowSeconds(rec_window.duration);
+  unsigned long per = windowSeconds(rec_window.period);
+  double planned, offset, prev = 0.0, worst = 0.0, dur_err = 0.0;
+  unsigned int done = 0;
+
+  printf("Schedule:      %lu s every %lu s, %u occurrences, "
+         "REC_DUR_CORRECTION_RATIO %.4f\n",
+         dur, per, rec_window.occurences, (double)REC_DUR_CORRECTION_RATIO);
+  printf("   #  planned start            actual start              "
+         "offset    drift  duration  RTC err\n");
+  for (size_t i = 0; i < recs.size(); i++) {
+    planned = recs[0].start + ((double)i * per);
+    offset = recs[i].start - planned;
+    printf("%4u  ", (unsigned int)(i + 1));
+    printTime(planned);
+    printf("  ");
+    printTime(recs[i].start);
+    printf("  %+7.3f  %+7.3f", offset, offset - prev);
+    if (recs[i].stop > 0.0) {
+      printf("  %8.3f", recs[i].stop - recs[i].start);
+      dur_err += (recs[i].stop - recs[i].start) - dur;
+      done++;
+    } else {
+      printf("         -");
+    }
+    printf("  %+7ld\n", recs[i].rtc_err);
+    if (fabs(offset) > fabs(worst))
+      worst = offset;
+    prev = offset;
+  }
+  printf("Start offset:  %+.3f s at most, %+.3f s at the last recording\n",
+         worst, prev);
+  if (done)
+    printf("Duration:      %+.3f s from the window duration on average\n",
+           dur_err / done);
+}
+
+static double hostSeconds(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+  const char *image = IMAGE_DEF;
+  const char *scenario = NULL;
+  double limit_h = LIMIT_DEF_H;
+  double ppm = 0.0;
+  double loop_limit_ms = 0.0;
+  unsigned long w_dur = 0, w_per = 0, w_occ = 0;
+  bool window = false;
+  bool format = false;
+  const char *reason = "time limit";
+  struct sdSimStats st;
+  ConsoleWriter console;
+  double host_t0, host_dt;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "i:ns:t:l:d:w:SL:v")) != -1) {
+    switch (opt) {
+    case 'i':
+      image = optarg;
+      break;
+    case 'n':
+      format = true;
+      break;
+    case 's':
+      scenario = optarg;
+      break;
+    case 't':
+      start_epoch = strtoul(optarg, NULL, 0);
+      break;
+    case 'l':
+      limit_h = atof(optarg);
+      break;
+    case 'd':
+      ppm = atof(optarg);
+      break;
+    case 'w':
+      window = (sscanf(optarg, "%lu:%lu:%lu", &w_dur, &w_per, &w_occ) == 3) &&
+               (w_dur < w_per);
+      if (!window) {
+        fprintf(stderr, "-w: <duration>:<period>:<occurrences>, "
+                        "duration < period\n");
+        return 1;
+      }
+      break;
+    case 'S':
+      simSetWarp(true);
+      AudioStream::simStop();
+      break;
+    case 'L':
+      loop_limit_ms = atof(optarg);
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      fprintf(stderr,
+              "Usage: %s [-i image] [-n] [-s scenario] [-t epoch] "
+              "[-l hours] [-d ppm] [-w dur:per:occ] [-S] [-L ms] [-v]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (!sdSimOpen(image, SDSIM_SIZE_DEF, format || access(image, F_OK),
+                 SDCARD_CS_PIN)) {
+    fprintf(stderr, "%s: unable to open the SD card image\n", image);
+    return 1;
+  }
+  Teensy3Clock.set(start_epoch);
+  simRtcDrift(ppm);
+  sim_end_ns = (uint64_t)(limit_h * 3600.0 * 1e9);
+  Serial.simAttach(usbTx, NULL);
+  bc127SimInit(verbose);
+  simSetIdleHook(traceStates);
+  simSetLoopHook(loopTime);
+  if (!loadScenario(scenario))
+    return 1;
+
+  host_t0 = hostSeconds();
+  try {
+    setup();
+    if (window) {
+      breakTime(w_dur, rec_window.duration);
+      breakTime(w_per, rec_window.period);
+      rec_window.occurences = w_occ;
+    }
+    for (;;)
+      loop();
+  } catch (SimEnd &e) {
+    reason = e.reason;
+  }
+  host_dt = hostSeconds() - host_t0;
+  // The report below still talks to the card
+  sim_end_ns = UINT64_MAX;
+
+  sdSimGetStats(&st);
+  printf("\nEnd of simulation: %s\n", reason);
+  printf("Virtual time:  %.1f s (%.1f s hibernating)\n", sim_ns / 1e9,
+         sim_sleep_ns / 1e9);
+  printf("Host time:     %.2f s (x%.0f)\n", host_dt,
+         (host_dt > 0.0) ? (sim_ns / 1e9) / host_dt : 0.0);
+  printf("Recordings:    %u started\n", (unsigned int)recs.size());
+  printf("SD card:       %llu blocks written, %llu read, %llu commands, "
+         "%llu stalls\n",
+         (unsigned long long)st.blocks_written,
+         (unsigned long long)st.blocks_read, (unsigned long long)st.commands,
+         (unsigned long long)st.stalls);
+  printf("BC127:         %lu command lines, %lu bytes lost on receive\n",
+         bc127SimLines(), BLUEPORT.simOverflows());
+  printf("Loop:          %.3f ms at most, %.3f ms during the recordings\n",
+         loop_max_ns / 1e6, loop_rec_max_ns / 1e6);
+  if (!recs.empty())
+    reportSchedule();
+  printf("Card content:\n");
+  sd.ls(&console, LS_R | LS_SIZE | LS_DATE);
+  sdSimClose();
+  if ((loop_limit_ms > 0.0) && ((loop_rec_max_ns / 1e6) > loop_limit_ms)) {
+    printf("Loop iteration over %.3f ms during a recording\n", loop_limit_ms);
+    return 2;
+  }
+  return 0;
+}
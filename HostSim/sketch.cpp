@@ -0,0 +1,17 @@
+/*
+ * Firmware sketch, built for the host
+ *
+ * The Arduino build adds the prototypes of the functions of the sketch
+ * before compiling it as C++; the same is done here.
+ *
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "main.h"
+
+/*** Function prototypes *****************************************************/
+bool setRts(struct sfState sf);
+void setDefaultValues(void);
+void helloWorld(void);
+
+#include "AudioShield_Teensy.ino"
@@ -0,0 +1,285 @@
+/*
+ * Host stand-in of the Teensyduino core
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+HardwareSerial Serial("USB");
+HardwareSerial Serial1("Serial1");
+HardwareSerial Serial2("Serial2");
+HardwareSerial Serial3("Serial3");
+HardwareSerial Serial4("Serial4");
+teensy3_clock_class Teensy3Clock;
+uint32_t SIM_SCGC6 = SIM_SCGC6_I2S;
+uint32_t ARM_DWT_CTRL = 0;
+uint32_t ARM_DEMCR = 0;
+
+static uint8_t pin_level[SIM_PINS];
+static int analog_level[SIM_PINS];
+static void (*pin_hook[SIM_PINS])(uint8_t pin, uint8_t val);
+// RTC: value and virtual time of the last setting, frequency error
+static unsigned long rtc_set_val = 0;
+static uint64_t rtc_set_ns = 0;
+static double rtc_ppm = 0.0;
+
+/*** Functions implementation ************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+size_t Print::write(const uint8_t *buf, size_t size) {
+  size_t n = 0;
+
+  while (size--)
+    n += write(*buf++);
+  return n;
+}
+
+size_t Print::print(long n, int base) {
+  if ((base == DEC) && (n < 0))
+    return print('-') + print((unsigned long)-n, base);
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  return write(String(n, (unsigned char)base).c_str());
+}
+
+size_t Print::print(double n, int digits) {
+  return write(String(n, (unsigned char)digits).c_str());
+}
+
+int Print::printf(const char *format, ...) {
+  char buf[512];
+  va_list args;
+  int n;
+
+  va_start(args, format);
+  n = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (n > (int)sizeof(buf) - 1)
+    n = sizeof(buf) - 1;
+  write((const uint8_t *)buf, n);
+  return n;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* Stream::timedRead(void)
+ * -----------------------
+ * Wait for a byte at most timeout_ms of virtual time.
+ */
+int Stream::timedRead(void) {
+  uint32_t start = millis();
+  int c;
+
+  do {
+    c = read();
+    if (c >= 0)
+      return c;
+    simYield(sim_ns + SIM_MS(1));
+  } while ((millis() - start) < timeout_ms);
+  return -1;
+}
+
+size_t Stream::readBytes(char *buf, size_t len) {
+  size_t n = 0;
+  int c;
+
+  while (n < len) {
+    c = timedRead();
+    if (c < 0)
+      break;
+    buf[n++] = (char)c;
+  }
+  return n;
+}
+
+size_t Stream::readBytesUntil(char terminator, char *buf, size_t len) {
+  size_t n = 0;
+  int c;
+
+  while ((n < len) && ((c = timedRead()) >= 0) && (c != terminator))
+    buf[n++] = (char)c;
+  return n;
+}
+
+String Stream::readString(void) {
+  String out;
+  int c;
+
+  while ((c = timedRead()) >= 0)
+    out.concat((char)c);
+  return out;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String out;
+  int c;
+
+  while (((c = timedRead()) >= 0) && (c != terminator))
+    out.concat((char)c);
+  return out;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+int HardwareSerial::read(void) {
+  int c;
+
+  if (rx.empty())
+    return -1;
+  c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+size_t HardwareSerial::write(uint8_t b) {
+  if (tx_hook)
+    tx_hook(b, tx_arg);
+  return 1;
+}
+
+void HardwareSerial::simFeed(const char *str) {
+  for (; *str; str++) {
+    if (rx.size() < SIM_SERIAL_RX_SIZE)
+      rx.push_back((uint8_t)*str);
+    else
+      rx_overflows++;
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+bool IntervalTimer::begin(void (*func)(void), unsigned int us) {
+  end();
+  fn = func;
+  id = simIrqAttach(run, this, (uint64_t)us * 1000ULL);
+  return id >= 0;
+}
+
+void IntervalTimer::update(unsigned int us) {
+  simIrqPeriod(id, (uint64_t)us * 1000ULL);
+}
+
+void IntervalTimer::end(void) {
+  simIrqDetach(id);
+  id = -1;
+}
+
+void IntervalTimer::run(void *arg) {
+  IntervalTimer *it = (IntervalTimer *)arg;
+
+  if (it->fn)
+    it->fn();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* teensy3_clock_class::get(void) / set(unsigned long)
+ * ---------------------------------------------------
+ * Seconds counter of the RTC. Setting it clears the prescaler, so that
+ * the next second starts at the setting time.
+ */
+unsigned long teensy3_clock_class::get(void) {
+  double el = (double)(sim_ns - rtc_set_ns) * (1.0 + (rtc_ppm / 1e6));
+
+  return rtc_set_val + (unsigned long)(el / 1e9);
+}
+
+void teensy3_clock_class::set(unsigned long t) {
+  rtc_set_val = t;
+  rtc_set_ns = sim_ns;
+}
+
+void simRtcDrift(double ppm) {
+  rtc_set_val = Teensy3Clock.get();
+  rtc_set_ns = sim_ns;
+  rtc_ppm = ppm;
+}
+
+/* simRtcTime(unsigned long)
+ * -------------------------
+ * Virtual time at which the RTC seconds counter reaches a value (RTC
+ * alarm).
+ * IN:	- RTC value (unsigned long)
+ * OUT:	- virtual time (ns), now if already reached
+ */
+uint64_t simRtcTime(unsigned long t) {
+  double el;
+
+  if (t <= Teensy3Clock.get())
+    return sim_ns;
+  el = (double)(t - rtc_set_val) * 1e9 / (1.0 + (rtc_ppm / 1e6));
+  return rtc_set_ns + (uint64_t)ceil(el);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void pinMode(uint8_t pin, uint8_t mode) {
+  if ((pin < SIM_PINS) && (mode == INPUT_PULLUP))
+    simPinSet(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < SIM_PINS)
+    simPinSet(pin, val ? HIGH : LOW);
+}
+
+uint8_t digitalRead(uint8_t pin) {
+  return (pin < SIM_PINS) ? pin_level[pin] : LOW;
+}
+
+int analogRead(uint8_t pin) { return (pin < SIM_PINS) ? analog_level[pin] : 0; }
+
+uint32_t millis(void) { return simMillis(); }
+
+uint32_t micros(void) { return simMicros(); }
+
+void delay(uint32_t ms) {
+  uint64_t end = sim_ns + SIM_MS(ms);
+
+  while (sim_ns < end)
+    simYield(end);
+}
+
+void delayMicroseconds(uint32_t us) { simAdvance((uint64_t)us * 1000ULL); }
+
+void yield(void) {}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simPinSet(uint8_t, uint8_t)
+ * ---------------------------
+ * Drive a pin (firmware output or simulated input), calling the hook of
+ * the peripheral model on a level change.
+ * IN:	- pin number (uint8_t)
+ *			- level (uint8_t)
+ * OUT:	- none
+ */
+void simPinSet(uint8_t pin, uint8_t val) {
+  if (pin >= SIM_PINS)
+    return;
+  if (pin_level[pin] != val) {
+    pin_level[pin] = val;
+    if (pin_hook[pin])
+      pin_hook[pin](pin, val);
+  }
+}
+
+void simPinHook(uint8_t pin, void (*hook)(uint8_t pin, uint8_t val)) {
+  if (pin < SIM_PINS)
+    pin_hook[pin] = hook;
+}
+
+void simAnalogSet(uint8_t pin, int val) {
+  if (pin < SIM_PINS)
+    analog_level[pin] = val;
+}
+/*****************************************************************************/
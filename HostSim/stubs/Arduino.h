@@ -0,0 +1,279 @@
+/*
+ * Arduino.h
+ *
+ * Host stand-in of the Teensyduino core: pins, time, serial ports and
+ * the few Kinetis registers touched by the firmware. Time is the
+ * virtual time of the simulation (simClock.h).
+ */
+#ifndef _ARDUINO_H_
+#define _ARDUINO_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <deque>
+
+#include "WString.h"
+#include "simClock.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+#define INPUT_PULLDOWN 3
+#define RISING 2
+#define FALLING 3
+#define CHANGE 4
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+#define PROGMEM
+#define SS 10
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+// Pins of the simulated MCU
+#define SIM_PINS 64
+// Bit of the I2S clock gate (SIM_SCGC6)
+#define SIM_SCGC6_I2S 0x00008000
+// Cycle counter enable (ARM_DWT_CTRL)
+#define ARM_DWT_CTRL_CYCCNTENA (1 << 0)
+// Trace enable (ARM_DEMCR), needed by the cycle counter
+#define ARM_DEMCR_TRCENA (1 << 24)
+
+/*** Types *******************************************************************/
+typedef uint8_t byte;
+typedef bool boolean;
+
+class __FlashStringHelper;
+#define F(str) (reinterpret_cast<const __FlashStringHelper *>(str))
+
+/* Print
+ * -----
+ * Formatted output on top of write(), as in the Teensyduino core.
+ */
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t b) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size);
+  size_t write(const char *str) {
+    return write((const uint8_t *)str, strlen(str));
+  }
+  virtual int availableForWrite(void) { return 0; }
+  virtual void flush(void) {}
+  size_t print(const String &s) { return write(s.c_str()); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(const __FlashStringHelper *s) {
+    return write(reinterpret_cast<const char *>(s));
+  }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) {
+    return print((unsigned long)n, base);
+  }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) {
+    return print((unsigned long)n, base);
+  }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  template <typename T> size_t println(T arg) {
+    size_t n = print(arg);
+    return n + println();
+  }
+  template <typename T> size_t println(T arg, int fmt) {
+    size_t n = print(arg, fmt);
+    return n + println();
+  }
+  size_t println(void) { return write("\r\n"); }
+  int printf(const char *format, ...)
+      __attribute__((format(printf, 2, 3)));
+};
+
+/* Stream
+ * ------
+ * Input side, with the blocking helpers waiting in virtual time.
+ */
+class Stream : public Print {
+public:
+  Stream() : timeout_ms(1000) {}
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+  virtual int peek(void) = 0;
+  void setTimeout(unsigned long ms) { timeout_ms = ms; }
+  size_t readBytes(char *buf, size_t len);
+  size_t readBytesUntil(char terminator, char *buf, size_t len);
+  String readString(void);
+  String readStringUntil(char terminator);
+
+protected:
+  int timedRead(void);
+  unsigned long timeout_ms;
+};
+
+// Receive buffer of the serial ports (SERIALx_RX_BUFFER_SIZE)
+#define SIM_SERIAL_RX_SIZE 64
+
+/* HardwareSerial
+ * --------------
+ * Serial port: bytes written go to the attached peripheral model, bytes
+ * received are queued by it (simFeed) into a receive buffer of the size
+ * of the Teensy one: bytes received while it is full are lost.
+ */
+class HardwareSerial : public Stream {
+public:
+  HardwareSerial(const char *port_name)
+      : name(port_name), tx_hook(NULL), tx_arg(NULL), rx_baud(0),
+        rx_overflows(0) {}
+  void begin(unsigned long baud) { rx_baud = baud; }
+  void end(void) {}
+  int available(void) {
+    // Polling loops on available() must let the virtual time run
+    simAdvance(sim_call_ns);
+    return rx.size();
+  }
+  int read(void);
+  int peek(void) { return rx.empty() ? -1 : rx.front(); }
+  size_t write(uint8_t b);
+  using Print::write;
+  operator bool() { return true; }
+  // Host simulation
+  void simAttach(void (*hook)(uint8_t b, void *arg), void *arg) {
+    tx_hook = hook;
+    tx_arg = arg;
+  }
+  void simFeed(const char *str);
+  unsigned long simBaud(void) { return rx_baud; }
+  unsigned long simOverflows(void) { return rx_overflows; }
+  const char *name;
+
+private:
+  std::deque<uint8_t> rx;
+  void (*tx_hook)(uint8_t b, void *arg);
+  void *tx_arg;
+  unsigned long rx_baud;
+  unsigned long rx_overflows;
+};
+
+/* elapsedMillis / elapsedMicros
+ * -----------------------------
+ * Teensyduino elapsed time variables.
+ */
+uint32_t millis(void);
+uint32_t micros(void);
+
+class elapsedMillis {
+public:
+  elapsedMillis(void) { ms = millis(); }
+  elapsedMillis(unsigned long val) { ms = millis() - val; }
+  operator unsigned long() const { return millis() - ms; }
+  elapsedMillis &operator=(unsigned long val) {
+    ms = millis() - val;
+    return *this;
+  }
+
+private:
+  unsigned long ms;
+};
+
+class elapsedMicros {
+public:
+  elapsedMicros(void) { us = micros(); }
+  elapsedMicros(unsigned long val) { us = micros() - val; }
+  operator unsigned long() const { return micros() - us; }
+  elapsedMicros &operator=(unsigned long val) {
+    us = micros() - val;
+    return *this;
+  }
+
+private:
+  unsigned long us;
+};
+
+/* IntervalTimer
+ * -------------
+ * Periodic interrupt (PIT), run at its period of virtual time.
+ */
+class IntervalTimer {
+public:
+  IntervalTimer(void) : id(-1), fn(NULL) {}
+  ~IntervalTimer(void) { end(); }
+  bool begin(void (*func)(void), unsigned int us);
+  bool begin(void (*func)(void), int us) {
+    return begin(func, (unsigned int)us);
+  }
+  bool begin(void (*func)(void), float us) {
+    return begin(func, (unsigned int)us);
+  }
+  void update(unsigned int us);
+  void update(int us) { update((unsigned int)us); }
+  void end(void);
+  void priority(uint8_t n) { (void)n; }
+
+private:
+  static void run(void *arg);
+  int id;
+  void (*fn)(void);
+};
+
+/* Teensy3Clock
+ * ------------
+ * Real-time clock, running in hibernation too.
+ */
+class teensy3_clock_class {
+public:
+  static unsigned long get(void);
+  static void set(unsigned long t);
+  static void compensate(int adj) { (void)adj; }
+};
+
+/*** Variables ***************************************************************/
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+extern HardwareSerial Serial4;
+extern teensy3_clock_class Teensy3Clock;
+extern uint32_t SIM_SCGC6;
+extern uint32_t ARM_DWT_CTRL;
+extern uint32_t ARM_DEMCR;
+#define ARM_DWT_CYCCNT (simCycles())
+
+/*** Functions ***************************************************************/
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+uint8_t digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield(void);
+#define __disable_irq() simIrqMask()
+#define __enable_irq() simIrqUnmask()
+
+// Host simulation: pin levels and pin change hooks
+void simPinSet(uint8_t pin, uint8_t val);
+void simPinHook(uint8_t pin, void (*hook)(uint8_t pin, uint8_t val));
+void simAnalogSet(uint8_t pin, int val);
+// Host simulation: RTC frequency error (ppm, > 0 runs fast)
+void simRtcDrift(double ppm);
+uint64_t simRtcTime(unsigned long t);
+
+#endif /* _ARDUINO_H_ */
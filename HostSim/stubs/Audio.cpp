@@ -0,0 +1,357 @@
+/*
+ * Host stand-in of the Teensy Audio library
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Audio.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+uint16_t AudioStream::cpu_cycles_total = 0;
+uint16_t AudioStream::cpu_cycles_total_max = 0;
+uint16_t AudioStream::memory_used = 0;
+uint16_t AudioStream::memory_used_max = 0;
+bool AudioStream::update_scheduled = false;
+int AudioStream::update_irq = -1;
+AudioStream *AudioStream::first_update = NULL;
+audio_block_t *AudioStream::memory_pool = NULL;
+unsigned int AudioStream::memory_pool_size = 0;
+uint8_t *AudioStream::memory_pool_used = NULL;
+
+// Test signal of the I2S input
+static float sig_tone_hz = 1000.0;
+static float sig_tone_amp = 0.1;
+static float sig_noise_amp = 0.01;
+// Tone oscillator: (cos, sin) of the phase, rotated at each sample
+static double sig_cos = 1.0, sig_sin = 0.0;
+static double sig_rot_cos = cos(2.0 * M_PI * 1000.0 / AUDIO_SAMPLE_RATE);
+static double sig_rot_sin = sin(2.0 * M_PI * 1000.0 / AUDIO_SAMPLE_RATE);
+static uint32_t sig_seed = 22222;
+
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* signalSample(void)
+ * ------------------
+ * Next sample of the test signal: a tone plus uniform noise from a
+ * linear congruential generator, identical from one run to the next.
+ * The tone comes from a rotating phasor rather than sin(), which would
+ * dominate the simulation time.
+ * IN:	- none
+ * OUT:	- sample (int16_t)
+ */
+static int16_t signalSample(void) {
+  double c = sig_cos;
+  float v;
+
+  sig_seed = (sig_seed * 1664525UL) + 1013904223UL;
+  v = (sig_tone_amp * (float)sig_sin) +
+      (sig_noise_amp * (((float)(int32_t)sig_seed) / 2147483648.0f));
+  sig_cos = (c * sig_rot_cos) - (sig_sin * sig_rot_sin);
+  sig_sin = (sig_sin * sig_rot_cos) + (c * sig_rot_sin);
+  v *= 32768.0f;
+  if (v > 32767.0f)
+    v = 32767.0f;
+  if (v < -32768.0f)
+    v = -32768.0f;
+  return (int16_t)v;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+AudioConnection::AudioConnection(AudioStream &source,
+                                 unsigned char sourceOutput,
+                                 AudioStream &destination,
+                                 unsigned char destinationInput)
+    : src(source), dst(destination), src_index(sourceOutput),
+      dest_index(destinationInput), next_dest(NULL) {
+  connect();
+}
+
+AudioConnection::AudioConnection(AudioStream &source,
+                                 AudioStream &destination)
+    : src(source), dst(destination), src_index(0), dest_index(0),
+      next_dest(NULL) {
+  connect();
+}
+
+void AudioConnection::connect(void) {
+  AudioConnection *p;
+
+  if (dest_index > dst.num_inputs)
+    return;
+  p = src.destination_list;
+  if (p == NULL) {
+    src.destination_list = this;
+  } else {
+    while (p->next_dest)
+      p = p->next_dest;
+    p->next_dest = this;
+  }
+  src.numConnections++;
+  src.active = true;
+  dst.numConnections++;
+  dst.active = true;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+AudioStream::AudioStream(unsigned char ninput, audio_block_t **iqueue)
+    : cpu_cycles(0), cpu_cycles_max(0), active(false), num_inputs(ninput),
+      numConnections(0), destination_list(NULL), inputQueue(iqueue),
+      next_update(NULL) {
+  AudioStream *p;
+
+  for (int i = 0; i < num_inputs; i++)
+    inputQueue[i] = NULL;
+  if (first_update == NULL) {
+    first_update = this;
+  } else {
+    for (p = first_update; p->next_update; p = p->next_update)
+      ;
+    p->next_update = this;
+  }
+}
+
+void AudioStream::initialize_memory(audio_block_t *data, unsigned int num) {
+  memory_pool = data;
+  memory_pool_size = num;
+  delete[] memory_pool_used;
+  memory_pool_used = new uint8_t[num]();
+  for (unsigned int i = 0; i < num; i++)
+    data[i].memory_pool_index = i;
+  memory_used = 0;
+  memory_used_max = 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioStream::allocate(void) / release(audio_block_t*)
+ * -----------------------------------------------------
+ * Blocks of the pool, reference counted. As on the target, allocate()
+ * returns NULL once the pool is exhausted.
+ */
+audio_block_t *AudioStream::allocate(void) {
+  audio_block_t *block = NULL;
+
+  simIrqMask();
+  for (unsigned int i = 0; i < memory_pool_size; i++) {
+    if (!memory_pool_used[i]) {
+      memory_pool_used[i] = 1;
+      block = &memory_pool[i];
+      block->ref_count = 1;
+      if (++memory_used > memory_used_max)
+        memory_used_max = memory_used;
+      break;
+    }
+  }
+  simIrqUnmask();
+  return block;
+}
+
+void AudioStream::release(audio_block_t *block) {
+  if (!block)
+    return;
+  simIrqMask();
+  if (block->ref_count > 1) {
+    block->ref_count--;
+  } else {
+    memory_pool_used[block->memory_pool_index] = 0;
+    memory_used--;
+  }
+  simIrqUnmask();
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void AudioStream::transmit(audio_block_t *block, unsigned char index) {
+  for (AudioConnection *c = destination_list; c != NULL; c = c->next_dest) {
+    if (c->src_index == index) {
+      if (c->dst.inputQueue[c->dest_index] == NULL) {
+        c->dst.inputQueue[c->dest_index] = block;
+        block->ref_count++;
+      }
+    }
+  }
+}
+
+audio_block_t *AudioStream::receiveReadOnly(unsigned int index) {
+  audio_block_t *in;
+
+  if (index >= num_inputs)
+    return NULL;
+  in = inputQueue[index];
+  inputQueue[index] = NULL;
+  return in;
+}
+
+audio_block_t *AudioStream::receiveWritable(unsigned int index) {
+  audio_block_t *in, *p;
+
+  if (index >= num_inputs)
+    return NULL;
+  in = inputQueue[index];
+  inputQueue[index] = NULL;
+  if (in && in->ref_count > 1) {
+    p = allocate();
+    if (p)
+      memcpy(p->data, in->data, sizeof(p->data));
+    in->ref_count--;
+    in = p;
+  }
+  return in;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* AudioStream::update_setup(void) / update_stop(void)
+ * ---------------------------------------------------
+ * The I2S output is responsible for the updates: a periodic interrupt
+ * of the virtual clock stands for its DMA interrupt.
+ */
+bool AudioStream::update_setup(void) {
+  if (update_scheduled)
+    return false;
+  update_irq = simIrqAttach(simUpdate, NULL, SIM_AUDIO_PERIOD_NS);
+  update_scheduled = (update_irq >= 0);
+  return update_scheduled;
+}
+
+void AudioStream::update_stop(void) {
+  simIrqDetach(update_irq);
+  update_irq = -1;
+  update_scheduled = false;
+}
+
+/* AudioStream::simUpdate(void*)
+ * -----------------------------
+ * Audio interrupt (software_isr): update all the active objects in
+ * creation order, with the same cycle accounting. Skipped while the I2S
+ * clock is gated.
+ */
+void AudioStream::simUpdate(void *arg) {
+  AudioStream *p;
+  uint32_t totalcycles, cycles;
+
+  (void)arg;
+  if (!(SIM_SCGC6 & SIM_SCGC6_I2S))
+    return;
+  totalcycles = ARM_DWT_CYCCNT;
+  for (p = first_update; p; p = p->next_update) {
+    if (p->active) {
+      cycles = ARM_DWT_CYCCNT;
+      p->update();
+      cycles = (ARM_DWT_CYCCNT - cycles) >> 4;
+      p->cpu_cycles = cycles;
+      if (cycles > p->cpu_cycles_max)
+        p->cpu_cycles_max = cycles;
+    }
+  }
+  totalcycles = (ARM_DWT_CYCCNT - totalcycles) >> 4;
+  cpu_cycles_total = totalcycles;
+  if (totalcycles > cpu_cycles_total_max)
+    cpu_cycles_total_max = totalcycles;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void AudioInputI2S::update(void) {
+  audio_block_t *left, *right;
+
+  left = allocate();
+  right = allocate();
+  if (left) {
+    for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++)
+      left->data[i] = signalSample();
+    // Keep the phasor on the unit circle
+    double k = 1.5 - (0.5 * ((sig_cos * sig_cos) + (sig_sin * sig_sin)));
+    sig_cos *= k;
+    sig_sin *= k;
+    if (right)
+      memcpy(right->data, left->data, sizeof(right->data));
+  } else if (right) {
+    memset(right->data, 0, sizeof(right->data));
+  }
+  if (left) {
+    transmit(left, 0);
+    release(left);
+  }
+  if (right) {
+    transmit(right, 1);
+    release(right);
+  }
+}
+
+void AudioOutputI2S::update(void) {
+  release(receiveReadOnly(0));
+  release(receiveReadOnly(1));
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void AudioMixer4::gain(unsigned int channel, float gain) {
+  if (channel >= 4)
+    return;
+  if (gain > 32767.0f)
+    gain = 32767.0f;
+  else if (gain < -32767.0f)
+    gain = -32767.0f;
+  multiplier[channel] = gain * 65536.0f;
+}
+
+void AudioMixer4::update(void) {
+  audio_block_t *in, *out = NULL;
+  int32_t v;
+
+  for (unsigned int ch = 0; ch < 4; ch++) {
+    if (!out) {
+      out = receiveWritable(ch);
+      if (out && (multiplier[ch] != 65536)) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+          v = (int32_t)(((int64_t)out->data[i] * multiplier[ch]) >> 16);
+          out->data[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+        }
+      }
+    } else {
+      in = receiveReadOnly(ch);
+      if (in) {
+        for (int i = 0; i < AUDIO_BLOCK_SAMPLES; i++) {
+          v = out->data[i] +
+              (int32_t)(((int64_t)in->data[i] * multiplier[ch]) >> 16);
+          out->data[i] = (v > 32767) ? 32767 : ((v < -32768) ? -32768 : v);
+        }
+        release(in);
+      }
+    }
+  }
+  if (out) {
+    transmit(out);
+    release(out);
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simAudioSignal(float, float, float)
+ * -----------------------------------
+ * Set the test signal of the I2S input.
+ * IN:	- tone frequency (Hz)
+ *			- tone amplitude (full scale 1.0)
+ *			- noise amplitude (full scale 1.0)
+ * OUT:	- none
+ */
+void simAudioSignal(float tone_hz, float tone_amp, float noise_amp) {
+  double step = 2.0 * M_PI * tone_hz / AUDIO_SAMPLE_RATE;
+
+  sig_tone_hz = tone_hz;
+  sig_tone_amp = tone_amp;
+  sig_noise_amp = noise_amp;
+  sig_rot_cos = cos(step);
+  sig_rot_sin = sin(step);
+}
+/*****************************************************************************/
@@ -0,0 +1,95 @@
+/*
+ * Audio.h
+ *
+ * Host stand-in of the Teensy Audio library objects used by the
+ * firmware. The I2S input produces a deterministic test signal (tone
+ * plus noise); the outputs and the SD player do nothing.
+ */
+#ifndef _AUDIO_H_
+#define _AUDIO_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "AudioStream.h"
+// As in the Teensy Audio library (AudioPlaySdWav)
+#include <SD.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define AUDIO_INPUT_LINEIN 0
+#define AUDIO_INPUT_MIC 1
+
+/*** Types *******************************************************************/
+class AudioInputI2S : public AudioStream {
+public:
+  AudioInputI2S(void) : AudioStream(0, NULL) { active = true; }
+  virtual void update(void);
+};
+
+class AudioOutputI2S : public AudioStream {
+public:
+  AudioOutputI2S(void) : AudioStream(2, inputQueueArray) { update_setup(); }
+  virtual void update(void);
+
+private:
+  audio_block_t *inputQueueArray[2];
+};
+
+class AudioMixer4 : public AudioStream {
+public:
+  AudioMixer4(void) : AudioStream(4, inputQueueArray) {
+    for (int i = 0; i < 4; i++)
+      multiplier[i] = 65536;
+  }
+  virtual void update(void);
+  void gain(unsigned int channel, float gain);
+
+private:
+  int32_t multiplier[4];
+  audio_block_t *inputQueueArray[4];
+};
+
+class AudioPlaySdWav : public AudioStream {
+public:
+  AudioPlaySdWav(void) : AudioStream(0, NULL) {}
+  bool play(const char *filename) {
+    (void)filename;
+    return false;
+  }
+  void stop(void) {}
+  bool isPlaying(void) { return false; }
+  uint32_t positionMillis(void) { return 0; }
+  uint32_t lengthMillis(void) { return 0; }
+  virtual void update(void) {}
+};
+
+class AudioControlSGTL5000 {
+public:
+  bool enable(void) { return true; }
+  bool disable(void) { return false; }
+  bool volume(float n) { return (n >= 0.0) && (n <= 1.0); }
+  bool inputLevel(float n) { return (n >= 0.0) && (n <= 1.0); }
+  bool muteHeadphone(void) { return true; }
+  bool unmuteHeadphone(void) { return true; }
+  bool muteLineout(void) { return true; }
+  bool unmuteLineout(void) { return true; }
+  bool inputSelect(int n) { return (n == AUDIO_INPUT_LINEIN) ||
+                                   (n == AUDIO_INPUT_MIC); }
+  bool micGain(unsigned int dB) { return dB <= 63; }
+  bool lineInLevel(uint8_t n) { return n <= 15; }
+  bool lineInLevel(uint8_t left, uint8_t right) {
+    return (left <= 15) && (right <= 15);
+  }
+  unsigned short lineOutLevel(uint8_t n) { return (n >= 13) && (n <= 31); }
+  unsigned short adcHighPassFilterEnable(void) { return 1; }
+  unsigned short adcHighPassFilterFreeze(void) { return 1; }
+  unsigned short adcHighPassFilterDisable(void) { return 1; }
+};
+
+/*** Functions ***************************************************************/
+// Host simulation: test signal of the I2S input (full scale 1.0)
+void simAudioSignal(float tone_hz, float tone_amp, float noise_amp);
+
+#endif /* _AUDIO_H_ */
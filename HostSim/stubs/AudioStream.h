@@ -0,0 +1,124 @@
+/*
+ * AudioStream.h
+ *
+ * Host stand-in of the Teensy Audio library core: reference counted
+ * blocks from a fixed pool, connections, and update_all() run by a
+ * periodic interrupt of the virtual clock every AUDIO_BLOCK_SAMPLES
+ * samples, as long as the I2S clock is enabled (SIM_SCGC6).
+ */
+#ifndef _AUDIOSTREAM_H_
+#define _AUDIOSTREAM_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define AUDIO_BLOCK_SAMPLES 128
+#define AUDIO_SAMPLE_RATE 44117.64706
+#define AUDIO_SAMPLE_RATE_EXACT 44117.64706f
+// Audio interrupt period: 128 samples at 750 kHz / 17 (ns)
+#define SIM_AUDIO_PERIOD_NS (AUDIO_BLOCK_SAMPLES * 17ULL * 1000000ULL / 750ULL)
+// CPU cycles of an audio interrupt (>> 4) to percent
+#define CYCLE_COUNTER_APPROX_PERCENT(n)                                       \
+  (((n) + (SIM_CPU_HZ / 32 / AUDIO_SAMPLE_RATE * AUDIO_BLOCK_SAMPLES / 100)) / \
+   (SIM_CPU_HZ / 16 / AUDIO_SAMPLE_RATE * AUDIO_BLOCK_SAMPLES / 100))
+
+/*** Types *******************************************************************/
+typedef struct audio_block_struct {
+  uint8_t ref_count;
+  uint8_t reserved1;
+  uint16_t memory_pool_index;
+  int16_t data[AUDIO_BLOCK_SAMPLES];
+} audio_block_t;
+
+class AudioStream;
+
+class AudioConnection {
+public:
+  AudioConnection(AudioStream &source, unsigned char sourceOutput,
+                  AudioStream &destination, unsigned char destinationInput);
+  AudioConnection(AudioStream &source, AudioStream &destination);
+
+protected:
+  void connect(void);
+  AudioStream &src;
+  AudioStream &dst;
+  unsigned char src_index;
+  unsigned char dest_index;
+  AudioConnection *next_dest;
+  friend class AudioStream;
+};
+
+class AudioStream {
+public:
+  AudioStream(unsigned char ninput, audio_block_t **iqueue);
+  virtual ~AudioStream() {}
+  static void initialize_memory(audio_block_t *data, unsigned int num);
+  float processorUsage(void) {
+    return CYCLE_COUNTER_APPROX_PERCENT(cpu_cycles);
+  }
+  float processorUsageMax(void) {
+    return CYCLE_COUNTER_APPROX_PERCENT(cpu_cycles_max);
+  }
+  void processorUsageMaxReset(void) { cpu_cycles_max = cpu_cycles; }
+  bool isActive(void) { return active; }
+  uint16_t cpu_cycles;
+  uint16_t cpu_cycles_max;
+  static uint16_t cpu_cycles_total;
+  static uint16_t cpu_cycles_total_max;
+  static uint16_t memory_used;
+  static uint16_t memory_used_max;
+  // Host simulation: run one audio interrupt, stop the audio interrupt
+  static void simUpdate(void *arg);
+  static void simStop(void) { update_stop(); }
+
+protected:
+  bool active;
+  unsigned char num_inputs;
+  static audio_block_t *allocate(void);
+  static void release(audio_block_t *block);
+  void transmit(audio_block_t *block, unsigned char index = 0);
+  audio_block_t *receiveReadOnly(unsigned int index = 0);
+  audio_block_t *receiveWritable(unsigned int index = 0);
+  static bool update_setup(void);
+  static void update_stop(void);
+  friend class AudioConnection;
+  uint8_t numConnections;
+
+private:
+  virtual void update(void) = 0;
+  AudioConnection *destination_list;
+  audio_block_t **inputQueue;
+  static bool update_scheduled;
+  static int update_irq;
+  static AudioStream *first_update;
+  AudioStream *next_update;
+  static audio_block_t *memory_pool;
+  static unsigned int memory_pool_size;
+  static uint8_t *memory_pool_used;
+};
+
+/*** Macros ******************************************************************/
+#define AudioMemory(num)                                                      \
+  ({                                                                          \
+    static audio_block_t data[num];                                           \
+    AudioStream::initialize_memory(data, num);                                \
+  })
+#define AudioProcessorUsage()                                                 \
+  (CYCLE_COUNTER_APPROX_PERCENT(AudioStream::cpu_cycles_total))
+#define AudioProcessorUsageMax()                                              \
+  (CYCLE_COUNTER_APPROX_PERCENT(AudioStream::cpu_cycles_total_max))
+#define AudioProcessorUsageMaxReset()                                         \
+  (AudioStream::cpu_cycles_total_max = AudioStream::cpu_cycles_total)
+#define AudioMemoryUsage() (AudioStream::memory_used)
+#define AudioMemoryUsageMax() (AudioStream::memory_used_max)
+#define AudioMemoryUsageMaxReset()                                            \
+  (AudioStream::memory_used_max = AudioStream::memory_used)
+#define AudioNoInterrupts() simIrqMask()
+#define AudioInterrupts() simIrqUnmask()
+
+#endif /* _AUDIOSTREAM_H_ */
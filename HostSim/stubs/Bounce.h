@@ -0,0 +1,69 @@
+/*
+ * Bounce.h
+ *
+ * Host stand-in of the Bounce library (Teensyduino version 1): lock-out
+ * debouncing of a digital input on millis().
+ */
+#ifndef _BOUNCE_H_
+#define _BOUNCE_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Types *******************************************************************/
+class Bounce {
+public:
+  Bounce(uint8_t pin, unsigned long interval_millis)
+      : pin(pin), interval_millis(interval_millis), rebounce_millis(0),
+        stateChanged(0) {
+    previous_millis = millis();
+    state = digitalRead(pin);
+  }
+  void interval(unsigned long interval_millis) {
+    this->interval_millis = interval_millis;
+  }
+  int update(void) {
+    if (debounce()) {
+      rebounce(0);
+      return stateChanged = 1;
+    }
+    if (rebounce_millis && (millis() - previous_millis >= rebounce_millis)) {
+      previous_millis = millis();
+      rebounce(0);
+      return stateChanged = 1;
+    }
+    return stateChanged = 0;
+  }
+  void rebounce(unsigned long interval) { rebounce_millis = interval; }
+  int read(void) { return (int)state; }
+  void write(int new_state) {
+    state = new_state;
+    digitalWrite(pin, state);
+  }
+  unsigned long duration(void) { return millis() - previous_millis; }
+  bool risingEdge(void) { return stateChanged && state; }
+  bool fallingEdge(void) { return stateChanged && !state; }
+
+protected:
+  int debounce(void) {
+    uint8_t newState = digitalRead(pin);
+    if (state != newState) {
+      if (millis() - previous_millis >= interval_millis) {
+        previous_millis = millis();
+        state = newState;
+        return 1;
+      }
+    }
+    return 0;
+  }
+  uint8_t pin;
+  unsigned long previous_millis, interval_millis, rebounce_millis;
+  uint8_t state;
+  uint8_t stateChanged;
+};
+
+#endif /* _BOUNCE_H_ */
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in of the Teensy SD library
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "SD.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+SDClass SD;
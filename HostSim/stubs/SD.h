@@ -0,0 +1,74 @@
+/*
+ * SD.h
+ *
+ * Host stand-in of the Teensy SD library, built on the vendored SdFat:
+ * File is an SdBaseFile with the Stream interface, SD mounts its own
+ * volume of the simulated card (as the Teensy SD library does next to
+ * SdFat).
+ */
+#ifndef _SD_H_
+#define _SD_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+#include <SdFat.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define FILE_READ O_READ
+#define FILE_WRITE (O_RDWR | O_CREAT | O_AT_END)
+
+/*** Types *******************************************************************/
+class File : public Stream {
+public:
+  File(void) {}
+  File(const SdBaseFile &f) : file(f) {}
+  virtual size_t write(uint8_t b) { return write(&b, 1); }
+  virtual size_t write(const uint8_t *buf, size_t size) {
+    int n = file.write(buf, size);
+    return (n < 0) ? 0 : n;
+  }
+  using Print::write;
+  virtual int available(void) {
+    uint32_t n = file.fileSize() - file.curPosition();
+    return (n > 0x7FFF) ? 0x7FFF : n;
+  }
+  virtual int read(void) { return file.read(); }
+  int read(void *buf, uint16_t n) { return file.read(buf, n); }
+  virtual int peek(void) { return file.peek(); }
+  virtual void flush(void) { file.sync(); }
+  bool seek(uint32_t pos) { return file.seekSet(pos); }
+  uint32_t position(void) { return file.curPosition(); }
+  uint32_t size(void) { return file.fileSize(); }
+  void close(void) { file.close(); }
+  bool isDirectory(void) { return file.isDir(); }
+  operator bool() { return file.isOpen(); }
+
+private:
+  SdBaseFile file;
+};
+
+class SDClass {
+public:
+  bool begin(uint8_t cs = SS) { return fs.begin(cs); }
+  File open(const char *path, uint8_t mode = FILE_READ) {
+    SdBaseFile f;
+    f.open(fs.vwd(), path, mode);
+    return File(f);
+  }
+  bool exists(const char *path) { return fs.exists(path); }
+  bool mkdir(const char *path) { return fs.mkdir(path); }
+  bool remove(const char *path) { return fs.remove(path); }
+  bool rmdir(const char *path) { return fs.rmdir(path); }
+
+private:
+  SdFat fs;
+};
+
+/*** Variables ***************************************************************/
+extern SDClass SD;
+
+#endif /* _SD_H_ */
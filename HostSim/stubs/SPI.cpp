@@ -0,0 +1,32 @@
+/*
+ * Host stand-in of the Teensyduino SPI library
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "SPI.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+SPIClass SPI;
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+/* SPIClass::beginTransaction(SPISettings)
+ * ---------------------------------------
+ * The clock is the closest one reachable below the requested one, at
+ * most F_BUS / 2.
+ */
+void SPIClass::beginTransaction(SPISettings settings) {
+  uint32_t clock = settings.clock;
+
+  if (clock > SIM_SPI_CLOCK_MAX)
+    clock = SIM_SPI_CLOCK_MAX;
+  if (clock == 0)
+    clock = 1;
+  byte_ns = (8ULL * 1000000000ULL + clock - 1) / clock;
+}
+/*****************************************************************************/
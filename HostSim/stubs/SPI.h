@@ -0,0 +1,82 @@
+/*
+ * SPI.h
+ *
+ * Host stand-in of the Teensyduino SPI library. Each byte is exchanged
+ * with the attached device model and takes its transfer time (8 clock
+ * periods) of virtual time.
+ */
+#ifndef _SPI_H_
+#define _SPI_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define LSBFIRST 0
+#define MSBFIRST 1
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+// Highest SPI clock of the Teensy 3.6 (F_BUS / 2)
+#define SIM_SPI_CLOCK_MAX 30000000UL
+
+/*** Types *******************************************************************/
+class SPISettings {
+public:
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode)
+      : clock(clock), bitOrder(bitOrder), dataMode(dataMode) {}
+  SPISettings(void) : clock(4000000), bitOrder(MSBFIRST), dataMode(SPI_MODE0) {}
+  uint32_t clock;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+};
+
+// Device model on the bus: byte in (MOSI), byte out (MISO)
+typedef uint8_t (*simSpiDev_t)(uint8_t in, void *arg);
+
+class SPIClass {
+public:
+  SPIClass(void) : byte_ns(2000), dev(NULL), dev_arg(NULL) {}
+  void begin(void) {}
+  void end(void) {}
+  void beginTransaction(SPISettings settings);
+  void endTransaction(void) {}
+  void usingInterrupt(uint8_t n) { (void)n; }
+  uint8_t transfer(uint8_t data) {
+    simAdvance(byte_ns);
+    return dev ? dev(data, dev_arg) : 0xFF;
+  }
+  uint16_t transfer16(uint16_t data) {
+    return ((uint16_t)transfer(data >> 8) << 8) | transfer(data & 0xFF);
+  }
+  void transfer(void *buf, size_t count) {
+    uint8_t *p = (uint8_t *)buf;
+    while (count--) {
+      *p = transfer(*p);
+      p++;
+    }
+  }
+  void setMOSI(uint8_t pin) { (void)pin; }
+  void setMISO(uint8_t pin) { (void)pin; }
+  void setSCK(uint8_t pin) { (void)pin; }
+  // Host simulation
+  void simAttach(simSpiDev_t device, void *arg) {
+    dev = device;
+    dev_arg = arg;
+  }
+
+private:
+  uint64_t byte_ns;
+  simSpiDev_t dev;
+  void *dev_arg;
+};
+
+/*** Variables ***************************************************************/
+extern SPIClass SPI;
+
+#endif /* _SPI_H_ */
@@ -0,0 +1,11 @@
+/*
+ * SerialFlash.h
+ *
+ * Host stand-in: the firmware includes the library but does not use it.
+ */
+#ifndef _SERIALFLASH_H_
+#define _SERIALFLASH_H_
+
+#include "Arduino.h"
+
+#endif /* _SERIALFLASH_H_ */
@@ -0,0 +1,126 @@
+/*
+ * Host stand-in of the Snooze library
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Snooze.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+SnoozeClass Snooze;
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+int SnoozeDigital::pinMode(int pin, int mode, int type) {
+  (void)type;
+  if ((pin < 0) || (pin >= SIM_PINS) || (nb_pins >= SIM_PINS))
+    return -1;
+  ::pinMode(pin, mode);
+  pins[nb_pins++] = pin;
+  return pin;
+}
+
+uint64_t SnoozeDigital::armWake(void) {
+  for (unsigned int i = 0; i < nb_pins; i++)
+    level[i] = digitalRead(pins[i]);
+  return UINT64_MAX;
+}
+
+int SnoozeDigital::checkWake(void) {
+  uint8_t val;
+
+  for (unsigned int i = 0; i < nb_pins; i++) {
+    val = digitalRead(pins[i]);
+    if ((level[i] == HIGH) && (val == LOW))
+      return pins[i];
+    level[i] = val;
+  }
+  return -1;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* SnoozeAlarm::setRtcTimer(uint8_t, uint8_t, uint8_t)
+ * ---------------------------------------------------
+ * Wake-up after the given time, counted by the RTC from the hibernation
+ * entry.
+ */
+void SnoozeAlarm::setRtcTimer(uint8_t hours, uint8_t minutes,
+                              uint8_t seconds) {
+  alarm_sec = (hours * 3600UL) + (minutes * 60UL) + seconds;
+}
+
+uint64_t SnoozeAlarm::armWake(void) {
+  wake_ns = simRtcTime(Teensy3Clock.get() + alarm_sec);
+  return wake_ns;
+}
+
+int SnoozeAlarm::checkWake(void) {
+  return (sim_ns >= wake_ns) ? SNOOZE_WAKE_RTC : -1;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+SnoozeBlock &SnoozeBlock::operator+=(SnoozeDriver &driver) {
+  for (unsigned int i = 0; i < nb; i++) {
+    if (drivers[i] == &driver)
+      return *this;
+  }
+  if (nb < SNOOZE_DRIVERS_MAX)
+    drivers[nb++] = &driver;
+  return *this;
+}
+
+SnoozeBlock &SnoozeBlock::operator-=(SnoozeDriver &driver) {
+  for (unsigned int i = 0; i < nb; i++) {
+    if (drivers[i] == &driver) {
+      drivers[i] = drivers[--nb];
+      break;
+    }
+  }
+  return *this;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* SnoozeClass::hibernate(SnoozeBlock&)
+ * ------------------------------------
+ * Sleep from one scheduled event to the next (scenario steps, peripheral
+ * responses) until a driver of the block wakes up. Hibernating with no
+ * wake-up source left ends the simulation.
+ * IN:	- drivers of the wake-up sources (SnoozeBlock&)
+ * OUT:	- wake-up source (int): pin number or SNOOZE_WAKE_RTC
+ */
+int SnoozeClass::hibernate(SnoozeBlock &configuration) {
+  uint64_t wake = UINT64_MAX, t;
+  unsigned int i;
+  int who;
+
+  for (i = 0; i < configuration.nb; i++) {
+    t = configuration.drivers[i]->armWake();
+    if (t < wake)
+      wake = t;
+  }
+  for (;;) {
+    t = simNextEvent();
+    if (wake < t)
+      t = wake;
+    if (sim_end_ns < t)
+      t = sim_end_ns;
+    if (t == UINT64_MAX) {
+      struct SimEnd end = {"hibernating with no wake-up source"};
+      throw end;
+    }
+    simSleep((t > sim_ns) ? (t - sim_ns) : 0);
+    for (i = 0; i < configuration.nb; i++) {
+      who = configuration.drivers[i]->checkWake();
+      if (who >= 0)
+        return who;
+    }
+  }
+}
+/*****************************************************************************/
@@ -0,0 +1,111 @@
+/*
+ * Snooze.h
+ *
+ * Host stand-in of the Snooze library: hibernate() lets the virtual
+ * time run, without the SysTick and the periodic interrupts, until the
+ * RTC alarm or a falling edge on a wake-up pin of the block.
+ */
+#ifndef _SNOOZE_H_
+#define _SNOOZE_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+// Wake-up source number of the RTC alarm (Teensy 3.6)
+#define SNOOZE_WAKE_RTC 35
+// Largest number of drivers in a block
+#define SNOOZE_DRIVERS_MAX 8
+
+/*** Types *******************************************************************/
+class SnoozeBlock;
+
+class SnoozeDriver {
+public:
+  virtual ~SnoozeDriver() {}
+
+protected:
+  // Hibernation entry: arm the wake-up, return its virtual time (RTC)
+  virtual uint64_t armWake(void) { return UINT64_MAX; }
+  // Wake-up source raised since armWake(), -1 if none
+  virtual int checkWake(void) { return -1; }
+  friend class SnoozeClass;
+};
+
+class SnoozeDigital : public SnoozeDriver {
+public:
+  SnoozeDigital(void) : nb_pins(0) {}
+  int pinMode(int pin, int mode, int type);
+
+protected:
+  virtual uint64_t armWake(void);
+  virtual int checkWake(void);
+
+private:
+  uint8_t pins[SIM_PINS];
+  uint8_t level[SIM_PINS];
+  unsigned int nb_pins;
+};
+
+class SnoozeAlarm : public SnoozeDriver {
+public:
+  SnoozeAlarm(void) : alarm_sec(0), wake_ns(UINT64_MAX) {}
+  void setRtcTimer(uint8_t hours, uint8_t minutes, uint8_t seconds);
+  void setAlarm(uint8_t hours, uint8_t minutes, uint8_t seconds) {
+    setRtcTimer(hours, minutes, seconds);
+  }
+
+protected:
+  virtual uint64_t armWake(void);
+  virtual int checkWake(void);
+
+private:
+  unsigned long alarm_sec;
+  uint64_t wake_ns;
+};
+
+class SnoozeUSBSerial : public SnoozeDriver, public Stream {
+public:
+  int available(void) { return Serial.available(); }
+  int read(void) { return Serial.read(); }
+  int peek(void) { return Serial.peek(); }
+  size_t write(uint8_t b) { return Serial.write(b); }
+  using Print::write;
+  operator bool() { return true; }
+};
+
+class SnoozeBlock {
+public:
+  SnoozeBlock(void) : nb(0) {}
+  template <typename... Drivers>
+  SnoozeBlock(Drivers &... drivers) : nb(0) {
+    SnoozeDriver *list[] = {&drivers...};
+    for (SnoozeDriver *d : list)
+      *this += *d;
+  }
+  SnoozeBlock &operator+=(SnoozeDriver &driver);
+  SnoozeBlock &operator-=(SnoozeDriver &driver);
+
+private:
+  SnoozeDriver *drivers[SNOOZE_DRIVERS_MAX];
+  unsigned int nb;
+  friend class SnoozeClass;
+};
+
+class SnoozeClass {
+public:
+  int hibernate(SnoozeBlock &configuration);
+  int deepSleep(SnoozeBlock &configuration) {
+    return hibernate(configuration);
+  }
+  int sleep(SnoozeBlock &configuration) { return hibernate(configuration); }
+};
+
+/*** Variables ***************************************************************/
+extern SnoozeClass Snooze;
+
+#endif /* _SNOOZE_H_ */
@@ -0,0 +1,257 @@
+/*
+ * Host stand-in of the TimeAlarms library
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+#include "TimeAlarms.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Variables ***************************************************************/
+TimeAlarmsClass Alarm;
+
+/*** Macros ******************************************************************/
+#define dtIsAlarm(_type_)                                                     \
+  ((_type_) >= dtExplicitAlarm && (_type_) < dtLastAlarmType)
+#define dtUseAbsoluteValue(_type_)                                            \
+  ((_type_) == dtExplicitAlarm || (_type_) == dtWeeklyAlarm)
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+AlarmClass::AlarmClass() {
+  Mode.isEnabled = Mode.isOneShot = 0;
+  Mode.alarmType = dtNotAllocated;
+  value = nextTrigger = 0;
+  onTickHandler = NULL;
+}
+
+void AlarmClass::updateNextTrigger() {
+  if (Mode.isEnabled) {
+    time_t time = now();
+    if (dtIsAlarm(Mode.alarmType) && nextTrigger <= time) {
+      if (Mode.alarmType == dtExplicitAlarm) {
+        nextTrigger = value;
+      } else if (Mode.alarmType == dtDailyAlarm) {
+        if (value + previousMidnight(now()) <= time)
+          nextTrigger = value + nextMidnight(time);
+        else
+          nextTrigger = value + previousMidnight(time);
+      } else if (Mode.alarmType == dtWeeklyAlarm) {
+        if ((value + previousSunday(now())) <= time)
+          nextTrigger = value + nextSunday(time);
+        else
+          nextTrigger = value + previousSunday(time);
+      } else {
+        Mode.isEnabled = 0;
+      }
+    }
+    if (Mode.alarmType == dtTimer)
+      nextTrigger = time + value;
+  }
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+TimeAlarmsClass::TimeAlarmsClass() {
+  isServicing = false;
+  for (uint8_t id = 0; id < dtNBR_ALARMS; id++)
+    free(id);
+}
+
+AlarmID_t TimeAlarmsClass::triggerOnce(time_t value, OnTick_t onTickHandler) {
+  if (value <= 0)
+    return dtINVALID_ALARM_ID;
+  return create(value, onTickHandler, true, dtExplicitAlarm);
+}
+
+AlarmID_t TimeAlarmsClass::alarmOnce(time_t value, OnTick_t onTickHandler) {
+  if (value <= 0 || value > SECS_PER_DAY)
+    return dtINVALID_ALARM_ID;
+  return create(value, onTickHandler, true, dtDailyAlarm);
+}
+
+AlarmID_t TimeAlarmsClass::alarmRepeat(time_t value, OnTick_t onTickHandler) {
+  if (value <= 0 || value > SECS_PER_DAY)
+    return dtINVALID_ALARM_ID;
+  return create(value, onTickHandler, false, dtDailyAlarm);
+}
+
+AlarmID_t TimeAlarmsClass::timerOnce(time_t value, OnTick_t onTickHandler) {
+  if (value <= 0)
+    return dtINVALID_ALARM_ID;
+  return create(value, onTickHandler, true, dtTimer);
+}
+
+AlarmID_t TimeAlarmsClass::timerRepeat(time_t value, OnTick_t onTickHandler) {
+  if (value <= 0)
+    return dtINVALID_ALARM_ID;
+  return create(value, onTickHandler, false, dtTimer);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void TimeAlarmsClass::enable(AlarmID_t ID) {
+  if (isAllocated(ID)) {
+    if ((!(dtUseAbsoluteValue(Alarm[ID].Mode.alarmType) &&
+           (Alarm[ID].value == 0))) &&
+        (Alarm[ID].onTickHandler != NULL)) {
+      Alarm[ID].Mode.isEnabled = true;
+      Alarm[ID].updateNextTrigger();
+    } else {
+      Alarm[ID].Mode.isEnabled = false;
+    }
+  }
+}
+
+void TimeAlarmsClass::disable(AlarmID_t ID) {
+  if (isAllocated(ID))
+    Alarm[ID].Mode.isEnabled = false;
+}
+
+void TimeAlarmsClass::write(AlarmID_t ID, time_t value) {
+  if (isAllocated(ID)) {
+    Alarm[ID].value = value;
+    Alarm[ID].nextTrigger = 0;
+    enable(ID);
+  }
+}
+
+time_t TimeAlarmsClass::read(AlarmID_t ID) const {
+  return isAllocated(ID) ? Alarm[ID].value : dtINVALID_TIME;
+}
+
+dtAlarmPeriod_t TimeAlarmsClass::readType(AlarmID_t ID) const {
+  return isAllocated(ID) ? (dtAlarmPeriod_t)Alarm[ID].Mode.alarmType
+                         : dtNotAllocated;
+}
+
+void TimeAlarmsClass::free(AlarmID_t ID) {
+  if (isAllocated(ID)) {
+    Alarm[ID].Mode.isEnabled = false;
+    Alarm[ID].Mode.alarmType = dtNotAllocated;
+    Alarm[ID].onTickHandler = NULL;
+    Alarm[ID].value = 0;
+    Alarm[ID].nextTrigger = 0;
+  }
+}
+
+uint8_t TimeAlarmsClass::count() const {
+  uint8_t c = 0;
+
+  for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+    if (isAllocated(id))
+      c++;
+  }
+  return c;
+}
+
+bool TimeAlarmsClass::isAllocated(AlarmID_t ID) const {
+  return (ID < dtNBR_ALARMS && Alarm[ID].Mode.alarmType != dtNotAllocated);
+}
+
+bool TimeAlarmsClass::isAlarm(AlarmID_t ID) const {
+  return (ID < dtNBR_ALARMS && dtIsAlarm(Alarm[ID].Mode.alarmType));
+}
+
+AlarmID_t TimeAlarmsClass::getTriggeredAlarmId() const {
+  return isServicing ? servicedAlarmId : dtINVALID_ALARM_ID;
+}
+
+time_t TimeAlarmsClass::getNextTrigger() const {
+  time_t nextTrigger = 0;
+
+  for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+    if (isAllocated(id)) {
+      if ((nextTrigger == 0) || (Alarm[id].nextTrigger < nextTrigger))
+        nextTrigger = Alarm[id].nextTrigger;
+    }
+  }
+  return nextTrigger;
+}
+
+time_t TimeAlarmsClass::getNextTrigger(AlarmID_t ID) const {
+  return isAllocated(ID) ? Alarm[ID].nextTrigger : 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* TimeAlarmsClass::delay(unsigned long)
+ * -------------------------------------
+ * Service the alarms while waiting, as the original does. The wait
+ * jumps from one interrupt or millisecond to the next; in schedule mode,
+ * the idle loop iterations (delay(0)) jump to the next alarm. delay(0)
+ * starts each iteration of the main loop: simLoopMark().
+ */
+void TimeAlarmsClass::delay(unsigned long ms) {
+  unsigned long start = millis();
+
+  if (!ms)
+    simLoopMark();
+  do {
+    serviceAlarms();
+    simYield(sim_ns + ((sim_warp && !ms) ? warpStep() : SIM_MS(1)));
+  } while (millis() - start <= ms);
+}
+
+/* TimeAlarmsClass::warpStep(void)
+ * -------------------------------
+ * Time left until the next alarm, within [1 ms, SIM_WARP_STEP_MAX_NS].
+ */
+uint64_t TimeAlarmsClass::warpStep(void) const {
+  time_t next = getNextTrigger();
+  uint64_t step = SIM_WARP_STEP_MAX_NS;
+  int32_t ms;
+
+  if (next) {
+    ms = (int32_t)(simMillisAt(next) - millis());
+    if (ms < 1)
+      ms = 1;
+    if (SIM_MS(ms) < step)
+      step = SIM_MS(ms);
+  }
+  return step;
+}
+
+void TimeAlarmsClass::serviceAlarms() {
+  if (!isServicing) {
+    isServicing = true;
+    for (servicedAlarmId = 0; servicedAlarmId < dtNBR_ALARMS;
+         servicedAlarmId++) {
+      if (Alarm[servicedAlarmId].Mode.isEnabled &&
+          (now() >= Alarm[servicedAlarmId].nextTrigger)) {
+        OnTick_t TickHandler = Alarm[servicedAlarmId].onTickHandler;
+        if (Alarm[servicedAlarmId].Mode.isOneShot)
+          free(servicedAlarmId);
+        else
+          Alarm[servicedAlarmId].updateNextTrigger();
+        if (TickHandler != NULL)
+          (*TickHandler)();
+      }
+    }
+    isServicing = false;
+  }
+}
+
+AlarmID_t TimeAlarmsClass::create(time_t value, OnTick_t onTickHandler,
+                                  uint8_t isOneShot,
+                                  dtAlarmPeriod_t alarmType) {
+  if (!((dtIsAlarm(alarmType) && now() < SECS_PER_YEAR) ||
+        (dtUseAbsoluteValue(alarmType) && (value == 0)))) {
+    for (uint8_t id = 0; id < dtNBR_ALARMS; id++) {
+      if (Alarm[id].Mode.alarmType == dtNotAllocated) {
+        Alarm[id].onTickHandler = onTickHandler;
+        Alarm[id].Mode.isOneShot = isOneShot;
+        Alarm[id].Mode.alarmType = alarmType;
+        Alarm[id].value = value;
+        enable(id);
+        return id;
+      }
+    }
+  }
+  return dtINVALID_ALARM_ID;
+}
+/*****************************************************************************/
@@ -0,0 +1,106 @@
+/*
+ * TimeAlarms.h
+ *
+ * Host stand-in of the TimeAlarms library, with the same alarm table,
+ * trigger rules and servicing as the original: alarms only fire from
+ * Alarm.delay(), which waits in virtual time.
+ */
+#ifndef _TIMEALARMS_H_
+#define _TIMEALARMS_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "TimeLib.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define dtNBR_ALARMS 12
+#define dtINVALID_ALARM_ID 255
+#define dtINVALID_TIME (time_t)(-1)
+#define AlarmHMS(_hr_, _min_, _sec_)                                          \
+  ((_hr_)*SECS_PER_HOUR + (_min_)*SECS_PER_MIN + (_sec_))
+
+/*** Types *******************************************************************/
+typedef enum {
+  dtNotAllocated,
+  dtTimer,
+  dtExplicitAlarm,
+  dtDailyAlarm,
+  dtWeeklyAlarm,
+  dtLastAlarmType
+} dtAlarmPeriod_t;
+
+typedef struct {
+  uint8_t alarmType : 4;
+  uint8_t isEnabled : 1;
+  uint8_t isOneShot : 1;
+} AlarmMode_t;
+
+typedef uint8_t AlarmID_t;
+typedef AlarmID_t AlarmId;
+typedef void (*OnTick_t)();
+
+class AlarmClass {
+public:
+  AlarmClass();
+  OnTick_t onTickHandler;
+  void updateNextTrigger();
+  time_t value;
+  time_t nextTrigger;
+  AlarmMode_t Mode;
+};
+
+class TimeAlarmsClass {
+public:
+  TimeAlarmsClass();
+  AlarmID_t triggerOnce(time_t value, OnTick_t onTickHandler);
+  AlarmID_t alarmOnce(time_t value, OnTick_t onTickHandler);
+  AlarmID_t alarmOnce(const int H, const int M, const int S,
+                      OnTick_t onTickHandler) {
+    return alarmOnce(AlarmHMS(H, M, S), onTickHandler);
+  }
+  AlarmID_t alarmRepeat(time_t value, OnTick_t onTickHandler);
+  AlarmID_t alarmRepeat(const int H, const int M, const int S,
+                        OnTick_t onTickHandler) {
+    return alarmRepeat(AlarmHMS(H, M, S), onTickHandler);
+  }
+  AlarmID_t timerOnce(time_t value, OnTick_t onTickHandler);
+  AlarmID_t timerOnce(const int H, const int M, const int S,
+                      OnTick_t onTickHandler) {
+    return timerOnce(AlarmHMS(H, M, S), onTickHandler);
+  }
+  AlarmID_t timerRepeat(time_t value, OnTick_t onTickHandler);
+  AlarmID_t timerRepeat(const int H, const int M, const int S,
+                        OnTick_t onTickHandler) {
+    return timerRepeat(AlarmHMS(H, M, S), onTickHandler);
+  }
+  void delay(unsigned long ms);
+  void enable(AlarmID_t ID);
+  void disable(AlarmID_t ID);
+  void write(AlarmID_t ID, time_t value);
+  time_t read(AlarmID_t ID) const;
+  dtAlarmPeriod_t readType(AlarmID_t ID) const;
+  void free(AlarmID_t ID);
+  uint8_t count() const;
+  time_t getNextTrigger() const;
+  time_t getNextTrigger(AlarmID_t ID) const;
+  bool isAllocated(AlarmID_t ID) const;
+  bool isAlarm(AlarmID_t ID) const;
+  AlarmID_t getTriggeredAlarmId() const;
+
+private:
+  void serviceAlarms();
+  uint64_t warpStep(void) const;
+  AlarmID_t create(time_t value, OnTick_t onTickHandler, uint8_t isOneShot,
+                   dtAlarmPeriod_t alarmType);
+  AlarmClass Alarm[dtNBR_ALARMS];
+  uint8_t isServicing;
+  uint8_t servicedAlarmId;
+};
+
+/*** Variables ***************************************************************/
+extern TimeAlarmsClass Alarm;
+
+#endif /* _TIMEALARMS_H_ */
@@ -0,0 +1,195 @@
+/*
+ * Host stand-in of the Time library
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+#include "TimeLib.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Constants ***************************************************************/
+static const uint8_t monthDays[] = {31, 28, 31, 30, 31, 30,
+                                    31, 31, 30, 31, 30, 31};
+
+/*** Variables ***************************************************************/
+static uint32_t sysTime = 0;
+static uint32_t prevMillis = 0;
+static uint32_t nextSyncTime = 0;
+static timeStatus_t Status = timeNotSet;
+static getExternalTime getTimePtr = NULL;
+static uint32_t syncInterval = 300;
+
+/*** Macros ******************************************************************/
+#define LEAP_YEAR(Y)                                                          \
+  (((1970 + (Y)) > 0) && !((1970 + (Y)) % 4) &&                               \
+   (((1970 + (Y)) % 100) || !((1970 + (Y)) % 400)))
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+void breakTime(time_t timeInput, tmElements_t &tm) {
+  uint8_t year, month, monthLength;
+  uint32_t time;
+  unsigned long days;
+
+  time = (uint32_t)timeInput;
+  tm.Second = time % 60;
+  time /= 60;
+  tm.Minute = time % 60;
+  time /= 60;
+  tm.Hour = time % 24;
+  time /= 24;
+  tm.Wday = ((time + 4) % 7) + 1;
+  year = 0;
+  days = 0;
+  while ((unsigned)(days += (LEAP_YEAR(year) ? 366 : 365)) <= time)
+    year++;
+  tm.Year = year;
+  days -= LEAP_YEAR(year) ? 366 : 365;
+  time -= days;
+  for (month = 0; month < 12; month++) {
+    if (month == 1)
+      monthLength = LEAP_YEAR(year) ? 29 : 28;
+    else
+      monthLength = monthDays[month];
+    if (time >= monthLength)
+      time -= monthLength;
+    else
+      break;
+  }
+  tm.Month = month + 1;
+  tm.Day = time + 1;
+}
+
+time_t makeTime(const tmElements_t &tm) {
+  int i;
+  uint32_t seconds;
+
+  seconds = tm.Year * (SECS_PER_DAY * 365);
+  for (i = 0; i < tm.Year; i++) {
+    if (LEAP_YEAR(i))
+      seconds += SECS_PER_DAY;
+  }
+  for (i = 1; i < tm.Month; i++) {
+    if ((i == 2) && LEAP_YEAR(tm.Year))
+      seconds += SECS_PER_DAY * 29;
+    else
+      seconds += SECS_PER_DAY * monthDays[i - 1];
+  }
+  seconds += (tm.Day - 1) * SECS_PER_DAY;
+  seconds += tm.Hour * SECS_PER_HOUR;
+  seconds += tm.Minute * SECS_PER_MIN;
+  seconds += tm.Second;
+  return (time_t)seconds;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* now(void)
+ * ---------
+ * System time: whole seconds counted from millis(), re-synced from the
+ * provider when due. As on the target, millis() stops in hibernation.
+ */
+time_t now(void) {
+  while (millis() - prevMillis >= 1000) {
+    sysTime++;
+    prevMillis += 1000;
+  }
+  if (nextSyncTime <= sysTime) {
+    if (getTimePtr != NULL) {
+      time_t t = getTimePtr();
+      if (t != 0) {
+        setTime(t);
+      } else {
+        nextSyncTime = sysTime + syncInterval;
+        Status = (Status == timeNotSet) ? timeNotSet : timeNeedsSync;
+      }
+    }
+  }
+  return (time_t)sysTime;
+}
+
+void setTime(time_t t) {
+  sysTime = (uint32_t)t;
+  nextSyncTime = (uint32_t)t + syncInterval;
+  Status = timeSet;
+  prevMillis = millis();
+}
+
+void setTime(int hr, int min, int sec, int dy, int mnth, int yr) {
+  tmElements_t tm;
+
+  if (yr > 99)
+    yr = yr - 1970;
+  else
+    yr += 30;
+  tm.Year = yr;
+  tm.Month = mnth;
+  tm.Day = dy;
+  tm.Hour = hr;
+  tm.Minute = min;
+  tm.Second = sec;
+  setTime(makeTime(tm));
+}
+
+void adjustTime(long adjustment) { sysTime += adjustment; }
+
+timeStatus_t timeStatus(void) {
+  now();
+  return Status;
+}
+
+void setSyncProvider(getExternalTime getTimeFunction) {
+  getTimePtr = getTimeFunction;
+  nextSyncTime = sysTime;
+  now();
+}
+
+void setSyncInterval(time_t interval) {
+  syncInterval = (uint32_t)interval;
+  nextSyncTime = sysTime + syncInterval;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* simMillisAt(time_t)
+ * -------------------
+ * millis() value at which the system time reaches a value, barring a
+ * re-sync in between.
+ * IN:	- system time (time_t)
+ * OUT:	- millis() value (uint32_t), current one if already reached
+ */
+uint32_t simMillisAt(time_t t) {
+  time_t cur = now();
+
+  if (t <= cur)
+    return millis();
+  return prevMillis + (uint32_t)(t - cur) * 1000UL;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+static tmElements_t cacheTm(time_t t) {
+  tmElements_t tm;
+  breakTime(t, tm);
+  return tm;
+}
+
+int hour(void) { return hour(now()); }
+int hour(time_t t) { return cacheTm(t).Hour; }
+int minute(void) { return minute(now()); }
+int minute(time_t t) { return cacheTm(t).Minute; }
+int second(void) { return second(now()); }
+int second(time_t t) { return cacheTm(t).Second; }
+int day(void) { return day(now()); }
+int day(time_t t) { return cacheTm(t).Day; }
+int weekday(void) { return weekday(now()); }
+int weekday(time_t t) { return cacheTm(t).Wday; }
+int month(void) { return month(now()); }
+int month(time_t t) { return cacheTm(t).Month; }
+int year(void) { return year(now()); }
+int year(time_t t) { return tmYearToCalendar(cacheTm(t).Year); }
+/*****************************************************************************/
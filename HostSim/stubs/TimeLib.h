@@ -0,0 +1,89 @@
+/*
+ * TimeLib.h
+ *
+ * Host stand-in of the Time library (PJRC/Michael Margolis), with the
+ * same system time keeping: seconds counted from millis() and re-synced
+ * from the sync provider every syncInterval seconds.
+ */
+#ifndef _TIMELIB_H_
+#define _TIMELIB_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdint.h>
+#include <time.h>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Constants ***************************************************************/
+#define SECS_PER_MIN ((time_t)(60UL))
+#define SECS_PER_HOUR ((time_t)(3600UL))
+#define SECS_PER_DAY ((time_t)(SECS_PER_HOUR * 24UL))
+#define DAYS_PER_WEEK ((time_t)(7UL))
+#define SECS_PER_WEEK ((time_t)(SECS_PER_DAY * DAYS_PER_WEEK))
+#define SECS_PER_YEAR ((time_t)(SECS_PER_DAY * 365UL))
+#define SECS_YR_2000 ((time_t)(946684800UL))
+
+/*** Types *******************************************************************/
+typedef enum { timeNotSet, timeNeedsSync, timeSet } timeStatus_t;
+
+typedef struct {
+  uint8_t Second;
+  uint8_t Minute;
+  uint8_t Hour;
+  uint8_t Wday; // day of week, sunday is day 1
+  uint8_t Day;
+  uint8_t Month;
+  uint8_t Year; // offset from 1970
+} tmElements_t, TimeElements, *tmElementsPtr_t;
+
+typedef time_t (*getExternalTime)();
+
+/*** Macros ******************************************************************/
+#define tmYearToCalendar(Y) ((Y) + 1970)
+#define CalendarYrToTm(Y) ((Y)-1970)
+#define tmYearToY2k(Y) ((Y)-30)
+#define y2kYearToTm(Y) ((Y) + 30)
+#define numberOfSeconds(_time_) ((_time_) % SECS_PER_MIN)
+#define numberOfMinutes(_time_) (((_time_) / SECS_PER_MIN) % SECS_PER_MIN)
+#define numberOfHours(_time_) (((_time_) % SECS_PER_DAY) / SECS_PER_HOUR)
+#define dayOfWeek(_time_) ((((_time_) / SECS_PER_DAY + 4) % DAYS_PER_WEEK) + 1)
+#define elapsedDays(_time_) ((_time_) / SECS_PER_DAY)
+#define elapsedSecsToday(_time_) ((_time_) % SECS_PER_DAY)
+#define previousMidnight(_time_) (((_time_) / SECS_PER_DAY) * SECS_PER_DAY)
+#define nextMidnight(_time_) (previousMidnight(_time_) + SECS_PER_DAY)
+#define elapsedSecsThisWeek(_time_)                                           \
+  (elapsedSecsToday(_time_) + ((dayOfWeek(_time_) - 1) * SECS_PER_DAY))
+#define previousSunday(_time_)                                                \
+  ((_time_)-elapsedSecsThisWeek(_time_))
+#define nextSunday(_time_) (previousSunday(_time_) + SECS_PER_WEEK)
+
+/*** Functions ***************************************************************/
+int hour(void);
+int hour(time_t t);
+int minute(void);
+int minute(time_t t);
+int second(void);
+int second(time_t t);
+int day(void);
+int day(time_t t);
+int weekday(void);
+int weekday(time_t t);
+int month(void);
+int month(time_t t);
+int year(void);
+int year(time_t t);
+time_t now(void);
+void setTime(time_t t);
+void setTime(int hr, int min, int sec, int day, int month, int yr);
+void adjustTime(long adjustment);
+timeStatus_t timeStatus(void);
+void setSyncProvider(getExternalTime getTimeFunction);
+void setSyncInterval(time_t interval);
+void breakTime(time_t time, tmElements_t &tm);
+time_t makeTime(const tmElements_t &tm);
+// Host simulation: millis() value at which now() reaches a time
+uint32_t simMillisAt(time_t t);
+
+#endif /* _TIMELIB_H_ */
@@ -0,0 +1,8 @@
+/*
+ * Host stand-in of the TinyGPS library
+ */
+#include "TinyGPS.h"
+
+const float TinyGPS::GPS_INVALID_F_ANGLE = 1000.0;
+const float TinyGPS::GPS_INVALID_F_ALTITUDE = 1000000.0;
+const float TinyGPS::GPS_INVALID_F_SPEED = -1.0;
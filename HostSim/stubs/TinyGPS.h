@@ -0,0 +1,82 @@
+/*
+ * TinyGPS.h
+ *
+ * Host stand-in of the TinyGPS library: no GPS module is simulated, so
+ * the receiver never reports a fix (the firmware then records without
+ * position, as when indoors).
+ */
+#ifndef _TINYGPS_H_
+#define _TINYGPS_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include "Arduino.h"
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Types *******************************************************************/
+class TinyGPS {
+public:
+  enum {
+    GPS_INVALID_AGE = 0xFFFFFFFF,
+    GPS_INVALID_ANGLE = 999999999,
+    GPS_INVALID_ALTITUDE = 999999999,
+    GPS_INVALID_DATE = 0,
+    GPS_INVALID_TIME = 0xFFFFFFFF,
+    GPS_INVALID_SPEED = 999999999,
+    GPS_INVALID_FIX_TIME = 0xFFFFFFFF,
+    GPS_INVALID_SATELLITES = 0xFF,
+    GPS_INVALID_HDOP = 0xFFFFFFFF
+  };
+  static const float GPS_INVALID_F_ANGLE;
+  static const float GPS_INVALID_F_ALTITUDE;
+  static const float GPS_INVALID_F_SPEED;
+
+  bool encode(char c) {
+    (void)c;
+    return false;
+  }
+  void get_position(long *latitude, long *longitude,
+                    unsigned long *fix_age = 0) {
+    if (latitude)
+      *latitude = GPS_INVALID_ANGLE;
+    if (longitude)
+      *longitude = GPS_INVALID_ANGLE;
+    if (fix_age)
+      *fix_age = GPS_INVALID_AGE;
+  }
+  void f_get_position(float *latitude, float *longitude,
+                      unsigned long *fix_age = 0) {
+    if (latitude)
+      *latitude = GPS_INVALID_F_ANGLE;
+    if (longitude)
+      *longitude = GPS_INVALID_F_ANGLE;
+    if (fix_age)
+      *fix_age = GPS_INVALID_AGE;
+  }
+  void get_datetime(unsigned long *date, unsigned long *time,
+                    unsigned long *age = 0) {
+    if (date)
+      *date = GPS_INVALID_DATE;
+    if (time)
+      *time = GPS_INVALID_TIME;
+    if (age)
+      *age = GPS_INVALID_AGE;
+  }
+  void crack_datetime(int *year, byte *month, byte *day, byte *hour,
+                      byte *minute, byte *second, byte *hundredths = 0,
+                      unsigned long *fix_age = 0) {
+    *year = 2000;
+    *month = *day = 1;
+    *hour = *minute = *second = 0;
+    if (hundredths)
+      *hundredths = 0;
+    if (fix_age)
+      *fix_age = GPS_INVALID_AGE;
+  }
+  unsigned short satellites(void) { return GPS_INVALID_SATELLITES; }
+  unsigned long hdop(void) { return GPS_INVALID_HDOP; }
+};
+
+#endif /* _TINYGPS_H_ */
@@ -0,0 +1,215 @@
+/*
+ * Host stand-in of the Arduino String class
+ */
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "WString.h"
+
+/*** MODULE OBJECTS **********************************************************/
+/*****************************************************************************/
+/*** Functions implementation ************************************************/
+
+/*****************************************************************************/
+/* toBase(unsigned long, unsigned char, bool)
+ * ------------------------------------------
+ * Integer to text, in base 2 to 36 (Arduino's utoa/ltoa).
+ */
+static std::string toBase(unsigned long val, unsigned char base, bool neg) {
+  std::string out;
+
+  if ((base < 2) || (base > 36))
+    base = 10;
+  do {
+    unsigned int d = val % base;
+    out.insert(out.begin(), (char)((d < 10) ? ('0' + d) : ('a' + d - 10)));
+    val /= base;
+  } while (val);
+  if (neg)
+    out.insert(out.begin(), '-');
+  return out;
+}
+/*****************************************************************************/
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+/*** Functions ***************************************************************/
+
+/*****************************************************************************/
+String::String(unsigned char val, unsigned char base)
+    : s(toBase(val, base, false)) {}
+String::String(int val, unsigned char base)
+    : s((base == 10) ? toBase((val < 0) ? -(long)val : val, 10, val < 0)
+                     : toBase((unsigned int)val, base, false)) {}
+String::String(unsigned int val, unsigned char base)
+    : s(toBase(val, base, false)) {}
+String::String(long val, unsigned char base)
+    : s((base == 10) ? toBase((val < 0) ? -(unsigned long)val : val, 10,
+                              val < 0)
+                     : toBase((unsigned long)val, base, false)) {}
+String::String(unsigned long val, unsigned char base)
+    : s(toBase(val, base, false)) {}
+
+String::String(float val, unsigned char decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, (double)val);
+  s = buf;
+}
+
+String::String(double val, unsigned char decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, val);
+  s = buf;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+bool String::equalsIgnoreCase(const String &str) const {
+  return (s.length() == str.s.length()) &&
+         !strcasecmp(s.c_str(), str.s.c_str());
+}
+
+bool String::endsWith(const String &suffix) const {
+  return (s.length() >= suffix.s.length()) &&
+         !s.compare(s.length() - suffix.s.length(), suffix.s.length(),
+                    suffix.s);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void String::getBytes(unsigned char *buf, unsigned int len,
+                      unsigned int idx) const {
+  unsigned int n;
+
+  if (!len || !buf)
+    return;
+  if (idx >= s.length()) {
+    buf[0] = 0;
+    return;
+  }
+  n = s.length() - idx;
+  if (n > (len - 1))
+    n = len - 1;
+  memcpy(buf, s.c_str() + idx, n);
+  buf[n] = 0;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+int String::indexOf(char c, unsigned int from) const {
+  size_t pos = (from < s.length()) ? s.find(c, from) : std::string::npos;
+  return (pos == std::string::npos) ? -1 : (int)pos;
+}
+
+int String::indexOf(const String &str, unsigned int from) const {
+  size_t pos = (from < s.length()) ? s.find(str.s, from) : std::string::npos;
+  return (pos == std::string::npos) ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t pos = s.rfind(c);
+  return (pos == std::string::npos) ? -1 : (int)pos;
+}
+
+int String::lastIndexOf(const String &str) const {
+  size_t pos = s.rfind(str.s);
+  return (pos == std::string::npos) ? -1 : (int)pos;
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+/* String::substring(unsigned int, unsigned int)
+ * ---------------------------------------------
+ * As on Arduino, swapped bounds are exchanged and out-of-range bounds
+ * are clipped.
+ */
+String String::substring(unsigned int from, unsigned int to) const {
+  unsigned int tmp;
+
+  if (from > to) {
+    tmp = to;
+    to = from;
+    from = tmp;
+  }
+  if (from >= s.length())
+    return String();
+  if (to > s.length())
+    to = s.length();
+  return String(s.substr(from, to - from));
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+void String::replace(char find, char repl) {
+  for (size_t i = 0; i < s.length(); i++) {
+    if (s[i] == find)
+      s[i] = repl;
+  }
+}
+
+void String::replace(const String &find, const String &repl) {
+  size_t pos = 0;
+
+  if (find.s.empty())
+    return;
+  while ((pos = s.find(find.s, pos)) != std::string::npos) {
+    s.replace(pos, find.s.length(), repl.s);
+    pos += repl.s.length();
+  }
+}
+
+void String::remove(unsigned int idx, unsigned int count) {
+  if (idx >= s.length())
+    return;
+  s.erase(idx, count);
+}
+
+void String::toLowerCase(void) {
+  for (size_t i = 0; i < s.length(); i++)
+    s[i] = (char)tolower((unsigned char)s[i]);
+}
+
+void String::toUpperCase(void) {
+  for (size_t i = 0; i < s.length(); i++)
+    s[i] = (char)toupper((unsigned char)s[i]);
+}
+
+void String::trim(void) {
+  size_t b = s.find_first_not_of(" \t\r\n\f\v");
+  size_t e = s.find_last_not_of(" \t\r\n\f\v");
+
+  if (b == std::string::npos)
+    s.clear();
+  else
+    s = s.substr(b, e - b + 1);
+}
+/*****************************************************************************/
+
+/*****************************************************************************/
+String operator+(const String &lhs, const String &rhs) {
+  String out(lhs);
+  out.concat(rhs);
+  return out;
+}
+String operator+(const String &lhs, const char *rhs) {
+  return lhs + String(rhs);
+}
+String operator+(const char *lhs, const String &rhs) {
+  return String(lhs) + rhs;
+}
+String operator+(const String &lhs, char rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, int rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, unsigned int rhs) {
+  return lhs + String(rhs);
+}
+String operator+(const String &lhs, long rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, unsigned long rhs) {
+  return lhs + String(rhs);
+}
+String operator+(const String &lhs, float rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, double rhs) { return lhs + String(rhs); }
+/*****************************************************************************/
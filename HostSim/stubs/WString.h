@@ -0,0 +1,131 @@
+/*
+ * WString.h
+ *
+ * Host stand-in of the Arduino String class (the subset used by the
+ * firmware), backed by std::string.
+ */
+#ifndef _WSTRING_H_
+#define _WSTRING_H_
+
+/*** IMPORTED EXTERNAL OBJECTS ***********************************************/
+/*****************************************************************************/
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <string>
+
+/*** EXPORTED OBJECTS ********************************************************/
+/*****************************************************************************/
+
+/*** Types *******************************************************************/
+class __FlashStringHelper;
+
+class String {
+public:
+  String(const char *cstr = "") : s(cstr ? cstr : "") {}
+  String(const std::string &str) : s(str) {}
+  String(const __FlashStringHelper *str)
+      : s(reinterpret_cast<const char *>(str)) {}
+  explicit String(char c) : s(1, c) {}
+  explicit String(unsigned char val, unsigned char base = 10);
+  explicit String(int val, unsigned char base = 10);
+  explicit String(unsigned int val, unsigned char base = 10);
+  explicit String(long val, unsigned char base = 10);
+  explicit String(unsigned long val, unsigned char base = 10);
+  explicit String(float val, unsigned char decimals = 2);
+  explicit String(double val, unsigned char decimals = 2);
+
+  unsigned int length(void) const { return s.length(); }
+  const char *c_str(void) const { return s.c_str(); }
+  void reserve(unsigned int size) { s.reserve(size); }
+
+  bool concat(const String &str) {
+    s += str.s;
+    return true;
+  }
+  bool concat(const char *cstr) {
+    s += cstr;
+    return true;
+  }
+  bool concat(char c) {
+    s += c;
+    return true;
+  }
+  bool concat(int val) { return concat(String(val)); }
+  bool concat(unsigned int val) { return concat(String(val)); }
+  bool concat(long val) { return concat(String(val)); }
+  bool concat(unsigned long val) { return concat(String(val)); }
+  bool concat(float val) { return concat(String(val)); }
+  bool concat(double val) { return concat(String(val)); }
+  template <typename T> String &operator+=(T val) {
+    concat(val);
+    return *this;
+  }
+
+  int compareTo(const String &str) const { return s.compare(str.s); }
+  bool equals(const String &str) const { return s == str.s; }
+  bool equals(const char *cstr) const { return s == cstr; }
+  bool equalsIgnoreCase(const String &str) const;
+  bool startsWith(const String &prefix) const {
+    return s.compare(0, prefix.s.length(), prefix.s) == 0;
+  }
+  bool endsWith(const String &suffix) const;
+  bool operator==(const String &str) const { return s == str.s; }
+  bool operator==(const char *cstr) const { return s == cstr; }
+  bool operator!=(const String &str) const { return s != str.s; }
+  bool operator!=(const char *cstr) const { return s != cstr; }
+  bool operator<(const String &str) const { return s < str.s; }
+
+  char charAt(unsigned int idx) const {
+    return (idx < s.length()) ? s[idx] : 0;
+  }
+  void setCharAt(unsigned int idx, char c) {
+    if (idx < s.length())
+      s[idx] = c;
+  }
+  char operator[](unsigned int idx) const { return charAt(idx); }
+  char &operator[](unsigned int idx) { return s[idx]; }
+  void getBytes(unsigned char *buf, unsigned int len,
+                unsigned int idx = 0) const;
+  void toCharArray(char *buf, unsigned int len, unsigned int idx = 0) const {
+    getBytes((unsigned char *)buf, len, idx);
+  }
+
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String &str, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(const String &str) const;
+  String substring(unsigned int from) const {
+    return substring(from, s.length());
+  }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(char find, char repl);
+  void replace(const String &find, const String &repl);
+  void remove(unsigned int idx) { remove(idx, (unsigned int)-1); }
+  void remove(unsigned int idx, unsigned int count);
+  void toLowerCase(void);
+  void toUpperCase(void);
+  void trim(void);
+
+  long toInt(void) const { return atol(s.c_str()); }
+  float toFloat(void) const { return (float)atof(s.c_str()); }
+  double toDouble(void) const { return atof(s.c_str()); }
+
+private:
+  std::string s;
+};
+
+/*** Functions ***************************************************************/
+String operator+(const String &lhs, const String &rhs);
+String operator+(const String &lhs, const char *rhs);
+String operator+(const char *lhs, const String &rhs);
+String operator+(const String &lhs, char rhs);
+String operator+(const String &lhs, int rhs);
+String operator+(const String &lhs, unsigned int rhs);
+String operator+(const String &lhs, long rhs);
+String operator+(const String &lhs, unsigned long rhs);
+String operator+(const String &lhs, float rhs);
+String operator+(const String &lhs, double rhs);
+
+#endif /* _WSTRING_H_ */
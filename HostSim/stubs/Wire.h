@@ -0,0 +1,12 @@
+/*
+ * Wire.h
+ *
+ * Host stand-in: the SGTL5000 control is modelled in Audio.h, nothing
+ * else uses the I2C bus.
+ */
+#ifndef _WIRE_H_
+#define _WIRE_H_
+
+#include "Arduino.h"
+
+#endif /* _WIRE_H_ */
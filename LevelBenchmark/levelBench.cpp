@@ -0,0 +1,115 @@
+/*
+ * levelBench
+ *
+ * Host benchmark of the level kernel of the AudioShield firmware
+ * (AudioShield_Teensy/levelKernel.cpp), run over large synthetic
+ * buffers cut into audio blocks. The results are checked against a
+ * plain reference implementation.
+ *
+ * Build: c++ -O2 -I../AudioShield_Teensy -o levelBench levelBench.cpp \
+ *          ../AudioShield_Teensy/levelKernel.cpp
+ * Usage: levelBench [<seconds of 44.1 kHz audio>]
+ *
+ * On the host, the portable code path of the kernel is measured; the
+ * SIMD path is only built for the Cortex-M4.
+ */
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "levelKernel.h"
+
+#define BLOCK_SAMPLES 128
+#define SAMPLING_RATE 44100
+
+/* reference(const int16_t*, unsigned int, struct levelStats*)
+ * -----------------------------------------------------------
+ * Straightforward statistics of a block, to check the kernel.
+ */
+static void reference(const int16_t *x, unsigned int n, struct levelStats *st) {
+  unsigned int i;
+
+  memset(st, 0, sizeof(*st));
+  st->max = -32768;
+  st->min = 32767;
+  for (i = 0; i < n; i++) {
+    if (x[i] > st->max)
+      st->max = x[i];
+    if (x[i] < st->min)
+      st->min = x[i];
+    st->sum += x[i];
+    st->sum_sq += (uint64_t)((int64_t)x[i] * x[i]);
+    if ((x[i] >= LEVEL_CLIP) || (x[i] <= -LEVEL_CLIP))
+      st->clips++;
+  }
+}
+
+/* synth(int16_t*, size_t)
+ * -----------------------
+ * Fill the buffer with a clipped, DC-shifted sine sweep plus noise,
+ * so that every statistic is exercised.
+ */
+static void synth(int16_t *x, size_t n) {
+  double ph = 0.0, f, v;
+  size_t i;
+
+  srand(1);
+  for (i = 0; i < n; i++) {
+    f = 50.0 + (8000.0 * (double)i / (double)n);
+    ph += 2.0 * M_PI * f / SAMPLING_RATE;
+    v = (36000.0 * sin(ph)) + 500.0 + (double)((rand() % 2001) - 1000);
+    if (v > 32767.0)
+      v = 32767.0;
+    else if (v < -32768.0)
+      v = -32768.0;
+    x[i] = (int16_t)v;
+  }
+}
+
+int main(int argc, char **argv) {
+  unsigned long sec = (argc > 1) ? strtoul(argv[1], NULL, 10) : 3600;
+  size_t n = (size_t)sec * SAMPLING_RATE, blocks, b;
+  struct levelStats st, ref;
+  uint64_t sum_sq = 0;
+  unsigned long errors = 0;
+  clock_t t0, t1;
+  double dt;
+  int16_t *x;
+
+  blocks = n / BLOCK_SAMPLES;
+  n = blocks * BLOCK_SAMPLES;
+  x = (int16_t *)malloc(n * sizeof(int16_t));
+  if (!x || !blocks) {
+    fprintf(stderr, "levelBench: cannot allocate %lu s of audio\n", sec);
+    return 1;
+  }
+  synth(x, n);
+
+  t0 = clock();
+  for (b = 0; b < blocks; b++) {
+    levelBlock(&x[b * BLOCK_SAMPLES], BLOCK_SAMPLES, &st);
+    sum_sq += st.sum_sq;
+  }
+  t1 = clock();
+  dt = (double)(t1 - t0) / CLOCKS_PER_SEC;
+
+  for (b = 0; b < blocks; b++) {
+    levelBlock(&x[b * BLOCK_SAMPLES], BLOCK_SAMPLES, &st);
+    reference(&x[b * BLOCK_SAMPLES], BLOCK_SAMPLES, &ref);
+    if ((st.max != ref.max) || (st.min != ref.min) || (st.sum != ref.sum) ||
+        (st.sum_sq != ref.sum_sq) || (st.clips != ref.clips))
+      errors++;
+  }
+
+  printf("%lu blocks (%lu s of audio) in %.3f s: %.1f Msamples/s, "
+         "%.1f ns/block\n",
+         (unsigned long)blocks, sec, dt, (dt > 0.0) ? (n / dt / 1e6) : 0.0,
+         dt * 1e9 / blocks);
+  printf("RMS %.1f dBFS, %lu mismatching blocks\n",
+         20.0 * log10(sqrt((double)sum_sq / n) / 32768.0), errors);
+  free(x);
+  return (errors ? 1 : 0);
+}
@@ -0,0 +1,166 @@
+// SD card write benchmark for the SoundingSoil recorder.
+//
+// Writes recording-sized files the way the AudioShield firmware can do it
+// and reports the throughput and the per-sector write latency:
+//   FS     -> regular file growing cluster by cluster, 512 bytes per write
+//   CONTIG -> contiguous pre-allocated file, 512 bytes per write through
+//             the file system
+//   RAW    -> contiguous pre-allocated file streamed with a single
+//             multi-block write (writeStart/writeData/writeStop)
+// A sector holds 5.8 ms of 44.1 kHz mono audio: every write slower than
+// that has to be absorbed by the record ring of the firmware.
+//
+// Like the SdFat StressTest, files are written until the card is nearly
+// full or a character is typed.
+#include <SPI.h>
+#include <SdFat.h>
+
+// Use the Teensy built-in SDIO slot (1) or the SPI adapter (0)
+#define USE_SDIO 0
+
+// SPI adapter pins (SSSHIELD v2.0+)
+#define SDCARD_CS_PIN 10
+#define SDCARD_MOSI_PIN 28
+#define SDCARD_MISO_PIN 39
+#define SDCARD_SCK_PIN 27
+
+// Recording size per file (5 minutes of 44.1 kHz/16-bit mono audio)
+const uint32_t FILE_SIZE = 300UL * 88200UL;
+const uint32_t SECTORS_PER_FILE = FILE_SIZE / 512;
+// Audio time held by one sector (us)
+const uint32_t SECTOR_AUDIO_US = 5805;
+// Longest multi-block write of the Teensy SDHC
+const uint32_t SDIO_BLOCKS_MAX = 0xFFFF;
+
+#if USE_SDIO
+SdFatSdio sd;
+#else
+SdFat sd;
+#endif
+
+SdBaseFile file;
+
+uint8_t buf[512] __attribute__((aligned(4)));
+char name[13];
+
+// Latency statistics of the current test
+uint32_t lat_min;
+uint32_t lat_max;
+uint32_t lat_sum;
+uint32_t lat_late;
+//------------------------------------------------------------------------------
+void statsReset() {
+  lat_min = 0xFFFFFFFF;
+  lat_max = 0;
+  lat_sum = 0;
+  lat_late = 0;
+}
+//------------------------------------------------------------------------------
+void statsAdd(uint32_t us) {
+  if (us < lat_min) lat_min = us;
+  if (us > lat_max) lat_max = us;
+  if (us > SECTOR_AUDIO_US) lat_late++;
+  lat_sum += us;
+}
+//------------------------------------------------------------------------------
+void statsPrint(const char* test, uint32_t total_us) {
+  Serial.printf("%-6s %6lu KB/s  lat min/avg/max %5lu/%5lu/%6lu us  "
+                "late %4lu  ring %3lu sectors\n", test,
+                (uint32_t)((uint64_t)FILE_SIZE * 1000 / total_us),
+                lat_min, lat_sum / SECTORS_PER_FILE, lat_max, lat_late,
+                lat_max / SECTOR_AUDIO_US + 1);
+}
+//------------------------------------------------------------------------------
+// Regular file or contiguous file, written through the file system
+void testFile(bool contiguous) {
+  bool ok = contiguous ? file.createContiguous(name, FILE_SIZE)
+                       : file.open(name, O_RDWR | O_CREAT | O_TRUNC);
+  if (!ok) sd.errorHalt("Open error!");
+  statsReset();
+  uint32_t t0 = micros();
+  for (uint32_t i = 0; i < SECTORS_PER_FILE; i++) {
+    uint32_t us = micros();
+    if (file.write(buf, 512) != 512) sd.errorHalt("Write error!");
+    statsAdd(micros() - us);
+  }
+  file.close();
+  statsPrint(contiguous ? "CONTIG" : "FS", micros() - t0);
+  file.open(name, O_RDWR);
+  file.remove();
+}
+//------------------------------------------------------------------------------
+// Contiguous file, streamed sector by sector to the card
+void testRaw() {
+  uint32_t bgn, end;
+  if (!file.createContiguous(name, FILE_SIZE)) sd.errorHalt("Open error!");
+  if (!file.contiguousRange(&bgn, &end)) sd.errorHalt("Range error!");
+  statsReset();
+  uint32_t t0 = micros();
+  for (uint32_t i = 0; i < SECTORS_PER_FILE; i++) {
+    uint32_t us = micros();
+#if USE_SDIO
+    if (i % SDIO_BLOCKS_MAX == 0) {
+      uint32_t cnt = SECTORS_PER_FILE - i;
+      if (cnt > SDIO_BLOCKS_MAX) cnt = SDIO_BLOCKS_MAX;
+      if (i && !sd.card()->writeStop()) sd.errorHalt("writeStop error!");
+      if (!sd.card()->writeStart(bgn + i, cnt)) sd.errorHalt("writeStart!");
+    }
+#else
+    if (i == 0 && !sd.card()->writeStart(bgn, SECTORS_PER_FILE)) {
+      sd.errorHalt("writeStart error!");
+    }
+#endif
+    if (!sd.card()->writeData(buf)) sd.errorHalt("writeData error!");
+    statsAdd(micros() - us);
+  }
+  if (!sd.card()->writeStop()) sd.errorHalt("writeStop error!");
+  file.close();
+  statsPrint("RAW", micros() - t0);
+  file.open(name, O_RDWR);
+  file.remove();
+}
+//------------------------------------------------------------------------------
+void setup() {
+  Serial.begin(9600);
+  while (!Serial) {}
+  Serial.printf("File size %lu bytes, %lu sectors\n", FILE_SIZE,
+                SECTORS_PER_FILE);
+  Serial.println("Type any character to start");
+  while (Serial.read() < 0) {}
+
+#if USE_SDIO
+  if (!sd.begin()) sd.initErrorHalt();
+#else
+  SPI.setMOSI(SDCARD_MOSI_PIN);
+  SPI.setMISO(SDCARD_MISO_PIN);
+  SPI.setSCK(SDCARD_SCK_PIN);
+  if (!sd.begin(SDCARD_CS_PIN)) sd.initErrorHalt();
+#endif
+
+  // Fill buf with a known value.
+  for (size_t i = 0; i < sizeof(buf); i++) buf[i] = i;
+
+  // Wait to begin.
+  do {delay(10);} while (Serial.read() >= 0);
+  Serial.println("Type any character to stop after next file");
+}
+//------------------------------------------------------------------------------
+void loop() {
+  // Free KB on SD.
+  uint32_t freeKB = sd.vol()->freeClusterCount()*sd.vol()->blocksPerCluster()/2;
+
+  Serial.print("Free KB: ");
+  Serial.println(freeKB);
+  if (freeKB < 2*FILE_SIZE/1024) {
+    Serial.println(" Done!");
+    while(1);
+  }
+  sprintf(name, "%lu.DAT", freeKB);
+  testFile(false);
+  testFile(true);
+  testRaw();
+  if (Serial.available()) {
+    Serial.println("Stopped!");
+    while(1);
+  }
+}